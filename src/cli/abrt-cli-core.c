@@ -74,6 +74,32 @@ vector_of_problem_data_t *fetch_crash_infos(void)
     return vpd;
 }
 
+vector_of_problem_data_t *fetch_crash_summaries(const char **elements)
+{
+    GList *problems = get_problems_over_dbus(g_cli_authenticate);
+    if (problems == ERR_PTR)
+        return NULL;
+
+    vector_of_problem_data_t *vpd = new_vector_of_problem_data();
+
+    for (GList *iter = problems; iter; iter = g_list_next(iter))
+    {
+        /* abrt-dbus reads these from the problem summary */
+        problem_data_t *problem_data = problem_data_new();
+        if (fill_problem_data_over_dbus((const char *)(iter->data), elements, problem_data) != 0)
+        {
+            problem_data_free(problem_data);
+            continue;
+        }
+
+        problem_data_add_text_noteditable(problem_data, CD_DUMPDIR, (const char *)(iter->data));
+        g_ptr_array_add(vpd, problem_data);
+    }
+
+    list_free_with_free(problems);
+    return vpd;
+}
+
 
 static bool isxdigit_str(const char *str)
 {
@@ -33,6 +33,9 @@ problem_data_t *get_problem_data(vector_of_problem_data_t *vector, unsigned i);
 void free_vector_of_problem_data(vector_of_problem_data_t *vector);
 vector_of_problem_data_t *new_vector_of_problem_data(void);
 vector_of_problem_data_t *fetch_crash_infos(void);
+/* Fetches only the NULL terminated list of ELEMENTS of all problems. The
+ * problem data always contain CD_DUMPDIR. */
+vector_of_problem_data_t *fetch_crash_summaries(const char **elements);
 
 /* Returns malloced string, or NULL if not found: */
 char *find_problem_by_hash(const char *hash, GList *problems);
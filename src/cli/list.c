@@ -82,8 +82,18 @@ static void print_crash(problem_data_t *problem_data, int detailed, int text_siz
     free(desc);
 }
 
+/* Elements needed for filtering and sorting of the list */
+static const char *s_summary_elements[] = {
+    FILENAME_LAST_OCCURRENCE,
+    FILENAME_REPORTED_TO,
+    NULL,
+};
+
 /**
  * Prints a list containing "crashes" to stdout.
+ * @param crash_list
+ *   Summaries of the crashes containing s_summary_elements, the full problem
+ *   data are loaded only for the printed crashes.
  * @param only_unreported
  *   Do not skip entries marked as already reported.
  */
@@ -109,11 +119,15 @@ static bool print_crash_list(vector_of_problem_data_t *crash_list, int detailed,
                 continue;
         }
 
+        const char *dump_dir_name = problem_data_get_content_or_NULL(crash, CD_DUMPDIR);
+        problem_data_t *full_crash = get_full_problem_data_over_dbus(dump_dir_name);
+        if (full_crash == ERR_PTR)
+            continue;
+
         char hash_str[SHA1_RESULT_LEN*2 + 1];
-        struct problem_item *item = g_hash_table_lookup(crash, CD_DUMPDIR);
-        if (item)
-            printf("id %s\n", str_to_sha1str(hash_str, item->content));
-        print_crash(crash, detailed, text_size);
+        printf("id %s\n", str_to_sha1str(hash_str, dump_dir_name));
+        print_crash(full_crash, detailed, text_size);
+        problem_data_free(full_crash);
         if (i != crash_list->len - 1)
             printf("\n");
         output = true;
@@ -143,7 +157,7 @@ int cmd_list(int argc, const char **argv)
 
     parse_opts(argc, (char **)argv, program_options, program_usage_string);
 
-    vector_of_problem_data_t *ci = fetch_crash_infos();
+    vector_of_problem_data_t *ci = fetch_crash_summaries(s_summary_elements);
     if (ci == NULL)
         return 1;
 
@@ -0,0 +1,145 @@
+/*
+    Copyright (C) 2016  ABRT team
+    Copyright (C) 2016  RedHat Inc
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "libabrt.h"
+#include "rpm.h"
+
+/* We want to handle both /proc/PID/maps format:
+ *  4f200000-4f215000 r-xp 00000000 08:03 1835520   /usr/lib64/libz.so.1.2.7
+ * and Xorg backtrace format:
+ *  [ 86985.880] 9: /usr/lib64/libdrm.so.2 (drmHandleEvent+0xa3) [0x376b407513]
+ * To do that, we take only lines which have a / character, then for each
+ * line we start at first /, then remove everything after first whitespace.
+ *
+ * Returns the unique file names in the order of their first occurrence.
+ */
+static GList *parse_maps(const char *maps_path)
+{
+    FILE *fp = fopen(maps_path, "r");
+    if (!fp)
+        perror_msg_and_die("Can't open '%s'", maps_path);
+
+    GList *paths = NULL;
+    GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+    char *line;
+    while ((line = xmalloc_fgetline(fp)) != NULL)
+    {
+        const char *slash = strchr(line, '/');
+        if (slash)
+        {
+            char *path = xstrndup(slash, strcspn(slash, " \t\n\r\v\f"));
+            if (!g_hash_table_contains(seen, path))
+            {
+                g_hash_table_add(seen, path);
+                paths = g_list_prepend(paths, path);
+            }
+            else
+                free(path);
+        }
+        free(line);
+    }
+
+    if (ferror(fp))
+        perror_msg_and_die("Can't read '%s'", maps_path);
+
+    fclose(fp);
+    g_hash_table_destroy(seen);
+
+    return g_list_reverse(paths);
+}
+
+int main(int argc, char **argv)
+{
+    /* I18n */
+    setlocale(LC_ALL, "");
+#if ENABLE_NLS
+    bindtextdomain(PACKAGE, LOCALEDIR);
+    textdomain(PACKAGE);
+#endif
+
+    abrt_init(argv);
+
+    const char *maps_path = NULL;
+    const char *out_path = NULL;
+
+    /* Can't keep these strings/structs static: _() doesn't support that */
+    const char *program_usage_string = _(
+        "& [-v] [-o OUTFILE] -m PROC_PID_MAP_FILE\n"
+        "\n"
+        "Prints out DSO from mapped memory regions"
+    );
+    enum {
+        OPT_v = 1 << 0,
+        OPT_o = 1 << 1,
+        OPT_m = 1 << 2,
+    };
+    /* Keep enum above and order of options below in sync! */
+    struct options program_options[] = {
+        OPT__VERBOSE(&g_verbose),
+        OPT_STRING('o', NULL, &out_path,  "OUTFILE"          , _("Output file")),
+        OPT_STRING('m', NULL, &maps_path, "PROC_PID_MAP_FILE", _("File containing the mapped memory regions")),
+        OPT_END()
+    };
+    /*unsigned opts =*/ parse_opts(argc, argv, program_options, program_usage_string);
+
+    if (!maps_path)
+    {
+        error_msg("MAP_FILE is not specified");
+        show_usage_and_die(program_usage_string, program_options);
+    }
+
+    GList *paths = parse_maps(maps_path);
+
+    rpm_init();
+    rpm_find_file_owners(paths);
+
+    /* Note that we open -o FILE only when we reach the point
+     * when we are definitely going to write something to it */
+    FILE *out = out_path ? NULL : stdout;
+    for (GList *li = paths; li != NULL; li = g_list_next(li))
+    {
+        const char *path = li->data;
+        const GPtrArray *owners = rpm_get_file_owners(path);
+        for (unsigned i = 0; i < owners->len; ++i)
+        {
+            const struct rpm_file_owner *owner = g_ptr_array_index(owners, i);
+
+            if (!out)
+            {
+                out = fopen(out_path, "w");
+                if (!out)
+                    perror_msg_and_die("Can't open '%s'", out_path);
+            }
+
+            /* The format of the original Python tool which printed None
+             * for packages without vendor */
+            fprintf(out, "%s %s (%s) %s\n", path,
+                    owner->fo_nevra ? owner->fo_nevra : "",
+                    owner->fo_vendor ? owner->fo_vendor : "None",
+                    owner->fo_installtime ? owner->fo_installtime : "None");
+        }
+    }
+
+    if (out && (fflush(out) != 0 || ferror(out) || (out != stdout && fclose(out) != 0)))
+        perror_msg_and_die("Error writing to '%s'", out_path ? out_path : "<stdout>");
+
+    rpm_destroy();
+    list_free_with_free(paths);
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2016  ABRT team
+    Copyright (C) 2016  RedHat Inc
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include <sys/resource.h>
+#include "libabrt.h"
+
+/* abrtd runs this tool periodically instead of doing the work in a forked
+ * copy of itself, so the job starts with a clean single threaded process.
+ */
+int main(int argc, char **argv)
+{
+    /* I18n */
+    setlocale(LC_ALL, "");
+#if ENABLE_NLS
+    bindtextdomain(PACKAGE, LOCALEDIR);
+    textdomain(PACKAGE);
+#endif
+
+    abrt_init(argv);
+
+    /* Can't keep these strings/structs static: _() doesn't support that */
+    const char *program_usage_string = _(
+        "& [-vs]\n"
+        "\n"
+        "Removes unused shared elements from DumpLocation and compresses big\n"
+        "elements of problems older than ColdStorageAge hours (see abrt.conf)."
+    );
+    enum {
+        OPT_v = 1 << 0,
+        OPT_s = 1 << 1,
+    };
+    /* Keep enum above and order of options below in sync! */
+    struct options program_options[] = {
+        OPT__VERBOSE(&g_verbose),
+        OPT_BOOL('s', NULL, NULL, _("Log to syslog")),
+        OPT_END()
+    };
+    const unsigned opts = parse_opts(argc, argv, program_options, program_usage_string);
+
+    export_abrt_envvars(0);
+
+    msg_prefix = g_progname;
+    if ((opts & OPT_s) || getenv("ABRT_SYSLOG"))
+        logmode = LOGMODE_JOURNAL;
+
+    /* Do not disturb crash processing */
+    if (setpriority(PRIO_PROCESS, 0, 19) != 0)
+        perror_msg("Can't lower the priority");
+
+    load_abrt_conf();
+
+    /* Problems deleted through D-Bus leave their blobs behind */
+    int r = dump_location_blobs_gc(g_settings_dump_location);
+
+    if (r >= 0 && g_settings_cold_storage_age != 0)
+        r = dump_location_compress_cold(g_settings_dump_location,
+                                        g_settings_cold_storage_age * 60 * 60);
+
+    free_abrt_conf_data();
+    return r < 0;
+}
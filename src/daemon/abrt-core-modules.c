@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2016  ABRT team
+    Copyright (C) 2016  RedHat Inc
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "libabrt.h"
+
+/* core_modules_load() runs this tool instead of reading the coredump in
+ * a forked copy of the caller, which can run threads. The caller kills the
+ * tool if libdwfl does not finish in time.
+ */
+int main(int argc, char **argv)
+{
+    /* I18n */
+    setlocale(LC_ALL, "");
+#if ENABLE_NLS
+    bindtextdomain(PACKAGE, LOCALEDIR);
+    textdomain(PACKAGE);
+#endif
+
+    abrt_init(argv);
+
+    /* Can't keep these strings/structs static: _() doesn't support that */
+    const char *program_usage_string = _(
+        "& [-vf] [NAME]\n"
+        "\n"
+        "Reads the modules of the coredump on standard input like 'eu-unstrip -n'\n"
+        "and writes them to standard output as NUL terminated fields. NAME of\n"
+        "the coredump is used in messages."
+    );
+    enum {
+        OPT_v = 1 << 0,
+        OPT_f = 1 << 1,
+    };
+    /* Keep enum above and order of options below in sync! */
+    struct options program_options[] = {
+        OPT__VERBOSE(&g_verbose),
+        OPT_BOOL('f', NULL, NULL, _("Look up the files of all modules")),
+        OPT_END()
+    };
+    const unsigned opts = parse_opts(argc, argv, program_options, program_usage_string);
+
+    argv += optind;
+    if (argv[0] && argv[1])
+        show_usage_and_die(program_usage_string, program_options);
+
+    const char *name = argv[0] ? argv[0] : "-";
+
+    msg_prefix = g_progname;
+
+    GList *modules;
+    int r = core_modules_read(STDIN_FILENO, name,
+                              (opts & OPT_f) ? CORE_MODULES_FIND_FILES : 0, &modules);
+    if (r == 0)
+    {
+        r = core_modules_write(STDOUT_FILENO, modules);
+        if (r != 0)
+            error_msg("Can't write modules of '%s'", name);
+        core_modules_free(modules);
+    }
+
+    return r != 0;
+}
@@ -125,7 +125,7 @@ static int dup_uuid_compare(const struct dump_dir *dd)
     if (corebt)
         return 0;
 
-    dd_uuid = dd_load_text_ext(dd, FILENAME_UUID, DD_FAIL_QUIETLY_ENOENT);
+    dd_uuid = problem_summary_load_text(dd, FILENAME_UUID, DD_FAIL_QUIETLY_ENOENT);
     different = strcmp(uuid, dd_uuid);
     free(dd_uuid);
 
@@ -237,24 +237,23 @@ static int is_crash_a_dup(const char *dump_dir_name, void *param)
     /* dump_dir_name can be relative */
     dump_dir_name = realpath(dump_dir_name, NULL);
 
-    DIR *dir = opendir(g_settings_dump_location);
-    if (dir == NULL)
+    /* Walks the shards of the dump location too */
+    GPtrArray *entries = dump_location_list(g_settings_dump_location, /*flags*/0);
+    if (entries == NULL)
         goto end;
 
     /* Scan crash dumps looking for a dup */
     //TODO: explain why this is safe wrt concurrent runs
-    struct dirent *dent;
-    while ((dent = readdir(dir)) != NULL && crash_dump_dup_name == NULL)
+    for (unsigned i = 0; i < entries->len && crash_dump_dup_name == NULL; ++i)
     {
-        if (dot_or_dotdot(dent->d_name))
-            continue; /* skip "." and ".." */
-        const char *ext = strrchr(dent->d_name, '.');
+        const struct dump_location_entry *entry = g_ptr_array_index(entries, i);
+        const char *ext = strrchr(entry->dle_name, '.');
         if (ext && strcmp(ext, ".new") == 0)
             continue; /* skip anything named "<dirname>.new" */
 
         dd = NULL;
 
-        char *tmp_concat_path = concat_path_file(g_settings_dump_location, dent->d_name);
+        char *tmp_concat_path = concat_path_file(g_settings_dump_location, entry->dle_name);
 
         char *dump_dir_name2 = realpath(tmp_concat_path, NULL);
         if (g_verbose > 1 && !dump_dir_name2)
@@ -282,7 +281,7 @@ static int is_crash_a_dup(const char *dump_dir_name, void *param)
         /* problems from different containers are not duplicates */
         if (container_id != NULL)
         {
-            dd_container_id = dd_load_text_ext(dd, FILENAME_CONTAINER_ID, DD_FAIL_QUIETLY_ENOENT);
+            dd_container_id = problem_summary_load_text(dd, FILENAME_CONTAINER_ID, DD_FAIL_QUIETLY_ENOENT);
             if (dd_container_id != NULL && strcmp(container_id, dd_container_id) != 0)
             {
                 goto next;
@@ -290,21 +289,21 @@ static int is_crash_a_dup(const char *dump_dir_name, void *param)
         }
 
         /* crashes of different users are not considered duplicates */
-        dd_uid = dd_load_text_ext(dd, FILENAME_UID, DD_FAIL_QUIETLY_ENOENT);
+        dd_uid = problem_summary_load_text(dd, FILENAME_UID, DD_FAIL_QUIETLY_ENOENT);
         if (strcmp(uid, dd_uid))
         {
             goto next;
         }
 
         /* different crash types are not duplicates */
-        dd_type = dd_load_text_ext(dd, FILENAME_TYPE, DD_FAIL_QUIETLY_ENOENT);
+        dd_type = problem_summary_load_text(dd, FILENAME_TYPE, DD_FAIL_QUIETLY_ENOENT);
         if (strcmp(type, dd_type))
         {
             goto next;
         }
 
         /* different executables are not duplicates */
-        dd_executable = dd_load_text_ext(dd, FILENAME_EXECUTABLE, DD_FAIL_QUIETLY_ENOENT);
+        dd_executable = problem_summary_load_text(dd, FILENAME_EXECUTABLE, DD_FAIL_QUIETLY_ENOENT);
         if (     (executable != NULL && dd_executable == NULL)
              ||  (executable == NULL && dd_executable != NULL)
              || ((executable != NULL && dd_executable != NULL)
@@ -329,7 +328,7 @@ next:
         free(dd_type);
         free(dd_container_id);
     }
-    closedir(dir);
+    g_ptr_array_free(entries, TRUE);
 
 end:
     free((char*)dump_dir_name);
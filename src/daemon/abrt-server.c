@@ -193,7 +193,21 @@ static int delete_path(const char *dump_dir_name)
     return 0; /* success */
 }
 
-static pid_t spawn_event_handler_child(const char *dump_dir_name, const char *event_name, int *fdp)
+/* PARAM is the pointer to DUP_OF_DIR of post-create, NULL for notify events */
+static void event_handler_output_line(struct abrt_child *child, char *line, void *param)
+{
+    char **dup_of_dir = param;
+    if (dup_of_dir && prefixcmp(line, "DUP_OF_DIR: ") == 0)
+    {
+        free(*dup_of_dir);
+        *dup_of_dir = xstrdup(line + strlen("DUP_OF_DIR: "));
+    }
+    else
+        log_warning("%s", line);
+}
+
+static struct abrt_child *spawn_event_handler_child(struct child_runner *runner,
+        const char *dump_dir_name, const char *event_name, char **dup_of_dir)
 {
     char *args[9];
     args[0] = (char *) LIBEXEC_DIR"/abrt-handle-event";
@@ -207,8 +221,7 @@ static pid_t spawn_event_handler_child(const char *dump_dir_name, const char *ev
     args[7] = (char *) dump_dir_name;
     args[8] = NULL;
 
-    int pipeout[2];
-    int flags = EXECFLG_INPUT_NUL | EXECFLG_OUTPUT | EXECFLG_QUIET | EXECFLG_ERR2OUT;
+    int flags = EXECFLG_INPUT_NUL | EXECFLG_QUIET | EXECFLG_ERR2OUT;
     VERB1 flags &= ~EXECFLG_QUIET;
 
     char *env_vec[3];
@@ -217,14 +230,28 @@ static pid_t spawn_event_handler_child(const char *dump_dir_name, const char *ev
     env_vec[1] = xasprintf("%s=%d", ABRT_SERVER_EVENT_ENV, getpid());
     env_vec[2] = NULL;
 
-    pid_t child = fork_execv_on_steroids(flags, args, pipeout,
-                                         env_vec, /*dir:*/ NULL,
-                                         /*uid(unused):*/ 0);
-    if (fdp)
-        *fdp = pipeout[0];
+    struct abrt_child *child = child_runner_spawn(runner, flags, args, env_vec,
+                                    /*timeout_ms:*/ 0, event_handler_output_line, dup_of_dir);
+    free(env_vec[0]);
+    free(env_vec[1]);
     return child;
 }
 
+/* Waits for the child to actually exit, returns its status */
+static int wait_event_handler_child(struct child_runner *runner,
+        const char *event_name, gint64 event_start)
+{
+    struct abrt_child *child = child_runner_wait(runner);
+    int status = child->status;
+    abrt_child_free(child);
+
+    char *metric = xasprintf("abrt_server_event_seconds{event=\"%s\"}", event_name);
+    metrics_observe_seconds(metric, (g_get_monotonic_time() - event_start) / (double)G_USEC_PER_SEC);
+    free(metric);
+
+    return status;
+}
+
 static int problem_dump_dir_was_provoked_by_abrt_event(struct dump_dir *dd, char  **provoker)
 {
     char *env_var = NULL;
@@ -359,7 +386,10 @@ static int run_post_create(const char *dirname, struct response *resp)
 
     g_idle_add(emit_new_problem_signal, &context);
 
+    const gint64 wait_start = g_get_monotonic_time();
     g_main_loop_run(context.main_loop);
+    metrics_observe_seconds("abrt_server_post_create_wait_seconds",
+            (g_get_monotonic_time() - wait_start) / (double)G_USEC_PER_SEC);
 
     g_main_loop_unref(context.main_loop);
     g_io_channel_unref(channel_signal);
@@ -367,6 +397,10 @@ static int run_post_create(const char *dirname, struct response *resp)
 
     log_notice("Waiting finished");
 
+    /* The function returns right away */
+    if (context.retcode != 0 || context.reply != ABRT_CONTINUE)
+        metrics_flush("abrt-server");
+
     if (context.retcode != 0)
         RESPONSE_RETURN(resp, context.retcode, NULL);
 
@@ -377,65 +411,17 @@ static int run_post_create(const char *dirname, struct response *resp)
      * The post-create event synchronization done.
      */
 
-    int child_stdout_fd;
-    int child_pid = spawn_event_handler_child(dirname, "post-create", &child_stdout_fd);
+    const char *event_name = "post-create";
+    gint64 event_start = g_get_monotonic_time();
 
     char *dup_of_dir = NULL;
-    struct strbuf *cmd_output = strbuf_new();
-
-    bool child_is_post_create = 1; /* else it is a notify child */
-
- read_child_output:
-    //log_warning("Reading from event fd %d", child_stdout_fd);
-
-    /* Read streamed data and split lines */
-    for (;;)
-    {
-        char buf[250]; /* usually we get one line, no need to have big buf */
-        errno = 0;
-        int r = safe_read(child_stdout_fd, buf, sizeof(buf) - 1);
-        if (r <= 0)
-            break;
-        buf[r] = '\0';
+    char *sharded_dir = NULL;
 
-        /* split lines in the current buffer */
-        char *raw = buf;
-        char *newline;
-        while ((newline = strchr(raw, '\n')) != NULL)
-        {
-            *newline = '\0';
-            strbuf_append_str(cmd_output, raw);
-            char *msg = cmd_output->buf;
-
-            if (child_is_post_create
-             && prefixcmp(msg, "DUP_OF_DIR: ") == 0
-            ) {
-                free(dup_of_dir);
-                dup_of_dir = xstrdup(msg + strlen("DUP_OF_DIR: "));
-            }
-            else
-                log_warning("%s", msg);
-
-            strbuf_clear(cmd_output);
-            /* jump to next line */
-            raw = newline + 1;
-        }
-
-        /* beginning of next line. the line continues by next read */
-        strbuf_append_str(cmd_output, raw);
-    }
+    /* Lines of the output are handled as they come, see event_handler_output_line() */
+    struct child_runner *runner = child_runner_new();
+    spawn_event_handler_child(runner, dirname, event_name, &dup_of_dir);
 
-    /* EOF/error */
-
-    /* Wait for child to actually exit, collect status */
-    int status = 0;
-    if (safe_waitpid(child_pid, &status, 0) <= 0)
-    /* should not happen */
-        perror_msg("waitpid(%d)", child_pid);
-
-    /* If it was a "notify[-dup]" event, then we're done */
-    if (!child_is_post_create)
-        goto ret;
+    int status = wait_event_handler_child(runner, event_name, event_start);
 
     /* exit 0 means "this is a good, non-dup dir" */
     /* exit with 1 + "DUP_OF_DIR: dir" string => dup */
@@ -514,9 +500,25 @@ static int run_post_create(const char *dirname, struct response *resp)
         }
     }
 
+    /* Problem listings read the summary instead of the individual elements */
+    problem_summary_save(dd);
+
     /* Reset mode/uig/gid to correct values for all files created by event run */
     dd_sanitize_mode_and_owner(dd);
 
+    /* Owner and mode are final now, identical elements can be shared */
+    if (g_settings_share_elements)
+        problem_dir_share_elements(dd, g_settings_dump_location);
+
+    /* The directory is complete now and can leave the top level of the dump
+     * location. Notify events get the new path. */
+    if (!dup_of_dir && g_settings_shard_dump_location)
+    {
+        sharded_dir = dump_location_move_to_shard(g_settings_dump_location, dd);
+        if (sharded_dir)
+            work_dir = sharded_dir;
+    }
+
     dd_close(dd);
 
     if (!dup_of_dir)
@@ -529,16 +531,13 @@ static int run_post_create(const char *dirname, struct response *resp)
         delete_dump_dir(dirname);
     }
 
+    metrics_counter_add(dup_of_dir ? "abrt_server_problems_total{result=\"dup\"}"
+                                   : "abrt_server_problems_total{result=\"new\"}", 1);
+
     /* Run "notify[-dup]" event */
-    int fd;
-    child_pid = spawn_event_handler_child(
-                work_dir,
-                (dup_of_dir ? "notify-dup" : "notify"),
-                &fd
-    );
-    //log_warning("Started notify, fd %d -> %d", fd, child_stdout_fd);
-    xmove_fd(fd, child_stdout_fd);
-    child_is_post_create = 0;
+    event_name = (dup_of_dir ? "notify-dup" : "notify");
+    event_start = g_get_monotonic_time();
+    spawn_event_handler_child(runner, work_dir, event_name, /*dup_of_dir:*/ NULL);
     if (dup_of_dir)
         RESPONSE_SETTER(resp, 303, dup_of_dir);
     else
@@ -547,19 +546,21 @@ static int run_post_create(const char *dirname, struct response *resp)
         free(dup_of_dir);
     }
     dup_of_dir = NULL;
-    strbuf_clear(cmd_output);
-    goto read_child_output;
+    wait_event_handler_child(runner, event_name, event_start);
+    goto ret;
 
  delete_bad_dir:
     log_warning("Deleting problem directory '%s'", dirname);
     delete_dump_dir(dirname);
+    metrics_counter_add("abrt_server_problems_total{result=\"bad\"}", 1);
     /* TODO - better code to allow detection on client's side */
     RESPONSE_SETTER(resp, 403, NULL);
 
  ret:
-    strbuf_free(cmd_output);
+    child_runner_free(runner);
     free(dup_of_dir);
-    close(child_stdout_fd);
+    free(sharded_dir);
+    metrics_flush("abrt-server");
     return 0;
 }
 
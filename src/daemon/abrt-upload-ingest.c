@@ -0,0 +1,630 @@
+/*
+    Copyright (C) 2013  ABRT Team
+    Copyright (C) 2013  Red Hat, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "abrt-upload-ingest.h"
+#include "libabrt.h"
+
+bool
+abrt_upload_archive_name_is_sane(const char *archive)
+{
+    if (archive[0] == '\0' || archive[0] == '.' || archive[0] == '/')
+        return false;
+
+    if (strchr(archive, '/') || strstr(archive, ".."))
+        return false;
+
+    /* Names are stored one per line in the backlog file */
+    if (strpbrk(archive, " \t\n"))
+        return false;
+
+    return true;
+}
+
+#if HAVE_LIBARCHIVE
+#include <archive.h>
+#include <archive_entry.h>
+
+/* Working directories are created in the directory for large temporary
+ * data like abrt-handle-upload does, so nothing walking the dump location
+ * (abrtd's size trimming, abrt-dbus) ever sees a half-extracted archive.
+ * Problem directories are renamed into the dump location, or copied if it
+ * is on another file system.
+ */
+#define INGEST_WORKDIR_TEMPLATE LARGE_DATA_TMP_DIR"/abrt-upload.XXXXXX"
+#define INGEST_READ_BLOCK_SIZE  (64 * 1024)
+
+static const char *const s_archive_suffixes[] = {
+    ".tar.gz",
+    ".tgz",
+    ".tar.bz2",
+    ".tar.xz",
+    NULL
+};
+
+static bool
+archive_has_known_suffix(const char *archive)
+{
+    for (const char *const *sfx = s_archive_suffixes; *sfx; ++sfx)
+        if (suffixcmp(archive, *sfx) == 0)
+            return true;
+
+    return false;
+}
+
+/* Removes a directory tree created by the extraction. The extraction never
+ * creates anything deeper than DIR/FILE and never creates symbolic links.
+ */
+static void
+remove_dir_at(int parent_fd, const char *name)
+{
+    int dir_fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dir_fd < 0)
+    {
+        if (errno != ENOENT)
+            perror_msg("Can't open directory '%s' for removal", name);
+        return;
+    }
+
+    DIR *d = fdopendir(dir_fd);
+    if (d == NULL)
+    {
+        perror_msg("Can't list directory '%s'", name);
+        close(dir_fd);
+        return;
+    }
+
+    struct dirent *dent;
+    while ((dent = readdir(d)) != NULL)
+    {
+        if (dot_or_dotdot(dent->d_name))
+            continue;
+
+        if (unlinkat(dir_fd, dent->d_name, 0) == 0)
+            continue;
+
+        if (errno == EISDIR || errno == EPERM)
+            remove_dir_at(dir_fd, dent->d_name);
+        else
+            perror_msg("Can't remove '%s/%s'", name, dent->d_name);
+    }
+    closedir(d);
+
+    if (unlinkat(parent_fd, name, AT_REMOVEDIR) != 0)
+        perror_msg("Can't remove directory '%s'", name);
+}
+
+/* Splits the path of an archive member into at most two components.
+ *
+ * Returns the number of components or -1 if the path is not acceptable
+ * (absolute, containing '..' or too deep).
+ */
+static int
+split_entry_path(char *path, char **dir, char **name)
+{
+    while (path[0] == '.' && path[1] == '/')
+        path += 2;
+
+    size_t len = strlen(path);
+    while (len > 0 && path[len - 1] == '/')
+        path[--len] = '\0';
+
+    if (len == 0)
+        return 0;
+
+    if (path[0] == '/')
+        return -1;
+
+    char *slash = strchr(path, '/');
+    if (slash == NULL)
+    {
+        if (!str_is_correct_filename(path))
+            return -1;
+
+        *dir = NULL;
+        *name = path;
+        return 1;
+    }
+
+    *slash = '\0';
+    if (!str_is_correct_filename(path) || !str_is_correct_filename(slash + 1))
+        return -1;
+
+    *dir = path;
+    *name = slash + 1;
+    return 2;
+}
+
+static int
+open_or_create_subdir(int workdir_fd, const char *name)
+{
+    if (mkdirat(workdir_fd, name, 0700) != 0 && errno != EEXIST)
+    {
+        perror_msg("Can't create directory '%s'", name);
+        return -1;
+    }
+
+    int fd = openat(workdir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        perror_msg("Can't open directory '%s'", name);
+
+    return fd;
+}
+
+/* Streams the data of the current archive member into a new file and gives
+ * the file the right owner and mode before the first byte is written.
+ */
+static int
+extract_regular_file(struct archive *a, struct archive_entry *entry,
+        int dir_fd, const char *name, gid_t abrt_gid)
+{
+    int fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, DEFAULT_DUMP_DIR_MODE);
+    if (fd < 0)
+    {
+        perror_msg("Can't create file '%s'", name);
+        return -1;
+    }
+
+    int retval = -1;
+    if (fchown(fd, 0, abrt_gid) != 0 || fchmod(fd, DEFAULT_DUMP_DIR_MODE) != 0)
+    {
+        perror_msg("Can't set owner and mode of '%s'", name);
+        goto finito;
+    }
+
+    const void *buf;
+    size_t size;
+    int64_t offset;
+    int r;
+    while ((r = archive_read_data_block(a, &buf, &size, &offset)) == ARCHIVE_OK)
+    {
+        /* pwrite() keeps holes of sparse members */
+        const char *data = buf;
+        while (size > 0)
+        {
+            ssize_t w = pwrite(fd, data, size, offset);
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                perror_msg("Can't write '%s'", name);
+                goto finito;
+            }
+            data += w;
+            size -= w;
+            offset += w;
+        }
+    }
+
+    if (r != ARCHIVE_EOF)
+    {
+        error_msg("Can't unpack '%s': %s", name, archive_error_string(a));
+        goto finito;
+    }
+
+    if (ftruncate(fd, archive_entry_size(entry)) != 0)
+    {
+        perror_msg("Can't set size of '%s'", name);
+        goto finito;
+    }
+
+    retval = 0;
+finito:
+    close(fd);
+    return retval;
+}
+
+static int
+extract_archive(struct archive *a, int workdir_fd, const char *archive, gid_t abrt_gid)
+{
+    struct archive_entry *entry;
+    int r;
+    while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK)
+    {
+        char *path = xstrdup(archive_entry_pathname(entry));
+        char *dir = NULL;
+        char *name = NULL;
+        const int depth = split_entry_path(path, &dir, &name);
+        const mode_t type = archive_entry_filetype(entry);
+
+        int retval = 0;
+        if (depth == 0)
+            /* "./" */;
+        else if (depth < 0)
+            log_notice("Skipping '%s' from '%s': invalid path", archive_entry_pathname(entry), archive);
+        else if (type == AE_IFDIR)
+        {
+            if (depth == 1)
+            {
+                int fd = open_or_create_subdir(workdir_fd, name);
+                if (fd < 0)
+                    retval = -1;
+                else
+                    close(fd);
+            }
+            else
+                log_notice("Skipping '%s' from '%s': nested directory", archive_entry_pathname(entry), archive);
+        }
+        else if (type == AE_IFREG)
+        {
+            int dir_fd = dir ? open_or_create_subdir(workdir_fd, dir) : workdir_fd;
+            if (dir_fd < 0)
+                retval = -1;
+            else
+            {
+                retval = extract_regular_file(a, entry, dir_fd, name, abrt_gid);
+                if (dir_fd != workdir_fd)
+                    close(dir_fd);
+            }
+        }
+        else
+            /* symbolic links, hard links, devices, fifos ... */
+            log_notice("Skipping '%s' from '%s': not a regular file", archive_entry_pathname(entry), archive);
+
+        free(path);
+
+        if (retval != 0)
+            return retval;
+    }
+
+    if (r != ARCHIVE_EOF)
+    {
+        error_msg("Can't unpack '%s': %s", archive, archive_error_string(a));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Several workers can unpack archives at the same time and they all share
+ * the PID, the counter makes the names of the moved directories unique.
+ */
+static volatile gint s_sequence;
+
+static bool
+is_regular_file_at(int dir_fd, const char *name)
+{
+    struct stat st;
+    return fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(st.st_mode);
+}
+
+/* Copies the problem directory DIR_FD (NAME in messages) to DEST when it can't
+ * be renamed across file systems. The directory contains only regular files.
+ */
+static int
+copy_problem_dir(int dir_fd, const char *name, const char *dest, gid_t abrt_gid)
+{
+    if (mkdir(dest, DEFAULT_DUMP_DIR_MODE | S_IXUSR | S_IXGRP) != 0)
+    {
+        perror_msg("Can't create '%s'", dest);
+        return -1;
+    }
+
+    int retval = -1;
+    int src_fd = -1;
+    DIR *d = NULL;
+    int dest_fd = open(dest, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dest_fd < 0)
+    {
+        perror_msg("Can't open '%s'", dest);
+        goto finito;
+    }
+
+    if (fchown(dest_fd, 0, abrt_gid) != 0)
+    {
+        perror_msg("Can't set owner of '%s'", dest);
+        goto finito;
+    }
+
+    src_fd = dup(dir_fd);
+    d = src_fd >= 0 ? fdopendir(src_fd) : NULL;
+    if (d == NULL)
+    {
+        perror_msg("Can't list '%s'", name);
+        goto finito;
+    }
+    src_fd = -1;
+
+    struct dirent *dent;
+    while ((dent = readdir(d)) != NULL)
+    {
+        if (dot_or_dotdot(dent->d_name) || !is_regular_file_at(dirfd(d), dent->d_name))
+            continue;
+
+        int in_fd = openat(dirfd(d), dent->d_name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (in_fd < 0)
+        {
+            perror_msg("Can't open '%s/%s'", name, dent->d_name);
+            goto finito;
+        }
+
+        int out_fd = openat(dest_fd, dent->d_name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, DEFAULT_DUMP_DIR_MODE);
+        if (out_fd < 0)
+        {
+            perror_msg("Can't create '%s/%s'", dest, dent->d_name);
+            close(in_fd);
+            goto finito;
+        }
+
+        const off_t copied = copyfd_eof(in_fd, out_fd, COPYFD_SPARSE);
+        close(in_fd);
+        if (copied < 0 || fchown(out_fd, 0, abrt_gid) != 0)
+        {
+            perror_msg("Can't copy '%s/%s' to '%s'", name, dent->d_name, dest);
+            close(out_fd);
+            goto finito;
+        }
+        close(out_fd);
+    }
+
+    retval = 0;
+
+finito:
+    if (d)
+        closedir(d);
+    if (src_fd >= 0)
+        close(src_fd);
+    if (dest_fd >= 0)
+        close(dest_fd);
+    if (retval != 0)
+        remove_dir_at(AT_FDCWD, dest);
+    return retval;
+}
+
+/* Gives the problem directory PARENT_FD/NAME its final form and moves it to
+ * DEST. The same transformation abrt-handle-upload does, except the
+ * sanitization of elements which has been already done while extracting.
+ */
+static int
+move_problem_dir(int parent_fd, const char *name, const char *dest, gid_t abrt_gid)
+{
+    int dir_fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dir_fd < 0)
+    {
+        perror_msg("Can't open '%s'", name);
+        return -1;
+    }
+
+    int retval = -1;
+    if (fchown(dir_fd, 0, abrt_gid) != 0
+        || fchmod(dir_fd, DEFAULT_DUMP_DIR_MODE | S_IXUSR | S_IXGRP) != 0)
+    {
+        perror_msg("Can't set owner and mode of '%s'", name);
+        goto finito;
+    }
+
+    /* overwrite remote if it exists */
+    int remote_fd = openat(dir_fd, FILENAME_REMOTE, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, DEFAULT_DUMP_DIR_MODE);
+    if (remote_fd < 0)
+    {
+        perror_msg("Can't create '%s/%s'", name, FILENAME_REMOTE);
+        goto finito;
+    }
+    if (fchown(remote_fd, 0, abrt_gid) != 0 || full_write(remote_fd, "1", 1) != 1)
+    {
+        perror_msg("Can't write '%s/%s'", name, FILENAME_REMOTE);
+        close(remote_fd);
+        goto finito;
+    }
+    close(remote_fd);
+
+    /* abrtd would increment count value and abrt-server refuses to process
+     * problem directories containing 'count' element when PrivateReports is on.
+     */
+    if (renameat(dir_fd, FILENAME_COUNT, dir_fd, "remote_count") != 0 && errno != ENOENT)
+    {
+        perror_msg("Can't rename '%s/%s'", name, FILENAME_COUNT);
+        goto finito;
+    }
+
+    if (renameat(parent_fd, name, AT_FDCWD, dest) != 0)
+    {
+        if (errno != EXDEV)
+        {
+            perror_msg("Can't move '%s' to '%s'", name, dest);
+            goto finito;
+        }
+
+        if (copy_problem_dir(dir_fd, name, dest, abrt_gid) != 0)
+            goto finito;
+
+        remove_dir_at(parent_fd, name);
+    }
+
+    notify_new_path(dest);
+    retval = 0;
+
+finito:
+    close(dir_fd);
+    return retval;
+}
+
+/* The archive can contain either plain dump files or one or more complete
+ * problem data directories.
+ */
+static int
+move_problem_dirs(int tmp_fd, const char *dump_location, const char *workdir, gid_t abrt_gid)
+{
+    int workdir_fd = openat(tmp_fd, workdir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (workdir_fd < 0)
+    {
+        perror_msg("Can't open '%s'", workdir);
+        return -1;
+    }
+
+    DIR *d = fdopendir(workdir_fd);
+    if (d == NULL)
+    {
+        perror_msg("Can't list '%s'", workdir);
+        close(workdir_fd);
+        return -1;
+    }
+
+    int retval = 0;
+    struct dirent *dent;
+
+    /* Checking the single problem directory possibility first. */
+    if ((is_regular_file_at(workdir_fd, FILENAME_ANALYZER) || is_regular_file_at(workdir_fd, FILENAME_TYPE))
+        && is_regular_file_at(workdir_fd, FILENAME_TIME))
+    {
+        /* remove directories */
+        while ((dent = readdir(d)) != NULL)
+            if (!dot_or_dotdot(dent->d_name) && !is_regular_file_at(workdir_fd, dent->d_name))
+                remove_dir_at(workdir_fd, dent->d_name);
+
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        char stamp[sizeof("YYYY-MM-DD-hh:mm:ss")];
+        struct tm tm;
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d-%H:%M:%S", localtime_r(&tv.tv_sec, &tm));
+
+        char *dest = xasprintf("%s/remote.%s.%06ld.%d.%d", dump_location, stamp,
+                (long)tv.tv_usec, (int)getpid(), g_atomic_int_add(&s_sequence, 1));
+        retval = move_problem_dir(tmp_fd, workdir, dest, abrt_gid);
+        free(dest);
+        goto finito;
+    }
+
+    while ((dent = readdir(d)) != NULL)
+    {
+        if (dot_or_dotdot(dent->d_name))
+            continue;
+
+        struct stat st;
+        if (fstatat(workdir_fd, dent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISDIR(st.st_mode))
+            continue;
+
+        char *dest = concat_path_file(dump_location, dent->d_name);
+        if (access(dest, F_OK) == 0)
+        {
+            char *alt = xasprintf("%s.%d.%d", dest, (int)getpid(), g_atomic_int_add(&s_sequence, 1));
+            free(dest);
+            dest = alt;
+        }
+
+        if (access(dest, F_OK) == 0)
+            log_notice("Skipping '%s': '%s' already exists", dent->d_name, dest);
+        else if (move_problem_dir(workdir_fd, dent->d_name, dest, abrt_gid) != 0)
+            retval = -1;
+
+        free(dest);
+    }
+
+finito:
+    closedir(d);
+    return retval;
+}
+
+int
+abrt_upload_ingest_archive(const char *dump_location, const char *upload_dir,
+        const char *archive, gid_t abrt_gid, int flags)
+{
+    if (!abrt_upload_archive_name_is_sane(archive))
+    {
+        error_msg(_("Skipping: '%s' (invalid file name)"), archive);
+        return -EINVAL;
+    }
+
+    if (!archive_has_known_suffix(archive))
+    {
+        error_msg(_("Unknown file type: '%s'"), archive);
+        return -EINVAL;
+    }
+
+    char *archive_path = concat_path_file(upload_dir, archive);
+    int archive_fd = open(archive_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (archive_fd < 0)
+    {
+        int retval = -errno;
+        if (errno != ENOENT)
+            perror_msg("Can't open '%s'", archive_path);
+        free(archive_path);
+        return retval;
+    }
+
+    /* Unlink it right now so another event for the same file does not
+     * process it twice; we still hold the descriptor. */
+    if ((flags & ABRT_UPLOAD_INGEST_DELETE_ARCHIVE) && unlink(archive_path) != 0)
+        perror_msg("Can't delete '%s'", archive_path);
+
+    int retval = -1;
+    struct archive *a = NULL;
+    char *workdir = NULL;
+    int tmp_fd = open(LARGE_DATA_TMP_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (tmp_fd < 0)
+    {
+        perror_msg("Can't open '%s'", LARGE_DATA_TMP_DIR);
+        goto finito;
+    }
+
+    workdir = xstrdup(INGEST_WORKDIR_TEMPLATE);
+    if (mkdtemp(workdir) == NULL)
+    {
+        perror_msg(_("Can't create working directory in '%s'"), LARGE_DATA_TMP_DIR);
+        free(workdir);
+        workdir = NULL;
+        goto finito;
+    }
+
+    int workdir_fd = open(workdir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (workdir_fd < 0)
+    {
+        perror_msg("Can't open '%s'", workdir);
+        goto finito;
+    }
+
+    a = archive_read_new();
+    archive_read_support_filter_gzip(a);
+    archive_read_support_filter_bzip2(a);
+    archive_read_support_filter_xz(a);
+    archive_read_support_format_tar(a);
+
+    log_warning(_("Unpacking '%s'"), archive);
+    if (archive_read_open_fd(a, archive_fd, INGEST_READ_BLOCK_SIZE) != ARCHIVE_OK)
+        error_msg(_("Can't unpack '%s'"), archive);
+    else
+        retval = extract_archive(a, workdir_fd, archive, abrt_gid);
+
+    close(workdir_fd);
+
+    if (retval == 0)
+        retval = move_problem_dirs(tmp_fd, dump_location, strrchr(workdir, '/') + 1, abrt_gid);
+
+    if (retval == 0)
+        log_warning(_("'%s' processed successfully"), archive);
+
+finito:
+    if (workdir)
+    {
+        /* The working directory is gone if it was a problem directory */
+        remove_dir_at(tmp_fd, strrchr(workdir, '/') + 1);
+        free(workdir);
+    }
+
+    if (a)
+        archive_read_free(a);
+
+    if (tmp_fd >= 0)
+        close(tmp_fd);
+
+    close(archive_fd);
+    free(archive_path);
+
+    return retval;
+}
+#endif /*HAVE_LIBARCHIVE*/
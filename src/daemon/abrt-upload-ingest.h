@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2013  ABRT Team
+    Copyright (C) 2013  Red Hat, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef _ABRT_UPLOAD_INGEST_H_
+#define _ABRT_UPLOAD_INGEST_H_
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+enum {
+    /* Remove the uploaded archive once it has been handled (DeleteUploaded) */
+    ABRT_UPLOAD_INGEST_DELETE_ARCHIVE = 1 << 0,
+};
+
+/* Returns true if the archive name passes the same checks abrt-handle-upload
+ * does (no slashes, no leading dot, no "..", no white spaces).
+ */
+bool
+abrt_upload_archive_name_is_sane(const char *archive);
+
+#if HAVE_LIBARCHIVE
+/* Unpacks the archive UPLOAD_DIR/ARCHIVE and moves its problem directories
+ * to DUMP_LOCATION.
+ *
+ * The archive is decompressed and untarred in-process into a working
+ * directory in LARGE_DATA_TMP_DIR. Only regular files are extracted and they
+ * are created with the right ownership (root:ABRT_GID) and mode while being
+ * written, so no post-processing pass is needed. Every problem directory
+ * found in the archive is renamed (or copied across file systems) into
+ * DUMP_LOCATION and abrtd is notified about it.
+ *
+ * The function is thread safe and never dies.
+ *
+ * Returns 0 on success, -ENOENT if the archive has disappeared in the
+ * meantime and another negative number on any other error.
+ */
+int
+abrt_upload_ingest_archive(const char *dump_location, const char *upload_dir,
+        const char *archive, gid_t abrt_gid, int flags);
+#endif
+
+#endif /*_ABRT_UPLOAD_INGEST_H_*/
@@ -16,7 +16,10 @@
     with this program; if not, write to the Free Software Foundation, Inc.,
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <grp.h>
+
 #include "abrt-inotify.h"
+#include "abrt-upload-ingest.h"
 #include "abrt_glib.h"
 #include "libabrt.h"
 
@@ -26,19 +29,190 @@
 #define DEFAULT_COUNT_OF_WORKERS 10
 #define DEFAULT_CACHE_MIB_SIZE 4
 
+/* Archives which do not fit into the in-memory queue are remembered in this
+ * file instead of being dropped. The file survives restarts of the daemon.
+ */
+#define BACKLOG_FILE VAR_STATE"/abrt-upload-watch.backlog"
+
 static int g_signal_pipe[2];
 
+/* The backlog file starts with a fixed size header holding the offset of the
+ * first unprocessed line, followed by archive names separated by '\n'.
+ */
+#define BACKLOG_HEADER_FMT "%019lld\n"
+#define BACKLOG_HEADER_SIZE 20
+
+struct backlog
+{
+    int fd;
+    off_t read_pos;
+    off_t write_pos;
+};
+
+static void
+backlog_save_read_pos(struct backlog *backlog)
+{
+    char header[BACKLOG_HEADER_SIZE + 1];
+    snprintf(header, sizeof(header), BACKLOG_HEADER_FMT, (long long)backlog->read_pos);
+    if (pwrite(backlog->fd, header, BACKLOG_HEADER_SIZE, 0) != BACKLOG_HEADER_SIZE)
+        perror_msg("Can't update '%s'", BACKLOG_FILE);
+}
+
+static void
+backlog_open(struct backlog *backlog)
+{
+    backlog->fd = open(BACKLOG_FILE, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (backlog->fd < 0)
+    {
+        perror_msg("Can't open '%s', archives may be omitted", BACKLOG_FILE);
+        return;
+    }
+
+    char header[BACKLOG_HEADER_SIZE + 1];
+    struct stat st;
+    if (fstat(backlog->fd, &st) == 0
+        && st.st_size > BACKLOG_HEADER_SIZE
+        && pread(backlog->fd, header, BACKLOG_HEADER_SIZE, 0) == BACKLOG_HEADER_SIZE)
+    {
+        header[BACKLOG_HEADER_SIZE] = '\0';
+        long long pos = strtoll(header, NULL, 10);
+        if (pos >= BACKLOG_HEADER_SIZE && pos <= st.st_size)
+        {
+            backlog->read_pos = pos;
+            backlog->write_pos = st.st_size;
+            log_notice("Resuming %lld bytes of backlog from '%s'",
+                    (long long)(backlog->write_pos - backlog->read_pos), BACKLOG_FILE);
+            return;
+        }
+    }
+
+    backlog->read_pos = backlog->write_pos = BACKLOG_HEADER_SIZE;
+    if (ftruncate(backlog->fd, 0) != 0)
+        perror_msg("Can't truncate '%s'", BACKLOG_FILE);
+    backlog_save_read_pos(backlog);
+}
+
+static bool
+backlog_is_empty(struct backlog *backlog)
+{
+    return backlog->read_pos >= backlog->write_pos;
+}
+
+static int
+backlog_push(struct backlog *backlog, const char *value)
+{
+    if (backlog->fd < 0)
+        return 0;
+
+    char *line = xasprintf("%s\n", value);
+    const size_t len = strlen(line);
+    const ssize_t w = pwrite(backlog->fd, line, len, backlog->write_pos);
+    free(line);
+
+    if (w != (ssize_t)len)
+    {
+        perror_msg("Can't write to '%s'", BACKLOG_FILE);
+        return 0;
+    }
+
+    backlog->write_pos += len;
+    return 1;
+}
+
+static char *
+backlog_pop(struct backlog *backlog)
+{
+    if (backlog->fd < 0 || backlog_is_empty(backlog))
+        return NULL;
+
+    char buf[FILENAME_MAX + 1];
+    ssize_t r = pread(backlog->fd, buf, sizeof(buf), backlog->read_pos);
+    char *eol = r > 0 ? memchr(buf, '\n', r) : NULL;
+    char *value = NULL;
+    if (eol == NULL)
+    {
+        error_msg("Corrupted backlog '%s', dropping it", BACKLOG_FILE);
+        backlog->read_pos = backlog->write_pos;
+    }
+    else
+    {
+        value = xstrndup(buf, eol - buf);
+        backlog->read_pos += eol - buf + 1;
+    }
+
+    if (backlog_is_empty(backlog))
+    {   /* All entries consumed, start from scratch */
+        backlog->read_pos = backlog->write_pos = BACKLOG_HEADER_SIZE;
+        if (ftruncate(backlog->fd, BACKLOG_HEADER_SIZE) != 0)
+            perror_msg("Can't truncate '%s'", BACKLOG_FILE);
+    }
+    backlog_save_read_pos(backlog);
+
+    return value;
+}
+
+/* Puts the values in front of the unprocessed entries, the oldest value is
+ * expected at the tail of the queue. Consumes the values.
+ */
+static void
+backlog_prepend(struct backlog *backlog, GQueue *values)
+{
+    if (g_queue_is_empty(values))
+        return;
+
+    size_t rest_len = backlog->write_pos - backlog->read_pos;
+    char *rest = xmalloc(rest_len + 1);
+    if (rest_len > 0
+        && pread(backlog->fd, rest, rest_len, backlog->read_pos) != (ssize_t)rest_len)
+    {
+        /* Keep the old entries and at least append the values */
+        perror_msg("Can't read '%s'", BACKLOG_FILE);
+        rest_len = 0;
+    }
+    else
+    {
+        backlog->read_pos = backlog->write_pos = BACKLOG_HEADER_SIZE;
+        if (ftruncate(backlog->fd, BACKLOG_HEADER_SIZE) != 0)
+            perror_msg("Can't truncate '%s'", BACKLOG_FILE);
+    }
+
+    char *name;
+    while ((name = (char *)g_queue_pop_tail(values)) != NULL)
+    {
+        backlog_push(backlog, name);
+        free(name);
+    }
+
+    if (rest_len > 0)
+    {
+        if (pwrite(backlog->fd, rest, rest_len, backlog->write_pos) != (ssize_t)rest_len)
+            perror_msg("Can't write to '%s'", BACKLOG_FILE);
+        else
+            backlog->write_pos += rest_len;
+    }
+    free(rest);
+
+    backlog_save_read_pos(backlog);
+}
+
 struct queue
 {
     unsigned capacity;
     GQueue q;
+    struct backlog backlog;
 };
 
 static int
 queue_push(struct queue *queue, char *value)
 {
-    if (g_queue_get_length(&queue->q) >= queue->capacity)
-        return 0;
+    /* Keep the FIFO order: once something has spilled to disk, every new
+     * value must go there too. */
+    if (g_queue_get_length(&queue->q) >= queue->capacity || !backlog_is_empty(&queue->backlog))
+    {
+        int r = backlog_push(&queue->backlog, value);
+        free(value);
+        return r;
+    }
 
     g_queue_push_head(&queue->q, value);
 
@@ -49,7 +223,7 @@ static char *
 queue_pop(struct queue *queue)
 {
     if (g_queue_is_empty(&queue->q))
-        return NULL;
+        return backlog_pop(&queue->backlog);
 
     return (char *)g_queue_pop_tail(&queue->q);
 }
@@ -61,6 +235,12 @@ struct process
     unsigned children;
     unsigned max_children;
     struct queue queue;
+#if HAVE_LIBARCHIVE
+    /* Names of archives being queued or processed */
+    GHashTable *pending;
+    GThreadPool *workers;
+    gid_t abrt_gid;
+#endif
 };
 
 static void
@@ -69,6 +249,50 @@ process_quit(struct process *proc)
     g_main_loop_quit(proc->main_loop);
 }
 
+static void process_next_in_queue(struct process *proc);
+static void print_stats(struct process *proc);
+
+#if HAVE_LIBARCHIVE
+struct ingest_job
+{
+    struct process *proc;
+    char *name;
+};
+
+/* Called in the main loop once a worker has finished a job */
+static gboolean
+ingest_job_done_cb(gpointer user_data)
+{
+    struct ingest_job *job = (struct ingest_job *)user_data;
+    struct process *proc = job->proc;
+
+    --proc->children;
+    g_hash_table_remove(proc->pending, job->name);
+    free(job);
+
+    process_next_in_queue(proc);
+    if (g_verbose > 1)
+        print_stats(proc);
+
+    return FALSE; /* one shot */
+}
+
+static void
+ingest_job_run(gpointer data, gpointer user_data)
+{
+    struct ingest_job *job = (struct ingest_job *)data;
+    struct process *proc = job->proc;
+
+    const int flags = g_settings_delete_uploaded ? ABRT_UPLOAD_INGEST_DELETE_ARCHIVE : 0;
+    const int r = abrt_upload_ingest_archive(g_settings_dump_location, proc->upload_directory,
+                                             job->name, proc->abrt_gid, flags);
+    if (r == -ENOENT)
+        log_info("Archive '%s' has already been processed", job->name);
+
+    g_idle_add(ingest_job_done_cb, job);
+}
+#endif
+
 static void
 run_abrt_handle_upload(struct process *proc, const char *name)
 {
@@ -77,6 +301,23 @@ run_abrt_handle_upload(struct process *proc, const char *name)
     ++proc->children;
     log_debug("Running workers: %d", proc->children);
 
+#if HAVE_LIBARCHIVE
+    struct ingest_job *job = xmalloc(sizeof(*job));
+    job->proc = proc;
+    /* The pending table owns the string */
+    job->name = (char *)g_hash_table_lookup(proc->pending, name);
+
+    GError *error = NULL;
+    g_thread_pool_push(proc->workers, job, &error);
+    if (error == NULL)
+        return;
+
+    error_msg("Can't start a worker for '%s': %s", name, error->message);
+    g_error_free(error);
+    free(job);
+    --proc->children;
+    g_hash_table_remove(proc->pending, name);
+#else
     fflush(NULL); /* paranoia */
     pid_t pid = fork();
     if (pid < 0)
@@ -98,6 +339,7 @@ run_abrt_handle_upload(struct process *proc, const char *name)
                            g_settings_dump_location, proc->upload_directory, name, (char*)NULL);
         perror_msg_and_die("Can't execute '%s'", "abrt-handle-upload");
     }
+#endif
 }
 
 static void
@@ -105,41 +347,81 @@ handle_new_path(struct process *proc, char *name)
 {
     log_warning("Detected creation of file '%s' in upload directory '%s'", name, proc->upload_directory);
 
+    if (!abrt_upload_archive_name_is_sane(name))
+    {
+        error_msg(_("Skipping: '%s' (invalid file name)"), name);
+        free(name);
+        return;
+    }
+
+#if HAVE_LIBARCHIVE
+    /* An archive can be reported more than once (e.g. closed after write
+     * several times or moved back and forth). */
+    if (g_hash_table_contains(proc->pending, name))
+    {
+        log_debug("Archive '%s' is already pending", name);
+        free(name);
+        return;
+    }
+#endif
+
     if (proc->children < proc->max_children)
     {
+#if HAVE_LIBARCHIVE
+        g_hash_table_add(proc->pending, name);
+        run_abrt_handle_upload(proc, name);
+#else
         run_abrt_handle_upload(proc, name);
         free(name);
+#endif
         return;
     }
 
     log_debug("Pushing '%s' to deferred queue", name);
-    if (!queue_push(&proc->queue, name))
+#if HAVE_LIBARCHIVE
+    g_hash_table_add(proc->pending, xstrdup(name));
+#endif
+    if (!queue_push(&proc->queue, xstrdup(name)))
     {
         error_msg(_("No free workers and full buffer. Omitting archive '%s'"), name);
-        free(name);
-        return;
+#if HAVE_LIBARCHIVE
+        g_hash_table_remove(proc->pending, name);
+#endif
     }
+    free(name);
 }
 
 static void
 print_stats(struct process *proc)
 {
     /* this is meant only for debugging, so not marking it as translatable */
-    fprintf(stderr, "%i archives to process, %i active workers\n", g_queue_get_length(&proc->queue.q), proc->children);
+    fprintf(stderr, "%i archives to process, %lld bytes of backlog, %i active workers\n",
+            g_queue_get_length(&proc->queue.q),
+            (long long)(proc->queue.backlog.write_pos - proc->queue.backlog.read_pos),
+            proc->children);
 }
 
 static void
 process_next_in_queue(struct process *proc)
 {
-    char *name = queue_pop(&proc->queue);
-    if (!name)
+    while (proc->children < proc->max_children)
     {
-        log_debug("Deferred queue is empty. Running workers: %d", proc->children);
-        return;
-    }
+        char *name = queue_pop(&proc->queue);
+        if (!name)
+        {
+            log_debug("Deferred queue is empty. Running workers: %d", proc->children);
+            return;
+        }
 
-    run_abrt_handle_upload(proc, name);
-    free(name);
+#if HAVE_LIBARCHIVE
+        /* Archives resumed from the backlog of a previous run are not
+         * known yet. */
+        if (!g_hash_table_contains(proc->pending, name))
+            g_hash_table_add(proc->pending, xstrdup(name));
+#endif
+        run_abrt_handle_upload(proc, name);
+        free(name);
+    }
 }
 
 static void
@@ -262,6 +544,9 @@ main(int argc, char **argv)
         "\n"
         "\nIf UPLOAD_DIRECTORY is not provided, uses a value of"
         "\nWatchCrashdumpArchiveDir option from abrt.conf"
+        "\n"
+        "\nArchives which do not fit into the cache are stored in"
+        "\n"BACKLOG_FILE" and processed later"
     );
     enum {
         OPT_v = 1 << 0,
@@ -271,7 +556,12 @@ main(int argc, char **argv)
         OPT_c = 1 << 4,
     };
 
+#if HAVE_LIBARCHIVE
+    /* Unpacking is CPU bound, one worker per core */
+    int concurrent_workers = g_get_num_processors();
+#else
     int concurrent_workers = DEFAULT_COUNT_OF_WORKERS;
+#endif
     int cache_size_mib = DEFAULT_CACHE_MIB_SIZE;
 
     /* Keep enum above and order of options below in sync! */
@@ -279,7 +569,11 @@ main(int argc, char **argv)
         OPT__VERBOSE(&g_verbose),
         OPT_BOOL('s', NULL, NULL              , _("Log to syslog")),
         OPT_BOOL('d', NULL, NULL              , _("Daemonize")),
+#if HAVE_LIBARCHIVE
+        OPT_INTEGER('w', NULL, &concurrent_workers, _("Number of concurrent workers. Default is the number of CPUs")),
+#else
         OPT_INTEGER('w', NULL, &concurrent_workers, _("Number of concurrent workers. Default is "STRINGIZE(DEFAULT_COUNT_OF_WORKERS))),
+#endif
         OPT_INTEGER('c', NULL, &cache_size_mib, _("Maximal cache size in MiB. Default is "STRINGIZE(DEFAULT_CACHE_MIB_SIZE))),
         OPT_END()
     };
@@ -300,6 +594,10 @@ main(int argc, char **argv)
     g_queue_init(&proc.queue.q);
     proc.queue.capacity = cache_size_mib * (1024 * 1024 / FILENAME_MAX);
     log_debug("Max queue size %u", proc.queue.capacity);
+#if HAVE_LIBARCHIVE
+    /* Workers get their names from this table */
+    proc.pending = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+#endif
 
     argv += optind;
     if (argv[0])
@@ -324,6 +622,22 @@ main(int argc, char **argv)
     if (opts & OPT_d)
         daemonize();
 
+    backlog_open(&proc.queue.backlog);
+
+#if HAVE_LIBARCHIVE
+    struct group *gr = getgrnam("abrt");
+    if (gr)
+        proc.abrt_gid = gr->gr_gid;
+    else
+        error_msg("Failed to get GID of 'abrt' (using 0 instead)");
+
+    GError *pool_error = NULL;
+    proc.workers = g_thread_pool_new(ingest_job_run, NULL, proc.max_children, TRUE, &pool_error);
+    if (pool_error)
+        error_msg_and_die("Can't create worker threads: %s", pool_error->message);
+    log_notice("Unpacking archives in %u worker threads", proc.max_children);
+#endif
+
     msg_prefix = g_progname;
     if ((opts & OPT_d) || (opts & OPT_s) || getenv("ABRT_SYSLOG"))
     {
@@ -356,6 +670,9 @@ main(int argc, char **argv)
                 handle_signal_pipe_cb,
                 &proc);
 
+    /* Pick up the archives left over from the previous run */
+    process_next_in_queue(&proc);
+
     log_info("Starting glib main loop");
 
     g_main_loop_run(proc.main_loop);
@@ -376,6 +693,21 @@ main(int argc, char **argv)
 
     abrt_inotify_watch_destroy(aiw);
 
+#if HAVE_LIBARCHIVE
+    /* Finish the archives being unpacked, the queued ones are in the
+     * backlog or will be reported again. */
+    g_thread_pool_free(proc.workers, /*immediate*/FALSE, /*wait*/TRUE);
+    g_hash_table_destroy(proc.pending);
+#endif
+
+    /* Archives still waiting in the memory queue would be lost otherwise.
+     * They were queued before anything in the backlog, so they go first. */
+    if (proc.queue.backlog.fd >= 0)
+    {
+        backlog_prepend(&proc.queue.backlog, &proc.queue.q);
+        close(proc.queue.backlog.fd);
+    }
+
     if (proc.main_loop)
         g_main_loop_unref(proc.main_loop);
 
@@ -20,6 +20,7 @@
 # include <locale.h>
 #endif
 #include <sys/un.h>
+#include <sys/resource.h>
 #include <glib-unix.h>
 
 #include "abrt_glib.h"
@@ -43,8 +44,29 @@
 #define MAX_CLIENT_COUNT  10
 
 #define IN_DUMP_LOCATION_FLAGS (IN_DELETE_SELF | IN_MOVE_SELF)
+#define IN_CONF_FLAGS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE)
 
 #define ABRTD_DBUS_NAME ABRT_DBUS_NAME".daemon"
+#define ABRTD_DBUS_OBJECT ABRT_DBUS_OBJECT"/daemon"
+
+/* Metrics of all ABRT components are periodically dumped to this file */
+#define METRICS_FILE        VAR_RUN"/abrt/metrics.prom"
+#define METRICS_DUMP_PERIOD 15
+
+/* Big elements of problems older than ColdStorageAge hours are compressed
+ * and unused blobs of shared elements are removed by abrt-cold-storage once
+ * per COLD_STORAGE_PERIOD seconds.
+ */
+#define COLD_STORAGE_PERIOD (60 * 60)
+static pid_t s_cold_storage_pid;
+
+/* Post-create scheduling, see post_create_queue.c
+ *
+ * The queue is configured from abrt.conf only at startup because the waiting
+ * problems refer to its classes.
+ */
+#define POST_CREATE_QUEUE_FILE       VAR_RUN"/abrt/post-create-queue"
+static struct post_create_queue *s_post_create_queue;
 
 /* Daemon initializes, then sits in glib main loop, waiting for events.
  * Events can be:
@@ -60,7 +82,6 @@ static int s_timeout_src;
 static GMainLoop *s_main_loop;
 
 GList *s_processes;
-GList *s_dir_queue;
 
 static GIOChannel *channel_socket = NULL;
 static guint channel_id_socket = 0;
@@ -77,6 +98,8 @@ struct abrt_server_proc
         AS_UKNOWN,
         AS_POST_CREATE,
     } type;
+    /* The item of the process in the post-create queue */
+    struct post_create_item *post_create;
 };
 
 /* Returns 0 if proc's pid equals the the given pid */
@@ -91,10 +114,17 @@ static gint abrt_server_compare_fdout(struct abrt_server_proc *proc, int *fdout)
     return proc->fdout != *fdout;
 }
 
-/* Returns 0 if proc's dirname equals the the given dirname */
-static gint abrt_server_compare_dirname(struct abrt_server_proc *proc, const char *dirname)
+/* Returns the process of the given dirname waiting in the post-create queue */
+static struct abrt_server_proc *find_queued_abrt_server(const char *dirname)
 {
-    return g_strcmp0(proc->dirname, dirname);
+    for (GList *iter = s_post_create_queue->items; iter != NULL; iter = g_list_next(iter))
+    {
+        struct abrt_server_proc *proc = (struct abrt_server_proc *)((struct post_create_item *)iter->data)->data;
+        if (g_strcmp0(proc->dirname, dirname) == 0)
+            return proc;
+    }
+
+    return NULL;
 }
 
 /* Helpers */
@@ -123,21 +153,116 @@ static void dispose_abrt_server(struct abrt_server_proc *proc)
         g_io_channel_unref(proc->channel);
 }
 
-static void notify_next_post_create_process(struct abrt_server_proc *finished)
+/* Reads the problem type directly to avoid waiting for the dump directory
+ * lock in the main loop. Returns NULL if the type is unknown. */
+static char *read_problem_type(const char *dirname)
 {
-    if (finished != NULL)
-        s_dir_queue = g_list_remove(s_dir_queue, finished);
+    char *type_path = concat_path_file(dirname, FILENAME_TYPE);
+    const int fd = open(type_path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    free(type_path);
+    if (fd < 0)
+        return NULL;
+
+    char type[64];
+    const ssize_t r = full_read(fd, type, sizeof(type) - 1);
+    close(fd);
+    if (r <= 0)
+        return NULL;
+    type[r] = '\0';
+    strchrnul(type, '\n')[0] = '\0';
+
+    return xstrdup(type);
+}
+
+/* Removes the process from the post-create queue whether it is running or
+ * waiting */
+static void post_create_dequeue(struct abrt_server_proc *proc)
+{
+    if (proc->post_create == NULL)
+        return;
+
+    if (proc->type == AS_POST_CREATE)
+    {
+        metrics_observe_seconds("abrtd_post_create_seconds",
+                (g_get_monotonic_time() - proc->post_create->started) / (double)G_USEC_PER_SEC);
+        proc->type = AS_UKNOWN;
+    }
+
+    post_create_queue_remove(s_post_create_queue, proc->post_create);
+    proc->post_create = NULL;
+}
+
+/* Lets users and administrators see what abrtd is doing. The wait times are
+ * relative to the modification time of the file.
+ */
+static void write_post_create_queue_file(void)
+{
+    const gint64 now = g_get_monotonic_time();
+
+    char *tmp_file = xasprintf("%s.new", POST_CREATE_QUEUE_FILE);
+    FILE *fp = fopen(tmp_file, "w");
+    if (fp == NULL)
+    {
+        log_debug("Can't open '%s': %s", tmp_file, strerror(errno));
+        free(tmp_file);
+        return;
+    }
 
-    while (s_dir_queue != NULL)
+    fprintf(fp, "# depth %u\n# running %u\n",
+            g_list_length(s_post_create_queue->items), s_post_create_queue->running);
+    fprintf(fp, "# TYPE RUNNING PROCESSED AVG_WAIT_MS MAX_WAIT_MS\n");
+    for (struct post_create_class *klass = s_post_create_queue->classes; ; ++klass)
     {
-        struct abrt_server_proc *n = (struct abrt_server_proc *)s_dir_queue->data;
-        if (n->type == AS_POST_CREATE)
+        fprintf(fp, "class %s %u %lu %lld %lld\n",
+                klass->type ? klass->type : "*",
+                klass->running, klass->processed,
+                (long long)(klass->processed ? klass->total_wait / klass->processed / 1000 : 0),
+                (long long)(klass->max_wait / 1000));
+        if (klass->type == NULL)
             break;
+    }
+
+    fprintf(fp, "# STATE PRIORITY WAIT_MS DIRECTORY\n");
+    for (GList *iter = s_post_create_queue->items; iter != NULL; iter = g_list_next(iter))
+    {
+        struct post_create_item *item = (struct post_create_item *)iter->data;
+        struct abrt_server_proc *p = (struct abrt_server_proc *)item->data;
+        fprintf(fp, "%s %d %lld %s\n",
+                item->running ? "running" : "waiting",
+                item->priority,
+                (long long)(((item->running ? item->started : now) - item->queued) / 1000),
+                p->dirname);
+    }
+
+    if (fclose(fp) != 0 || rename(tmp_file, POST_CREATE_QUEUE_FILE) != 0)
+    {
+        log_debug("Can't update '%s': %s", POST_CREATE_QUEUE_FILE, strerror(errno));
+        unlink(tmp_file);
+    }
 
+    free(tmp_file);
+}
+
+static void notify_next_post_create_process(struct abrt_server_proc *finished)
+{
+    if (finished != NULL)
+        post_create_dequeue(finished);
+
+    const gint64 now = g_get_monotonic_time();
+    struct post_create_item *next;
+    while ((next = post_create_queue_start_next(s_post_create_queue, now)) != NULL)
+    {
+        struct abrt_server_proc *n = (struct abrt_server_proc *)next->data;
         if (kill(n->pid, SIGUSR1) >= 0)
         {
             n->type = AS_POST_CREATE;
-            break;
+
+            const gint64 wait = next->started - next->queued;
+            metrics_observe_seconds("abrtd_post_create_wait_seconds", wait / (double)G_USEC_PER_SEC);
+
+            log_info("Starting post-create of '%s' (priority %d) after %lld ms",
+                    n->dirname, next->priority, (long long)(wait / 1000));
+            continue;
         }
 
         /* This could happen only if the notified process disappeared - crashed?
@@ -148,49 +273,60 @@ static void notify_next_post_create_process(struct abrt_server_proc *finished)
         /* Remove the problematic process from the post-crate directory queue
          * and go to try to notify another process.
          */
-        s_dir_queue = g_list_delete_link(s_dir_queue, s_dir_queue);
+        post_create_dequeue(n);
     }
+
+    write_post_create_queue_file();
+}
+
+static const char *problem_dir_base_name(const char *dirname)
+{
+    const char *base = strrchr(dirname, '/');
+    /* Paranoia, this should not happen. */
+    return base != NULL ? base + 1 : dirname;
 }
 
 /* Queueing the process will also lead to cleaning up the dump location.
  */
 static void queue_post_craete_process(struct abrt_server_proc *proc)
 {
-    load_abrt_conf();
-    struct abrt_server_proc *running = s_dir_queue == NULL ? NULL
-                                                           : (struct abrt_server_proc *)s_dir_queue->data;
     if (g_settings_nMaxCrashReportsSize == 0)
         goto consider_processing;
 
-    const char *full_path_ignored = running != NULL ? running->dirname
-                                                    : proc->dirname;
-    const char *ignored = strrchr(full_path_ignored, '/');
-    if (NULL == ignored)
-        /* Paranoia, this should not happen. */
-        ignored = full_path_ignored;
-    else
-        /* Move behind '/' */
-        ++ignored;
+    /* Directories of running post-create processes must not be deleted under
+     * their hands; the new directory is spared only if nothing is running. */
+    GHashTable *ignored = g_hash_table_new(g_str_hash, g_str_equal);
+    for (GList *iter = s_post_create_queue->items; iter != NULL; iter = g_list_next(iter))
+    {
+        struct post_create_item *item = (struct post_create_item *)iter->data;
+        if (item->running)
+            g_hash_table_add(ignored,
+                    (gpointer)problem_dir_base_name(((struct abrt_server_proc *)item->data)->dirname));
+    }
+
+    if (g_hash_table_size(ignored) == 0)
+        g_hash_table_add(ignored, (gpointer)problem_dir_base_name(proc->dirname));
 
     char *worst_dir = NULL;
+    unsigned deleted_count = 0;
     const double max_size = 1024 * 1024 * g_settings_nMaxCrashReportsSize;
-    while (get_dirsize_find_largest_dir(g_settings_dump_location, &worst_dir, ignored) >= max_size
+    const gint64 trim_start = g_get_monotonic_time();
+    while (dump_location_size_find_largest_dir_ext(g_settings_dump_location, &worst_dir, ignored) >= max_size
            && worst_dir)
     {
         const char *kind = "old";
 
-        GList *proc_of_deleted_item = NULL;
+        struct abrt_server_proc *removed_proc = NULL;
         if (proc != NULL && strcmp(worst_dir, proc->dirname) == 0)
         {
             kind = "new";
             stop_abrt_server(proc);
             proc = NULL;
         }
-        else if ((proc_of_deleted_item = g_list_find_custom(s_dir_queue, worst_dir, (GCompareFunc)abrt_server_compare_dirname)))
+        else if ((removed_proc = find_queued_abrt_server(worst_dir)) != NULL)
         {
             kind = "unprocessed";
-            struct abrt_server_proc *removed_proc = (struct abrt_server_proc *)proc_of_deleted_item->data;
-            s_dir_queue = g_list_delete_link(s_dir_queue, proc_of_deleted_item);
+            post_create_dequeue(removed_proc);
             stop_abrt_server(removed_proc);
         }
 
@@ -198,6 +334,10 @@ static void queue_post_craete_process(struct abrt_server_proc *proc)
                 g_settings_dump_location, g_settings_nMaxCrashReportsSize,
                 kind, worst_dir);
 
+        char *metric = xasprintf("abrtd_deleted_problems_total{kind=\"%s\"}", kind);
+        metrics_counter_add(metric, 1);
+        free(metric);
+
         char *deleted = concat_path_file(g_settings_dump_location, worst_dir);
         free(worst_dir);
         worst_dir = NULL;
@@ -207,21 +347,38 @@ static void queue_post_craete_process(struct abrt_server_proc *proc)
             dd_delete(dd);
 
         free(deleted);
+        ++deleted_count;
     }
 
+    /* Space of shared elements is freed with their last link */
+    if (deleted_count > 0)
+        dump_location_blobs_gc(g_settings_dump_location);
+
+    g_hash_table_destroy(ignored);
+
+    metrics_observe_seconds("abrtd_trim_seconds",
+            (g_get_monotonic_time() - trim_start) / (double)G_USEC_PER_SEC);
+
 consider_processing:
     /* If the process survived cleaning up the dump location, append it to the
      * post-create queue.
      */
     if (proc != NULL)
-        s_dir_queue = g_list_append(s_dir_queue, proc);
+    {
+        char *type = read_problem_type(proc->dirname);
+        const double size = get_dirsize(proc->dirname);
+        proc->post_create = post_create_queue_push(s_post_create_queue, proc,
+                type, size, g_get_monotonic_time());
+        free(type);
+
+        log_debug("Queueing '%s' (%.0f bytes) with priority %d",
+                proc->dirname, size, proc->post_create->priority);
+    }
 
-    /* If there were no running post-crate process before we added the
-     * currently handled process to the post-create queue, start processing of
-     * the currently handled process.
+    /* Start processing of the currently handled process if there is a free
+     * slot for it, otherwise it waits until a running process finishes.
      */
-    if (running == NULL)
-        notify_next_post_create_process(NULL/*finished*/);
+    notify_next_post_create_process(NULL/*finished*/);
 }
 
 static gboolean abrt_server_output_cb(GIOChannel *channel, GIOCondition condition, gpointer user_data)
@@ -273,7 +430,7 @@ static gboolean abrt_server_output_cb(GIOChannel *channel, GIOCondition conditio
                 log_warning("abrt-server(%d): already handling: %s", proc->pid, proc->dirname);
                 free(proc->dirname);
                 /* Because process can be only once in the dir queue */
-                s_dir_queue = g_list_remove(s_dir_queue, proc);
+                post_create_dequeue(proc);
             }
 
             proc->dirname = xstrdup(line + strlen("NEW_PROBLEM_DETECTED: "));
@@ -296,6 +453,7 @@ static void add_abrt_server_proc(const pid_t pid, int fdout)
     proc->fdout = fdout;
     proc->dirname = NULL;
     proc->type = AS_UKNOWN;
+    proc->post_create = NULL;
     proc->channel = abrt_gio_channel_unix_new(proc->fdout);
     proc->watch_id = g_io_add_watch(proc->channel,
                                     G_IO_IN | G_IO_HUP,
@@ -359,7 +517,8 @@ static void remove_abrt_server_proc(pid_t pid, int status)
     {   /* Make sure out-of-order exited abrt-server post-create processes do
          * not stay in the post-create queue.
          */
-        s_dir_queue = g_list_remove(s_dir_queue, proc);
+        post_create_dequeue(proc);
+        write_post_create_queue_file();
     }
 
     dispose_abrt_server(proc);
@@ -376,7 +535,6 @@ static void remove_abrt_server_proc(pid_t pid, int status)
 static gboolean server_socket_cb(GIOChannel *source, GIOCondition condition, gpointer ptr_unused)
 {
     kill_idle_timeout();
-    load_abrt_conf();
 
     int socket = accept(g_io_channel_unix_get_fd(source), NULL, NULL);
     if (socket == -1)
@@ -386,6 +544,7 @@ static gboolean server_socket_cb(GIOChannel *source, GIOCondition condition, gpo
     }
 
     log_notice("New client connected");
+    metrics_counter_add("abrtd_clients_total", 1);
     fflush(NULL); /* paranoia */
 
     int pipefd[2];
@@ -448,6 +607,13 @@ static gboolean handle_signal_cb(GIOChannel *gio, GIOCondition condition, gpoint
             int status;
             while ((cpid = safe_waitpid(-1, &status, WNOHANG)) > 0)
             {
+                if (cpid == s_cold_storage_pid)
+                {
+                    log_debug("Cold storage job(%d) finished with status %d", cpid, status);
+                    s_cold_storage_pid = 0;
+                    continue;
+                }
+
                 if (WIFSIGNALED(status))
                     log_debug("abrt-server(%d) signaled with %d", cpid, WTERMSIG(status));
                 else if (WIFEXITED(status))
@@ -477,6 +643,72 @@ static void sanitize_dump_dir_rights(void)
     ensure_writable_dir(VAR_RUN"/abrt", 0755, "root");
 }
 
+/* Moves processed problem directories of a flat dump location to shards.
+ * Runs from the main loop to not delay start-up.
+ */
+/* Existing problems are moved to shards in small steps from a low priority
+ * idle source, so a big dump location does not stall clients and D-Bus */
+#define MIGRATION_STEP 32
+
+static struct dump_location_migration *s_migration;
+
+static gboolean migrate_dump_location_cb(gpointer user_data)
+{
+    if (g_settings_shard_dump_location
+        && dump_location_migration_step(s_migration, MIGRATION_STEP))
+        return TRUE; /* more directories to check */
+
+    dump_location_migration_free(s_migration);
+    s_migration = NULL;
+    return FALSE;
+}
+
+static void start_dump_location_migration(void)
+{
+    if (s_migration != NULL)
+        return;
+
+    s_migration = dump_location_migration_new(g_settings_dump_location);
+    if (s_migration == NULL)
+    {
+        perror_msg("Can't open directory '%s'", g_settings_dump_location);
+        return;
+    }
+
+    g_idle_add_full(G_PRIORITY_LOW, migrate_dump_location_cb, NULL, NULL);
+}
+
+static gboolean cold_storage_cb(gpointer user_data)
+{
+    if (s_cold_storage_pid > 0)
+        return TRUE; /* keep the timer */
+
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror_msg("fork");
+        return TRUE;
+    }
+
+    if (pid == 0)
+    {
+        /* abrtd runs threads (GDBus), only exec is safe in the child */
+        char *argv[3];  /* abrt-cold-storage [-s] NULL */
+        char **pp = argv;
+        *pp++ = (char*)LIBEXEC_DIR"/abrt-cold-storage";
+        if (logmode & LOGMODE_JOURNAL)
+            *pp++ = (char*)"-s";
+        *pp = NULL;
+
+        execv(argv[0], argv);
+        perror_msg_and_die("Can't execute '%s'", argv[0]);
+    }
+
+    log_debug("Started cold storage job(%d)", pid);
+    s_cold_storage_pid = pid;
+    return TRUE;
+}
+
 /* Inotify handler */
 
 static void handle_inotify_cb(struct abrt_inotify_watch *watch, struct inotify_event *event, gpointer ptr_unused)
@@ -496,6 +728,37 @@ static void handle_inotify_cb(struct abrt_inotify_watch *watch, struct inotify_e
     start_idle_timeout();
 }
 
+/* abrt.conf is re-loaded only if it has been changed; the dump location
+ * watch is passed as the user data because it has to follow DumpLocation.
+ */
+static void handle_conf_inotify_cb(struct abrt_inotify_watch *watch, struct inotify_event *event, gpointer user_data)
+{
+    if (event->len == 0 || strcmp(event->name, get_abrt_conf_file_name()) != 0)
+        return;
+
+    kill_idle_timeout();
+
+    log_notice("Reloading '%s'", event->name);
+    char *old_dump_location = xstrdup(g_settings_dump_location);
+    const bool was_sharded = g_settings_shard_dump_location;
+    load_abrt_conf();
+
+    if (strcmp(old_dump_location, g_settings_dump_location) != 0)
+    {
+        log_warning("Dump location changed from '%s' to '%s'", old_dump_location, g_settings_dump_location);
+
+        sanitize_dump_dir_rights();
+        abrt_inotify_watch_reset((struct abrt_inotify_watch *)user_data,
+                g_settings_dump_location, IN_DUMP_LOCATION_FLAGS);
+    }
+    free(old_dump_location);
+
+    if (g_settings_shard_dump_location && !was_sharded)
+        start_dump_location_migration();
+
+    start_idle_timeout();
+}
+
 /* Initializes the dump socket, usually in /var/run directory
  * (the path depends on compile-time configuration).
  */
@@ -643,6 +906,11 @@ static void mark_unprocessed_dump_dirs_not_reportable(const char *path)
         if (dot_or_dotdot(dent->d_name))
             continue; /* skip "." and ".." */
 
+        /* Unprocessed directories are never in the blob store or in shards */
+        if (strcmp(dent->d_name, BLOB_STORE_DIR_NAME) == 0
+            || dump_location_is_shard_name(dent->d_name))
+            continue;
+
         char *full_name = concat_path_file(path, dent->d_name);
 
         struct stat stat_buf;
@@ -682,11 +950,104 @@ static void mark_unprocessed_dump_dirs_not_reportable(const char *path)
     closedir(dp);
 }
 
+/* Metrics */
+static void update_metrics(void)
+{
+    metrics_gauge_set("abrtd_post_create_queue_depth", g_list_length(s_post_create_queue->items));
+    metrics_gauge_set("abrtd_post_create_running", s_post_create_queue->running);
+    metrics_gauge_set("abrtd_clients", g_list_length(s_processes));
+    metrics_flush("abrtd");
+}
+
+static gboolean dump_metrics_cb(gpointer user_data)
+{
+    update_metrics();
+
+    char *text = metrics_load_text();
+    char *tmp_file = xasprintf("%s.new", METRICS_FILE);
+    FILE *fp = fopen(tmp_file, "w");
+    if (fp == NULL
+        || fputs(text, fp) < 0
+        || fclose(fp) != 0
+        || rename(tmp_file, METRICS_FILE) != 0)
+    {
+        log_debug("Can't write '%s': %s", METRICS_FILE, strerror(errno));
+        unlink(tmp_file);
+    }
+    free(tmp_file);
+    free(text);
+
+    return TRUE; /* keep the timer */
+}
+
+/* D-Bus */
+static const gchar s_introspection_xml[] =
+    "<node>"
+    "  <interface name='"ABRTD_DBUS_NAME"'>"
+    "    <property type='a{sd}' name='Metrics' access='read'/>"
+    "  </interface>"
+    "</node>";
+
+static GDBusNodeInfo *s_introspection_data;
+
+static GVariant *handle_get_property(GDBusConnection *connection,
+                                     const gchar *caller,
+                                     const gchar *object_path,
+                                     const gchar *interface_name,
+                                     const gchar *property_name,
+                                     GError      **error,
+                                     gpointer    user_data)
+{
+    if (strcmp(property_name, "Metrics") != 0)
+    {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+                    "Unknown property '%s'", property_name);
+        return NULL;
+    }
+
+    update_metrics();
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sd}"));
+
+    GHashTable *values = metrics_load();
+    GHashTableIter iter;
+    const char *series;
+    const double *value;
+    g_hash_table_iter_init(&iter, values);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&series, (gpointer *)&value))
+        g_variant_builder_add(&builder, "{sd}", series, *value);
+    g_hash_table_destroy(values);
+
+    return g_variant_builder_end(&builder);
+}
+
+static const GDBusInterfaceVTable s_interface_vtable =
+{
+    .method_call = NULL,
+    .get_property = handle_get_property,
+    .set_property = NULL,
+};
+
 static void on_bus_acquired(GDBusConnection *connection,
                  const gchar     *name,
                  gpointer         user_data)
 {
     log_debug("Going to own bus '%s'", name);
+
+    GError *error = NULL;
+    guint registration_id = g_dbus_connection_register_object(connection,
+                                                       ABRTD_DBUS_OBJECT,
+                                                       s_introspection_data->interfaces[0],
+                                                       &s_interface_vtable,
+                                                       NULL,  /* user_data */
+                                                       NULL,  /* user_data_free_func */
+                                                       &error);
+    if (registration_id == 0)
+    {
+        error_msg("Failed to register '%s': %s", ABRTD_DBUS_OBJECT, error->message);
+        g_error_free(error);
+    }
 }
 
 static void on_name_acquired (GDBusConnection *connection,
@@ -773,6 +1134,7 @@ int main(int argc, char** argv)
     guint channel_id_signal_event = 0;
     bool pidfile_created = false;
     struct abrt_inotify_watch *aiw = NULL;
+    GList *conf_watches = NULL;
     int ret = 1;
 
     /* Initialization */
@@ -780,6 +1142,11 @@ int main(int argc, char** argv)
     if (load_abrt_conf() != 0)
         goto init_error;
 
+    s_post_create_queue = post_create_queue_new(g_settings_post_create_classes,
+            g_settings_post_create_max_running,
+            g_settings_post_create_aging_period,
+            g_settings_post_create_big_problem_size);
+
     /* Moved before daemonization because parent waits for signal from daemon
      * only for short period and time consumed by
      * mark_unprocessed_dump_dirs_not_reportable() is slightly unpredictable.
@@ -832,6 +1199,18 @@ int main(int argc, char** argv)
     aiw = abrt_inotify_watch_init(g_settings_dump_location,
             IN_DUMP_LOCATION_FLAGS, handle_inotify_cb, /*user data*/NULL);
 
+    /* Watching the configuration directories to re-load abrt.conf
+     * only when it has been modified
+     */
+    for (const char *const *dir = get_abrt_conf_directories(); *dir != NULL; ++dir)
+    {
+        if (access(*dir, F_OK) != 0)
+            continue;
+
+        conf_watches = g_list_prepend(conf_watches,
+                abrt_inotify_watch_init(*dir, IN_CONF_FLAGS, handle_conf_inotify_cb, aiw));
+    }
+
     /* Add an event source which waits for INT/TERM signal */
     log_notice("Adding signal pipe watch to glib main loop");
     channel_signal = abrt_gio_channel_unix_new(s_signal_pipe[0]);
@@ -840,6 +1219,8 @@ int main(int argc, char** argv)
                         handle_signal_cb);
 
     guint name_id = 0;
+    guint metrics_source_id = 0;
+    guint cold_storage_source_id = 0;
 
     /* Mark the territory */
     log_notice("Creating pid file");
@@ -862,7 +1243,19 @@ int main(int argc, char** argv)
     /* Only now we want signal pipe to work */
     s_signal_pipe_write = s_signal_pipe[1];
 
+    /* Existing flat dump locations are sharded on the fly */
+    if (g_settings_shard_dump_location)
+        start_dump_location_migration();
+
+    /* Dump metrics periodically */
+    metrics_source_id = g_timeout_add_seconds(METRICS_DUMP_PERIOD, dump_metrics_cb, NULL);
+
+    /* The timer runs always, ColdStorageAge can be enabled by re-loading
+     * the configuration */
+    cold_storage_source_id = g_timeout_add_seconds(COLD_STORAGE_PERIOD, cold_storage_cb, NULL);
+
     /* Own a name on D-Bus */
+    s_introspection_data = g_dbus_node_info_new_for_xml(s_introspection_xml, NULL);
     name_id = g_bus_own_name(G_BUS_TYPE_SYSTEM,
                              ABRTD_DBUS_NAME,
                              G_BUS_NAME_OWNER_FLAGS_NONE,
@@ -894,10 +1287,23 @@ int main(int argc, char** argv)
     if (name_id > 0)
         g_bus_unown_name (name_id);
 
+    if (s_introspection_data)
+        g_dbus_node_info_unref(s_introspection_data);
+
+    if (cold_storage_source_id > 0)
+        g_source_remove(cold_storage_source_id);
+
+    if (metrics_source_id > 0)
+    {
+        g_source_remove(metrics_source_id);
+        update_metrics();
+    }
+
     /* Error or INT/TERM. Clean up, in reverse order.
      * Take care to not undo things we did not do.
      */
     dumpsocket_shutdown();
+    unlink(POST_CREATE_QUEUE_FILE);
     if (pidfile_created)
         unlink(VAR_RUN_PIDFILE);
 
@@ -906,11 +1312,13 @@ int main(int argc, char** argv)
     if (channel_signal)
         g_io_channel_unref(channel_signal);
 
+    g_list_free_full(conf_watches, (GDestroyNotify)abrt_inotify_watch_destroy);
     abrt_inotify_watch_destroy(aiw);
 
     if (s_main_loop)
         g_main_loop_unref(s_main_loop);
 
+    post_create_queue_free(s_post_create_queue);
     free_abrt_conf_data();
 
     if (s_sig_caught && s_sig_caught != SIGCHLD)
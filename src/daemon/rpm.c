@@ -24,8 +24,35 @@
 #include <rpm/rpmcli.h>
 #include <rpm/rpmdb.h>
 #include <rpm/rpmpgp.h>
+#include <rpm/rpmfileutil.h>
 #endif
 
+/*
+ * File owner cache
+ *
+ * Every CCpp and Xorg problem asks the rpm database for the packages owning
+ * the executable and tens or hundreds of mapped libraries, mostly the same
+ * ones. The answers are kept in RPM_FILE_CACHE together with a hash of the
+ * time stamps of the rpm database files (the generation), so the cache is
+ * thrown away when a package is installed or removed.
+ *
+ * The cache is a snapshot file, its payload consists of records of NUL
+ * terminated strings:
+ *   PATH, OWNER_COUNT and OWNER_COUNT times RPM_FILE_OWNER_FIELDS values of
+ *   struct rpm_file_owner, an empty string stands for NULL
+ */
+#define RPM_FILE_CACHE           VAR_RUN"/abrt/rpm-files.cache"
+#define RPM_FILE_CACHE_MAGIC     "ABRTRPF2"
+/* The cache starts over when it gets bigger */
+#define RPM_FILE_CACHE_MAX_PATHS 16384
+#define RPM_FILE_OWNER_FIELDS    (sizeof(struct rpm_file_owner) / sizeof(char *))
+
+/* path -> GPtrArray of struct rpm_file_owner */
+static GHashTable *s_file_owners;
+static uint8_t s_rpmdb_generation[SHA1_RESULT_LEN];
+static bool s_rpmdb_generation_valid;
+static bool s_file_owners_modified;
+
 /**
 * A set, which contains finger prints.
 */
@@ -68,8 +95,19 @@ void rpm_init()
     list_fingerprints = g_list_alloc();
 }
 
+static void file_owners_save(void);
+
 void rpm_destroy()
 {
+    if (s_file_owners != NULL)
+    {
+        if (s_file_owners_modified)
+            file_owners_save();
+
+        g_hash_table_destroy(s_file_owners);
+        s_file_owners = NULL;
+    }
+
 #ifdef HAVE_LIBRPM
     /* Mirroring the order of deinit calls in rpm-4.11.1/lib/poptALL.c::rpmcliFini() */
     rpmFreeCrypto();
@@ -245,9 +283,324 @@ static int rpm_query_file(rpmts *ts, rpmdbMatchIterator *iter, Header *header,
 }
 #endif
 
+static void free_rpm_file_owner(struct rpm_file_owner *owner)
+{
+    if (!owner)
+        return;
+
+    char **field = (char **)owner;
+    for (size_t i = 0; i < RPM_FILE_OWNER_FIELDS; ++i)
+        free(field[i]);
+    free(owner);
+}
+
+static GPtrArray *new_file_owner_array(void)
+{
+    return g_ptr_array_new_with_free_func((GDestroyNotify)free_rpm_file_owner);
+}
+
+/* Hashes the stamps of the rpm database files. Returns false if the
+ * database can't be read or it is being modified right now: a next
+ * modification in the same second would not change the stamps on file
+ * systems with coarse time stamps.
+ */
+static bool get_rpmdb_generation(uint8_t generation[SHA1_RESULT_LEN])
+{
+#ifdef HAVE_LIBRPM
+    char *dbpath = rpmGetPath("%{_dbpath}", NULL);
+    DIR *dir = opendir(dbpath);
+    if (dir == NULL)
+    {
+        log_debug("Can't open rpm database '%s': %s", dbpath, strerror(errno));
+        free(dbpath);
+        return false;
+    }
+
+    bool trusted = true;
+    const time_t now = time(NULL);
+    GList *stamps = NULL;
+    struct dirent *dent;
+    while ((dent = readdir(dir)) != NULL)
+    {
+        /* Skip the Berkeley DB environment and the SQLite shared memory,
+         * they are modified by readers too */
+        if (dent->d_name[0] == '.' || prefixcmp(dent->d_name, "__db.") == 0
+            || suffixcmp(dent->d_name, "-shm") == 0)
+            continue;
+
+        struct stat st;
+        if (fstatat(dirfd(dir), dent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        stamps = g_list_prepend(stamps, xasprintf("%s %llu %lld %lld.%09ld", dent->d_name,
+                    (unsigned long long)st.st_ino, (long long)st.st_size,
+                    (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec));
+
+        trusted = trusted && st.st_mtim.tv_sec < now;
+    }
+    closedir(dir);
+    free(dbpath);
+
+    /* No files, no database */
+    trusted = trusted && stamps != NULL;
+
+    stamps = g_list_sort(stamps, (GCompareFunc)strcmp);
+    sha1_ctx_t ctx;
+    sha1_begin(&ctx);
+    for (GList *li = stamps; li != NULL; li = g_list_next(li))
+        sha1_hash(&ctx, li->data, strlen(li->data) + 1);
+    sha1_end(&ctx, generation);
+    list_free_with_free(stamps);
+
+    return trusted;
+#else
+    return false;
+#endif
+}
+
+/* Returns the next string of the payload or NULL at its end */
+static const char *next_payload_string(const char **item, const char *end)
+{
+    const char *const str = *item;
+    const char *const nul = memchr(str, '\0', end - str);
+    if (nul == NULL)
+        return NULL;
+
+    *item = nul + 1;
+    return str;
+}
+
+static GHashTable *parse_file_owners(const char *payload, const char *end)
+{
+    GHashTable *file_owners = g_hash_table_new_full(g_str_hash, g_str_equal,
+            free, (GDestroyNotify)g_ptr_array_unref);
+
+    const char *item = payload;
+    while (item < end)
+    {
+        const char *const path = next_payload_string(&item, end);
+        const char *const count_str = next_payload_string(&item, end);
+        if (path == NULL || count_str == NULL)
+            goto corrupted;
+
+        char *count_end;
+        const unsigned long count = strtoul(count_str, &count_end, 10);
+        if (*count_end != '\0')
+            goto corrupted;
+
+        GPtrArray *owners = new_file_owner_array();
+        g_hash_table_replace(file_owners, xstrdup(path), owners);
+        for (unsigned long j = 0; j < count; ++j)
+        {
+            struct rpm_file_owner *owner = xzalloc(sizeof(*owner));
+            g_ptr_array_add(owners, owner);
+
+            char **field = (char **)owner;
+            for (size_t k = 0; k < RPM_FILE_OWNER_FIELDS; ++k)
+            {
+                const char *const value = next_payload_string(&item, end);
+                if (value == NULL)
+                    goto corrupted;
+
+                field[k] = value[0] != '\0' ? xstrdup(value) : NULL;
+            }
+        }
+    }
+
+    if (item == end)
+        return file_owners;
+
+corrupted:
+    g_hash_table_destroy(file_owners);
+    return NULL;
+}
+
+static GHashTable *file_owners_load(void)
+{
+    struct abrt_snapshot_file snapshot;
+    if (snapshot_file_open(&snapshot, RPM_FILE_CACHE, RPM_FILE_CACHE_MAGIC, s_rpmdb_generation) != 0)
+        return NULL;
+
+    GHashTable *file_owners = parse_file_owners(snapshot.payload,
+            snapshot.payload + snapshot.payload_size);
+    if (file_owners == NULL)
+        log_notice("'%s' is corrupted", RPM_FILE_CACHE);
+    else
+        log_debug("Loaded %u files from '%s'", g_hash_table_size(file_owners), RPM_FILE_CACHE);
+
+    snapshot_file_close(&snapshot);
+    return file_owners;
+}
+
+static void file_owners_save(void)
+{
+    /* The database may have changed while we were reading it */
+    uint8_t generation[SHA1_RESULT_LEN];
+    if (!s_rpmdb_generation_valid || !get_rpmdb_generation(generation)
+        || memcmp(generation, s_rpmdb_generation, sizeof(generation)) != 0)
+    {
+        log_debug("Not saving '%s', the rpm database is being modified", RPM_FILE_CACHE);
+        return;
+    }
+
+    struct strbuf *payload = strbuf_new();
+    GHashTableIter iter;
+    const char *path;
+    GPtrArray *owners;
+    g_hash_table_iter_init(&iter, s_file_owners);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&path, (gpointer *)&owners))
+    {
+        strbuf_append_str(payload, path);
+        strbuf_append_char(payload, '\0');
+        strbuf_append_strf(payload, "%u", owners->len);
+        strbuf_append_char(payload, '\0');
+        for (unsigned i = 0; i < owners->len; ++i)
+        {
+            char **field = g_ptr_array_index(owners, i);
+            for (size_t k = 0; k < RPM_FILE_OWNER_FIELDS; ++k)
+            {
+                if (field[k] != NULL)
+                    strbuf_append_str(payload, field[k]);
+                strbuf_append_char(payload, '\0');
+            }
+        }
+    }
+
+    if (snapshot_file_save(RPM_FILE_CACHE, RPM_FILE_CACHE_MAGIC, generation, payload->buf, payload->len) == 0)
+        log_debug("Saved %u files to '%s'", g_hash_table_size(s_file_owners), RPM_FILE_CACHE);
+
+    strbuf_free(payload);
+}
+
+static void file_owners_init(void)
+{
+    if (s_file_owners != NULL)
+        return;
+
+    s_file_owners_modified = false;
+    s_rpmdb_generation_valid = get_rpmdb_generation(s_rpmdb_generation);
+    if (s_rpmdb_generation_valid)
+        s_file_owners = file_owners_load();
+
+    if (s_file_owners == NULL)
+        s_file_owners = g_hash_table_new_full(g_str_hash, g_str_equal,
+                free, (GDestroyNotify)g_ptr_array_unref);
+}
+
+#ifdef HAVE_LIBRPM
+/* Returns NULL if the header doesn't have the value */
+static char *header_format_or_null(Header header, const char *fmt)
+{
+    const char *errmsg = NULL;
+    char *value = headerFormat(header, fmt, &errmsg);
+    if (!value)
+    {
+        error_msg("cannot format '%s': %s", fmt, errmsg);
+        return NULL;
+    }
+
+    if (value[0] == '\0')
+    {
+        free(value);
+        return NULL;
+    }
+
+    return value;
+}
+
+static struct rpm_file_owner *rpm_file_owner_new(Header header)
+{
+    struct rpm_file_owner *owner = xzalloc(sizeof(*owner));
+    owner->fo_nevra = header_format_or_null(header, "%{NEVRA}");
+    owner->fo_epoch = header_format_or_null(header, "%|EPOCH?{%{EPOCH}}|");
+    owner->fo_name = header_format_or_null(header, "%{NAME}");
+    owner->fo_version = header_format_or_null(header, "%{VERSION}");
+    owner->fo_release = header_format_or_null(header, "%{RELEASE}");
+    owner->fo_arch = header_format_or_null(header, "%|ARCH?{%{ARCH}}|");
+    owner->fo_vendor = header_format_or_null(header, "%|VENDOR?{%{VENDOR}}|");
+    owner->fo_sourcerpm = header_format_or_null(header, "%|SOURCERPM?{%{SOURCERPM}}|");
+    owner->fo_installtime = header_format_or_null(header, "%|INSTALLTIME?{%{INSTALLTIME}}|");
+    return owner;
+}
+#endif
+
+void rpm_find_file_owners(GList *paths)
+{
+    file_owners_init();
+
+#ifdef HAVE_LIBRPM
+    rpmts ts = NULL;
+    unsigned cached = 0;
+    unsigned queried = 0;
+    for (GList *li = paths; li != NULL; li = g_list_next(li))
+    {
+        const char *path = li->data;
+        if (g_hash_table_contains(s_file_owners, path))
+        {
+            ++cached;
+            continue;
+        }
+
+        if (ts == NULL)
+            ts = rpmtsCreate();
+
+        GPtrArray *owners = new_file_owner_array();
+        rpmdbMatchIterator iter = rpmtsInitIterator(ts, RPMTAG_BASENAMES, path, 0);
+        Header header;
+        while ((header = rpmdbNextIterator(iter)) != NULL)
+            g_ptr_array_add(owners, rpm_file_owner_new(header));
+        rpmdbFreeIterator(iter);
+
+        if (g_hash_table_size(s_file_owners) >= RPM_FILE_CACHE_MAX_PATHS)
+            g_hash_table_remove_all(s_file_owners);
+
+        g_hash_table_replace(s_file_owners, xstrdup(path), owners);
+        s_file_owners_modified = true;
+        ++queried;
+    }
+
+    if (ts != NULL)
+        rpmtsFree(ts);
+
+    log_info("Found owners of %u files in the cache, queried %u files", cached, queried);
+#endif
+}
+
+const GPtrArray *rpm_get_file_owners(const char *path)
+{
+    file_owners_init();
+
+    GPtrArray *owners = g_hash_table_lookup(s_file_owners, path);
+    if (owners == NULL)
+    {
+        GList *paths = g_list_prepend(NULL, (gpointer)path);
+        rpm_find_file_owners(paths);
+        g_list_free(paths);
+
+        owners = g_hash_table_lookup(s_file_owners, path);
+        if (owners == NULL)
+        {
+            owners = new_file_owner_array();
+            g_hash_table_replace(s_file_owners, xstrdup(path), owners);
+        }
+    }
+
+    return owners;
+}
+
 char* rpm_get_component(const char *filename, const char *rootdir_or_NULL)
 {
 #ifdef HAVE_LIBRPM
+    if (!rootdir_or_NULL)
+    {
+        const GPtrArray *owners = rpm_get_file_owners(filename);
+        if (owners->len == 0)
+            return NULL;
+
+        const struct rpm_file_owner *owner = g_ptr_array_index(owners, 0);
+        return get_package_name_from_NVR_or_NULL(owner->fo_sourcerpm ? owner->fo_sourcerpm : "(none)");
+    }
+
     char *ret = NULL;
     char *srpm = NULL;
     rpmts ts;
@@ -306,6 +659,31 @@ pkg_add_id(vendor);
 struct pkg_envra *rpm_get_package_nvr(const char *filename, const char *rootdir_or_NULL)
 {
 #ifdef HAVE_LIBRPM
+    if (!rootdir_or_NULL)
+    {
+        const GPtrArray *owners = rpm_get_file_owners(filename);
+        if (owners->len == 0)
+            return NULL;
+
+        const struct rpm_file_owner *owner = g_ptr_array_index(owners, 0);
+        if (!owner->fo_name || !owner->fo_version || !owner->fo_release)
+            return NULL;
+
+        /* A missing epoch is considered equal to zero epoch, see below */
+        struct pkg_envra *p = xzalloc(sizeof(*p));
+        p->p_epoch = xstrdup(owner->fo_epoch ? owner->fo_epoch : "0");
+        p->p_name = xstrdup(owner->fo_name);
+        p->p_version = xstrdup(owner->fo_version);
+        p->p_release = xstrdup(owner->fo_release);
+        p->p_arch = xstrdup(owner->fo_arch ? owner->fo_arch : "(none)");
+        p->p_vendor = xstrdup(owner->fo_vendor ? owner->fo_vendor : "(none)");
+        if (strcmp(p->p_epoch, "0") == 0)
+            p->p_nvr = xasprintf("%s-%s-%s", p->p_name, p->p_version, p->p_release);
+        else
+            p->p_nvr = xasprintf("%s:%s-%s-%s", p->p_epoch, p->p_name, p->p_version, p->p_release);
+        return p;
+    }
+
     rpmts ts;
     rpmdbMatchIterator iter;
     Header header;
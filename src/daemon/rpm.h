@@ -97,6 +97,40 @@ char* rpm_get_component(const char *filename, const char *rootdir_or_NULL);
 
 char* get_package_name_from_NVR_or_NULL(const char* packageNVR);
 
+/* A package owning a file, NULL members are not set in the package header.
+ * Keep only strings here, the cache stores the members in this order. */
+struct rpm_file_owner {
+    char *fo_nevra;
+    char *fo_epoch;
+    char *fo_name;
+    char *fo_version;
+    char *fo_release;
+    char *fo_arch;
+    char *fo_vendor;
+    char *fo_sourcerpm;
+    char *fo_installtime;
+};
+
+/**
+ * Finds the packages owning the files in the rpm database of the running
+ * system. All files are looked up through one transaction set.
+ *
+ * The results are cached in memory and rpm_destroy() saves them in
+ * VAR_RUN/abrt, so the next process looks up only the files it has not
+ * seen yet. The saved cache is valid until the rpm database changes.
+ * rpm_get_package_nvr() and rpm_get_component() use the same cache.
+ * @param paths A list of absolute file names.
+ */
+void rpm_find_file_owners(GList *paths);
+/**
+ * Gets the packages owning a file, looks the file up if it has not been
+ * passed to rpm_find_file_owners().
+ * @param path An absolute file name.
+ * @return An array of struct rpm_file_owner, empty if no package owns the
+ * file. The array is valid until rpm_destroy().
+ */
+const GPtrArray *rpm_get_file_owners(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,10 @@ static unsigned g_timeout_value = 120;
 static guint g_signal_crash;
 static guint g_signal_dup_crash;
 
+/* Method calls only update the metrics in memory, they are written out
+ * every METRICS_FLUSH_PERIOD seconds and at exit */
+#define METRICS_FLUSH_PERIOD 15
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static GDBusNodeInfo *introspection_data = NULL;
@@ -128,7 +132,8 @@ bool allowed_problem_dir(const char *dir_name)
 
 bool allowed_problem_element(GDBusMethodInvocation *invocation, const char *element)
 {
-    if (str_is_correct_filename(element))
+    /* The summary is maintained by ABRT only */
+    if (str_is_correct_filename(element) && strcmp(element, PROBLEM_SUMMARY_FILENAME) != 0)
         return true;
 
     log_notice("'%s' is not a valid element name", element);
@@ -312,13 +317,13 @@ static int add_dirname_to_GList_if_matches(struct dump_dir *dd, void *arg)
 {
     struct field_and_time_range *me = arg;
 
-    char *field_data = dd_load_text(dd, me->element);
+    char *field_data = problem_summary_load_text(dd, me->element, /*flags:*/0);
     int brk = (strcmp(field_data, me->value) != 0);
     free(field_data);
     if (brk)
         return 0;
 
-    field_data = dd_load_text(dd, FILENAME_LAST_OCCURRENCE);
+    field_data = problem_summary_load_text(dd, FILENAME_LAST_OCCURRENCE, /*flags:*/0);
     long val = atol(field_data);
     free(field_data);
     if (val < me->timestamp_from || val > me->timestamp_to)
@@ -351,7 +356,7 @@ static GList *get_problem_dirs_for_element_in_time(uid_t uid,
 }
 
 
-static void handle_method_call(GDBusConnection *connection,
+static void process_method_call(GDBusConnection *connection,
                         const gchar *caller,
                         const gchar *object_path,
                         const gchar *interface_name,
@@ -499,7 +504,10 @@ static void handle_method_call(GDBusConnection *connection,
             return;
         }
 
-        int chown_res = dd_chown(dd, caller_uid);
+        /* Elements shared with other problems must not change owner */
+        int chown_res = problem_dir_unshare_elements(dd);
+        if (chown_res == 0)
+            chown_res = dd_chown(dd, caller_uid);
         if (chown_res != 0)
             g_dbus_method_invocation_return_dbus_error(invocation,
                                               "org.freedesktop.problems.ChownError",
@@ -534,7 +542,7 @@ static void handle_method_call(GDBusConnection *connection,
         for (GList *l = elements; l; l = l->next)
         {
             const char *element_name = (const char*)l->data;
-            char *value = dd_load_text_ext(dd, element_name, 0
+            char *value = problem_summary_load_text(dd, element_name, 0
                                                 | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE
                                                 | DD_FAIL_QUIETLY_ENOENT
                                                 | DD_FAIL_QUIETLY_EACCES);
@@ -576,6 +584,7 @@ static void handle_method_call(GDBusConnection *connection,
             return;
 
         problem_data_t *pd = create_problem_data_from_dump_dir(dd);
+        g_hash_table_remove(pd, PROBLEM_SUMMARY_FILENAME);
         dd_close(dd);
 
         GVariantBuilder *response_builder = g_variant_builder_new(G_VARIANT_TYPE_ARRAY);
@@ -652,6 +661,7 @@ static void handle_method_call(GDBusConnection *connection,
         else
         {
             dd_save_text(dd, element, value);
+            problem_summary_save(dd);
             g_dbus_method_invocation_return_value(invocation, NULL);
         }
 
@@ -677,6 +687,8 @@ static void handle_method_call(GDBusConnection *connection,
             return;
 
         const int res = dd_delete_item(dd, element);
+        if (res == 0)
+            problem_summary_save(dd);
         dd_close(dd);
 
         if (res != 0)
@@ -800,6 +812,32 @@ static void handle_method_call(GDBusConnection *connection,
     }
 }
 
+/* Collects call counts and latencies of org.freedesktop.problems methods */
+static void handle_method_call(GDBusConnection *connection,
+                        const gchar *caller,
+                        const gchar *object_path,
+                        const gchar *interface_name,
+                        const gchar *method_name,
+                        GVariant    *parameters,
+                        GDBusMethodInvocation *invocation,
+                        gpointer    user_data)
+{
+    const gint64 call_start = g_get_monotonic_time();
+
+    process_method_call(connection, caller, object_path, interface_name,
+            method_name, parameters, invocation, user_data);
+
+    char *metric = xasprintf("abrt_dbus_method_seconds{method=\"%s.%s\"}", interface_name, method_name);
+    metrics_observe_seconds(metric, (g_get_monotonic_time() - call_start) / (double)G_USEC_PER_SEC);
+    free(metric);
+}
+
+static gboolean flush_metrics_cb(gpointer user_data)
+{
+    metrics_flush("abrt-dbus");
+    return TRUE; /* keep the timer */
+}
+
 static void handle_abrtd_problem_signals(GDBusConnection *connection,
             const gchar     *sender_name,
             const gchar     *object_path,
@@ -1091,10 +1129,16 @@ int main(int argc, char *argv[])
     load_abrt_conf();
 
     loop = g_main_loop_new(NULL, FALSE);
+    const guint metrics_source_id = g_timeout_add_seconds(METRICS_FLUSH_PERIOD, flush_metrics_cb, NULL);
     g_main_loop_run(loop);
 
     log_notice("Cleaning up");
 
+    g_source_remove(metrics_source_id);
+    metrics_flush("abrt-dbus");
+
+    abrt_p2_service_save_entries_snapshot(p2_service);
+
     g_bus_unown_name(owner_id);
 
     g_dbus_node_info_unref(introspection_data);
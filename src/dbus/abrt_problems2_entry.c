@@ -165,6 +165,7 @@ GVariant *abrt_p2_entry_problem_data(AbrtP2Entry *node,
         return NULL;
 
     problem_data_t *pd = create_problem_data_from_dump_dir(dd);
+    g_hash_table_remove(pd, PROBLEM_SUMMARY_FILENAME);
     problem_data_add_text_noteditable(pd, CD_DUMPDIR, node->pv->p2e_dirname);
 
     GVariantBuilder response_builder;
@@ -520,6 +521,7 @@ GVariant *abrt_p2_entry_save_elements(AbrtP2Entry *entry,
                                             limits,
                                             error);
 
+    problem_summary_save(dd);
     dd_close(dd);
     return NULL;
 }
@@ -574,7 +576,10 @@ int abrt_p2_entry_save_elements_in_dump_dir(struct dump_dir *dd,
         struct stat item_stat;
         memset(&item_stat, 0, sizeof(item_stat));
 
-        const int r = dd_item_stat(dd, name, &item_stat);
+        /* The summary is maintained by ABRT only */
+        const int r = strcmp(name, PROBLEM_SUMMARY_FILENAME) == 0
+                      ? -EINVAL
+                      : dd_item_stat(dd, name, &item_stat);
         if (r == -EINVAL)
         {
             error_msg("Attempt to save prohibited data: '%s'", name);
@@ -944,12 +949,15 @@ GVariant *abrt_p2_entry_delete_elements(AbrtP2Entry *entry,
     while (g_variant_iter_loop(&iter, "s", &name))
     {
         log_debug("Deleting element: %s", name);
-        const int r = dd_delete_item(dd, name);
+        const int r = strcmp(name, PROBLEM_SUMMARY_FILENAME) == 0
+                      ? -EINVAL
+                      : dd_delete_item(dd, name);
 
         if (r == -EINVAL)
             error_msg("Attempt to remove prohibited data: '%s'", name);
     }
 
+    problem_summary_save(dd);
     dd_close(dd);
 
     return NULL;
@@ -176,6 +176,14 @@ typedef struct
     unsigned p2srv_limit_new_problems_batch;
 
     AbrtP2Object *p2srv_p2_object;
+
+    /* Problem directories known from the entries snapshot:
+     * Entry path -> struct entry_snapshot_item
+     */
+    GHashTable      *p2srv_entry_snapshot;
+    char            *p2srv_entry_snapshot_location;
+    struct timespec  p2srv_entry_snapshot_mtime;
+    guint            p2srv_entry_subtree_regid;
 } AbrtP2ServicePrivate;
 
 struct _AbrtP2Service
@@ -919,23 +927,21 @@ static void entry_object_dbus_method_call(GDBusConnection *connection,
 #define GET_PLAIN_TEXT_PROPERTY(name, element) \
         if (strcmp(name, property_name) == 0) \
         { \
-            char *tmp_value = dd_load_text_ext(dd, element, DD_FAIL_QUIETLY_ENOENT); \
+            char *tmp_value = problem_summary_load_text(dd, element, DD_FAIL_QUIETLY_ENOENT); \
             retval = g_variant_new_string(tmp_value ? tmp_value : ""); \
             free(tmp_value); \
             goto return_property_value; \
         }
 
-#define GET_INTEGER_PROPERTY(name, element, S, def) \
+#define GET_UINT32_PROPERTY(name, element, def) \
         if (strcmp(name, property_name) == 0) \
         { \
-            uint##S##_t tmp_value = def; \
-            dd_load_uint##S (dd, element, &tmp_value); \
-            retval = g_variant_new_uint##S ((guint##S)tmp_value); \
+            uint32_t tmp_value = def; \
+            problem_summary_load_uint32(dd, element, &tmp_value); \
+            retval = g_variant_new_uint32((guint32)tmp_value); \
             goto return_property_value; \
         }
 
-#define GET_UINT32_PROPERTY(name, element, def) GET_INTEGER_PROPERTY(name, element, 32, def)
-
 static GVariant *entry_object_dbus_get_property(GDBusConnection *connection,
             const gchar *caller,
             const gchar *object_path,
@@ -1022,7 +1028,7 @@ static GVariant *entry_object_dbus_get_property(GDBusConnection *connection,
         g_variant_builder_init(&builder, G_VARIANT_TYPE("(sssss)"));
         for (size_t i = 0; i < ARRAY_SIZE(elements); ++i)
         {
-            char *data = dd_load_text_ext(dd, elements[i], DD_FAIL_QUIETLY_ENOENT);
+            char *data = problem_summary_load_text(dd, elements[i], DD_FAIL_QUIETLY_ENOENT);
             g_variant_builder_add(&builder, "s", data);
             free(data);
         }
@@ -1094,7 +1100,8 @@ static GVariant *entry_object_dbus_get_property(GDBusConnection *connection,
         char *short_name;
         while (dd_get_next_file(dd, &short_name, NULL))
         {
-            g_variant_builder_add(&builder, "s", short_name);
+            if (strcmp(short_name, PROBLEM_SUMMARY_FILENAME) != 0)
+                g_variant_builder_add(&builder, "s", short_name);
             free(short_name);
         }
         retval = g_variant_builder_end(&builder);
@@ -1309,6 +1316,39 @@ static AbrtP2Object *entry_object_register_dump_dir(AbrtP2Service *service,
     return abrt_p2_service_register_entry(service, entry, error);
 }
 
+static void abrt_p2_service_user_add_problem(AbrtP2Service *service,
+            uid_t owner)
+{
+    struct user_info *user = abrt_p2_service_user_lookup(service, owner);
+
+    if (user == NULL)
+        user = abrt_p2_service_user_new(service, owner);
+
+    if (user->problems == ULONG_MAX)
+    {
+        /* Give up, we cannot recover from this. */
+        error_msg_and_die("Too many problems owned by a single user: uid=%lu",
+                          (long unsigned)owner);
+    }
+
+    user->problems++;
+}
+
+static void abrt_p2_service_user_remove_problem(AbrtP2Service *service,
+            uid_t owner)
+{
+    struct user_info *user = abrt_p2_service_user_lookup(service, owner);
+
+    if (user == NULL || user->problems == 0)
+    {
+        error_msg("BUG: removing a problem of user who does not have any: uid=%lu",
+                  (long unsigned)owner);
+        return;
+    }
+
+    user->problems--;
+}
+
 AbrtP2Object *abrt_p2_service_register_entry(AbrtP2Service *service,
             struct _AbrtP2Entry *entry,
             GError **error)
@@ -1331,25 +1371,476 @@ AbrtP2Object *abrt_p2_service_register_entry(AbrtP2Service *service,
         return NULL;
     }
 
+    /* Owners of the entries from the snapshot have been already counted */
+    if (g_hash_table_contains(service->pv->p2srv_entry_snapshot, obj->p2o_path))
+        return obj;
+
     struct dump_dir *dd = dd_opendir(dd_dirname, DD_OPEN_FD_ONLY);
     uid_t owner = dd_get_owner(dd);
     dd_close(dd);
 
-    struct user_info *user = abrt_p2_service_user_lookup(service, owner);
+    abrt_p2_service_user_add_problem(service, owner);
 
-    if (user == NULL)
-        user = abrt_p2_service_user_new(service, owner);
+    return obj;
+}
 
-    if (user->problems == ULONG_MAX)
+/*
+ * Entries snapshot
+ *
+ * Registering an Entry object for every problem directory at start-up means
+ * opening and locking all of them. Instead, abrt-dbus keeps the list of
+ * problem directories and their modification times in a file and exports the
+ * entries through a D-Bus subtree; an Entry object is registered once a client
+ * accesses it for the first time.
+ *
+ * The snapshot is valid as long as the modification time of the dump location
+ * does not change. Otherwise, the dump location is scanned again but without
+ * opening any problem directory. The owners of the problems are stored in the
+ * snapshot too, so loading it does not touch the problem directories at all.
+ * A directory is checked with stat() when a client accesses it for the first
+ * time: a directory modified since the snapshot was taken must still be
+ * a problem and the owner is taken from it.
+ */
+#define ENTRY_SNAPSHOT_FILE VAR_RUN"/abrt/problems2-entries"
+#define ENTRY_SNAPSHOT_HEADER "# abrt-dbus entries 3"
+
+struct entry_snapshot_item
+{
+    char *esi_dirname;
+    uid_t esi_owner;
+    time_t esi_mtime;
+    bool esi_validated;
+};
+
+static void entry_snapshot_item_free(struct entry_snapshot_item *item)
+{
+    if (item == NULL)
+        return;
+
+    free(item->esi_dirname);
+    free(item);
+}
+
+static void entry_snapshot_add(GHashTable *snapshot,
+            const char *dump_location,
+            const char *name,
+            uid_t owner,
+            time_t mtime)
+{
+    struct entry_snapshot_item *item = xmalloc(sizeof(*item));
+    item->esi_dirname = concat_path_file(dump_location, name);
+    item->esi_owner = owner;
+    item->esi_mtime = mtime;
+    item->esi_validated = false;
+
+    g_hash_table_replace(snapshot, entry_object_dir_name_to_path(item->esi_dirname), item);
+}
+
+/* Checks for the 'time' element without opening the problem directory */
+static bool is_problem_dir(const char *dirname)
+{
+    struct stat st;
+    char *time_path = concat_path_file(dirname, FILENAME_TIME);
+    const bool problem = lstat(time_path, &st) == 0 && S_ISREG(st.st_mode);
+    free(time_path);
+    return problem;
+}
+
+/* Returns 0 if the snapshot file describes the current contents of
+ * DUMP_LOCATION whose modification time is MTIME.
+ */
+static int entry_snapshot_load(GHashTable *snapshot,
+            const char *dump_location,
+            const struct timespec *mtime)
+{
+    FILE *fp = fopen(ENTRY_SNAPSHOT_FILE, "r");
+    if (fp == NULL)
     {
-        /* Give up, we cannot recover from this. */
-        error_msg_and_die("Too many problems owned by a single user: uid=%lu",
-                          (long unsigned)owner);
+        if (errno != ENOENT)
+            perror_msg("Can't open '%s'", ENTRY_SNAPSHOT_FILE);
+        return -1;
     }
 
-    user->problems++;
+    int r = -1;
+    char *line = xmalloc_fgetline(fp);
+    if (line == NULL || strcmp(line, ENTRY_SNAPSHOT_HEADER) != 0)
+        goto finito;
 
-    return obj;
+    free(line);
+    line = xmalloc_fgetline(fp);
+    if (line == NULL || strcmp(line, dump_location) != 0)
+        goto finito;
+
+    free(line);
+    line = xmalloc_fgetline(fp);
+    long long sec, nsec, scanned;
+    if (line == NULL || sscanf(line, "%lld %lld %lld", &sec, &nsec, &scanned) != 3)
+        goto finito;
+
+    if (sec != (long long)mtime->tv_sec || nsec != (long long)mtime->tv_nsec)
+    {
+        log_debug("Dump location has been modified since the snapshot was taken");
+        goto finito;
+    }
+
+    /* Changes made within the second of the scan might not have updated the
+     * modification time on file systems with coarse time stamps.
+     */
+    if (sec >= scanned)
+    {
+        log_debug("Dump location was modified while the snapshot was taken");
+        goto finito;
+    }
+
+    while (free(line), (line = xmalloc_fgetline(fp)) != NULL)
+    {
+        long long dir_mtime;
+        unsigned long owner;
+        int name_offset = -1;
+        if (sscanf(line, "%lld %lu %n", &dir_mtime, &owner, &name_offset) != 2
+            || name_offset <= 0 || line[name_offset] == '\0')
+        {
+            error_msg("Malformed line in '%s': '%s'", ENTRY_SNAPSHOT_FILE, line);
+            g_hash_table_remove_all(snapshot);
+            goto finito;
+        }
+
+        const char *name = line + name_offset;
+        char *dirname = concat_path_file(dump_location, name);
+        if (!dir_is_in_dump_location(dirname))
+        {
+            error_msg("Invalid problem directory in '%s': '%s'", ENTRY_SNAPSHOT_FILE, name);
+            free(dirname);
+            g_hash_table_remove_all(snapshot);
+            goto finito;
+        }
+
+        /* Validated on the first access */
+        entry_snapshot_add(snapshot, dump_location, name, (uid_t)owner, (time_t)dir_mtime);
+
+        free(dirname);
+    }
+
+    r = 0;
+
+finito:
+    free(line);
+    fclose(fp);
+    return r;
+}
+
+/* Lists the problem directories in DUMP_LOCATION without opening them.
+ *
+ * Returns the number of the problem directories that have been skipped
+ * because they are locked, i.e. still being created.
+ */
+static int entry_snapshot_scan(GHashTable *snapshot,
+            const char *dump_location)
+{
+    /* Lists only problem directories */
+    GPtrArray *entries = dump_location_list(dump_location,
+            DUMP_LOCATION_LIST_STAT | DUMP_LOCATION_LIST_LOCKED);
+    if (entries == NULL)
+    {
+        if (errno != ENOENT)
+            perror_msg("Can't open directory '%s'", dump_location);
+        return 0;
+    }
+
+    int locked = 0;
+    for (unsigned i = 0; i < entries->len; ++i)
+    {
+        const struct dump_location_entry *entry = g_ptr_array_index(entries, i);
+        if (strchr(entry->dle_name, '\n') != NULL)
+            continue;
+
+        if (entry->dle_locked)
+        {
+            log_debug("Skipping locked problem directory: %s", entry->dle_name);
+            ++locked;
+            continue;
+        }
+
+        entry_snapshot_add(snapshot, dump_location, entry->dle_name, entry->dle_owner, entry->dle_mtime);
+    }
+    g_ptr_array_free(entries, TRUE);
+
+    return locked;
+}
+
+static void entry_snapshot_save(GHashTable *snapshot,
+            const char *dump_location,
+            const struct timespec *mtime,
+            time_t scanned)
+{
+    char *tmp_path = xasprintf(ENTRY_SNAPSHOT_FILE".%lu", (long unsigned)getpid());
+    FILE *fp = fopen(tmp_path, "w");
+    if (fp == NULL)
+    {
+        perror_msg("Can't create '%s'", tmp_path);
+        goto finito;
+    }
+
+    fprintf(fp, "%s\n%s\n%lld %lld %lld\n", ENTRY_SNAPSHOT_HEADER, dump_location,
+            (long long)mtime->tv_sec, (long long)mtime->tv_nsec, (long long)scanned);
+
+    GHashTableIter iter;
+    g_hash_table_iter_init(&iter, snapshot);
+    struct entry_snapshot_item *item;
+    const size_t location_len = strlen(dump_location);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer)&item))
+        /* The names are relative to the dump location, e.g. shard-XX/NAME */
+        fprintf(fp, "%lld %lu %s\n", (long long)item->esi_mtime, (long unsigned)item->esi_owner,
+                item->esi_dirname + location_len + 1);
+
+    if (ferror(fp) | (fclose(fp) != 0))
+    {
+        perror_msg("Can't write '%s'", tmp_path);
+        unlink(tmp_path);
+        goto finito;
+    }
+
+    if (rename(tmp_path, ENTRY_SNAPSHOT_FILE) != 0)
+    {
+        perror_msg("Can't rename '%s' to '%s'", tmp_path, ENTRY_SNAPSHOT_FILE);
+        unlink(tmp_path);
+    }
+
+finito:
+    free(tmp_path);
+}
+
+/* Scans DUMP_LOCATION and saves the snapshot if the scan was consistent */
+static void entry_snapshot_rescan(GHashTable *snapshot,
+            const char *dump_location,
+            struct timespec *mtime)
+{
+    /* Take the time stamp before reading the directory to not miss
+     * modifications made during the scan. */
+    const int r = dump_location_get_mtime(dump_location, mtime);
+    if (r != 0)
+    {
+        if (r != -ENOENT)
+            perror_msg("Can't stat '%s'", dump_location);
+        return;
+    }
+
+    const time_t scanned = time(NULL);
+
+    g_hash_table_remove_all(snapshot);
+    if (entry_snapshot_scan(snapshot, dump_location) == 0)
+        entry_snapshot_save(snapshot, dump_location, mtime, scanned);
+}
+
+static void abrt_p2_service_load_entries(AbrtP2Service *service)
+{
+    AbrtP2ServicePrivate *pv = service->pv;
+    pv->p2srv_entry_snapshot_location = xstrdup(g_settings_dump_location);
+
+    /* Removals from shards do not change the time stamp of the dump location */
+    struct timespec mtime;
+    const int r = dump_location_get_mtime(g_settings_dump_location, &mtime);
+    if (r != 0)
+    {
+        if (r != -ENOENT)
+            perror_msg("Can't stat '%s'", g_settings_dump_location);
+        return;
+    }
+
+    if (entry_snapshot_load(pv->p2srv_entry_snapshot, g_settings_dump_location, &mtime) == 0)
+    {
+        log_debug("Loaded %u entries from the snapshot", g_hash_table_size(pv->p2srv_entry_snapshot));
+        pv->p2srv_entry_snapshot_mtime = mtime;
+    }
+    else
+    {
+        entry_snapshot_rescan(pv->p2srv_entry_snapshot, g_settings_dump_location,
+                              &pv->p2srv_entry_snapshot_mtime);
+        log_debug("Found %u entries in '%s'", g_hash_table_size(pv->p2srv_entry_snapshot),
+                  g_settings_dump_location);
+    }
+
+    GHashTableIter iter;
+    g_hash_table_iter_init(&iter, pv->p2srv_entry_snapshot);
+    struct entry_snapshot_item *item;
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer)&item))
+        abrt_p2_service_user_add_problem(service, item->esi_owner);
+}
+
+/* Checks the problem directory of a snapshot entry on the first access or on
+ * every call if RECHECK is set. Returns false if the entry is stale.
+ */
+static bool entry_snapshot_validate(AbrtP2Service *service,
+            struct entry_snapshot_item *item,
+            bool recheck)
+{
+    if (item->esi_validated && !recheck)
+        return true;
+
+    struct stat st;
+    if (lstat(item->esi_dirname, &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        log_debug("Problem directory disappeared: %s", item->esi_dirname);
+        return false;
+    }
+
+    /* Problems modified in place must still be problems */
+    if (st.st_mtime != item->esi_mtime && !is_problem_dir(item->esi_dirname))
+    {
+        log_debug("Not a problem directory anymore: %s", item->esi_dirname);
+        return false;
+    }
+
+    if (st.st_uid != item->esi_owner)
+    {
+        abrt_p2_service_user_remove_problem(service, item->esi_owner);
+        abrt_p2_service_user_add_problem(service, st.st_uid);
+        item->esi_owner = st.st_uid;
+    }
+
+    item->esi_mtime = st.st_mtime;
+    item->esi_validated = true;
+    return true;
+}
+
+/* Forgets a snapshot entry whose problem directory is gone */
+static void entry_snapshot_drop(AbrtP2Service *service,
+            const char *entry_path)
+{
+    struct entry_snapshot_item *item = g_hash_table_lookup(service->pv->p2srv_entry_snapshot,
+                                                           entry_path);
+    if (item == NULL)
+        return;
+
+    abrt_p2_service_user_remove_problem(service, item->esi_owner);
+    g_hash_table_remove(service->pv->p2srv_entry_snapshot, entry_path);
+}
+
+void abrt_p2_service_save_entries_snapshot(AbrtP2Service *service)
+{
+    AbrtP2ServicePrivate *pv = service->pv;
+    if (pv->p2srv_entry_snapshot_location == NULL)
+        return;
+
+    struct timespec current;
+    if (dump_location_get_mtime(pv->p2srv_entry_snapshot_location, &current) != 0)
+        return;
+
+    if (   current.tv_sec == pv->p2srv_entry_snapshot_mtime.tv_sec
+        && current.tv_nsec == pv->p2srv_entry_snapshot_mtime.tv_nsec)
+    {
+        log_debug("Entries snapshot is up to date");
+        return;
+    }
+
+    GHashTable *snapshot = g_hash_table_new_full(g_str_hash, g_str_equal, free,
+                                                 (GDestroyNotify)entry_snapshot_item_free);
+    struct timespec mtime;
+    entry_snapshot_rescan(snapshot, pv->p2srv_entry_snapshot_location, &mtime);
+    g_hash_table_destroy(snapshot);
+}
+
+/* Registers an Entry object for a problem directory from the snapshot */
+static AbrtP2Object *entry_object_materialize(AbrtP2Service *service,
+            const char *entry_path,
+            GError **error)
+{
+    struct entry_snapshot_item *item = g_hash_table_lookup(service->pv->p2srv_entry_snapshot,
+                                                           entry_path);
+    if (item == NULL)
+        return NULL;
+
+    /* The directory may have disappeared since the last check */
+    if (!entry_snapshot_validate(service, item, /*recheck*/true))
+    {
+        entry_snapshot_drop(service, entry_path);
+        return NULL;
+    }
+
+    log_debug("Materializing entry: %s", entry_path);
+    return entry_object_register_dump_dir(service, item->esi_dirname, error);
+}
+
+/*
+ * /org/freedesktop/Problems2/Entry subtree
+ */
+static gchar **entry_subtree_enumerate(GDBusConnection *connection,
+            const gchar *sender,
+            const gchar *object_path,
+            gpointer user_data)
+{
+    AbrtP2Service *service = ABRT_P2_SERVICE(user_data);
+    GPtrArray *nodes = g_ptr_array_new();
+
+    GHashTableIter iter;
+    const char *entry_path;
+    g_hash_table_iter_init(&iter, service->pv->p2srv_entry_snapshot);
+    while (g_hash_table_iter_next(&iter, (gpointer)&entry_path, NULL))
+        g_ptr_array_add(nodes, g_strdup(strrchr(entry_path, '/') + 1));
+
+    g_hash_table_iter_init(&iter, service->pv->p2srv_p2_entry_type.objects);
+    while (g_hash_table_iter_next(&iter, (gpointer)&entry_path, NULL))
+        if (!g_hash_table_contains(service->pv->p2srv_entry_snapshot, entry_path))
+            g_ptr_array_add(nodes, g_strdup(strrchr(entry_path, '/') + 1));
+
+    g_ptr_array_add(nodes, NULL);
+    return (gchar **)g_ptr_array_free(nodes, FALSE);
+}
+
+static GDBusInterfaceInfo **entry_subtree_introspect(GDBusConnection *connection,
+            const gchar *sender,
+            const gchar *object_path,
+            const gchar *node,
+            gpointer user_data)
+{
+    if (node == NULL)
+        return NULL;
+
+    AbrtP2Service *service = ABRT_P2_SERVICE(user_data);
+    char *entry_path = xasprintf("%s/%s", object_path, node);
+    const bool known = g_hash_table_contains(service->pv->p2srv_entry_snapshot, entry_path);
+    free(entry_path);
+
+    if (!known)
+        return NULL;
+
+    GDBusInterfaceInfo **ifaces = g_new0(GDBusInterfaceInfo *, 2);
+    ifaces[0] = g_dbus_interface_info_ref(service->pv->p2srv_p2_entry_type.iface);
+    return ifaces;
+}
+
+static const GDBusInterfaceVTable *entry_subtree_dispatch(GDBusConnection *connection,
+            const gchar *sender,
+            const gchar *object_path,
+            const gchar *interface_name,
+            const gchar *node,
+            gpointer *out_user_data,
+            gpointer user_data)
+{
+    AbrtP2Service *service = ABRT_P2_SERVICE(user_data);
+    if (node == NULL || strcmp(interface_name, service->pv->p2srv_p2_entry_type.iface->name) != 0)
+        return NULL;
+
+    GError *error = NULL;
+    char *entry_path = xasprintf("%s/%s", object_path, node);
+    AbrtP2Object *obj = problems2_object_type_get_object(&(service->pv->p2srv_p2_entry_type),
+                                                         entry_path);
+    if (obj == NULL)
+        obj = entry_object_materialize(service, entry_path, &error);
+    free(entry_path);
+
+    if (error != NULL)
+    {
+        error_msg("Failed to register Entry object: %s", error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    if (obj == NULL)
+        return NULL;
+
+    *out_user_data = obj;
+    return service->pv->p2srv_p2_entry_type.vtable;
 }
 
 struct entry_object_save_problem_args
@@ -1546,6 +2037,13 @@ AbrtP2Object *abrt_p2_service_get_entry_object(AbrtP2Service *service,
     AbrtP2Object *obj = problems2_object_type_get_object(&(service->pv->p2srv_p2_entry_type),
                                                          entry_path);
 
+    if (obj == NULL)
+    {
+        obj = entry_object_materialize(service, entry_path, error);
+        if (error != NULL && *error != NULL)
+            return NULL;
+    }
+
     if (obj == NULL && !(flags & ABRT_P2_SERVICE_ENTRY_LOOKUP_OPTIONAL))
     {
         g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_BAD_ADDRESS,
@@ -1599,6 +2097,8 @@ int abrt_p2_service_remove_problem(AbrtP2Service *service,
         return ret;
     }
 
+    g_hash_table_remove(service->pv->p2srv_entry_snapshot, entry_path);
+
     abrt_p2_object_destroy(obj);
     return 0;
 }
@@ -2079,6 +2579,53 @@ GVariant *abrt_p2_service_get_problems(AbrtP2Service *service,
         }
     }
 
+    log_debug("Going through not registered entries");
+    GList *stale = NULL;
+    struct entry_snapshot_item *item;
+    g_hash_table_iter_init(&iter, service->pv->p2srv_entry_snapshot);
+    while(g_hash_table_iter_next(&iter, (gpointer)&entry_path, (gpointer)&item))
+    {
+        if (problems2_object_type_get_object(&(service->pv->p2srv_p2_entry_type), entry_path) != NULL)
+            continue;
+
+        /* The entries from the snapshot have been completed before. */
+        bool singleout = flags == 0;
+
+        log_debug("Entry: %s", entry_path);
+        if (!entry_snapshot_validate(service, item, /*recheck*/false))
+        {
+            stale = g_list_prepend(stale, (gpointer)entry_path);
+            continue;
+        }
+
+        if (!dump_dir_accessible_by_uid(item->esi_dirname, caller_uid))
+        {
+            struct stat st;
+            if (lstat(item->esi_dirname, &st) != 0 && errno == ENOENT)
+            {
+                log_debug("Problem directory disappeared: %s", item->esi_dirname);
+                stale = g_list_prepend(stale, (gpointer)entry_path);
+                continue;
+            }
+
+            if (flags == 0)
+                continue;
+
+            log_debug("Entry not accessible: %s", entry_path);
+            singleout = singleout || (flags & ABRT_P2_SERVICE_GET_PROBLEM_FLAGS_FOREIGN);
+        }
+
+        if (singleout)
+        {
+            log_debug("Adding entry: %s", entry_path);
+            g_variant_builder_add(&builder, "o", entry_path);
+        }
+    }
+
+    for (GList *iter = stale; iter != NULL; iter = g_list_next(iter))
+        entry_snapshot_drop(service, iter->data);
+    g_list_free(stale);
+
 
     GVariant *retval_body[1];
     retval_body[0] = g_variant_builder_end(&builder);
@@ -2115,7 +2662,7 @@ GVariant *abrt_p2_service_delete_problems(AbrtP2Service *service,
 
 /* D-Bus method handler
  */
-static void p2_object_dbus_method_call(GDBusConnection *connection,
+static void p2_object_dbus_process_method_call(GDBusConnection *connection,
                         const gchar *caller,
                         const gchar *object_path,
                         const gchar *interface_name,
@@ -2226,11 +2773,46 @@ static void p2_object_dbus_method_call(GDBusConnection *connection,
     return;
 }
 
+/* Collects call counts and latencies of org.freedesktop.Problems2 methods */
+static void p2_object_dbus_method_call(GDBusConnection *connection,
+                        const gchar *caller,
+                        const gchar *object_path,
+                        const gchar *interface_name,
+                        const gchar *method_name,
+                        GVariant    *parameters,
+                        GDBusMethodInvocation *invocation,
+                        gpointer    user_data)
+{
+    const gint64 call_start = g_get_monotonic_time();
+
+    p2_object_dbus_process_method_call(connection, caller, object_path, interface_name,
+            method_name, parameters, invocation, user_data);
+
+    char *metric = xasprintf("abrt_dbus_method_seconds{method=\"%s.%s\"}", interface_name, method_name);
+    metrics_observe_seconds(metric, (g_get_monotonic_time() - call_start) / (double)G_USEC_PER_SEC);
+    free(metric);
+}
+
 /*
  * Service functions
  */
 static void abrt_p2_service_private_destroy(AbrtP2ServicePrivate *pv)
 {
+    if (pv->p2srv_entry_subtree_regid != 0)
+    {
+        g_dbus_connection_unregister_subtree(pv->p2srv_dbus, pv->p2srv_entry_subtree_regid);
+        pv->p2srv_entry_subtree_regid = 0;
+    }
+
+    if (pv->p2srv_entry_snapshot != NULL)
+    {
+        g_hash_table_destroy(pv->p2srv_entry_snapshot);
+        pv->p2srv_entry_snapshot = NULL;
+    }
+
+    free(pv->p2srv_entry_snapshot_location);
+    pv->p2srv_entry_snapshot_location = NULL;
+
     if (pv->p2srv_connected_users != NULL)
     {
         g_hash_table_destroy(pv->p2srv_connected_users);
@@ -2354,6 +2936,11 @@ static int abrt_p2_service_private_init(AbrtP2ServicePrivate *pv,
                                                       NULL,
                                                       (GDestroyNotify)user_info_free);
 
+    pv->p2srv_entry_snapshot = g_hash_table_new_full(g_str_hash,
+                                                     g_str_equal,
+                                                     free,
+                                                     (GDestroyNotify)entry_snapshot_item_free);
+
     if (g_polkit_authority != NULL)
     {
         ++g_polkit_authority_refs;
@@ -2466,21 +3053,6 @@ static GDBusConnection *abrt_p2_service_dbus(AbrtP2Service *service)
     return service->pv->p2srv_dbus;
 }
 
-struct bridge_call_args
-{
-    AbrtP2Service *service;
-    GError **error;
-};
-
-static int bridge_register_dump_dir_entry_node(struct dump_dir *dd,
-            void *call_args)
-{
-    struct bridge_call_args *args = call_args;
-    return NULL == entry_object_register_dump_dir(args->service,
-                                                  dd->dd_dirname,
-                                                  args->error);
-}
-
 static void on_g_signal(GDBusProxy *proxy,
             gchar      *sender_name,
             gchar      *signal_name,
@@ -2566,13 +3138,23 @@ int abrt_p2_service_register_objects(AbrtP2Service *service, GDBusConnection *co
         return -1;
     }
 
-    struct bridge_call_args args;
-    args.service = service;
-    args.error = error;
+    abrt_p2_service_load_entries(service);
+
+    static GDBusSubtreeVTable entry_subtree_vtable = {
+        .enumerate = entry_subtree_enumerate,
+        .introspect = entry_subtree_introspect,
+        .dispatch = entry_subtree_dispatch,
+    };
 
-    for_each_problem_in_dir(g_settings_dump_location, (uid_t)-1, bridge_register_dump_dir_entry_node, &args);
+    service->pv->p2srv_entry_subtree_regid = g_dbus_connection_register_subtree(connection,
+                                                      ABRT_P2_PATH"/Entry",
+                                                      &entry_subtree_vtable,
+                                                      G_DBUS_SUBTREE_FLAGS_DISPATCH_TO_UNENUMERATED_NODES,
+                                                      service,
+                                                      /*user_data_free_func*/NULL,
+                                                      error);
 
-    if (*args.error != NULL)
+    if (service->pv->p2srv_entry_subtree_regid == 0)
     {
         g_prefix_error(error, "Failed to register Problems objects: ");
         return -1;
@@ -101,6 +101,11 @@ AbrtP2Object *abrt_p2_service_register_entry(AbrtP2Service *service,
             struct _AbrtP2Entry *entry,
             GError **error);
 
+/* Writes the list of problem directories down, so the next instance of the
+ * service does not need to scan the dump location.
+ */
+void abrt_p2_service_save_entries_snapshot(AbrtP2Service *service);
+
 void abrt_p2_service_notify_entry_object(AbrtP2Service *service,
             AbrtP2Object *obj,
             GError **error);
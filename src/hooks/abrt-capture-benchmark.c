@@ -0,0 +1,181 @@
+/*
+    Copyright (C) 2016  ABRT team
+    Copyright (C) 2016  RedHat Inc
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Feeds synthetic cores through the capture functions of abrt-hook-ccpp.
+ *
+ * A child process writes the core to a pipe of the default size, the same
+ * way the kernel writes to the core_pattern pipe, and the parent captures it
+ * once with the kernel pipe size and fixed chunks and once with the adaptive
+ * capture. Half of the pages of the synthetic core are zero pages.
+ */
+
+#include "core-capture.h"
+
+#define BENCHMARK_WRITE_SIZE (1024 * 1024)
+
+enum capture_mode {
+    CAPTURE_ABRT,
+    CAPTURE_BOTH,
+    CAPTURE_SPARSE,
+};
+
+static const char *const s_mode_names[] = {
+    [CAPTURE_ABRT] = "abrt",
+    [CAPTURE_BOTH] = "abrt+user",
+    [CAPTURE_SPARSE] = "sparse",
+};
+
+static void write_synthetic_core(int fd, size_t size)
+{
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    char *buf = xzalloc(BENCHMARK_WRITE_SIZE);
+
+    /* Every other page contains data */
+    unsigned seed = 1;
+    for (size_t ofs = 0; ofs < BENCHMARK_WRITE_SIZE; ofs += 2 * page_size)
+        for (size_t i = 0; i < page_size; ++i)
+            buf[ofs + i] = rand_r(&seed);
+
+    while (size != 0)
+    {
+        const size_t len = MIN(size, (size_t)BENCHMARK_WRITE_SIZE);
+        if (full_write(fd, buf, len) != (ssize_t)len)
+            perror_msg_and_die("Can't write the synthetic core");
+        size -= len;
+    }
+
+    free(buf);
+}
+
+/* Returns MB/s or a negative number on errors */
+static double run_capture(enum capture_mode mode, bool adaptive, size_t size, const char *dir)
+{
+    int core_pipe[2];
+    xpipe(core_pipe);
+
+    const pid_t pid = xfork();
+    if (pid == 0)
+    {
+        close(core_pipe[0]);
+        write_synthetic_core(core_pipe[1], size);
+        _exit(0);
+    }
+    close(core_pipe[1]);
+
+    struct core_capture cap;
+    if (adaptive)
+        core_capture_init(&cap, core_pipe[0]);
+    else
+    {
+        memset(&cap, 0, sizeof(cap));
+        cap.fd = core_pipe[0];
+        cap.pipe_size = cap.chunk = KERNEL_PIPE_BUFFER_SIZE;
+    }
+
+    char *abrt_path = concat_path_file(dir, "abrt-capture-benchmark.abrt");
+    char *user_path = concat_path_file(dir, "abrt-capture-benchmark.user");
+    const int abrt_fd = xopen3(abrt_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    const int user_fd = mode == CAPTURE_ABRT ? -1 : xopen3(user_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+    size_t abrt_limit = SIZE_MAX;
+    size_t user_limit = SIZE_MAX;
+    int r = 0;
+    switch (mode)
+    {
+        case CAPTURE_ABRT:
+            r = splice_entire_per_partes(&cap, abrt_fd, abrt_limit) < 0;
+            break;
+        case CAPTURE_BOTH:
+            r = dump_two_core_files(&cap, abrt_fd, &abrt_limit, user_fd, &user_limit);
+            break;
+        case CAPTURE_SPARSE:
+            r = dump_sparse_core_files(&cap, abrt_fd, &abrt_limit, user_fd, &user_limit);
+            break;
+    }
+
+    /* The hook syncs the files too */
+    if (fsync(abrt_fd) != 0 || (user_fd >= 0 && fsync(user_fd) != 0))
+        r = -1;
+    cap.end = g_get_monotonic_time();
+
+    close(abrt_fd);
+    if (user_fd >= 0)
+        close(user_fd);
+    close(core_pipe[0]);
+    safe_waitpid(pid, NULL, 0);
+
+    unlink(abrt_path);
+    unlink(user_path);
+    free(abrt_path);
+    free(user_path);
+
+    if (r != 0 || cap.bytes != size)
+    {
+        error_msg("Captured %zu of %zu bytes", cap.bytes, size);
+        return -1;
+    }
+
+    return core_capture_rate(&cap);
+}
+
+int main(int argc, char **argv)
+{
+    abrt_init(argv);
+
+    const char *dir = LARGE_DATA_TMP_DIR;
+    const char *sizes = "16,128,512";
+
+    const char *program_usage_string =
+        "& [-v] [-d DIR] [-s MiB[,MiB]...]\n"
+        "\n"
+        "Measures the throughput of the core capture of abrt-hook-ccpp\n"
+        "with synthetic cores of the given sizes written to DIR";
+    struct options program_options[] = {
+        OPT__VERBOSE(&g_verbose),
+        OPT_STRING('d', NULL, &dir, "DIR", "Directory for the core files"),
+        OPT_STRING('s', NULL, &sizes, "MiB[,MiB]...", "Sizes of the synthetic cores"),
+        OPT_END()
+    };
+    parse_opts(argc, argv, program_options, program_usage_string);
+
+    /* Don't die when the capture closes the pipe */
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%-10s %8s %12s %12s\n", "mode", "MiB", "fixed MB/s", "adaptive MB/s");
+
+    int retval = 0;
+    GList *size_list = parse_list(sizes);
+    for (GList *li = size_list; li != NULL; li = g_list_next(li))
+    {
+        const size_t size = (size_t)xatou(li->data) * 1024 * 1024;
+        for (enum capture_mode mode = CAPTURE_ABRT; mode <= CAPTURE_SPARSE; ++mode)
+        {
+            const double fixed = run_capture(mode, false, size, dir);
+            const double adaptive = run_capture(mode, true, size, dir);
+            if (fixed < 0 || adaptive < 0)
+                retval = 1;
+
+            printf("%-10s %8s %12.1f %12.1f\n", s_mode_names[mode], (const char *)li->data, fixed, adaptive);
+        }
+    }
+    list_free_with_free(size_list);
+
+    return retval;
+}
@@ -21,6 +21,7 @@
 #include <fnmatch.h>
 #include <sys/utsname.h>
 #include "libabrt.h"
+#include "core-capture.h"
 #ifdef HAVE_SELINUX
 #include <selinux/selinux.h>
 #else
@@ -30,6 +31,8 @@ typedef char *security_context_t;
 #include <sys/resource.h>
 
 #include <sys/types.h>
+#include <sys/procfs.h>
+#include <link.h>
 
 /* capabilities */
 #include <sys/capability.h>
@@ -40,10 +43,10 @@ typedef char *security_context_t;
 #include <satyr/core/unwind.h>
 #endif /* ENABLE_DUMP_TIME_UNWIND */
 
-#define KERNEL_PIPE_BUFFER_SIZE 65536
-
 static int g_user_core_flags;
 static int g_need_nonrelative;
+static bool g_sparse_core;
+static unsigned g_core_filter;
 
 /* I want to use -Werror, but gcc-4.4 throws a curveball:
  * "warning: ignoring return value of 'ftruncate', declared with attribute warn_unused_result"
@@ -55,6 +58,7 @@ static int g_need_nonrelative;
 static char *user_pwd;
 static DIR *proc_cwd;
 static struct dump_dir *dd;
+static struct core_capture core_capture;
 
 /*
  * %s - signal number
@@ -314,46 +318,879 @@ static int open_user_core(uid_t uid, uid_t fsuid, gid_t fsgid, pid_t pid,
         goto user_core_fail;
     }
 
-    return user_core_fd;
+    return user_core_fd;
+
+user_core_fail:
+    if (user_core_fd >= 0)
+        close(user_core_fd);
+    return -1;
+}
+
+static int close_user_core(int user_core_fd, off_t core_size)
+{
+    if (user_core_fd >= 0 && (fsync(user_core_fd) != 0 || close(user_core_fd) != 0 || core_size < 0))
+    {
+        perror_msg("Error writing '%s' at '%s'", core_basename, user_pwd);
+        return -1;
+    }
+    return 0;
+}
+
+/* Filtered core capture
+ *
+ * The hook parses the ELF core from STDIN on the fly and leaves parts of the
+ * PT_LOAD segments out of the ABRT core file. The left out parts are replaced
+ * by segments with p_filesz == 0, exactly as the kernel does for the mappings
+ * it does not dump, so gdb and satyr load the result as an ordinary core.
+ *
+ * Minidump (MinidumpCore) keeps only the data debuggers need for backtraces:
+ * the notes (registers, auxv, file mappings), the stack of every thread, a
+ * small window around every register value and the small read-only segments
+ * the kernel dumped (vdso, ELF headers of the mapped files).
+ *
+ * Mapped files elision (ElideMappedFiles) leaves out read-only segments that
+ * are mappings of files (NT_FILE) which are still present on the disk. Their
+ * first page is kept for build-ids and the rest is described in the
+ * FILENAME_COREDUMP_ELIDED element, so problem_coredump_restore() can put the
+ * data back from the files.
+ *
+ * Notes precede the memory contents in the core stream, so the output layout
+ * is known before the first byte of memory is read and the dropped parts are
+ * spliced to /dev/null without being copied to user space.
+ */
+enum core_filter_flags {
+    CORE_FILTER_MINIDUMP     = 1 << 0,
+    CORE_FILTER_MAPPED_FILES = 1 << 1,
+};
+
+#if defined(__x86_64__)
+# define MINIDUMP_MACHINE EM_X86_64
+# define MINIDUMP_SP_REG 19 /* RSP in sys/reg.h */
+#elif defined(__i386__)
+# define MINIDUMP_MACHINE EM_386
+# define MINIDUMP_SP_REG 15 /* UESP in sys/reg.h */
+#elif defined(__aarch64__)
+# define MINIDUMP_MACHINE EM_AARCH64
+# define MINIDUMP_SP_REG 31
+#elif defined(__powerpc64__)
+# define MINIDUMP_MACHINE EM_PPC64
+# define MINIDUMP_SP_REG 1
+#elif defined(__s390x__)
+# define MINIDUMP_MACHINE EM_S390
+# define MINIDUMP_SP_REG 17 /* psw mask, psw addr, gprs[15] */
+#else
+/* Minidumps are not supported */
+# define MINIDUMP_MACHINE EM_NONE
+# define MINIDUMP_SP_REG ELF_NGREG
+#endif
+
+#if __WORDSIZE == 64
+# define CORE_ELFCLASS ELFCLASS64
+#else
+# define CORE_ELFCLASS ELFCLASS32
+#endif
+
+/* Bytes kept around the value of every register */
+#define MINIDUMP_WINDOW (4 * 1024)
+/* Bytes of stack kept above the stack pointer */
+#define MINIDUMP_STACK_SIZE (8 * 1024 * 1024)
+/* Read-only segments up to this size are kept whole (vdso) */
+#define MINIDUMP_SMALL_SEGMENT (64 * 1024)
+/* Upper limit for the ELF headers and notes held in memory */
+#define CORE_MAX_HEAD_SIZE (64 * 1024 * 1024)
+
+#define CORE_ALIGN_DOWN(x, a) ((x) & ~((uintptr_t)(a) - 1))
+#define CORE_ALIGN_UP(x, a) CORE_ALIGN_DOWN((x) + (a) - 1, (a))
+#define NOTE_ALIGN(x) (((x) + 3) & ~(size_t)3)
+
+struct core_stream
+{
+    struct core_capture *cap;
+    off_t pos;          /* bytes consumed from the pipe */
+    bool eof;
+    bool no_splice;     /* the core is not read from a pipe */
+    int user_core_fd;   /* receives all consumed bytes up to user_limit */
+    size_t user_limit;
+    bool user_failed;
+};
+
+struct core_range
+{
+    uintptr_t start;
+    uintptr_t end;
+};
+
+/* An entry of the NT_FILE note */
+struct core_mapped_file
+{
+    uintptr_t start;
+    uintptr_t end;
+    off_t offset;
+    const char *path;   /* points to the notes */
+    bool pristine;      /* no page differs from the file */
+};
+
+struct core_piece
+{
+    ElfW(Phdr) phdr;
+    ElfW(Off) src_offset;
+};
+
+struct core_filter
+{
+    unsigned flags;
+    size_t page_size;
+    GArray *ranges;     /* memory kept in minidumps */
+    GArray *files;      /* mapped files */
+    GArray *pieces;     /* output segments */
+    int pid_proc_fd;
+    int root_fd;        /* root of the crashed process */
+    struct strbuf *manifest;
+};
+
+static bool core_stream_user_wants(const struct core_stream *cs)
+{
+    return cs->user_core_fd >= 0 && !cs->user_failed && (size_t)cs->pos < cs->user_limit;
+}
+
+/* Reads up to SIZE bytes of the core and copies them to the user core */
+static ssize_t core_stream_read(struct core_stream *cs, void *buf, size_t size)
+{
+    const ssize_t r = full_read(cs->cap->fd, buf, size);
+    if (r < 0)
+    {
+        perror_msg("Failed to read core dump from stdin");
+        return r;
+    }
+
+    if ((size_t)r < size)
+        cs->eof = true;
+
+    if (core_stream_user_wants(cs))
+    {
+        const size_t len = MIN((size_t)r, cs->user_limit - cs->pos);
+        if (full_write(cs->user_core_fd, buf, len) != (ssize_t)len)
+        {
+            perror_msg("Failed to write user core file");
+            cs->user_failed = true;
+        }
+    }
+
+    cs->pos += r;
+    core_capture_account(cs->cap, r);
+    return r;
+}
+
+/* Consumes SIZE bytes of the core which are not needed in the ABRT core.
+ * Splice moves the data to the user core or to /dev/null without copying
+ * them to user space.
+ */
+static int core_stream_skip(struct core_stream *cs, int null_fd, char *buffer, size_t buffer_size, size_t size)
+{
+    while (size != 0 && !cs->eof)
+    {
+        int out_fd = null_fd;
+        size_t len = size;
+        if (core_stream_user_wants(cs))
+        {
+            out_fd = cs->user_core_fd;
+            len = MIN(len, cs->user_limit - cs->pos);
+        }
+
+        ssize_t r = -1;
+        errno = EINVAL;
+        if (out_fd >= 0 && !cs->no_splice)
+            r = splice(cs->cap->fd, NULL, out_fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+
+        if (r < 0 && errno == EINTR)
+            continue;
+
+        if (r < 0)
+        {
+            if (out_fd == cs->user_core_fd && errno != EINVAL)
+            {
+                perror_msg("Failed to write user core file");
+                cs->user_failed = true;
+                continue;
+            }
+
+            /* STDIN is not a pipe or /dev/null is not available */
+            r = core_stream_read(cs, buffer, MIN(size, buffer_size));
+            if (r < 0)
+                return -1;
+            size -= r;
+            continue;
+        }
+
+        if (r == 0)
+        {
+            cs->eof = true;
+            break;
+        }
+
+        cs->pos += r;
+        core_capture_account(cs->cap, r);
+        size -= r;
+    }
+
+    return 0;
+}
+
+/* Copies SIZE bytes of the core to OUT_FD at offset OFS. Bytes beyond LIMIT
+ * are consumed but not written. Returns DUMP_*_FAILED flags.
+ */
+static int core_stream_copy(struct core_stream *cs, int out_fd, off_t ofs, size_t size, size_t limit,
+        char *buffer, size_t buffer_size)
+{
+    while (size != 0 && !cs->eof)
+    {
+        /* Zero copy if the data are not needed in the user core */
+        if (!cs->no_splice && !core_stream_user_wants(cs) && (size_t)ofs < limit)
+        {
+            loff_t out_ofs = ofs;
+            const ssize_t r = splice(cs->cap->fd, NULL, out_fd, &out_ofs,
+                                     MIN(size, limit - ofs), SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (r < 0 && errno == EINTR)
+                continue;
+
+            if (r < 0 && errno != EINVAL)
+            {
+                perror_msg("Failed to write ABRT core file");
+                return DUMP_ABRT_CORE_FAILED;
+            }
+
+            if (r == 0)
+            {
+                cs->eof = true;
+                break;
+            }
+
+            if (r > 0)
+            {
+                cs->pos += r;
+                core_capture_account(cs->cap, r);
+                ofs += r;
+                size -= r;
+                continue;
+            }
+
+            cs->no_splice = true;
+        }
+
+        const ssize_t rd = core_stream_read(cs, buffer, MIN(size, buffer_size));
+        if (rd < 0)
+            return DUMP_ABRT_CORE_FAILED | DUMP_USER_CORE_FAILED;
+
+        if ((size_t)ofs < limit)
+        {
+            const size_t len = MIN((size_t)rd, limit - ofs);
+            for (size_t written = 0; written < len; )
+            {
+                const ssize_t w = pwrite(out_fd, buffer + written, len - written, ofs + written);
+                if (w < 0 && errno == EINTR)
+                    continue;
+                if (w < 0)
+                {
+                    perror_msg("Failed to write ABRT core file");
+                    return DUMP_ABRT_CORE_FAILED;
+                }
+                written += w;
+            }
+        }
+
+        ofs += rd;
+        size -= rd;
+    }
+
+    return 0;
+}
+
+static int pwrite_limited(int fd, const void *buf, size_t size, off_t ofs, size_t limit)
+{
+    if ((size_t)ofs >= limit)
+        return 0;
+
+    size = MIN(size, limit - ofs);
+    for (size_t written = 0; written < size; )
+    {
+        const ssize_t w = pwrite(fd, (const char *)buf + written, size - written, ofs + written);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        written += w;
+    }
+
+    return 0;
+}
+
+static int core_range_cmp(gconstpointer a, gconstpointer b)
+{
+    const struct core_range *ra = a;
+    const struct core_range *rb = b;
+    return ra->start < rb->start ? -1 : ra->start > rb->start;
+}
+
+static const ElfW(Phdr) *core_find_segment(const ElfW(Phdr) *phdrs, unsigned phnum, uintptr_t addr)
+{
+    for (unsigned i = 0; i < phnum; ++i)
+        if (phdrs[i].p_type == PT_LOAD
+            && addr >= phdrs[i].p_vaddr && addr - phdrs[i].p_vaddr < phdrs[i].p_memsz)
+            return phdrs + i;
+
+    return NULL;
+}
+
+/* Collects the ranges of memory kept in minidumps from NT_PRSTATUS */
+static void minidump_add_ranges(struct core_filter *filter, const struct elf_prstatus *prstatus,
+        const ElfW(Phdr) *phdrs, unsigned phnum)
+{
+    for (unsigned i = 0; i < ELF_NGREG; ++i)
+    {
+        const uintptr_t value = prstatus->pr_reg[i];
+        const ElfW(Phdr) *seg = core_find_segment(phdrs, phnum, value);
+        if (seg == NULL)
+            continue;
+
+        struct core_range range;
+        range.start = CORE_ALIGN_DOWN(value, filter->page_size);
+        range.start = range.start - seg->p_vaddr > MINIDUMP_WINDOW ? range.start - MINIDUMP_WINDOW : seg->p_vaddr;
+        range.end = CORE_ALIGN_UP(value + (i == MINIDUMP_SP_REG ? MINIDUMP_STACK_SIZE : MINIDUMP_WINDOW), filter->page_size);
+
+        /* The stack must not spill to the neighbouring mappings */
+        const uintptr_t seg_end = seg->p_vaddr + seg->p_memsz;
+        if (range.end > seg_end || range.end < range.start)
+            range.end = seg_end;
+
+        g_array_append_val(filter->ranges, range);
+    }
+}
+
+/* Parses NT_FILE: count, page size, count * (start, end, page offset) and
+ * count NUL terminated file names.
+ */
+static void core_add_mapped_files(struct core_filter *filter, const char *desc, size_t size)
+{
+    const unsigned long *words = (const unsigned long *)desc;
+    if (size < 2 * sizeof(*words))
+        return;
+
+    const unsigned long count = words[0];
+    const unsigned long page_size = words[1];
+    if (count > (size - 2 * sizeof(*words)) / (3 * sizeof(*words)))
+        return;
+
+    const char *name = desc + (2 + 3 * count) * sizeof(*words);
+    const char *const end = desc + size;
+    for (unsigned long i = 0; i < count && name < end; ++i)
+    {
+        const char *const name_end = memchr(name, '\0', end - name);
+        if (name_end == NULL)
+            break;
+
+        struct core_mapped_file file = {
+            .start = words[2 + 3 * i],
+            .end = words[2 + 3 * i + 1],
+            .offset = (off_t)words[2 + 3 * i + 2] * page_size,
+            .path = name,
+        };
+        g_array_append_val(filter->files, file);
+
+        name = name_end + 1;
+    }
+}
+
+static void core_parse_notes(struct core_filter *filter, const char *notes, size_t size,
+        const ElfW(Phdr) *phdrs, unsigned phnum)
+{
+    size_t pos = 0;
+    while (pos + sizeof(ElfW(Nhdr)) <= size)
+    {
+        const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr) *)(notes + pos);
+        const size_t desc_pos = pos + sizeof(*nhdr) + NOTE_ALIGN(nhdr->n_namesz);
+        if (desc_pos > size || nhdr->n_descsz > size - desc_pos)
+            break;
+
+        pos = desc_pos + NOTE_ALIGN(nhdr->n_descsz);
+
+        if ((filter->flags & CORE_FILTER_MINIDUMP)
+            && nhdr->n_type == NT_PRSTATUS && nhdr->n_descsz >= sizeof(struct elf_prstatus))
+        {
+            struct elf_prstatus prstatus;
+            memcpy(&prstatus, notes + desc_pos, sizeof(prstatus));
+            minidump_add_ranges(filter, &prstatus, phdrs, phnum);
+        }
+        else if ((filter->flags & CORE_FILTER_MAPPED_FILES) && nhdr->n_type == NT_FILE)
+            core_add_mapped_files(filter, notes + desc_pos, nhdr->n_descsz);
+    }
+}
+
+/* Finds the mapped files whose pages have not been modified. Read-only
+ * private mappings may still contain modified pages (e.g. RELRO of shared
+ * libraries) which must be kept in the core.
+ */
+static void core_check_mapped_files(struct core_filter *filter)
+{
+    const int fd = openat(filter->pid_proc_fd, "smaps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    char *smaps = xmalloc_read(fd, NULL);
+    close(fd);
+    if (smaps == NULL)
+        return;
+
+    struct core_mapped_file *current = NULL;
+    for (char *line = smaps, *next; line != NULL && *line != '\0'; line = next)
+    {
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        unsigned long start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+        {
+            current = NULL;
+            for (unsigned i = 0; i < filter->files->len && current == NULL; ++i)
+            {
+                struct core_mapped_file *file = &g_array_index(filter->files, struct core_mapped_file, i);
+                if (file->start == start && file->end == end)
+                    current = file;
+            }
+            continue;
+        }
+
+        unsigned long anonymous_kb;
+        if (current != NULL && sscanf(line, "Anonymous: %lu kB", &anonymous_kb) == 1)
+            current->pristine = anonymous_kb == 0;
+    }
+
+    free(smaps);
+}
+
+/* Sorts the minidump ranges and merges the overlapping ones */
+static void minidump_merge_ranges(GArray *ranges)
+{
+    g_array_sort(ranges, core_range_cmp);
+
+    unsigned merged = 0;
+    for (unsigned i = 0; i < ranges->len; ++i)
+    {
+        struct core_range *cur = &g_array_index(ranges, struct core_range, i);
+        struct core_range *last = merged ? &g_array_index(ranges, struct core_range, merged - 1) : NULL;
+        if (last != NULL && cur->start <= last->end)
+        {
+            if (cur->end > last->end)
+                last->end = cur->end;
+        }
+        else
+            g_array_index(ranges, struct core_range, merged++) = *cur;
+    }
+    g_array_set_size(ranges, merged);
+}
+
+static void core_add_piece(GArray *pieces, const ElfW(Phdr) *seg, uintptr_t start, uintptr_t end, bool keep)
+{
+    struct core_piece piece;
+    piece.phdr = *seg;
+    piece.phdr.p_vaddr = start;
+    piece.phdr.p_paddr = 0;
+    piece.phdr.p_memsz = end - start;
+    piece.phdr.p_filesz = keep ? end - start : 0;
+    piece.src_offset = seg->p_offset + (start - seg->p_vaddr);
+    g_array_append_val(pieces, piece);
+}
+
+/* Returns the file mapped to SEG if the file is still on the disk */
+/* The manifest is line based, paths with new lines could forge entries */
+static bool is_manifest_safe_path(const char *path)
+{
+    for (const unsigned char *c = (const unsigned char *)path; *c != '\0'; ++c)
+        if (*c < ' ' || *c == 0x7f)
+            return false;
+
+    return true;
+}
+
+static const struct core_mapped_file *core_find_elidable_file(struct core_filter *filter,
+        const ElfW(Phdr) *seg, struct stat *st)
+{
+    if ((seg->p_flags & PF_W) || seg->p_filesz != seg->p_memsz || seg->p_filesz <= filter->page_size)
+        return NULL;
+
+    for (unsigned i = 0; i < filter->files->len; ++i)
+    {
+        const struct core_mapped_file *file = &g_array_index(filter->files, struct core_mapped_file, i);
+        if (file->start != seg->p_vaddr || file->end != seg->p_vaddr + seg->p_memsz)
+            continue;
+
+        if (!file->pristine)
+        {
+            log_debug("Keeping modified mapping of '%s'", file->path);
+            return NULL;
+        }
+
+        /* The file at the path must be the mapped one, not a new version */
+        char map_file[sizeof("map_files/%lx-%lx") + sizeof(long) * 4];
+        sprintf(map_file, "map_files/%lx-%lx", (unsigned long)file->start, (unsigned long)file->end);
+
+        struct stat mapped;
+        if (file->path[0] != '/'
+            || !is_manifest_safe_path(file->path)
+            || fstatat(filter->pid_proc_fd, map_file, &mapped, 0) != 0
+            || fstatat(filter->root_fd, file->path + 1, st, 0) != 0
+            || !S_ISREG(st->st_mode)
+            || st->st_dev != mapped.st_dev
+            || st->st_ino != mapped.st_ino)
+        {
+            log_debug("Keeping mapping of '%s'", file->path);
+            return NULL;
+        }
+
+        return file;
+    }
+
+    return NULL;
+}
+
+/* Splits a PT_LOAD segment to kept and left out parts */
+static void core_plan_segment(struct core_filter *filter, const ElfW(Phdr) *seg)
+{
+    GArray *pieces = filter->pieces;
+
+    struct stat st;
+    const struct core_mapped_file *file = NULL;
+    if (filter->flags & CORE_FILTER_MAPPED_FILES)
+        file = core_find_elidable_file(filter, seg, &st);
+
+    if (file != NULL)
+    {
+        uintptr_t start = seg->p_vaddr;
+        off_t offset = file->offset;
+
+        /* The first page of ELF files holds the build-id */
+        if (offset == 0)
+        {
+            core_add_piece(pieces, seg, start, start + filter->page_size, /*keep*/true);
+            start += filter->page_size;
+            offset += filter->page_size;
+        }
+
+        core_add_piece(pieces, seg, start, seg->p_vaddr + seg->p_memsz, /*keep*/false);
+
+        strbuf_append_strf(filter->manifest, "%lx %lx %llx %llx %llu %lld %lld %s\n",
+                (unsigned long)start, (unsigned long)(seg->p_vaddr + seg->p_memsz),
+                (unsigned long long)offset, (unsigned long long)st.st_dev,
+                (unsigned long long)st.st_ino, (long long)st.st_size,
+                (long long)st.st_mtime, file->path);
+        return;
+    }
+
+    const size_t page_size = filter->page_size;
+    const bool keep_all = !(filter->flags & CORE_FILTER_MINIDUMP)
+        || seg->p_filesz == 0
+        || (seg->p_filesz < seg->p_memsz && seg->p_filesz <= page_size)
+        || (!(seg->p_flags & PF_W) && seg->p_filesz <= MINIDUMP_SMALL_SEGMENT);
+
+    if (keep_all)
+    {
+        struct core_piece piece = { .phdr = *seg, .src_offset = seg->p_offset };
+        g_array_append_val(pieces, piece);
+        return;
+    }
+
+    const uintptr_t data_end = seg->p_vaddr + seg->p_filesz;
+    uintptr_t cursor = seg->p_vaddr;
+    for (unsigned i = 0; i < filter->ranges->len; ++i)
+    {
+        const struct core_range *range = &g_array_index(filter->ranges, struct core_range, i);
+        const uintptr_t start = MAX(range->start, cursor);
+        const uintptr_t end = MIN(range->end, data_end);
+        if (start >= end)
+            continue;
+
+        if (start > cursor)
+            core_add_piece(pieces, seg, cursor, start, /*keep*/false);
+        core_add_piece(pieces, seg, start, end, /*keep*/true);
+        cursor = end;
+    }
+
+    if (cursor < seg->p_vaddr + seg->p_memsz)
+        core_add_piece(pieces, seg, cursor, seg->p_vaddr + seg->p_memsz, /*keep*/false);
+}
+
+/* Reads the core up to offset SIZE into HEAD */
+static bool core_read_head_up_to(struct core_stream *cs, char **head, size_t *head_size, size_t size)
+{
+    *head = xrealloc(*head, size);
+    const ssize_t r = core_stream_read(cs, *head + *head_size, size - *head_size);
+    if (r > 0)
+        *head_size += r;
+
+    return *head_size == size;
+}
+
+/* Reads ELF header, program headers and notes. Returns NULL if the core
+ * cannot be filtered, HEAD holds all data read so far then.
+ */
+static ElfW(Phdr) *core_read_head(struct core_stream *cs, unsigned flags, char **head, size_t *head_size)
+{
+    if (!core_read_head_up_to(cs, head, head_size, sizeof(ElfW(Ehdr))))
+        return NULL;
+
+    const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)*head;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0
+        || ehdr->e_ident[EI_CLASS] != CORE_ELFCLASS
+        || ehdr->e_type != ET_CORE
+        || ((flags & CORE_FILTER_MINIDUMP) && ehdr->e_machine != MINIDUMP_MACHINE)
+        || ehdr->e_phentsize != sizeof(ElfW(Phdr))
+        || ehdr->e_phnum == 0
+        || ehdr->e_phnum == PN_XNUM
+        || ehdr->e_phoff < sizeof(*ehdr)
+        || ehdr->e_phoff > CORE_MAX_HEAD_SIZE)
+    {
+        log_notice("Unsupported core dump format, saving full core");
+        return NULL;
+    }
+
+    const size_t phoff = ehdr->e_phoff;
+    const unsigned phnum = ehdr->e_phnum;
+    const size_t phdrs_end = phoff + phnum * sizeof(ElfW(Phdr));
+    if (!core_read_head_up_to(cs, head, head_size, phdrs_end))
+        return NULL;
+
+    ElfW(Phdr) *phdrs = xmalloc(phdrs_end - phoff);
+    memcpy(phdrs, *head + phoff, phdrs_end - phoff);
+
+    /* All notes must precede the memory contents */
+    size_t notes_end = phdrs_end;
+    ElfW(Off) last_load = 0;
+    for (unsigned i = 0; i < phnum; ++i)
+    {
+        if (phdrs[i].p_type == PT_NOTE)
+        {
+            if (phdrs[i].p_offset < phdrs_end
+                || phdrs[i].p_offset > CORE_MAX_HEAD_SIZE
+                || phdrs[i].p_filesz > CORE_MAX_HEAD_SIZE - phdrs[i].p_offset)
+                goto unsupported;
+            notes_end = MAX(notes_end, phdrs[i].p_offset + phdrs[i].p_filesz);
+        }
+        else if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_filesz != 0)
+        {
+            if (phdrs[i].p_offset < last_load)
+                goto unsupported;
+            last_load = phdrs[i].p_offset;
+        }
+    }
+
+    for (unsigned i = 0; i < phnum; ++i)
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_filesz != 0 && phdrs[i].p_offset < notes_end)
+            goto unsupported;
+
+    if (!core_read_head_up_to(cs, head, head_size, notes_end))
+        goto fail;
+
+    return phdrs;
+
+ unsupported:
+    log_notice("Unsupported layout of core dump, saving full core");
+ fail:
+    free(phdrs);
+    return NULL;
+}
+
+/* Creation of a filtered ABRT core and optionally of the full user core
+ *
+ * FLAGS are enum core_filter_flags. Returns the same flags as
+ * dump_sparse_core_files(). The limits are updated to the sizes of the
+ * written files. MANIFEST is set to the contents of FILENAME_COREDUMP_ELIDED
+ * if any segment was left out because of CORE_FILTER_MAPPED_FILES.
+ */
+static int dump_filtered_core_file(struct core_capture *cap, int abrt_core_fd, size_t *abrt_limit,
+        int user_core_fd, size_t *user_limit, unsigned flags, int pid_proc_fd, char **manifest)
+{
+    core_capture_begin(cap);
+    const size_t buffer_size = cap->pipe_size;
+    char *buffer = xmalloc(buffer_size);
+
+    const int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    struct core_stream cs = {
+        .cap = cap,
+        .user_core_fd = user_core_fd,
+        .user_limit = user_core_fd >= 0 ? *user_limit : 0,
+    };
+
+    struct core_filter filter = {
+        .flags = flags,
+        .page_size = sysconf(_SC_PAGESIZE),
+        .ranges = g_array_new(FALSE, FALSE, sizeof(struct core_range)),
+        .files = g_array_new(FALSE, FALSE, sizeof(struct core_mapped_file)),
+        .pieces = g_array_new(FALSE, FALSE, sizeof(struct core_piece)),
+        .pid_proc_fd = pid_proc_fd,
+        .root_fd = openat(pid_proc_fd, "root", O_RDONLY | O_DIRECTORY | O_CLOEXEC),
+        .manifest = strbuf_new(),
+    };
+
+    int r = 0;
+    size_t out_size = 0;
+    char *head = NULL;
+    size_t head_size = 0;
+    *manifest = NULL;
+
+    ElfW(Phdr) *phdrs = core_read_head(&cs, flags, &head, &head_size);
+    if (phdrs == NULL)
+        goto full_core;
+
+    ElfW(Ehdr) ehdr;
+    memcpy(&ehdr, head, sizeof(ehdr));
+
+    for (unsigned i = 0; i < ehdr.e_phnum; ++i)
+        if (phdrs[i].p_type == PT_NOTE)
+            core_parse_notes(&filter, head + phdrs[i].p_offset, phdrs[i].p_filesz, phdrs, ehdr.e_phnum);
+
+    minidump_merge_ranges(filter.ranges);
+
+    if (filter.files->len != 0)
+        core_check_mapped_files(&filter);
+
+    for (unsigned i = 0; i < ehdr.e_phnum; ++i)
+    {
+        if (phdrs[i].p_type == PT_LOAD)
+            core_plan_segment(&filter, phdrs + i);
+        else
+        {
+            struct core_piece piece = { .phdr = phdrs[i], .src_offset = phdrs[i].p_offset };
+            g_array_append_val(filter.pieces, piece);
+        }
+    }
+    free(phdrs);
+
+    GArray *pieces = filter.pieces;
+    if (pieces->len >= PN_XNUM)
+    {
+        log_notice("Too many segments in filtered core, saving full core");
+        strbuf_clear(filter.manifest);
+        goto full_core;
+    }
+
+    /* Layout: ELF header, program headers, notes, memory */
+    ehdr.e_phoff = sizeof(ehdr);
+    ehdr.e_phnum = pieces->len;
+    ehdr.e_shoff = 0;
+    ehdr.e_shnum = 0;
+    ehdr.e_shstrndx = SHN_UNDEF;
+    out_size = sizeof(ehdr) + pieces->len * sizeof(ElfW(Phdr));
+
+    for (unsigned i = 0; i < pieces->len; ++i)
+    {
+        struct core_piece *piece = &g_array_index(pieces, struct core_piece, i);
+        if (piece->phdr.p_type != PT_NOTE)
+            continue;
+
+        if (pwrite_limited(abrt_core_fd, head + piece->src_offset, piece->phdr.p_filesz, out_size, *abrt_limit) < 0)
+            goto write_failed;
+        piece->phdr.p_offset = out_size;
+        out_size += piece->phdr.p_filesz;
+    }
+
+    out_size = CORE_ALIGN_UP(out_size, filter.page_size);
+    for (unsigned i = 0; i < pieces->len; ++i)
+    {
+        struct core_piece *piece = &g_array_index(pieces, struct core_piece, i);
+        if (piece->phdr.p_type != PT_LOAD)
+            continue;
+
+        piece->phdr.p_offset = out_size;
+        out_size += piece->phdr.p_filesz;
+    }
 
-user_core_fail:
-    if (user_core_fd >= 0)
-        close(user_core_fd);
-    return -1;
-}
+    if (pwrite_limited(abrt_core_fd, &ehdr, sizeof(ehdr), 0, *abrt_limit) < 0)
+        goto write_failed;
 
-static int close_user_core(int user_core_fd, off_t core_size)
-{
-    if (user_core_fd >= 0 && (fsync(user_core_fd) != 0 || close(user_core_fd) != 0 || core_size < 0))
+    for (unsigned i = 0; i < pieces->len; ++i)
     {
-        perror_msg("Error writing '%s' at '%s'", core_basename, user_pwd);
-        return -1;
+        const struct core_piece *piece = &g_array_index(pieces, struct core_piece, i);
+        if (pwrite_limited(abrt_core_fd, &piece->phdr, sizeof(piece->phdr),
+                    sizeof(ehdr) + i * sizeof(piece->phdr), *abrt_limit) < 0)
+            goto write_failed;
     }
-    return 0;
-}
 
-static ssize_t splice_entire_per_partes(int in_fd, int out_fd, size_t size_limit)
-{
-    size_t bytes = 0;
-    size_t soft_limit = KERNEL_PIPE_BUFFER_SIZE;
-    while (bytes < size_limit)
+    /* Stream the kept memory */
+    for (unsigned i = 0; i < pieces->len && !cs.eof; ++i)
     {
-        const size_t hard_limit = size_limit - bytes;
-        if (hard_limit < soft_limit)
-            soft_limit = hard_limit;
+        const struct core_piece *piece = &g_array_index(pieces, struct core_piece, i);
+        if (piece->phdr.p_type != PT_LOAD || piece->phdr.p_filesz == 0)
+            continue;
+
+        if ((off_t)piece->src_offset > cs.pos
+            && core_stream_skip(&cs, null_fd, buffer, buffer_size, piece->src_offset - cs.pos) < 0)
+        {
+            r |= DUMP_ABRT_CORE_FAILED | DUMP_USER_CORE_FAILED;
+            goto finito;
+        }
 
-        const ssize_t copied = splice(in_fd, NULL, out_fd, NULL, soft_limit, SPLICE_F_MOVE | SPLICE_F_MORE);
-        if (copied < 0)
-            return copied;
+        r |= core_stream_copy(&cs, abrt_core_fd, piece->phdr.p_offset, piece->phdr.p_filesz, *abrt_limit,
+                buffer, buffer_size);
+        if (r != 0)
+            goto finish_user_core;
+    }
 
-        bytes += copied;
+    log_info("Filtered core: %u segments, %u minidump ranges, %zu of %llu bytes",
+            pieces->len, filter.ranges->len, out_size, (unsigned long long)cs.pos);
+    goto finish_user_core;
 
-        /* Check EOF. */
-        if (copied == 0)
-            break;
+ full_core:
+    /* Copy what has been read and the rest of the core */
+    if (pwrite_limited(abrt_core_fd, head, head_size, 0, *abrt_limit) < 0)
+        goto write_failed;
+
+    r |= core_stream_copy(&cs, abrt_core_fd, head_size, *abrt_limit > head_size ? *abrt_limit - head_size : 0,
+            *abrt_limit, buffer, buffer_size);
+    out_size = cs.pos;
+    goto finish_user_core;
+
+ write_failed:
+    perror_msg("Failed to write ABRT core file");
+    r |= DUMP_ABRT_CORE_FAILED;
+
+ finish_user_core:
+    /* The rest of the core is needed only in the user core */
+    if (!(r & DUMP_USER_CORE_FAILED) && core_stream_user_wants(&cs)
+        && core_stream_skip(&cs, -1, buffer, buffer_size, cs.user_limit - cs.pos) < 0)
+        r |= DUMP_USER_CORE_FAILED;
+
+ finito:
+    if (cs.user_failed)
+        r |= DUMP_USER_CORE_FAILED;
+
+    *abrt_limit = MIN(out_size, *abrt_limit);
+    if (!(r & DUMP_ABRT_CORE_FAILED) && ftruncate(abrt_core_fd, *abrt_limit) != 0)
+    {
+        perror_msg("Failed to set size of ABRT core file");
+        r |= DUMP_ABRT_CORE_FAILED;
     }
 
-    return bytes;
+    *user_limit = MIN((size_t)cs.pos, cs.user_limit);
+
+    if (!(r & DUMP_ABRT_CORE_FAILED) && filter.manifest->len != 0)
+        *manifest = strbuf_free_nobuf(filter.manifest);
+    else
+        strbuf_free(filter.manifest);
+
+    g_array_free(filter.pieces, TRUE);
+    g_array_free(filter.files, TRUE);
+    g_array_free(filter.ranges, TRUE);
+    if (filter.root_fd >= 0)
+        close(filter.root_fd);
+    free(head);
+    if (null_fd >= 0)
+        close(null_fd);
+    free(buffer);
+
+    return r;
 }
 
 static int create_user_core(int user_core_fd, pid_t pid, off_t ulimit_c)
@@ -362,14 +1199,25 @@ static int create_user_core(int user_core_fd, pid_t pid, off_t ulimit_c)
     if (user_core_fd >= 0)
     {
         errno = 0;
-        ssize_t core_size = splice_entire_per_partes(STDIN_FILENO, user_core_fd, ulimit_c);
+        ssize_t core_size;
+        if (g_sparse_core)
+        {
+            size_t abrt_limit = 0;
+            size_t user_limit = ulimit_c;
+            const int r = dump_sparse_core_files(&core_capture, -1, &abrt_limit, user_core_fd, &user_limit);
+            core_size = (r & DUMP_USER_CORE_FAILED) ? -1 : (ssize_t)user_limit;
+        }
+        else
+            core_size = splice_entire_per_partes(&core_capture, user_core_fd, ulimit_c);
+
         if (core_size < 0)
             perror_msg("Failed to create user core '%s' in '%s'", core_basename, user_pwd);
 
         if (close_user_core(user_core_fd, core_size) != 0 || core_size < 0)
             goto finito;
 
-        log_notice("Saved core dump of pid %lu to '%s' at '%s' (%llu bytes)", (long)pid, core_basename, user_pwd, (long long)core_size);
+        log_notice("Saved core dump of pid %lu to '%s' at '%s' (%llu bytes, %.1f MB/s)", (long)pid, core_basename, user_pwd,
+                (long long)core_size, core_capture_rate(&core_capture));
     }
     err = 0;
 
@@ -450,6 +1298,128 @@ static int test_configuration(bool setting_SaveFullCore, bool setting_CreateCore
     return 0;
 }
 
+/*
+ * The crashing process stays in /proc until the hook closes its stdin, so the
+ * files describing it can be read while the core is being streamed. The
+ * collector thread writes only its own elements, the main thread joins it
+ * before it forks, unwinds or renames the dump directory.
+ */
+struct proc_data_collector
+{
+    struct dump_dir *dd;
+    int pid_proc_fd;
+    uid_t fsuid;
+    /* /proc/[pid]/root if the process is chrooted and ExploreChroots is on */
+    char *chroot_dir;
+    bool containerized;
+
+    GThread *thread;
+    gint64 duration;
+};
+
+static struct proc_data_collector proc_collector;
+
+static void collect_proc_data(struct proc_data_collector *collector)
+{
+    const gint64 start = g_get_monotonic_time();
+    struct dump_dir *dd = collector->dd;
+    const int pid_proc_fd = collector->pid_proc_fd;
+
+    dd_create_basic_files(dd, collector->fsuid, collector->chroot_dir);
+
+    // Disabled for now: /proc/PID/smaps tends to be BIG,
+    // and not much more informative than /proc/PID/maps:
+    // dd_copy_file_at(dd, FILENAME_SMAPS, pid_proc_fd, "smaps");
+
+    dd_copy_file_at(dd, FILENAME_MAPS, pid_proc_fd, "maps");
+    dd_copy_file_at(dd, FILENAME_LIMITS, pid_proc_fd, "limits");
+    dd_copy_file_at(dd, FILENAME_CGROUP, pid_proc_fd, "cgroup");
+    dd_copy_file_at(dd, FILENAME_MOUNTINFO, pid_proc_fd, "mountinfo");
+
+    FILE *open_fds = dd_open_item_file(dd, FILENAME_OPEN_FDS, O_RDWR);
+    if (open_fds != NULL)
+    {
+        if (dump_fd_info_at(pid_proc_fd, open_fds) < 0)
+            dd_delete_item(dd, FILENAME_OPEN_FDS);
+        fclose(open_fds);
+    }
+
+    const int init_proc_dir_fd = open_proc_pid_dir(1);
+    FILE *namespaces = dd_open_item_file(dd, FILENAME_NAMESPACES, O_RDWR);
+    if (namespaces != NULL && init_proc_dir_fd >= 0)
+    {
+        if (dump_namespace_diff_at(init_proc_dir_fd, pid_proc_fd, namespaces) < 0)
+            dd_delete_item(dd, FILENAME_NAMESPACES);
+    }
+    if (init_proc_dir_fd >= 0)
+        close(init_proc_dir_fd);
+    if (namespaces != NULL)
+        fclose(namespaces);
+
+    if (collector->containerized)
+    {
+        pid_t container_pid;
+        if (get_pid_of_container_at(pid_proc_fd, &container_pid) == 0)
+        {
+            char *container_cmdline = get_cmdline(container_pid);
+            dd_save_text(dd, FILENAME_CONTAINER_CMDLINE, container_cmdline);
+            free(container_cmdline);
+        }
+    }
+
+    char *cmdline = get_cmdline_at(pid_proc_fd);
+    dd_save_text(dd, FILENAME_CMDLINE, cmdline ? : "");
+    free(cmdline);
+
+    char *environ = get_environ_at(pid_proc_fd);
+    dd_save_text(dd, FILENAME_ENVIRON, environ ? : "");
+    free(environ);
+
+    char *fips_enabled = xmalloc_fopen_fgetline_fclose("/proc/sys/crypto/fips_enabled");
+    if (fips_enabled)
+    {
+        if (strcmp(fips_enabled, "0") != 0)
+            dd_save_text(dd, "fips_enabled", fips_enabled);
+        free(fips_enabled);
+    }
+
+    collector->duration = g_get_monotonic_time() - start;
+}
+
+static gpointer collect_proc_data_thread(gpointer data)
+{
+    collect_proc_data(data);
+    return NULL;
+}
+
+static void start_collecting_proc_data(struct proc_data_collector *collector)
+{
+    GError *error = NULL;
+    collector->thread = g_thread_try_new("proc-collector", collect_proc_data_thread, collector, &error);
+    if (collector->thread == NULL)
+    {
+        /* Not fatal, the data are only collected before the core */
+        log_notice("Can't start the /proc collector thread: %s", error->message);
+        g_error_free(error);
+        collect_proc_data(collector);
+        free(collector->chroot_dir);
+        collector->chroot_dir = NULL;
+    }
+}
+
+/* Must be called before fork() and before the dump directory is renamed or deleted */
+static void finish_collecting_proc_data(struct proc_data_collector *collector)
+{
+    if (collector->thread == NULL)
+        return;
+
+    g_thread_join(collector->thread);
+    collector->thread = NULL;
+
+    free(collector->chroot_dir);
+    collector->chroot_dir = NULL;
+}
+
 static int save_crashing_binary(pid_t pid, struct dump_dir *dd)
 {
     char buf[sizeof("/proc/%lu/exe") + sizeof(long)*3];
@@ -512,188 +1482,273 @@ static void error_msg_ignore_crash(const char *pid_str, const char *process_str,
     error_msg_process_crash(pid_str, process_str, uid, signal_no, signame, "ignoring (%s)", message_full);
 
     free(message_full);
+
+    /* The hook exits right after ignoring a crash */
+    metrics_counter_add("abrt_hook_ccpp_ignored_crashes_total", 1);
+    metrics_flush("abrt-hook-ccpp");
     return;
 }
 
-static void dump_abrt_process(pid_t pid, const char *executable)
+/* Crash loop coalescing
+ *
+ * A record file named by the crash fingerprint lives in CRASH_LOOPS_DIR. It
+ * holds the path of the problem directory created for the first occurrence
+ * and its mtime is the time of the last occurrence.
+ */
+#define CRASH_LOOPS_DIR VAR_RUN"/abrt/ccpp-crash-loops"
+
+enum crash_loop_status {
+    CRASH_LOOP_UNKNOWN,   /* no usable record, create a new problem */
+    CRASH_LOOP_PENDING,   /* the recorded problem is not processed yet */
+    CRASH_LOOP_COALESCED, /* the recorded problem has been updated */
+};
+
+/* Returns the address of the faulting instruction or 0 if it cannot be
+ * determined. The kernel exposes 'kstkeip' only for tasks which are dumping
+ * core, which is exactly our case.
+ */
+static unsigned long long get_crash_ip_at(int pid_proc_fd)
 {
-    /* If abrtd/abrt-foo crashes, we don't want to create a _directory_,
-     * since that can make new copy of abrtd to process it,
-     * and maybe crash again...
-     * Unlike dirs, mere files are ignored by abrtd.
-     */
-    const char *basename = strrchr(executable, '/') + 1;
-    char *path = xasprintf("%s/%s-coredump", g_settings_dump_location, basename);
-    unlink(path);
-    int abrt_core_fd = xopen3(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
-    off_t core_size = splice_entire_per_partes(STDIN_FILENO, abrt_core_fd, SIZE_MAX);
-    if (core_size < 0 || fsync(abrt_core_fd) != 0 || close(abrt_core_fd) < 0)
+    int stat_fd = openat(pid_proc_fd, "stat", O_RDONLY | O_CLOEXEC);
+    if (stat_fd < 0)
+        return 0;
+
+    char buf[2048];
+    ssize_t r = full_read(stat_fd, buf, sizeof(buf) - 1);
+    close(stat_fd);
+    if (r <= 0)
+        return 0;
+    buf[r] = '\0';
+
+    /* comm can contain anything including ')', find the last one */
+    char *p = strrchr(buf, ')');
+    if (p == NULL)
+        return 0;
+
+    /* The field following ')' is the 3rd one, kstkeip is the 30th one */
+    int field = 2;
+    while (*p != '\0' && field < 30)
     {
-        unlink(path);
-        /* copyfd_eof logs the error including errno string,
-         * but it does not log file name */
-        error_msg_and_die("Error saving '%s'", path);
+        p = skip_whitespace(skip_non_whitespace(p));
+        ++field;
     }
-    log_notice("Saved core dump of pid %lu (%s) to %s (%llu bytes)", (long)pid, basename, path, (long long)core_size);
-    free(path);
+
+    if (*p == '\0')
+        return 0;
+
+    return strtoull(p, NULL, 10);
 }
 
-static ssize_t splice_full(int in_fd, int out_fd, size_t size)
+/* Returns a hash of executable, signal, uid, mount namespace and the faulting
+ * module + offset or NULL if the faulting instruction cannot be mapped to a
+ * module. The offset is relative to the module so the fingerprint does not
+ * depend on ASLR. Crashes of different users or containers never share a
+ * problem directory.
+ */
+static char *get_crash_fingerprint_at(int pid_proc_fd, const char *executable, uid_t uid, int signal_no)
 {
-    ssize_t total = 0;
-    while (size != 0)
+    const unsigned long long ip = get_crash_ip_at(pid_proc_fd);
+    if (ip == 0)
+        return NULL;
+
+    /* "mnt:[INODE]" */
+    char mnt_ns[64];
+    ssize_t ns_len = readlinkat(pid_proc_fd, "ns/mnt", mnt_ns, sizeof(mnt_ns) - 1);
+    if (ns_len < 0)
     {
-        const ssize_t b = splice(in_fd, NULL, out_fd, NULL, size, 0);
-        if (b < 0)
-            return b;
+        perror_msg("Can't read mount namespace of the crashed process");
+        return NULL;
+    }
+    mnt_ns[ns_len] = '\0';
 
-        if (b == 0)
-            break;
+    int maps_fd = openat(pid_proc_fd, "maps", O_RDONLY | O_CLOEXEC);
+    if (maps_fd < 0)
+        return NULL;
 
-        total += b;
-        size -= b;
+    FILE *maps = fdopen(maps_fd, "r");
+    if (maps == NULL)
+    {
+        close(maps_fd);
+        return NULL;
     }
 
-    return total;
-}
+    char *fingerprint = NULL;
+    char *line;
+    while ((line = xmalloc_fgetline(maps)) != NULL)
+    {
+        unsigned long long start, end, offset;
+        int module_ofs = 0;
+        if (sscanf(line, "%llx-%llx %*s %llx %*s %*s %n", &start, &end, &offset, &module_ofs) < 3
+            || module_ofs == 0 || ip < start || ip >= end)
+        {
+            free(line);
+            continue;
+        }
 
-static size_t xsplice_full(int in_fd, int out_fd, size_t size)
-{
-    const ssize_t r = splice_full(in_fd, out_fd, size);
-    if (r < 0)
-        perror_msg_and_die("Failed to write core dump to file");
-    return (size_t)r;
-}
+        const char *module = line + module_ofs;
+        char *data = xasprintf("%s\n%d\n%lu\n%s\n%s+0x%llx", executable, signal_no,
+                (unsigned long)uid, mnt_ns, module[0] != '\0' ? module : "[anon]", ip - start + offset);
 
-static void pipe_close(int *pfds)
-{
-    close(pfds[0]);
-    close(pfds[1]);
-    pfds[0] = pfds[1] = -1;
-}
+        fingerprint = xmalloc(SHA1_RESULT_LEN*2 + 1);
+        str_to_sha1str(fingerprint, data);
 
-enum dump_core_files_ret_flags {
-    DUMP_ABRT_CORE_FAILED  = 0x0001,
-    DUMP_USER_CORE_FAILED  = 0x0100,
-};
+        log_debug("Crash fingerprint '%s' of '%s'", fingerprint, data);
+        free(data);
+        free(line);
+        break;
+    }
 
-/* Optimized creation of two core files - ABRT and CWD
- *
- * The simplest optimization is to avoid the need to copy data to user space.
- * In that case we cannot read data once and write them twice as we do with
- * read/write approach because there is no syscall forwarding data from a
- * single source fd to several destination fds (one might claim that there is
- * tee() function but such a solution is suboptimal from our perspective).
- *
- * So the function first create ABRT core file and then creates user core file.
- * If ABRT limit made the ABRT core to be smaller than allowed user core size,
- * then the function reads more data from STDIN and appends them to the user
- * core file.
- *
- * We must not read from the user core fd because that operation might be
- * refused by OS.
+    fclose(maps);
+    return fingerprint;
+}
+
+/* Bumps 'count' and 'last_occurrence' of the problem recorded for the
+ * FINGERPRINT if the last occurrence happened less than PERIOD seconds ago.
  */
-static int dump_two_core_files(int abrt_core_fd, size_t *abrt_limit, int user_core_fd, size_t *user_limit)
+static enum crash_loop_status coalesce_crash_loop(const char *fingerprint,
+        unsigned period, const char *time_str)
 {
-   /* tee() does not move the in_fd, thus you need to call splice to be
-    * get next chunk of data loaded into the in_fd buffer.
-    * So, calling tee() without splice() would be looping on the same
-    * data. Hence, we must ensure that after tee() we call splice() and
-    * that would be problematic if tee core limit is greater than splice
-    * core limit. Therefore, we swap the out fds based on their limits.
-    */
-    int    spliced_fd          = *abrt_limit > *user_limit ? abrt_core_fd    : user_core_fd;
-    size_t spliced_core_limit  = *abrt_limit > *user_limit ? *abrt_limit     : *user_limit;
-    int    teed_fd             = *abrt_limit > *user_limit ? user_core_fd    : abrt_core_fd;
-    size_t teed_core_limit     = *abrt_limit > *user_limit ? *user_limit     : *abrt_limit;
-
-    size_t *spliced_core_size  = *abrt_limit > *user_limit ? abrt_limit : user_limit;
-    size_t *teed_core_size     = *abrt_limit > *user_limit ? user_limit : abrt_limit;
-
-    *spliced_core_size = *teed_core_size = 0;
-
-    int cp[2] = { -1, -1 };
-    if (pipe(cp) < 0)
-    {
-        perror_msg("Failed to create temporary pipe for core file");
-        cp[0] = cp[1] = -1;
-    }
-
-    /* tee() can copy duplicate up to size of the pipe buffer bytes.
-     * It should not be problem to ask for more (in that case, tee would simply
-     * duplicate up to the limit bytes) but I would rather not to exceed
-     * the pipe buffer limit.
-     */
-    int copy_buffer_size = fcntl(STDIN_FILENO, F_GETPIPE_SZ);
-    if (copy_buffer_size < 0)
-        copy_buffer_size = KERNEL_PIPE_BUFFER_SIZE;
+    char *record = concat_path_file(CRASH_LOOPS_DIR, fingerprint);
+    enum crash_loop_status result = CRASH_LOOP_UNKNOWN;
 
-    ssize_t to_write = copy_buffer_size;
-    for (;;)
+    int record_fd = open(record, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (record_fd < 0)
+        goto finito;
+
+    struct stat sb;
+    if (fstat(record_fd, &sb) != 0
+        || !S_ISREG(sb.st_mode)
+        || (unsigned)(time(NULL) - sb.st_mtime) >= period)
+        goto finito;
+
+    char problem_dir[PATH_MAX];
+    ssize_t r = full_read(record_fd, problem_dir, sizeof(problem_dir) - 1);
+    if (r <= 0)
+        goto finito;
+    problem_dir[r] = '\0';
+
+    /* Do not trust the record blindly */
+    const size_t loc_len = strlen(g_settings_dump_location);
+    if (strncmp(problem_dir, g_settings_dump_location, loc_len) != 0
+        || problem_dir[loc_len] != '/'
+        || !str_is_correct_filename(problem_dir + loc_len + 1))
     {
-        if (cp[1] >= 0)
-        {
-            to_write = tee(STDIN_FILENO, cp[1], copy_buffer_size, 0);
+        log_notice("Ignoring invalid crash loop record '%s'", record);
+        goto finito;
+    }
 
-            /* Check EOF. */
-            if (to_write == 0)
-                break;
+    struct dump_dir *loop_dd = dd_opendir(problem_dir, DD_FAIL_QUIETLY_ENOENT);
+    if (loop_dd == NULL)
+    {
+        /* abrt-server moves processed problems to shards */
+        char *sharded = dump_location_shard_path(g_settings_dump_location, problem_dir + loc_len + 1);
+        loop_dd = dd_opendir(sharded, DD_FAIL_QUIETLY_ENOENT);
+        free(sharded);
+    }
 
-            if (to_write < 0)
-            {
-                perror_msg("Cannot duplicate stdin buffer for core file");
-                pipe_close(cp);
-                to_write = copy_buffer_size;
-            }
-        }
+    if (loop_dd == NULL)
+    {
+        /* The problem has been deleted in the meantime */
+        unlink(record);
+        goto finito;
+    }
 
-        size_t to_splice = to_write;
-        if (*spliced_core_size + to_splice > spliced_core_limit)
-            to_splice = spliced_core_limit - *spliced_core_size;
+    /* abrtd creates 'count' when post-create is finished; a dump directory
+     * without it can still turn out to be a duplicate or to be deleted. */
+    char *count_str = dd_load_text_ext(loop_dd, FILENAME_COUNT,
+            DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE | DD_FAIL_QUIETLY_ENOENT);
+    if (count_str == NULL)
+    {
+        dd_close(loop_dd);
+        result = CRASH_LOOP_PENDING;
+        goto finito;
+    }
 
-        const size_t spliced = xsplice_full(STDIN_FILENO, spliced_fd, to_splice);
-        *spliced_core_size += spliced;
+    unsigned long count = strtoul(count_str, NULL, 10);
+    free(count_str);
 
-        if (cp[0] >= 0)
-        {
-            size_t to_tee = to_write;
-            if (*teed_core_size + to_tee > teed_core_limit)
-                to_tee = teed_core_limit - *teed_core_size;
+    char new_count_str[sizeof(long)*3 + 2];
+    sprintf(new_count_str, "%lu", count + 1);
+    dd_save_text(loop_dd, FILENAME_COUNT, new_count_str);
+    dd_save_text(loop_dd, FILENAME_LAST_OCCURRENCE, time_str);
+    problem_summary_save(loop_dd);
+    dd_close(loop_dd);
 
-            const ssize_t teed = splice_full(cp[0], teed_fd, to_tee);
-            if (teed < 0)
-            {
-                perror_msg("Cannot splice teed data to core file");
-                pipe_close(cp);
-                to_write = copy_buffer_size;
-            }
-            else
-                *teed_core_size += teed;
+    /* Slide the window */
+    if (futimens(record_fd, NULL) != 0)
+        perror_msg("Can't update time stamp of '%s'", record);
 
-            if (*teed_core_size >= teed_core_limit)
-            {
-                pipe_close(cp);
-                to_write = copy_buffer_size;
-            }
-        }
+    log_notice("Crash loop: updated %s (count %lu)", problem_dir, count + 1);
+    result = CRASH_LOOP_COALESCED;
 
-        /* Check EOF. */
-        if (spliced == 0 || *spliced_core_size >= spliced_core_limit)
-            break;
+finito:
+    if (record_fd >= 0)
+        close(record_fd);
+    free(record);
+    return result;
+}
+
+/* Remembers PROBLEM_DIR as the first occurrence of the FINGERPRINT crash */
+static void record_crash_loop(const char *fingerprint, const char *problem_dir, pid_t pid)
+{
+    if (mkdir(CRASH_LOOPS_DIR, 0700) != 0 && errno != EEXIST)
+    {
+        perror_msg("Can't create directory '%s'", CRASH_LOOPS_DIR);
+        return;
     }
 
-    int r = 0;
-    if (cp[0] < 0)
+    char *record = concat_path_file(CRASH_LOOPS_DIR, fingerprint);
+    char *tmp_record = xasprintf("%s.%ld.new", record, (long)pid);
+
+    int record_fd = open(tmp_record, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (record_fd < 0)
     {
-        if (abrt_limit < user_limit)
-            r |= DUMP_ABRT_CORE_FAILED;
-        else
-            r |= DUMP_USER_CORE_FAILED;
+        perror_msg("Can't create crash loop record '%s'", tmp_record);
+        goto finito;
     }
-    else
-        pipe_close(cp);
 
-    return r;
+    const size_t len = strlen(problem_dir);
+    if (full_write(record_fd, problem_dir, len) != (ssize_t)len || close(record_fd) != 0)
+    {
+        perror_msg("Can't write crash loop record '%s'", tmp_record);
+        unlink(tmp_record);
+        goto finito;
+    }
+
+    /* Atomically replace the stale record, if any */
+    if (rename(tmp_record, record) != 0)
+    {
+        perror_msg("Can't rename '%s' to '%s'", tmp_record, record);
+        unlink(tmp_record);
+    }
+
+finito:
+    free(tmp_record);
+    free(record);
+}
+
+static void dump_abrt_process(pid_t pid, const char *executable)
+{
+    /* If abrtd/abrt-foo crashes, we don't want to create a _directory_,
+     * since that can make new copy of abrtd to process it,
+     * and maybe crash again...
+     * Unlike dirs, mere files are ignored by abrtd.
+     */
+    const char *basename = strrchr(executable, '/') + 1;
+    char *path = xasprintf("%s/%s-coredump", g_settings_dump_location, basename);
+    unlink(path);
+    int abrt_core_fd = xopen3(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    off_t core_size = splice_entire_per_partes(&core_capture, abrt_core_fd, SIZE_MAX);
+    if (core_size < 0 || fsync(abrt_core_fd) != 0 || close(abrt_core_fd) < 0)
+    {
+        unlink(path);
+        /* copyfd_eof logs the error including errno string,
+         * but it does not log file name */
+        error_msg_and_die("Error saving '%s'", path);
+    }
+    log_notice("Saved core dump of pid %lu (%s) to %s (%llu bytes, %.1f MB/s)", (long)pid, basename, path,
+            (long long)core_size, core_capture_rate(&core_capture));
+    free(path);
 }
 
 enum create_core_backtrace_status
@@ -846,6 +1901,10 @@ int main(int argc, char** argv)
     if (fd > 2)
         close(fd);
 
+    /* Grow the pipe first, so the kernel can go on dumping while we read
+     * the configuration and /proc */
+    core_capture_init(&core_capture, STDIN_FILENO);
+
     int err = 1;
     logmode = LOGMODE_JOURNAL;
 
@@ -868,6 +1927,8 @@ int main(int argc, char** argv)
     bool setting_CreateCoreBacktrace;
     bool setting_SaveContainerizedPackageData;
     bool setting_StandaloneHook;
+    bool setting_CoalesceCrashLoops;
+    unsigned int setting_CoalesceCrashLoopsPeriod = 3600;
     unsigned int setting_MaxCoreFileSize = g_settings_nMaxCrashReportsSize;
 
     GList *setting_ignored_paths = NULL;
@@ -913,6 +1974,30 @@ int main(int argc, char** argv)
 
         value = get_map_string_item_or_NULL(settings, "StandaloneHook");
         setting_StandaloneHook = value && string_to_bool(value);
+
+        value = get_map_string_item_or_NULL(settings, "SparseCore");
+        g_sparse_core = value && string_to_bool(value);
+
+        value = get_map_string_item_or_NULL(settings, "MinidumpCore");
+        if (value && string_to_bool(value))
+        {
+#if MINIDUMP_MACHINE == EM_NONE
+            log_warning("Ignoring MinidumpCore because it is not supported on this architecture");
+#else
+            g_core_filter |= CORE_FILTER_MINIDUMP;
+#endif
+        }
+
+        value = get_map_string_item_or_NULL(settings, "ElideMappedFiles");
+        if (value && string_to_bool(value))
+            g_core_filter |= CORE_FILTER_MAPPED_FILES;
+
+        value = get_map_string_item_or_NULL(settings, "CoalesceCrashLoops");
+        setting_CoalesceCrashLoops = value && string_to_bool(value);
+        value = get_map_string_item_or_NULL(settings, "CoalesceCrashLoopsPeriod");
+        if (value && !try_get_map_string_item_as_uint(settings, "CoalesceCrashLoopsPeriod", &setting_CoalesceCrashLoopsPeriod))
+            log_warning("The CoalesceCrashLoopsPeriod option in the CCpp.conf file holds an invalid value");
+
         value = get_map_string_item_or_NULL(settings, "VerboseLog");
         if (value)
             g_verbose = xatoi_positive(value);
@@ -1021,6 +2106,8 @@ int main(int argc, char** argv)
         }
     }
 
+    char *crash_fingerprint = NULL;
+
     snprintf(path, sizeof(path), "%s/last-ccpp", g_settings_dump_location);
 
     char *executable = get_executable_at(pid_proc_fd);
@@ -1144,10 +2231,31 @@ int main(int argc, char** argv)
         }
     }
 
+    /* crash loop - the same crash of the same executable has been recently
+     * captured, do not waste time and space on capturing it again */
+    enum crash_loop_status crash_loop = CRASH_LOOP_UNKNOWN;
+    if (setting_CoalesceCrashLoops && setting_CoalesceCrashLoopsPeriod > 0 && executable && !abrt_crash)
+    {
+        crash_fingerprint = get_crash_fingerprint_at(pid_proc_fd, executable, uid, signal_no);
+        if (crash_fingerprint)
+            crash_loop = coalesce_crash_loop(crash_fingerprint, setting_CoalesceCrashLoopsPeriod, argv[6]);
+
+        if (crash_loop == CRASH_LOOP_COALESCED)
+        {
+            metrics_counter_add("abrt_hook_ccpp_coalesced_crashes_total", 1);
+            error_msg_ignore_crash(pid_str, last_slash, (long unsigned)uid, signal_no,
+                    signame, "crash loop");
+            free(crash_fingerprint);
+            return create_user_core(user_core_fd, pid, ulimit_c);
+        }
+    }
+
     // processing crash - inform user about it
     error_msg_process_crash(pid_str, last_slash, (long unsigned)uid,
                 signal_no, signame, "dumping core");
 
+    const gint64 capture_start = g_get_monotonic_time();
+
     pid_t tid = -1;
     const char *tid_str = argv[8];
     if (tid_str)
@@ -1186,54 +2294,12 @@ int main(int argc, char** argv)
     if (dd)
     {
         char source_filename[sizeof("/proc/%lu/somewhat_long_name") + sizeof(long)*3];
-        int source_base_ofs = sprintf(source_filename, "/proc/%lu/root", (long)pid);
-        source_base_ofs -= strlen("root");
+        sprintf(source_filename, "/proc/%lu/root", (long)pid);
 
         /* What's wrong on using /proc/[pid]/root every time ?*/
         /* It creates os_info_in_root_dir for all crashes. */
         char *rootdir = process_has_own_root_at(pid_proc_fd) ? get_rootdir_at(pid_proc_fd) : NULL;
 
-        /* Reading data from an arbitrary root directory is not secure. */
-        if (g_settings_explorechroots)
-        {
-            /* Yes, test 'rootdir' but use 'source_filename' because 'rootdir' can
-             * be '/' for a process with own namespace. 'source_filename' is /proc/[pid]/root. */
-            dd_create_basic_files(dd, fsuid, (rootdir != NULL) ? source_filename : NULL);
-        }
-        else
-        {
-            dd_create_basic_files(dd, fsuid, NULL);
-        }
-
-        // Disabled for now: /proc/PID/smaps tends to be BIG,
-        // and not much more informative than /proc/PID/maps:
-        // dd_copy_file_at(dd, FILENAME_SMAPS, pid_proc_fd, "smaps");
-
-        dd_copy_file_at(dd, FILENAME_MAPS, pid_proc_fd, "maps");
-        dd_copy_file_at(dd, FILENAME_LIMITS, pid_proc_fd, "limits");
-        dd_copy_file_at(dd, FILENAME_CGROUP, pid_proc_fd, "cgroup");
-        dd_copy_file_at(dd, FILENAME_MOUNTINFO, pid_proc_fd, "mountinfo");
-
-        FILE *open_fds = dd_open_item_file(dd, FILENAME_OPEN_FDS, O_RDWR);
-        if (open_fds != NULL)
-        {
-            if (dump_fd_info_at(pid_proc_fd, open_fds) < 0)
-                dd_delete_item(dd, FILENAME_OPEN_FDS);
-            fclose(open_fds);
-        }
-
-        const int init_proc_dir_fd = open_proc_pid_dir(1);
-        FILE *namespaces = dd_open_item_file(dd, FILENAME_NAMESPACES, O_RDWR);
-        if (namespaces != NULL && init_proc_dir_fd >= 0)
-        {
-            if (dump_namespace_diff_at(init_proc_dir_fd, pid_proc_fd, namespaces) < 0)
-                dd_delete_item(dd, FILENAME_NAMESPACES);
-        }
-        if (init_proc_dir_fd >= 0)
-            close(init_proc_dir_fd);
-        if (namespaces != NULL)
-            fclose(namespaces);
-
         /* There's no need to compare mount namespaces and search for '/' in
          * mountifo.  Comparison of inodes of '/proc/[pid]/root' and '/' works
          * fine. If those inodes do not equal each other, we have to verify
@@ -1241,16 +2307,17 @@ int main(int argc, char** argv)
          */
         const int containerized = (rootdir != NULL && strcmp(rootdir, "/") == 0);
         if (containerized)
-        {
             log_debug("Process %d is considered to be containerized", pid);
-            pid_t container_pid;
-            if (get_pid_of_container_at(pid_proc_fd, &container_pid) == 0)
-            {
-                char *container_cmdline = get_cmdline(container_pid);
-                dd_save_text(dd, FILENAME_CONTAINER_CMDLINE, container_cmdline);
-                free(container_cmdline);
-            }
-        }
+
+        /* Reading data from an arbitrary root directory is not secure.
+         * Yes, test 'rootdir' but use 'source_filename' because 'rootdir' can
+         * be '/' for a process with own namespace. 'source_filename' is /proc/[pid]/root. */
+        proc_collector.dd = dd;
+        proc_collector.pid_proc_fd = pid_proc_fd;
+        proc_collector.fsuid = fsuid;
+        proc_collector.chroot_dir = (g_settings_explorechroots && rootdir != NULL) ? xstrdup(source_filename) : NULL;
+        proc_collector.containerized = containerized;
+        start_collecting_proc_data(&proc_collector);
 
         dd_save_text(dd, FILENAME_ANALYZER, "abrt-ccpp");
         dd_save_text(dd, FILENAME_TYPE, "CCpp");
@@ -1275,22 +2342,6 @@ int main(int argc, char** argv)
         dd_save_text(dd, FILENAME_REASON, reason);
         free(reason);
 
-        char *cmdline = get_cmdline_at(pid_proc_fd);
-        dd_save_text(dd, FILENAME_CMDLINE, cmdline ? : "");
-        free(cmdline);
-
-        char *environ = get_environ_at(pid_proc_fd);
-        dd_save_text(dd, FILENAME_ENVIRON, environ ? : "");
-        free(environ);
-
-        char *fips_enabled = xmalloc_fopen_fgetline_fclose("/proc/sys/crypto/fips_enabled");
-        if (fips_enabled)
-        {
-            if (strcmp(fips_enabled, "0") != 0)
-                dd_save_text(dd, "fips_enabled", fips_enabled);
-            free(fips_enabled);
-        }
-
         dd_save_text(dd, FILENAME_ABRT_VERSION, VERSION);
 
         /* In case of errors, treat the process as if it has locked memory */
@@ -1357,9 +2408,38 @@ int main(int argc, char** argv)
                 else
                     abrt_limit = SIZE_MAX;
 
-                if (user_core_fd < 0)
+                if (g_core_filter != 0)
+                {
+                    size_t user_limit = user_core_fd >= 0 ? ulimit_c : 0;
+                    char *manifest = NULL;
+                    const int r = dump_filtered_core_file(&core_capture, abrt_core_fd, &abrt_limit,
+                                                          user_core_fd, &user_limit,
+                                                          g_core_filter, pid_proc_fd, &manifest);
+
+                    if (user_core_fd >= 0)
+                        close_user_core(user_core_fd, (r & DUMP_USER_CORE_FAILED) ? -1 : user_limit);
+
+                    if (!(r & DUMP_ABRT_CORE_FAILED))
+                        core_size = abrt_limit;
+
+                    if (manifest != NULL)
+                        dd_save_text(dd, FILENAME_COREDUMP_ELIDED, manifest);
+                    free(manifest);
+                }
+                else if (g_sparse_core)
+                {
+                    size_t user_limit = user_core_fd >= 0 ? ulimit_c : 0;
+                    const int r = dump_sparse_core_files(&core_capture, abrt_core_fd, &abrt_limit, user_core_fd, &user_limit);
+
+                    if (user_core_fd >= 0)
+                        close_user_core(user_core_fd, (r & DUMP_USER_CORE_FAILED) ? -1 : user_limit);
+
+                    if (!(r & DUMP_ABRT_CORE_FAILED))
+                        core_size = abrt_limit;
+                }
+                else if (user_core_fd < 0)
                 {
-                    const ssize_t r = splice_entire_per_partes(STDIN_FILENO, abrt_core_fd, abrt_limit);
+                    const ssize_t r = splice_entire_per_partes(&core_capture, abrt_core_fd, abrt_limit);
                     if (r < 0)
                         perror_msg("Failed to write ABRT core file");
                     else
@@ -1368,7 +2448,7 @@ int main(int argc, char** argv)
                 else
                 {
                     size_t user_limit = ulimit_c;
-                    const int r = dump_two_core_files(abrt_core_fd, &abrt_limit, user_core_fd, &user_limit);
+                    const int r = dump_two_core_files(&core_capture, abrt_core_fd, &abrt_limit, user_core_fd, &user_limit);
 
                     close_user_core(user_core_fd, (r & DUMP_USER_CORE_FAILED) ? -1 : user_limit);
 
@@ -1389,6 +2469,11 @@ int main(int argc, char** argv)
         /* User core is either written or closed */
         user_core_fd = -1;
 
+        const gint64 stream_duration = g_get_monotonic_time() - capture_start;
+        finish_collecting_proc_data(&proc_collector);
+        log_info("Collected /proc data in %lld ms while streaming the core in %lld ms",
+                 (long long)(proc_collector.duration / 1000), (long long)(stream_duration / 1000));
+
         /*
          * ! No other errors should cause removal of the user core !
          */
@@ -1460,6 +2545,7 @@ int main(int argc, char** argv)
         /* Make sure we closed STDIN_FILENO to let kernel to wipe out the process. */
         if (!(cbr & CB_STDIN_CLOSED))
             close(STDIN_FILENO);
+        const gint64 reap_time = g_get_monotonic_time();
 
         /* We close dumpdir before we start catering for crash storm case.
          * Otherwise, delete_dump_dir's from other concurrent
@@ -1478,12 +2564,25 @@ int main(int argc, char** argv)
         free(newpath);
 
         if (core_size > 0)
-            log_notice("Saved core dump of pid %lu (%s) to %s (%zu bytes)",
-                       (long)pid, executable, path, core_size);
+            log_notice("Saved core dump of pid %lu (%s) to %s (%zu bytes, %.1f MB/s)",
+                       (long)pid, executable, path, core_size, core_capture_rate(&core_capture));
 
         if (abrtd_running)
             notify_new_path(path);
 
+        /* Do not replace a record of a problem which is still being
+         * processed; this one is likely to be its duplicate. */
+        if (crash_fingerprint && crash_loop == CRASH_LOOP_UNKNOWN)
+            record_crash_loop(crash_fingerprint, path, pid);
+
+        metrics_counter_add("abrt_hook_ccpp_problems_total", 1);
+        metrics_counter_add("abrt_hook_ccpp_core_bytes_total", core_size);
+        metrics_observe_seconds("abrt_hook_ccpp_capture_seconds",
+                (g_get_monotonic_time() - capture_start) / (double)G_USEC_PER_SEC);
+        metrics_observe_seconds("abrt_hook_ccpp_reap_seconds",
+                (reap_time - capture_start) / (double)G_USEC_PER_SEC);
+        metrics_flush("abrt-hook-ccpp");
+
         /* rhbz#539551: "abrt going crazy when crashing process is respawned" */
         if (g_settings_nMaxCrashReportsSize > 0)
         {
@@ -1504,6 +2603,10 @@ int main(int argc, char** argv)
     }
 
 cleanup_and_exit:
+    free(crash_fingerprint);
+
+    finish_collecting_proc_data(&proc_collector);
+
     if (dd)
         dd_delete(dd);
 
@@ -0,0 +1,467 @@
+/*
+    Copyright (C) 2016  ABRT team
+    Copyright (C) 2016  RedHat Inc
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Core capture
+ *
+ * Moves the core from the core_pattern pipe to the ABRT and/or the user core
+ * file. Shared by abrt-hook-ccpp and abrt-capture-benchmark, which feeds
+ * synthetic cores through the same code.
+ */
+
+#include "core-capture.h"
+
+/* Throughput is sampled after every window of this many bytes */
+#define CAPTURE_WINDOW_SIZE (8 * 1024 * 1024)
+
+static size_t pipe_max_size(void)
+{
+    static size_t max_size;
+    if (max_size != 0)
+        return max_size;
+
+    max_size = KERNEL_PIPE_BUFFER_SIZE;
+    char *value = xmalloc_fopen_fgetline_fclose("/proc/sys/fs/pipe-max-size");
+    if (value != NULL)
+    {
+        char *end;
+        errno = 0;
+        const unsigned long size = strtoul(value, &end, 10);
+        if (errno == 0 && *end == '\0' && size > max_size && size <= INT_MAX)
+            max_size = size;
+        free(value);
+    }
+
+    return max_size;
+}
+
+size_t pipe_raise_size(int fd)
+{
+    int size = fcntl(fd, F_GETPIPE_SZ);
+    if (size < 0)
+        return KERNEL_PIPE_BUFFER_SIZE;
+
+    /* F_SETPIPE_SZ fails with EPERM if the user is over the pipe-user-pages
+     * limits and with EBUSY if the pipe contains more data, so try smaller
+     * sizes before giving up.
+     */
+    for (size_t wanted = pipe_max_size(); wanted > (size_t)size; wanted /= 2)
+    {
+        const int r = fcntl(fd, F_SETPIPE_SZ, (int)wanted);
+        if (r >= 0)
+        {
+            size = r;
+            break;
+        }
+    }
+
+    log_debug("Pipe buffer size is %d bytes", size);
+    return size < KERNEL_PIPE_BUFFER_SIZE ? KERNEL_PIPE_BUFFER_SIZE : size;
+}
+
+void core_capture_init(struct core_capture *cap, int fd)
+{
+    memset(cap, 0, sizeof(*cap));
+    cap->fd = fd;
+    cap->pipe_size = pipe_raise_size(fd);
+    cap->chunk = cap->pipe_size;
+    /* Start with the biggest chunk and try a smaller one first */
+    cap->step = -1;
+    core_capture_begin(cap);
+}
+
+void core_capture_begin(struct core_capture *cap)
+{
+    cap->start = cap->end = cap->window_start = g_get_monotonic_time();
+    cap->bytes = cap->window_bytes = 0;
+    cap->window_rate = 0;
+}
+
+void core_capture_account(struct core_capture *cap, size_t bytes)
+{
+    cap->end = g_get_monotonic_time();
+    cap->bytes += bytes;
+    cap->window_bytes += bytes;
+    if (cap->window_bytes < CAPTURE_WINDOW_SIZE)
+        return;
+
+    const double rate = cap->window_bytes / (double)MAX(cap->end - cap->window_start, 1);
+
+    /* The last change made it slower, go back */
+    if (rate < cap->window_rate)
+        cap->step = -cap->step;
+
+    size_t chunk = cap->step > 0 ? cap->chunk * 2 : cap->chunk / 2;
+    if (chunk > cap->pipe_size || chunk < KERNEL_PIPE_BUFFER_SIZE)
+    {
+        cap->step = -cap->step;
+        chunk = cap->chunk;
+    }
+
+    if (chunk != cap->chunk)
+        log_debug("Capture rate %.1f MB/s, chunk size %zu -> %zu", rate, cap->chunk, chunk);
+
+    cap->chunk = chunk;
+    cap->window_rate = rate;
+    cap->window_start = cap->end;
+    cap->window_bytes = 0;
+}
+
+double core_capture_rate(const struct core_capture *cap)
+{
+    /* bytes per microsecond == MB/s */
+    return cap->bytes / (double)MAX(cap->end - cap->start, 1);
+}
+
+ssize_t splice_entire_per_partes(struct core_capture *cap, int out_fd, size_t size_limit)
+{
+    core_capture_begin(cap);
+
+    size_t bytes = 0;
+    while (bytes < size_limit)
+    {
+        size_t soft_limit = cap->chunk;
+        const size_t hard_limit = size_limit - bytes;
+        if (hard_limit < soft_limit)
+            soft_limit = hard_limit;
+
+        const ssize_t copied = splice(cap->fd, NULL, out_fd, NULL, soft_limit, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (copied < 0)
+            return copied;
+
+        bytes += copied;
+        core_capture_account(cap, copied);
+
+        /* Check EOF. */
+        if (copied == 0)
+            break;
+    }
+
+    return bytes;
+}
+
+/* Returns true if the block contains only zero bytes.
+ *
+ * Comparing the block with itself shifted by one byte lets memcmp() do the
+ * work and the libc implementation of memcmp() is vectorized.
+ */
+static bool is_zero_block(const char *block, size_t size)
+{
+    return size == 0 || (block[0] == '\0' && memcmp(block, block + 1, size - 1) == 0);
+}
+
+/* Writes the non-zero pages of BUF to FD at offset OFS. All-zero pages are
+ * skipped and left as holes in the file. LIMIT is the number of bytes of BUF
+ * that may be written.
+ */
+static int pwrite_sparse(int fd, const char *buf, size_t limit, off_t ofs, size_t page_size)
+{
+    size_t pos = 0;
+    while (pos < limit)
+    {
+        /* Skip a run of zero pages */
+        size_t len = page_size < limit - pos ? page_size : limit - pos;
+        if (is_zero_block(buf + pos, len))
+        {
+            pos += len;
+            continue;
+        }
+
+        /* Find the end of the run of non-zero pages */
+        size_t end = pos + len;
+        while (end < limit)
+        {
+            len = page_size < limit - end ? page_size : limit - end;
+            if (is_zero_block(buf + end, len))
+                break;
+            end += len;
+        }
+
+        size_t written = 0;
+        while (written < end - pos)
+        {
+            const ssize_t w = pwrite(fd, buf + pos + written, end - pos - written, ofs + pos + written);
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            written += w;
+        }
+
+        pos = end;
+    }
+
+    return 0;
+}
+
+/* Sparse creation of the ABRT and/or the user core file
+ *
+ * Kernel writes zero pages of the crashed process to the pipe as well, which
+ * makes core files of processes with huge sparse address spaces occupy
+ * gigabytes of disk space. This function reads the core from the pipe and
+ * writes only the pages containing non-zero bytes. The zero pages are left as
+ * holes and a final ftruncate() sets the right file size, so the files are
+ * never fully materialized on disk.
+ *
+ * Any of the out fds can be -1. The limits are updated to the number of bytes
+ * read for the corresponding file.
+ */
+int dump_sparse_core_files(struct core_capture *cap, int abrt_core_fd, size_t *abrt_limit,
+        int user_core_fd, size_t *user_limit)
+{
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    core_capture_begin(cap);
+    char *buffer = xmalloc(cap->pipe_size);
+
+    const size_t abrt_core_limit = abrt_core_fd >= 0 ? *abrt_limit : 0;
+    const size_t user_core_limit = user_core_fd >= 0 ? *user_limit : 0;
+    const size_t limit = abrt_core_limit > user_core_limit ? abrt_core_limit : user_core_limit;
+
+    int r = 0;
+    size_t total = 0;
+    while (total < limit)
+    {
+        size_t to_read = cap->chunk;
+        if (to_read > limit - total)
+            to_read = limit - total;
+
+        /* full_read() keeps the file offsets page aligned */
+        const ssize_t rd = full_read(cap->fd, buffer, to_read);
+        if (rd < 0)
+        {
+            perror_msg("Failed to read core dump from stdin");
+            r |= DUMP_ABRT_CORE_FAILED | DUMP_USER_CORE_FAILED;
+            break;
+        }
+
+        if (rd == 0)
+            break;
+
+        core_capture_account(cap, rd);
+
+        if (!(r & DUMP_ABRT_CORE_FAILED) && total < abrt_core_limit)
+        {
+            const size_t len = MIN((size_t)rd, abrt_core_limit - total);
+            if (pwrite_sparse(abrt_core_fd, buffer, len, total, page_size) < 0)
+            {
+                perror_msg("Failed to write ABRT core file");
+                r |= DUMP_ABRT_CORE_FAILED;
+            }
+        }
+
+        if (!(r & DUMP_USER_CORE_FAILED) && total < user_core_limit)
+        {
+            const size_t len = MIN((size_t)rd, user_core_limit - total);
+            if (pwrite_sparse(user_core_fd, buffer, len, total, page_size) < 0)
+            {
+                perror_msg("Failed to write user core file");
+                r |= DUMP_USER_CORE_FAILED;
+            }
+        }
+
+        total += rd;
+    }
+
+    free(buffer);
+
+    /* Trailing zero pages were not written at all */
+    *abrt_limit = MIN(total, abrt_core_limit);
+    if (abrt_core_fd >= 0 && !(r & DUMP_ABRT_CORE_FAILED) && ftruncate(abrt_core_fd, *abrt_limit) != 0)
+    {
+        perror_msg("Failed to set size of ABRT core file");
+        r |= DUMP_ABRT_CORE_FAILED;
+    }
+
+    *user_limit = MIN(total, user_core_limit);
+    if (user_core_fd >= 0 && !(r & DUMP_USER_CORE_FAILED) && ftruncate(user_core_fd, *user_limit) != 0)
+    {
+        perror_msg("Failed to set size of user core file");
+        r |= DUMP_USER_CORE_FAILED;
+    }
+
+    struct stat sb;
+    if (g_verbose >= 1 && abrt_core_fd >= 0 && fstat(abrt_core_fd, &sb) == 0)
+        log_info("ABRT core file: %zu bytes, %llu bytes allocated", *abrt_limit, (unsigned long long)sb.st_blocks * 512);
+    if (g_verbose >= 1 && user_core_fd >= 0 && fstat(user_core_fd, &sb) == 0)
+        log_info("User core file: %zu bytes, %llu bytes allocated", *user_limit, (unsigned long long)sb.st_blocks * 512);
+
+    return r;
+}
+
+static ssize_t splice_full(int in_fd, int out_fd, size_t size)
+{
+    ssize_t total = 0;
+    while (size != 0)
+    {
+        const ssize_t b = splice(in_fd, NULL, out_fd, NULL, size, 0);
+        if (b < 0)
+            return b;
+
+        if (b == 0)
+            break;
+
+        total += b;
+        size -= b;
+    }
+
+    return total;
+}
+
+static size_t xsplice_full(int in_fd, int out_fd, size_t size)
+{
+    const ssize_t r = splice_full(in_fd, out_fd, size);
+    if (r < 0)
+        perror_msg_and_die("Failed to write core dump to file");
+    return (size_t)r;
+}
+
+static void pipe_close(int *pfds)
+{
+    close(pfds[0]);
+    close(pfds[1]);
+    pfds[0] = pfds[1] = -1;
+}
+
+/* Optimized creation of two core files - ABRT and CWD
+ *
+ * The simplest optimization is to avoid the need to copy data to user space.
+ * In that case we cannot read data once and write them twice as we do with
+ * read/write approach because there is no syscall forwarding data from a
+ * single source fd to several destination fds (one might claim that there is
+ * tee() function but such a solution is suboptimal from our perspective).
+ *
+ * So the function first create ABRT core file and then creates user core file.
+ * If ABRT limit made the ABRT core to be smaller than allowed user core size,
+ * then the function reads more data from the pipe and appends them to the user
+ * core file.
+ *
+ * We must not read from the user core fd because that operation might be
+ * refused by OS.
+ */
+int dump_two_core_files(struct core_capture *cap, int abrt_core_fd, size_t *abrt_limit,
+        int user_core_fd, size_t *user_limit)
+{
+   /* tee() does not move the in_fd, thus you need to call splice to be
+    * get next chunk of data loaded into the in_fd buffer.
+    * So, calling tee() without splice() would be looping on the same
+    * data. Hence, we must ensure that after tee() we call splice() and
+    * that would be problematic if tee core limit is greater than splice
+    * core limit. Therefore, we swap the out fds based on their limits.
+    */
+    int    spliced_fd          = *abrt_limit > *user_limit ? abrt_core_fd    : user_core_fd;
+    size_t spliced_core_limit  = *abrt_limit > *user_limit ? *abrt_limit     : *user_limit;
+    int    teed_fd             = *abrt_limit > *user_limit ? user_core_fd    : abrt_core_fd;
+    size_t teed_core_limit     = *abrt_limit > *user_limit ? *user_limit     : *abrt_limit;
+
+    size_t *spliced_core_size  = *abrt_limit > *user_limit ? abrt_limit : user_limit;
+    size_t *teed_core_size     = *abrt_limit > *user_limit ? user_limit : abrt_limit;
+
+    *spliced_core_size = *teed_core_size = 0;
+
+    core_capture_begin(cap);
+
+    int cp[2] = { -1, -1 };
+    size_t cp_size = 0;
+    if (pipe(cp) < 0)
+    {
+        perror_msg("Failed to create temporary pipe for core file");
+        cp[0] = cp[1] = -1;
+    }
+    else
+        cp_size = pipe_raise_size(cp[1]);
+
+    /* tee() can copy duplicate up to size of the pipe buffer bytes.
+     * It should not be problem to ask for more (in that case, tee would simply
+     * duplicate up to the limit bytes) but I would rather not to exceed
+     * the pipe buffer limit.
+     */
+    size_t copy_buffer_size = cap->chunk;
+
+    ssize_t to_write = copy_buffer_size;
+    for (;;)
+    {
+        copy_buffer_size = cap->chunk;
+        if (cp[1] >= 0)
+        {
+            to_write = tee(cap->fd, cp[1], MIN(copy_buffer_size, cp_size), 0);
+
+            /* Check EOF. */
+            if (to_write == 0)
+                break;
+
+            if (to_write < 0)
+            {
+                perror_msg("Cannot duplicate stdin buffer for core file");
+                pipe_close(cp);
+                to_write = copy_buffer_size;
+            }
+        }
+
+        size_t to_splice = to_write;
+        if (*spliced_core_size + to_splice > spliced_core_limit)
+            to_splice = spliced_core_limit - *spliced_core_size;
+
+        const size_t spliced = xsplice_full(cap->fd, spliced_fd, to_splice);
+        *spliced_core_size += spliced;
+        core_capture_account(cap, spliced);
+
+        if (cp[0] >= 0)
+        {
+            size_t to_tee = to_write;
+            if (*teed_core_size + to_tee > teed_core_limit)
+                to_tee = teed_core_limit - *teed_core_size;
+
+            const ssize_t teed = splice_full(cp[0], teed_fd, to_tee);
+            if (teed < 0)
+            {
+                perror_msg("Cannot splice teed data to core file");
+                pipe_close(cp);
+                to_write = copy_buffer_size;
+            }
+            else
+                *teed_core_size += teed;
+
+            if (*teed_core_size >= teed_core_limit)
+            {
+                pipe_close(cp);
+                to_write = copy_buffer_size;
+            }
+        }
+
+        /* Check EOF. */
+        if (spliced == 0 || *spliced_core_size >= spliced_core_limit)
+            break;
+    }
+
+    int r = 0;
+    if (cp[0] < 0)
+    {
+        if (abrt_limit < user_limit)
+            r |= DUMP_ABRT_CORE_FAILED;
+        else
+            r |= DUMP_USER_CORE_FAILED;
+    }
+    else
+        pipe_close(cp);
+
+    return r;
+}
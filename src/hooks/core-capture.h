@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2016  ABRT team
+    Copyright (C) 2016  RedHat Inc
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef _CORE_CAPTURE_H_
+#define _CORE_CAPTURE_H_
+
+#include "libabrt.h"
+
+#define KERNEL_PIPE_BUFFER_SIZE 65536
+
+enum dump_core_files_ret_flags {
+    DUMP_ABRT_CORE_FAILED  = 0x0001,
+    DUMP_USER_CORE_FAILED  = 0x0100,
+};
+
+/* State of reading a core from a pipe
+ *
+ * The pipe is grown to /proc/sys/fs/pipe-max-size, so the dumping kernel
+ * blocks less often. The chunk size moves between KERNEL_PIPE_BUFFER_SIZE and
+ * the pipe size in the direction which improved the throughput of the last
+ * sampling window.
+ */
+struct core_capture
+{
+    int fd;
+    size_t pipe_size;
+    size_t chunk;
+
+    gint64 start;
+    gint64 end;
+    size_t bytes;
+
+    gint64 window_start;
+    size_t window_bytes;
+    double window_rate;
+    int step;
+};
+
+void core_capture_init(struct core_capture *cap, int fd);
+
+/* Called by the dump functions when they start reading */
+void core_capture_begin(struct core_capture *cap);
+
+/* Records BYTES read from the pipe and adapts the chunk size */
+void core_capture_account(struct core_capture *cap, size_t bytes);
+
+/* Returns MB/s achieved since core_capture_begin() */
+double core_capture_rate(const struct core_capture *cap);
+
+/* Grows the pipe to pipe-max-size if permitted, returns the resulting size */
+size_t pipe_raise_size(int fd);
+
+ssize_t splice_entire_per_partes(struct core_capture *cap, int out_fd, size_t size_limit);
+
+int dump_sparse_core_files(struct core_capture *cap, int abrt_core_fd, size_t *abrt_limit,
+        int user_core_fd, size_t *user_limit);
+
+int dump_two_core_files(struct core_capture *cap, int abrt_core_fd, size_t *abrt_limit,
+        int user_core_fd, size_t *user_limit);
+
+#endif /*_CORE_CAPTURE_H_*/
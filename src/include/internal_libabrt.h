@@ -48,3 +48,12 @@ void libabrt_init(void);
     } \
     while (0)
 
+/* Works like load_conf_file_from_dirs() but uses the compiled snapshot of
+ * the files from VAR_RUN/abrt/conf if the files have not been modified.
+ * The directory can be overridden by the ABRT_CONF_SNAPSHOT_DIR environment
+ * variable.
+ */
+#define load_conf_file_from_dirs_cached abrt_load_conf_file_from_dirs_cached
+int load_conf_file_from_dirs_cached(const char *file, const char *const *dirs,
+        map_string_t *settings);
+
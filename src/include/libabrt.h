@@ -48,10 +48,66 @@ void ensure_writable_dir_uid_gid(const char *dir, mode_t mode, uid_t uid, gid_t
 void ensure_writable_dir(const char *dir, mode_t mode, const char *user);
 #define ensure_writable_dir_group abrt_ensure_writable_dir_group
 void ensure_writable_dir_group(const char *dir, mode_t mode, const char *user, const char *group);
+/* Returns the output 'eu-unstrip -n --core=coredump' would print or NULL if
+ * the modules can't be read within TIMEOUT_SEC */
 #define run_unstrip_n abrt_run_unstrip_n
 char *run_unstrip_n(const char *dump_dir_name, unsigned timeout_sec);
+
+/* A module of coredump as reported by 'eu-unstrip -n' */
+struct core_module
+{
+    unsigned long long cm_start;
+    unsigned long long cm_size;
+    /* Hexadecimal build-id or NULL */
+    char *cm_build_id;
+    /* The address of the build-id note or 0 */
+    unsigned long long cm_build_id_vaddr;
+    /* The paths of the ELF and debuginfo files, "." if the file is only in
+     * memory, "-" if it wasn't found and NULL if it wasn't looked up */
+    char *cm_file;
+    char *cm_debug;
+    char *cm_name;
+};
+enum {
+    /* Look up the files of all modules, not only those without build-id */
+    CORE_MODULES_FIND_FILES = 1 << 0,
+};
+/* Reads the modules of coredump (or of coredump.xz) of DD by abrt-core-modules
+ * which is killed after TIMEOUT_SEC, 0 means no limit. MODULES is set to a
+ * list of struct core_module.
+ * Returns 0 or -errno, -ENOENT if there is no coredump and -ETIMEDOUT. */
+#define core_modules_load abrt_core_modules_load
+int core_modules_load(struct dump_dir *dd, int flags, unsigned timeout_sec, GList **modules);
+/* Reads the modules of the coredump opened as FD in the calling process, NAME
+ * of the coredump is used in messages. Returns 0 or -errno. */
+#define core_modules_read abrt_core_modules_read
+int core_modules_read(int fd, const char *name, int flags, GList **modules);
+/* Writes MODULES to FD in the form core_modules_load() reads from
+ * abrt-core-modules. Returns 0 or -errno. */
+#define core_modules_write abrt_core_modules_write
+int core_modules_write(int fd, GList *modules);
+#define core_module_free abrt_core_module_free
+void core_module_free(struct core_module *module);
+#define core_modules_free abrt_core_modules_free
+void core_modules_free(GList *modules);
+/* Formats MODULES like 'eu-unstrip -n' */
+#define core_modules_to_unstrip_n abrt_core_modules_to_unstrip_n
+char *core_modules_to_unstrip_n(GList *modules);
 #define get_backtrace abrt_get_backtrace
 char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char *debuginfo_dirs);
+enum {
+    /* Run abrt-gdb-exploitable, *EXPLOITABLE is NULL if the rating is low */
+    GET_BACKTRACE_EXPLOITABLE = 1 << 0,
+    /* Get the output of "info registers" in *REGISTERS */
+    GET_BACKTRACE_REGISTERS   = 1 << 1,
+};
+/* Like get_backtrace() but the same gdb session runs the analyses selected
+ * by FLAGS, so the core and debuginfo are loaded only once. EXPLOITABLE and
+ * REGISTERS can be NULL. */
+#define get_backtrace_ext abrt_get_backtrace_ext
+char *get_backtrace_ext(const char *dump_dir_name, unsigned timeout_sec, const char *debuginfo_dirs,
+        int flags, char **exploitable, char **registers);
+#define FILENAME_REGISTERS "registers"
 
 #define dir_is_in_dump_location abrt_dir_is_in_dump_location
 bool dir_is_in_dump_location(const char *dir_name);
@@ -83,6 +139,20 @@ extern bool          g_settings_shortenedreporting;
 extern bool          g_settings_explorechroots;
 #define g_settings_debug_level abrt_g_settings_debug_level
 extern unsigned int  g_settings_debug_level;
+#define g_settings_shard_dump_location abrt_g_settings_shard_dump_location
+extern bool          g_settings_shard_dump_location;
+#define g_settings_cold_storage_age abrt_g_settings_cold_storage_age
+extern unsigned int  g_settings_cold_storage_age;
+#define g_settings_share_elements abrt_g_settings_share_elements
+extern bool          g_settings_share_elements;
+#define g_settings_post_create_classes abrt_g_settings_post_create_classes
+extern char *        g_settings_post_create_classes;
+#define g_settings_post_create_max_running abrt_g_settings_post_create_max_running
+extern unsigned int  g_settings_post_create_max_running;
+#define g_settings_post_create_aging_period abrt_g_settings_post_create_aging_period
+extern unsigned int  g_settings_post_create_aging_period;
+#define g_settings_post_create_big_problem_size abrt_g_settings_post_create_big_problem_size
+extern unsigned int  g_settings_post_create_big_problem_size;
 
 
 #define load_abrt_conf abrt_load_abrt_conf
@@ -90,6 +160,15 @@ int load_abrt_conf(void);
 #define free_abrt_conf_data abrt_free_abrt_conf_data
 void free_abrt_conf_data(void);
 
+/* Returns the name of the main configuration file (abrt.conf) */
+#define get_abrt_conf_file_name abrt_get_abrt_conf_file_name
+const char *get_abrt_conf_file_name(void);
+/* Returns NULL terminated list of directories the configuration files are
+ * loaded from; files in later directories override the former ones.
+ */
+#define get_abrt_conf_directories abrt_get_abrt_conf_directories
+const char *const *get_abrt_conf_directories(void);
+
 #define load_abrt_conf_file abrt_load_abrt_conf_file
 int load_abrt_conf_file(const char *file, map_string_t *settings);
 
@@ -130,6 +209,348 @@ wait for the reply
 #define notify_new_path_with_response abrt_notify_new_path_with_response
 int notify_new_path_with_response(const char *path, char **message);
 
+/* Snapshot files
+ *
+ * Binary caches of data derived from other files, e.g. parsed configuration
+ * files or answers of the rpm database. The payload is opaque; the file
+ * starts with a MAGIC of SNAPSHOT_FILE_MAGIC_LEN characters, the GENERATION
+ * of the source data (e.g. a SHA-1 of their time stamps) and a SHA-1 of the
+ * payload. Only regular files owned by root and not writable by group or
+ * others are loaded.
+ */
+#define SNAPSHOT_FILE_MAGIC_LEN 8
+struct abrt_snapshot_file
+{
+    const char *payload;
+    size_t payload_size;
+
+    /* Private */
+    void *map;
+    size_t map_size;
+};
+/* Maps PATH to memory. Returns 0 if it is an intact snapshot of GENERATION,
+ * -1 otherwise. The payload is valid until snapshot_file_close(). */
+#define snapshot_file_open abrt_snapshot_file_open
+int snapshot_file_open(struct abrt_snapshot_file *snapshot, const char *path,
+        const char *magic, const uint8_t generation[SHA1_RESULT_LEN]);
+#define snapshot_file_close abrt_snapshot_file_close
+void snapshot_file_close(struct abrt_snapshot_file *snapshot);
+/* Atomically replaces PATH by a file readable only by the current user.
+ * Returns 0 on success, -1 otherwise. */
+#define snapshot_file_save abrt_snapshot_file_save
+int snapshot_file_save(const char *path, const char *magic,
+        const uint8_t generation[SHA1_RESULT_LEN], const void *payload, size_t payload_size);
+#define snapshot_file_compute_sha1 abrt_snapshot_file_compute_sha1
+void snapshot_file_compute_sha1(const void *data, size_t size, uint8_t sha1[SHA1_RESULT_LEN]);
+
+/* Metrics
+ *
+ * Counters, gauges and latency histograms are collected in memory and merged
+ * into VAR_RUN/abrt/metrics/COMPONENT.prom (Prometheus text format) by
+ * metrics_flush(). Counters and histograms are accumulated across processes,
+ * so short-lived programs should flush right before they exit. A metric name
+ * can include labels, e.g. 'abrtd_deleted_problems_total{kind="new"}'.
+ * The directory can be overridden by the ABRT_METRICS_DIR environment
+ * variable.
+ */
+#define metrics_counter_add abrt_metrics_counter_add
+void metrics_counter_add(const char *name, double value);
+#define metrics_gauge_set abrt_metrics_gauge_set
+void metrics_gauge_set(const char *name, double value);
+#define metrics_observe_seconds abrt_metrics_observe_seconds
+void metrics_observe_seconds(const char *name, double seconds);
+/* Returns 0 on success, -errno otherwise. Never dies. */
+#define metrics_flush abrt_metrics_flush
+int metrics_flush(const char *component);
+/* Returns the contents of all metrics files, never NULL */
+#define metrics_load_text abrt_metrics_load_text
+char *metrics_load_text(void);
+/* Returns a hash table of metric series names to values (double *) */
+#define metrics_load abrt_metrics_load
+GHashTable *metrics_load(void);
+
+/* Problem summary
+ *
+ * PROBLEM_SUMMARY_FILENAME holds the values of the elements read by problem
+ * listings (type, uid, executable, count, ...) so they can be loaded from a
+ * single file. problem_summary_save() must be called on a locked directory
+ * after the elements are modified. The loaders fall back to the element files
+ * if the summary is missing or out of date, i.e. they behave like
+ * dd_load_text_ext() and dd_load_uint32(). The summary is read once per
+ * opened directory; the loaders are thread safe.
+ */
+#define PROBLEM_SUMMARY_FILENAME ".abrt-summary"
+/* Returns 0 on success, -errno otherwise. Never dies. */
+#define problem_summary_save abrt_problem_summary_save
+int problem_summary_save(struct dump_dir *dd);
+#define problem_summary_load_text abrt_problem_summary_load_text
+char *problem_summary_load_text(const struct dump_dir *dd, const char *name, unsigned flags);
+#define problem_summary_load_uint32 abrt_problem_summary_load_uint32
+int problem_summary_load_uint32(const struct dump_dir *dd, const char *name, uint32_t *value);
+
+/* Sharded dump location
+ *
+ * Problem directories live either directly in the dump location or in
+ * DumpLocation/shard-XX/ where XX is derived from the problem name (see
+ * dump_location_shard_name()). The listing functions walk the top level and
+ * all shards, the shards are read by parallel threads.
+ */
+#define dump_location_is_shard_name abrt_dump_location_is_shard_name
+bool dump_location_is_shard_name(const char *name);
+#define dump_location_shard_name abrt_dump_location_shard_name
+char *dump_location_shard_name(const char *name);
+/* Returns DUMP_LOCATION/shard-XX/NAME */
+#define dump_location_shard_path abrt_dump_location_shard_path
+char *dump_location_shard_path(const char *dump_location, const char *name);
+
+/* Any of the flags leaves out everything but directories */
+enum {
+    /* Fill dle_owner and dle_mtime */
+    DUMP_LOCATION_LIST_STAT   = 1 << 0,
+    /* Fill dle_locked */
+    DUMP_LOCATION_LIST_LOCKED = 1 << 1,
+    /* Fill dle_size, the size of the whole directory */
+    DUMP_LOCATION_LIST_SIZE   = 1 << 2,
+};
+
+struct dump_location_entry
+{
+    char *dle_name; /* relative to the dump location, e.g. shard-1f/ccpp-... */
+    uid_t dle_owner;
+    time_t dle_mtime;
+    bool dle_locked;
+    double dle_size;
+};
+
+#define dump_location_entry_free abrt_dump_location_entry_free
+void dump_location_entry_free(struct dump_location_entry *entry);
+/* Returns an array of struct dump_location_entry or NULL if the dump location
+ * cannot be read. Shards, hidden directories and directories which have
+ * neither the 'time' element nor the lock are not listed. */
+#define dump_location_list abrt_dump_location_list
+GPtrArray *dump_location_list(const char *dump_location, int flags);
+/* Shard aware get_dirsize_find_largest_dir(), WORST_DIR is relative to
+ * DUMP_LOCATION and EXCLUDED can be either relative or a base name. */
+#define dump_location_size_find_largest_dir abrt_dump_location_size_find_largest_dir
+double dump_location_size_find_largest_dir(const char *dump_location, char **worst_dir, const char *excluded);
+/* Like dump_location_size_find_largest_dir() but excludes all directories
+ * in the EXCLUDED set of strings (relative names or base names). */
+#define dump_location_size_find_largest_dir_ext abrt_dump_location_size_find_largest_dir_ext
+double dump_location_size_find_largest_dir_ext(const char *dump_location, char **worst_dir, GHashTable *excluded);
+/* Gets the latest modification time of the dump location and its shards,
+ * i.e. the time of the last addition or removal of a problem.
+ * Returns 0 on success, -errno otherwise. */
+#define dump_location_get_mtime abrt_dump_location_get_mtime
+int dump_location_get_mtime(const char *dump_location, struct timespec *mtime);
+/* Moves the locked problem directory from the top level of DUMP_LOCATION to
+ * its shard. Returns the new path or NULL on error. */
+#define dump_location_move_to_shard abrt_dump_location_move_to_shard
+char *dump_location_move_to_shard(const char *dump_location, struct dump_dir *dd);
+/* Moves all processed problem directories from the top level to shards.
+ * Returns the number of moved directories or -errno. */
+#define dump_location_migrate abrt_dump_location_migrate
+int dump_location_migrate(const char *dump_location);
+/* Incremental variant of dump_location_migrate() for main loops; every step
+ * checks at most COUNT directories and returns false when all are done.
+ * _new() returns NULL on error (errno is set), _free() returns the number of
+ * moved directories. */
+struct dump_location_migration;
+#define dump_location_migration_new abrt_dump_location_migration_new
+struct dump_location_migration *dump_location_migration_new(const char *dump_location);
+#define dump_location_migration_step abrt_dump_location_migration_step
+bool dump_location_migration_step(struct dump_location_migration *migration, unsigned count);
+#define dump_location_migration_free abrt_dump_location_migration_free
+int dump_location_migration_free(struct dump_location_migration *migration);
+
+/* Cold storage
+ *
+ * Big elements (coredump, binary, vmcore) of old problems are replaced by
+ * their compressed variants ELEMENT.xz. All functions return 0 or -errno.
+ */
+/* DD must be locked */
+#define problem_element_compress abrt_problem_element_compress
+int problem_element_compress(struct dump_dir *dd, const char *name);
+/* Restores NAME from NAME.xz unless NAME exists. DD must be locked. */
+#define problem_element_inflate abrt_problem_element_inflate
+int problem_element_inflate(struct dump_dir *dd, const char *name);
+/* Opens NAME for reading. If only NAME.xz exists, the inflated data are
+ * written to an unlinked temporary file in LARGE_DATA_TMP_DIR and the problem
+ * directory is left untouched. Returns a file descriptor or -errno, -ENOSPC
+ * if the data would not leave 5% of LARGE_DATA_TMP_DIR free. */
+#define problem_element_open_inflated abrt_problem_element_open_inflated
+int problem_element_open_inflated(struct dump_dir *dd, const char *name);
+/* Restores all compressed elements and the segments of coredump left out by
+ * abrt-hook-ccpp. Must be called by tools that need the whole coredump before
+ * they open the problem directory. Tools that need only some elements use
+ * problem_element_inflate(). */
+#define problem_dir_inflate abrt_problem_dir_inflate
+int problem_dir_inflate(const char *dump_dir_name);
+/* Compresses big elements of complete problems whose last occurrence is
+ * older than MIN_AGE_SEC. Returns the number of compressed problems. */
+#define dump_location_compress_cold abrt_dump_location_compress_cold
+int dump_location_compress_cold(const char *dump_location, unsigned min_age_sec);
+
+/* Segments of coredump left out by abrt-hook-ccpp because they are mappings
+ * of files present on the disk. One line per segment:
+ * START END FILE_OFFSET DEV INODE SIZE MTIME PATH (the first four numbers are
+ * hexadecimal) */
+#define FILENAME_COREDUMP_ELIDED "coredump_elided"
+/* Copies the left out segments back to coredump from the files. Fails with
+ * -ESTALE if a file has changed and with -EACCES if the crashed user can't
+ * read it. DD must be locked. Returns 0 or -errno. */
+#define problem_coredump_restore abrt_problem_coredump_restore
+int problem_coredump_restore(struct dump_dir *dd);
+
+/* Blob store
+ *
+ * Identical elements of problem directories are hard links to a single file
+ * in DUMP_LOCATION/.blobs. The link count serves as the reference count.
+ */
+#define BLOB_STORE_DIR_NAME ".blobs"
+/* Links the shareable elements of DD to the blob store. DD must be locked
+ * and its elements must already have their final owner and mode.
+ * Returns the number of linked elements or -errno. */
+#define problem_dir_share_elements abrt_problem_dir_share_elements
+int problem_dir_share_elements(struct dump_dir *dd, const char *dump_location);
+/* Replaces the links to blobs with private copies. Must be called before
+ * changing owner or mode of the elements. Returns 0 or -errno. */
+#define problem_dir_unshare_elements abrt_problem_dir_unshare_elements
+int problem_dir_unshare_elements(struct dump_dir *dd);
+/* Removes the blobs no problem directory refers to.
+ * Returns the number of removed blobs or -errno. */
+#define dump_location_blobs_gc abrt_dump_location_blobs_gc
+int dump_location_blobs_gc(const char *dump_location);
+
+/* Child runner
+ *
+ * Supervises any number of children started by fork_execv_on_steroids()
+ * concurrently, collects their standard output and kills the children which
+ * exceed their timeouts.
+ */
+struct abrt_child;
+/* Called for every line of the output, LINE is without the newline */
+typedef void (*abrt_child_line_cb)(struct abrt_child *child, char *line, void *param);
+struct abrt_child
+{
+    pid_t pid;
+    /* See waitpid(2), valid when the child is returned by child_runner_wait() */
+    int status;
+    /* The child was killed because it exceeded its timeout */
+    bool timed_out;
+    /* The output, NUL terminated. Contains only the incomplete last line if
+     * LINE_CB is set. */
+    char *output;
+    size_t output_len;
+
+    /* Private */
+    const char *name;
+    size_t output_size;
+    int output_fd;
+    int pidfd;
+    bool reaped;
+    long long deadline_ms;
+    abrt_child_line_cb line_cb;
+    void *line_cb_param;
+};
+struct child_runner;
+#define child_runner_new abrt_child_runner_new
+struct child_runner *child_runner_new(void);
+/* Kills and reaps the children which haven't finished yet */
+#define child_runner_free abrt_child_runner_free
+void child_runner_free(struct child_runner *runner);
+/* Starts ARGS with EXECFLG_* FLAGS, EXECFLG_OUTPUT is implied. The child is
+ * killed after TIMEOUT_MS milliseconds, 0 means no limit. The output of a
+ * killed child is closed a second later even if its own children still hold
+ * it. If LINE_CB is set, it gets the output line by line instead of
+ * collecting it. The child belongs to RUNNER until it is returned by
+ * child_runner_wait(). */
+#define child_runner_spawn abrt_child_runner_spawn
+struct abrt_child *child_runner_spawn(struct child_runner *runner, int flags,
+        char **args, char **env_vec, unsigned timeout_ms,
+        abrt_child_line_cb line_cb, void *param);
+/* Like child_runner_spawn() but the standard input of the child is read from
+ * IN_FD and the standard output is written to OUT_FD. The collected output of
+ * the child is its standard error output. If OUT_FD is -1, the standard
+ * output is collected and the standard error output is inherited. */
+#define child_runner_spawn_filter abrt_child_runner_spawn_filter
+struct abrt_child *child_runner_spawn_filter(struct child_runner *runner,
+        char **args, int in_fd, int out_fd, unsigned timeout_ms);
+/* Waits for the next child which has exited and closed its output.
+ * Returns NULL if there are no children left. The caller must free the
+ * returned child with abrt_child_free(). */
+#define child_runner_wait abrt_child_runner_wait
+struct abrt_child *child_runner_wait(struct child_runner *runner);
+void abrt_child_free(struct abrt_child *child);
+/* Returns the malloced output and leaves the child without it */
+char *abrt_child_steal_output(struct abrt_child *child);
+/* Runs a single child and returns its output, STATUS and TIMED_OUT can be
+ * NULL. */
+#define run_child abrt_run_child
+char *run_child(char **args, int flags, char **env_vec, unsigned timeout_ms,
+        int *status, bool *timed_out);
+
+/* Post-create queue
+ *
+ * Decides which of the problems waiting for post-create processing starts
+ * next, see PostCreate* options in abrt.conf.
+ */
+struct post_create_class
+{
+    /* NULL for the class of all other types */
+    char *type;
+    int priority;
+    unsigned max_running;
+
+    /* Statistics */
+    unsigned running;
+    unsigned long processed;
+    gint64 total_wait; /* us */
+    gint64 max_wait;   /* us */
+};
+struct post_create_item
+{
+    void *data;
+    struct post_create_class *klass;
+    int priority;
+    bool running;
+    gint64 queued;  /* monotonic time, us */
+    gint64 started; /* monotonic time, us */
+};
+struct post_create_queue
+{
+    /* Terminated by the class of all other types */
+    struct post_create_class *classes;
+    unsigned max_running;
+    unsigned aging_period; /* s, 0 disables aging */
+    double big_problem_size; /* bytes, 0 disables the penalty */
+    unsigned running;
+    /* struct post_create_item *, in the order of arrival */
+    GList *items;
+};
+/* CLASSES is a list of TYPE:PRIORITY[:MAX_RUNNING] separated by white spaces
+ * or commas, type '*' stands for all other types. BIG_PROBLEM_SIZE is in
+ * MiB. */
+#define post_create_queue_new abrt_post_create_queue_new
+struct post_create_queue *post_create_queue_new(const char *classes,
+        unsigned max_running, unsigned aging_period, unsigned big_problem_size);
+#define post_create_queue_free abrt_post_create_queue_free
+void post_create_queue_free(struct post_create_queue *queue);
+#define post_create_queue_find_class abrt_post_create_queue_find_class
+struct post_create_class *post_create_queue_find_class(struct post_create_queue *queue,
+        const char *type);
+/* Appends a waiting problem of TYPE, SIZE is in bytes */
+#define post_create_queue_push abrt_post_create_queue_push
+struct post_create_item *post_create_queue_push(struct post_create_queue *queue,
+        void *data, const char *type, double size, gint64 now);
+/* Marks the waiting item which should be processed next as running.
+ * Returns NULL if none can be started now. */
+#define post_create_queue_start_next abrt_post_create_queue_start_next
+struct post_create_item *post_create_queue_start_next(struct post_create_queue *queue,
+        gint64 now);
+/* Removes a waiting or running ITEM and frees it */
+#define post_create_queue_remove abrt_post_create_queue_remove
+void post_create_queue_remove(struct post_create_queue *queue, struct post_create_item *item);
+
 /* Note: should be public since unit tests need to call it */
 #define koops_extract_version abrt_koops_extract_version
 char *koops_extract_version(const char *line);
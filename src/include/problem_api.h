@@ -24,6 +24,9 @@
 /*
  * Function called for each problem directory in @for_each_problem_in_dir
  *
+ * Use problem_summary_load_text() to read the elements stored in the problem
+ * summary, listing of all problems then reads one file per problem.
+ *
  * @param dd A dump directory
  * @param arg User's arguments
  * @returns 0 if everything is OK, a non zero value in order to break the iterator
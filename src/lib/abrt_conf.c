@@ -16,10 +16,13 @@
     with this program; if not, write to the Free Software Foundation, Inc.,
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
-#include "libabrt.h"
+#include "internal_libabrt.h"
 
 #define ABRT_CONF "abrt.conf"
 
+#define DEFAULT_POST_CREATE_CLASSES \
+    "Python:0 Python3:0 Ruby:0 Java:0 Kerneloops:1 xorg:1 CCpp:2 vmcore:3 *:2"
+
 char *        g_settings_sWatchCrashdumpArchiveDir = NULL;
 unsigned int  g_settings_nMaxCrashReportsSize = 1000;
 char *        g_settings_dump_location = NULL;
@@ -29,6 +32,13 @@ char *        g_settings_autoreporting_event = NULL;
 bool          g_settings_shortenedreporting = 0;
 bool          g_settings_explorechroots = 0;
 unsigned int  g_settings_debug_level = 0;
+bool          g_settings_shard_dump_location = 0;
+unsigned int  g_settings_cold_storage_age = 0;
+bool          g_settings_share_elements = 0;
+char *        g_settings_post_create_classes = NULL;
+unsigned int  g_settings_post_create_max_running = 3;
+unsigned int  g_settings_post_create_aging_period = 30;
+unsigned int  g_settings_post_create_big_problem_size = 512;
 
 void free_abrt_conf_data()
 {
@@ -40,6 +50,9 @@ void free_abrt_conf_data()
 
     free(g_settings_autoreporting_event);
     g_settings_autoreporting_event = NULL;
+
+    free(g_settings_post_create_classes);
+    g_settings_post_create_classes = NULL;
 }
 
 /* Beware - the function normalizes only slashes - that's the most often
@@ -65,6 +78,27 @@ static char *xstrdup_normalized_path(const char *path)
     return res;
 }
 
+/* Keeps DEFAULT_VALUE if the option is not set or invalid */
+static unsigned parse_unsigned(map_string_t *settings, const char *name,
+        unsigned min_value, unsigned max_value, unsigned default_value)
+{
+    const char *value = get_map_string_item_or_NULL(settings, name);
+    if (value == NULL)
+        return default_value;
+
+    unsigned result = default_value;
+    char *end;
+    errno = 0;
+    unsigned long ul = strtoul(value, &end, 10);
+    if (errno || end == value || *end != '\0' || ul < min_value || ul > max_value)
+        error_msg("Error parsing %s setting: '%s'", name, value);
+    else
+        result = ul;
+    remove_map_string_item(settings, name);
+
+    return result;
+}
+
 static void ParseCommon(map_string_t *settings, const char *conf_filename)
 {
     const char *value;
@@ -143,6 +177,55 @@ static void ParseCommon(map_string_t *settings, const char *conf_filename)
     else
         g_settings_explorechroots = false;
 
+    value = get_map_string_item_or_NULL(settings, "ShardDumpLocation");
+    if (value)
+    {
+        g_settings_shard_dump_location = string_to_bool(value);
+        remove_map_string_item(settings, "ShardDumpLocation");
+    }
+    else
+        g_settings_shard_dump_location = false;
+
+    value = get_map_string_item_or_NULL(settings, "ShareElements");
+    if (value)
+    {
+        g_settings_share_elements = string_to_bool(value);
+        remove_map_string_item(settings, "ShareElements");
+    }
+    else
+        g_settings_share_elements = false;
+
+    value = get_map_string_item_or_NULL(settings, "ColdStorageAge");
+    if (value)
+    {
+        char *end;
+        errno = 0;
+        unsigned long ul = strtoul(value, &end, 10);
+        if (errno || end == value || *end != '\0' || ul > UINT_MAX / 3600)
+            error_msg("Error parsing %s setting: '%s'", "ColdStorageAge", value);
+        else
+            g_settings_cold_storage_age = ul;
+        remove_map_string_item(settings, "ColdStorageAge");
+    }
+    else
+        g_settings_cold_storage_age = 0;
+
+    value = get_map_string_item_or_NULL(settings, "PostCreateClasses");
+    if (value)
+    {
+        g_settings_post_create_classes = xstrdup(value);
+        remove_map_string_item(settings, "PostCreateClasses");
+    }
+    else
+        g_settings_post_create_classes = xstrdup(DEFAULT_POST_CREATE_CLASSES);
+
+    g_settings_post_create_max_running =
+        parse_unsigned(settings, "PostCreateMaxRunning", 1, INT_MAX, 3);
+    g_settings_post_create_aging_period =
+        parse_unsigned(settings, "PostCreateAgingPeriod", 0, INT_MAX, 30);
+    g_settings_post_create_big_problem_size =
+        parse_unsigned(settings, "PostCreateBigProblemSize", 0, INT_MAX, 512);
+
     value = get_map_string_item_or_NULL(settings, "DebugLevel");
     if (value)
     {
@@ -166,7 +249,7 @@ static void ParseCommon(map_string_t *settings, const char *conf_filename)
     }
 }
 
-static const char *get_abrt_conf_file_name(void)
+const char *get_abrt_conf_file_name(void)
 {
     const char *const abrt_conf = getenv("ABRT_CONF_FILE_NAME");
     return abrt_conf == NULL ? ABRT_CONF : abrt_conf;
@@ -187,7 +270,7 @@ int load_abrt_conf()
     return 0;
 }
 
-static const char *const *get_conf_directories(void)
+const char *const *get_abrt_conf_directories(void)
 {
     static const char *base_directories[3];
 
@@ -203,15 +286,15 @@ static const char *const *get_conf_directories(void)
 
 int load_abrt_conf_file(const char *file, map_string_t *settings)
 {
-    const char *const *conf_directories = get_conf_directories();
-    return load_conf_file_from_dirs(file, conf_directories, settings, /*skip key w/o values:*/ false);
+    const char *const *conf_directories = get_abrt_conf_directories();
+    return load_conf_file_from_dirs_cached(file, conf_directories, settings);
 }
 
 int load_abrt_plugin_conf_file(const char *file, map_string_t *settings)
 {
     static const char *const base_directories[] = { DEFAULT_PLUGINS_CONF_DIR, PLUGINS_CONF_DIR, NULL };
 
-    return load_conf_file_from_dirs(file, base_directories, settings, /*skip key w/o values:*/ false);
+    return load_conf_file_from_dirs_cached(file, base_directories, settings);
 }
 
 int save_abrt_conf_file(const char *file, map_string_t *settings)
@@ -0,0 +1,314 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Blob store
+ *
+ * Problems of the same program carry many identical elements (binary,
+ * os_release, dso_list, ...). Such elements are stored only once in
+ *
+ *   DumpLocation/.blobs/XX/SHA1-UID-GID-MODE
+ *
+ * and the problem directories contain hard links to the blobs. Owner, group
+ * and mode are part of the key because they are shared by all links.
+ *
+ * The link count of a blob is its reference count. Deleting a problem
+ * directory only drops the links; dump_location_blobs_gc() removes the blobs
+ * whose only link is the one in the store.
+ *
+ * Elements are never modified in place (libreport writes a new file), so an
+ * element modified in one problem directory is detached from the blob
+ * automatically.
+ */
+
+#include "internal_libabrt.h"
+
+/* Links save less than the lookup costs */
+#define BLOB_MIN_SIZE 512
+
+static const char *const s_shared_elements[] = {
+    FILENAME_BINARY,
+    FILENAME_OS_INFO,
+    FILENAME_OS_INFO_IN_ROOTDIR,
+    FILENAME_OS_RELEASE,
+    FILENAME_OS_RELEASE_IN_ROOTDIR,
+    FILENAME_DSO_LIST,
+    FILENAME_MAPS,
+    "proc_modules",
+    NULL
+};
+
+/* Opens DUMP_LOCATION/.blobs/XX, creates the directories if needed */
+static int open_blob_dir(const char *dump_location, const char *bucket)
+{
+    char *store = concat_path_file(dump_location, BLOB_STORE_DIR_NAME);
+    char *path = concat_path_file(store, bucket);
+    int fd = -1;
+
+    /* Only the owner of the store needs to access the blobs through it */
+    if ((mkdir(store, 0700) != 0 && errno != EEXIST)
+        || (mkdir(path, 0700) != 0 && errno != EEXIST))
+    {
+        perror_msg("Can't create '%s'", path);
+        goto finito;
+    }
+
+    fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        perror_msg("Can't open '%s'", path);
+
+finito:
+    free(path);
+    free(store);
+    return fd;
+}
+
+/* Returns the blob name or NULL if the element cannot be shared */
+static char *blob_name(int fd, const struct stat *st)
+{
+    sha1_ctx_t ctx;
+    sha1_begin(&ctx);
+
+    char buf[64 * 1024];
+    ssize_t r;
+    off_t total = 0;
+    while ((r = safe_read(fd, buf, sizeof(buf))) > 0)
+    {
+        sha1_hash(&ctx, buf, r);
+        total += r;
+    }
+
+    if (r < 0 || total != st->st_size)
+        return NULL;
+
+    uint8_t sha1[SHA1_RESULT_LEN];
+    sha1_end(&ctx, sha1);
+
+    char hex[SHA1_RESULT_LEN * 2 + 1];
+    bin2hex(hex, (const char *)sha1, SHA1_RESULT_LEN)[0] = '\0';
+
+    return xasprintf("%s-%lu-%lu-%04o", hex, (long unsigned)st->st_uid,
+                     (long unsigned)st->st_gid, (unsigned)(st->st_mode & 07777));
+}
+
+/* Returns 1 if the element has been linked to a blob, 0 if it has not and
+ * -errno on errors.
+ */
+static int share_element(struct dump_dir *dd, const char *dump_location, const char *name)
+{
+    const int fd = openat(dd->dd_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return errno == ENOENT ? 0 : -errno;
+
+    int r = 0;
+    char *blob = NULL;
+    char *tmp = NULL;
+    int blob_dir_fd = -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0
+        || !S_ISREG(st.st_mode)
+        || st.st_nlink != 1
+        || st.st_size < BLOB_MIN_SIZE)
+        goto finito;
+
+    blob = blob_name(fd, &st);
+    if (blob == NULL)
+        goto finito;
+
+    char bucket[3] = { blob[0], blob[1], '\0' };
+    blob_dir_fd = open_blob_dir(dump_location, bucket);
+    if (blob_dir_fd < 0)
+    {
+        r = -EIO;
+        goto finito;
+    }
+
+    /* The first occurrence becomes the blob */
+    if (linkat(dd->dd_fd, name, blob_dir_fd, blob, 0) == 0)
+    {
+        log_debug("New blob '%s' for '%s/%s'", blob, dd->dd_dirname, name);
+        r = 1;
+        goto finito;
+    }
+
+    if (errno != EEXIST)
+    {
+        r = -errno;
+        perror_msg("Can't link '%s/%s' to the blob store", dd->dd_dirname, name);
+        goto finito;
+    }
+
+    struct stat blob_st;
+    if (fstatat(blob_dir_fd, blob, &blob_st, AT_SYMLINK_NOFOLLOW) != 0
+        || !S_ISREG(blob_st.st_mode)
+        || blob_st.st_size != st.st_size)
+    {
+        log_notice("Blob '%s' is not valid", blob);
+        goto finito;
+    }
+
+    /* Replace the element with a link to the blob atomically */
+    tmp = xasprintf("%s.blob", name);
+    unlinkat(dd->dd_fd, tmp, 0);
+    if (linkat(blob_dir_fd, blob, dd->dd_fd, tmp, 0) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't link blob '%s' to '%s/%s'", blob, dd->dd_dirname, tmp);
+        goto finito;
+    }
+
+    if (renameat(dd->dd_fd, tmp, dd->dd_fd, name) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't rename '%s/%s' to '%s'", dd->dd_dirname, tmp, name);
+        unlinkat(dd->dd_fd, tmp, 0);
+        goto finito;
+    }
+
+    log_debug("Linked '%s/%s' to blob '%s'", dd->dd_dirname, name, blob);
+    r = 1;
+
+finito:
+    if (blob_dir_fd >= 0)
+        close(blob_dir_fd);
+    free(tmp);
+    free(blob);
+    close(fd);
+    return r;
+}
+
+int problem_dir_share_elements(struct dump_dir *dd, const char *dump_location)
+{
+    if (!dd->locked)
+    {
+        error_msg("Problem directory '%s' must be locked", dd->dd_dirname);
+        return -EPERM;
+    }
+
+    int shared = 0;
+    for (const char *const *name = s_shared_elements; *name != NULL; ++name)
+    {
+        const int r = share_element(dd, dump_location, *name);
+        if (r > 0)
+            shared += r;
+    }
+
+    if (shared > 0)
+        log_info("Linked %d elements of '%s' to the blob store", shared, dd->dd_dirname);
+
+    return shared;
+}
+
+int problem_dir_unshare_elements(struct dump_dir *dd)
+{
+    if (!dd->locked)
+    {
+        error_msg("Problem directory '%s' must be locked", dd->dd_dirname);
+        return -EPERM;
+    }
+
+    int r = 0;
+    for (const char *const *name = s_shared_elements; *name != NULL && r == 0; ++name)
+    {
+        const int src_fd = openat(dd->dd_fd, *name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (src_fd < 0)
+            continue;
+
+        struct stat st;
+        if (fstat(src_fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_nlink == 1)
+        {
+            close(src_fd);
+            continue;
+        }
+
+        char *tmp = xasprintf("%s.blob", *name);
+        unlinkat(dd->dd_fd, tmp, 0);
+        const int dst_fd = openat(dd->dd_fd, tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                                  st.st_mode & 07777);
+        if (dst_fd < 0
+            || (geteuid() == 0 && fchown(dst_fd, st.st_uid, st.st_gid) != 0)
+            || copyfd_eof(src_fd, dst_fd, COPYFD_SPARSE) != st.st_size
+            || close(dst_fd) != 0
+            || renameat(dd->dd_fd, tmp, dd->dd_fd, *name) != 0)
+        {
+            r = -errno;
+            perror_msg("Can't detach '%s/%s' from the blob store", dd->dd_dirname, *name);
+            unlinkat(dd->dd_fd, tmp, 0);
+        }
+
+        free(tmp);
+        close(src_fd);
+    }
+
+    return r;
+}
+
+int dump_location_blobs_gc(const char *dump_location)
+{
+    char *store = concat_path_file(dump_location, BLOB_STORE_DIR_NAME);
+    DIR *store_dp = opendir(store);
+    if (store_dp == NULL)
+    {
+        free(store);
+        return errno == ENOENT ? 0 : -errno;
+    }
+
+    int removed = 0;
+    struct dirent *bucket;
+    while ((bucket = readdir(store_dp)) != NULL)
+    {
+        if (dot_or_dotdot(bucket->d_name))
+            continue;
+
+        const int bucket_fd = openat(dirfd(store_dp), bucket->d_name,
+                                     O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (bucket_fd < 0)
+            continue;
+
+        DIR *dp = fdopendir(bucket_fd);
+        if (dp == NULL)
+        {
+            close(bucket_fd);
+            continue;
+        }
+
+        struct dirent *dent;
+        while ((dent = readdir(dp)) != NULL)
+        {
+            struct stat st;
+            if (dot_or_dotdot(dent->d_name)
+                || fstatat(bucket_fd, dent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0
+                || st.st_nlink != 1)
+                continue;
+
+            /* No problem directory refers to the blob */
+            if (unlinkat(bucket_fd, dent->d_name, 0) == 0)
+                ++removed;
+        }
+        closedir(dp);
+    }
+    closedir(store_dp);
+
+    if (removed > 0)
+        log_info("Removed %d unused blobs from '%s'", removed, store);
+
+    free(store);
+    return removed;
+}
@@ -0,0 +1,428 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Child runner
+ *
+ * All children of a runner are supervised by one epoll instance. A child is
+ * watched through the read end of its output pipe and through a pidfd, so
+ * the runner learns about its exit without polling waitpid(). On kernels
+ * without pidfd_open() (< 5.3) the child is reaped by a blocking waitpid()
+ * after its output reaches EOF, which is what the callers did before.
+ *
+ * The output is read directly into a buffer of the child which grows
+ * geometrically, so a big backtrace takes a few large reads instead of
+ * thousands of 1 KiB ones.
+ */
+
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include "internal_libabrt.h"
+
+/* The minimal free space in the output buffer for a read */
+#define CHILD_READ_SIZE (64 * 1024)
+
+/* How long the output of a killed child is read before it is abandoned.
+ * Its own children can keep the pipe open after it died. */
+#define CHILD_KILL_GRACE_MS 1000
+
+struct child_runner
+{
+    int epoll_fd;
+    /* Running children */
+    GList *children;
+    /* Finished children waiting for child_runner_wait() */
+    GQueue finished;
+};
+
+static long long monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int open_pidfd(pid_t pid)
+{
+#ifdef __NR_pidfd_open
+    int fd = syscall(__NR_pidfd_open, pid, 0);
+    if (fd >= 0)
+    {
+        close_on_exec_on(fd);
+        return fd;
+    }
+
+    if (errno != ENOSYS)
+        perror_msg("pidfd_open(%d)", (int)pid);
+#endif
+    return -1;
+}
+
+struct child_runner *child_runner_new(void)
+{
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+        perror_msg_and_die("epoll_create1");
+
+    struct child_runner *runner = xzalloc(sizeof(*runner));
+    runner->epoll_fd = epoll_fd;
+    g_queue_init(&runner->finished);
+    return runner;
+}
+
+void abrt_child_free(struct abrt_child *child)
+{
+    if (!child)
+        return;
+
+    free(child->output);
+    free(child);
+}
+
+char *abrt_child_steal_output(struct abrt_child *child)
+{
+    char *output = child->output;
+    child->output = NULL;
+    child->output_len = 0;
+    child->output_size = 0;
+    return output ? output : xstrdup("");
+}
+
+static void child_close_fd(struct child_runner *runner, int *fd)
+{
+    if (*fd < 0)
+        return;
+
+    epoll_ctl(runner->epoll_fd, EPOLL_CTL_DEL, *fd, NULL);
+    close(*fd);
+    *fd = -1;
+}
+
+static void child_reap(struct child_runner *runner, struct abrt_child *child, bool block)
+{
+    if (child->reaped)
+        return;
+
+    pid_t r = safe_waitpid(child->pid, &child->status, block ? 0 : WNOHANG);
+    if (r == 0)
+        return;
+
+    if (r < 0)
+    {
+        perror_msg("waitpid(%d)", (int)child->pid);
+        child->status = -1;
+    }
+
+    child->reaped = true;
+    child_close_fd(runner, &child->pidfd);
+}
+
+/* Passes complete lines to the callback and keeps the incomplete one */
+static void child_emit_lines(struct abrt_child *child, bool eof)
+{
+    char *line = child->output;
+    char *end = child->output + child->output_len;
+    char *newline;
+    while (line < end && (newline = memchr(line, '\n', end - line)) != NULL)
+    {
+        *newline = '\0';
+        child->line_cb(child, line, child->line_cb_param);
+        line = newline + 1;
+    }
+
+    if (eof && line < end)
+    {
+        child->line_cb(child, line, child->line_cb_param);
+        line = end;
+    }
+
+    child->output_len = end - line;
+    memmove(child->output, line, child->output_len);
+    child->output[child->output_len] = '\0';
+}
+
+static void child_read_output(struct child_runner *runner, struct abrt_child *child)
+{
+    while (child->output_fd >= 0)
+    {
+        if (child->output_size - child->output_len < CHILD_READ_SIZE + 1)
+        {
+            child->output_size = MAX(child->output_size * 2, child->output_len + CHILD_READ_SIZE + 1);
+            child->output = xrealloc(child->output, child->output_size);
+            child->output[child->output_len] = '\0';
+        }
+
+        ssize_t r = read(child->output_fd, child->output + child->output_len,
+                         child->output_size - child->output_len - 1);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            perror_msg("Can't read output of '%s'", child->name);
+        }
+
+        if (r <= 0)
+        {
+            child_close_fd(runner, &child->output_fd);
+            if (child->line_cb)
+                child_emit_lines(child, /*eof:*/ true);
+            break;
+        }
+
+        child->output_len += r;
+        child->output[child->output_len] = '\0';
+
+        if (child->line_cb)
+            child_emit_lines(child, /*eof:*/ false);
+    }
+}
+
+static void child_check_finished(struct child_runner *runner, struct abrt_child *child)
+{
+    if (child->output_fd >= 0)
+        return;
+
+    /* Without pidfd, EOF is the only sign of exit we get */
+    child_reap(runner, child, /*block:*/ child->pidfd < 0);
+    if (!child->reaped)
+        return;
+
+    runner->children = g_list_remove(runner->children, child);
+    g_queue_push_tail(&runner->finished, child);
+}
+
+static struct abrt_child *child_new(char **args, abrt_child_line_cb line_cb, void *param)
+{
+    struct abrt_child *child = xzalloc(sizeof(*child));
+    child->name = args[0];
+    child->line_cb = line_cb;
+    child->line_cb_param = param;
+    child->pidfd = -1;
+    child->output_fd = -1;
+    return child;
+}
+
+/* Starts watching the started CHILD and reading OUTPUT_FD */
+static void child_runner_add(struct child_runner *runner, struct abrt_child *child,
+        int output_fd, unsigned timeout_ms)
+{
+    child->output_fd = output_fd;
+    ndelay_on(child->output_fd);
+    /* The other children must not hold the pipe */
+    close_on_exec_on(child->output_fd);
+
+    if (timeout_ms > 0)
+        child->deadline_ms = monotonic_ms() + timeout_ms;
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = child };
+    if (epoll_ctl(runner->epoll_fd, EPOLL_CTL_ADD, child->output_fd, &ev) != 0)
+        perror_msg_and_die("epoll_ctl");
+
+    child->pidfd = open_pidfd(child->pid);
+    if (child->pidfd >= 0
+     && epoll_ctl(runner->epoll_fd, EPOLL_CTL_ADD, child->pidfd, &ev) != 0)
+        perror_msg_and_die("epoll_ctl");
+
+    runner->children = g_list_append(runner->children, child);
+}
+
+struct abrt_child *child_runner_spawn(struct child_runner *runner, int flags,
+        char **args, char **env_vec, unsigned timeout_ms,
+        abrt_child_line_cb line_cb, void *param)
+{
+    struct abrt_child *child = child_new(args, line_cb, param);
+
+    int pipeout[2];
+    child->pid = fork_execv_on_steroids(flags | EXECFLG_OUTPUT, args, pipeout,
+                    env_vec, /*dir:*/ NULL, /*uid(unused):*/ 0);
+
+    child_runner_add(runner, child, pipeout[0], timeout_ms);
+    return child;
+}
+
+struct abrt_child *child_runner_spawn_filter(struct child_runner *runner,
+        char **args, int in_fd, int out_fd, unsigned timeout_ms)
+{
+    struct abrt_child *child = child_new(args, /*line_cb:*/ NULL, /*param:*/ NULL);
+
+    /* Only the child gets the write end, dup2() clears FD_CLOEXEC */
+    int pipeout[2];
+    if (pipe2(pipeout, O_CLOEXEC) != 0)
+        perror_msg_and_die("pipe");
+
+    child->pid = fork();
+    if (child->pid < 0)
+        perror_msg_and_die("fork");
+
+    if (child->pid == 0)
+    {
+        /* Without OUT_FD the standard output is collected and the standard
+         * error output is inherited */
+        if (dup2(in_fd, STDIN_FILENO) < 0
+            || dup2(out_fd >= 0 ? out_fd : pipeout[1], STDOUT_FILENO) < 0
+            || (out_fd >= 0 && dup2(pipeout[1], STDERR_FILENO) < 0))
+            perror_msg_and_die("dup2");
+
+        execvp(args[0], args);
+        perror_msg_and_die("Can't execute '%s'", args[0]);
+    }
+
+    close(pipeout[1]);
+    child_runner_add(runner, child, pipeout[0], timeout_ms);
+    return child;
+}
+
+/* The PID of a reaped child can belong to an unrelated process already */
+static void child_kill(struct abrt_child *child)
+{
+    if (!child->reaped)
+        kill(child->pid, SIGKILL);
+}
+
+static void child_runner_kill_expired(struct child_runner *runner, long long now)
+{
+    GList *next;
+    for (GList *li = runner->children; li != NULL; li = next)
+    {
+        /* child_check_finished() removes the child from the list */
+        next = g_list_next(li);
+
+        struct abrt_child *child = li->data;
+        if (child->deadline_ms == 0 || child->deadline_ms > now)
+            continue;
+
+        if (!child->timed_out)
+        {
+            log_notice("Killing '%s' (pid %d), timeout exceeded", child->name, (int)child->pid);
+            child_kill(child);
+            child->timed_out = true;
+            child->deadline_ms = now + CHILD_KILL_GRACE_MS;
+            continue;
+        }
+
+        log_notice("Output of '%s' (pid %d) still open after kill, closing it",
+                child->name, (int)child->pid);
+        child->deadline_ms = 0;
+        child_read_output(runner, child);
+        child_close_fd(runner, &child->output_fd);
+        if (child->line_cb)
+            child_emit_lines(child, /*eof:*/ true);
+        /* SIGKILL-ed a while ago, does not block for long */
+        child_reap(runner, child, /*block:*/ true);
+        child_check_finished(runner, child);
+    }
+}
+
+/* Milliseconds to the nearest deadline or -1 */
+static int child_runner_timeout(struct child_runner *runner, long long now)
+{
+    long long nearest = -1;
+    for (GList *li = runner->children; li != NULL; li = g_list_next(li))
+    {
+        struct abrt_child *child = li->data;
+        if (child->deadline_ms == 0)
+            continue;
+
+        long long left = MAX(child->deadline_ms - now, 0);
+        if (nearest < 0 || left < nearest)
+            nearest = left;
+    }
+
+    return MIN(nearest, INT_MAX);
+}
+
+struct abrt_child *child_runner_wait(struct child_runner *runner)
+{
+    while (g_queue_is_empty(&runner->finished) && runner->children != NULL)
+    {
+        long long now = monotonic_ms();
+        child_runner_kill_expired(runner, now);
+        /* A child whose output was abandoned is finished now */
+        if (!g_queue_is_empty(&runner->finished))
+            break;
+
+        struct epoll_event events[16];
+        int n = epoll_wait(runner->epoll_fd, events, ARRAY_SIZE(events),
+                           child_runner_timeout(runner, now));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror_msg_and_die("epoll_wait");
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            struct abrt_child *child = events[i].data.ptr;
+            /* Both fds of a finished child can be in one batch */
+            if (child->reaped && child->output_fd < 0)
+                continue;
+
+            child_read_output(runner, child);
+            if (child->pidfd >= 0)
+                child_reap(runner, child, /*block:*/ false);
+            child_check_finished(runner, child);
+        }
+    }
+
+    return g_queue_pop_head(&runner->finished);
+}
+
+void child_runner_free(struct child_runner *runner)
+{
+    if (!runner)
+        return;
+
+    for (GList *li = runner->children; li != NULL; li = g_list_next(li))
+    {
+        struct abrt_child *child = li->data;
+        child_kill(child);
+        child_close_fd(runner, &child->output_fd);
+        child_reap(runner, child, /*block:*/ true);
+        abrt_child_free(child);
+    }
+    g_list_free(runner->children);
+
+    struct abrt_child *child;
+    while ((child = g_queue_pop_head(&runner->finished)) != NULL)
+        abrt_child_free(child);
+
+    close(runner->epoll_fd);
+    free(runner);
+}
+
+char *run_child(char **args, int flags, char **env_vec, unsigned timeout_ms,
+        int *status, bool *timed_out)
+{
+    struct child_runner *runner = child_runner_new();
+    child_runner_spawn(runner, flags, args, env_vec, timeout_ms, /*line_cb:*/ NULL, /*param:*/ NULL);
+    struct abrt_child *child = child_runner_wait(runner);
+
+    if (status)
+        *status = child->status;
+    if (timed_out)
+        *timed_out = child->timed_out;
+
+    char *output = abrt_child_steal_output(child);
+    abrt_child_free(child);
+    child_runner_free(runner);
+    return output;
+}
@@ -0,0 +1,479 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Cold storage
+ *
+ * Big elements of old problems are compressed in place: ELEMENT is replaced
+ * by ELEMENT.xz. The other elements are left untouched, so the problem can
+ * still be listed and reported. Tools that need the original data call
+ * problem_dir_inflate() first.
+ *
+ * The xz tool is used because it can compress in more threads (-T0) and is
+ * available everywhere 'abrt-handle-upload' works. It runs under the child
+ * runner and is killed if it does not process at least FILTER_MIN_SPEED
+ * bytes per second, so a stuck xz cannot block abrtd or a reporter forever.
+ */
+
+#include <sys/statvfs.h>
+#include "internal_libabrt.h"
+#include "problem_api.h"
+
+#define XZ "xz"
+#define COLD_SUFFIX ".xz"
+#define COLD_TMP_SUFFIX ".tmp"
+
+/* Smaller elements are not worth the trouble */
+#define COLD_MIN_ELEMENT_SIZE (1024 * 1024)
+
+/* The part of the file system left free when inflating, in 1/N */
+#define INFLATE_RESERVE_PART 20
+
+/* xz gets FILTER_MIN_TIMEOUT_SEC plus one second per FILTER_MIN_SPEED bytes
+ * of its input */
+#define FILTER_MIN_TIMEOUT_SEC 60
+#define FILTER_MIN_SPEED (1024 * 1024)
+
+static const char *const s_cold_elements[] = {
+    FILENAME_COREDUMP,
+    FILENAME_BINARY,
+    FILENAME_VMCORE,
+    NULL
+};
+
+static unsigned filter_timeout_ms(off_t input_size)
+{
+    const unsigned long long timeout_sec = FILTER_MIN_TIMEOUT_SEC + input_size / FILTER_MIN_SPEED;
+    return MIN(timeout_sec * 1000, UINT_MAX);
+}
+
+/* Runs ARGS with stdin redirected from IN_FD and stdout to OUT_FD */
+static int run_filter(const char *const *args, int in_fd, int out_fd)
+{
+    struct stat st;
+    if (fstat(in_fd, &st) != 0)
+    {
+        perror_msg("fstat");
+        return -errno;
+    }
+
+    struct child_runner *runner = child_runner_new();
+    child_runner_spawn_filter(runner, (char **)args, in_fd, out_fd, filter_timeout_ms(st.st_size));
+    struct abrt_child *child = child_runner_wait(runner);
+
+    int r = 0;
+    if (child->timed_out)
+    {
+        error_msg("'%s' has been killed, it did not finish in time", args[0]);
+        r = -ETIMEDOUT;
+    }
+    else if (!WIFEXITED(child->status) || WEXITSTATUS(child->status) != 0)
+    {
+        error_msg("'%s' failed with status %d: %s", args[0], child->status, child->output ? child->output : "");
+        r = -EIO;
+    }
+
+    abrt_child_free(child);
+    child_runner_free(runner);
+    return r;
+}
+
+/* Converts dd/SRC to dd/DST through ARGS. DST gets the owner and mode of SRC
+ * and SRC is removed on success.
+ */
+static int convert_element(struct dump_dir *dd, const char *src, const char *dst,
+        const char *const *args)
+{
+    if (!dd->locked)
+    {
+        error_msg("Problem directory '%s' must be locked", dd->dd_dirname);
+        return -EPERM;
+    }
+
+    int r = 0;
+    char *tmp = xasprintf("%s"COLD_TMP_SUFFIX, dst);
+
+    const int in_fd = openat(dd->dd_fd, src, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (in_fd < 0)
+    {
+        r = -errno;
+        perror_msg("Can't open '%s/%s'", dd->dd_dirname, src);
+        goto finito;
+    }
+
+    struct stat st;
+    if (fstat(in_fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        r = -EINVAL;
+        error_msg("'%s/%s' is not a regular file", dd->dd_dirname, src);
+        goto close_in;
+    }
+
+    /* A left-over of an interrupted run */
+    unlinkat(dd->dd_fd, tmp, 0);
+
+    const int out_fd = openat(dd->dd_fd, tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                              st.st_mode & 0777);
+    if (out_fd < 0)
+    {
+        r = -errno;
+        perror_msg("Can't create '%s/%s'", dd->dd_dirname, tmp);
+        goto close_in;
+    }
+
+    if (geteuid() == 0 && fchown(out_fd, st.st_uid, st.st_gid) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't change owner of '%s/%s'", dd->dd_dirname, tmp);
+        goto close_out;
+    }
+
+    r = run_filter(args, in_fd, out_fd);
+    if (r == 0 && fsync(out_fd) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't write '%s/%s'", dd->dd_dirname, tmp);
+    }
+
+close_out:
+    close(out_fd);
+
+    if (r == 0 && renameat(dd->dd_fd, tmp, dd->dd_fd, dst) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't rename '%s/%s' to '%s'", dd->dd_dirname, tmp, dst);
+    }
+
+    if (r == 0)
+        unlinkat(dd->dd_fd, src, 0);
+    else
+        unlinkat(dd->dd_fd, tmp, 0);
+
+close_in:
+    close(in_fd);
+finito:
+    free(tmp);
+    return r;
+}
+
+int problem_element_compress(struct dump_dir *dd, const char *name)
+{
+    static const char *const args[] = { XZ, "-T0", "-3", "-q", "-c", NULL };
+
+    char *cold = xasprintf("%s"COLD_SUFFIX, name);
+    const int r = convert_element(dd, name, cold, args);
+    free(cold);
+
+    if (r == 0)
+        log_info("Compressed '%s/%s'", dd->dd_dirname, name);
+
+    return r;
+}
+
+/* Returns the size of the data compressed in dd/COLD or -errno */
+static long long inflated_size(struct dump_dir *dd, const char *cold)
+{
+    char *path = concat_path_file(dd->dd_dirname, cold);
+    char *args[] = { (char *)XZ, (char *)"--robot", (char *)"--list", path, NULL };
+
+    int status;
+    char *out = run_child(args, EXECFLG_INPUT_NUL | EXECFLG_ERR_NUL, /*env_vec:*/ NULL,
+                          FILTER_MIN_TIMEOUT_SEC * 1000, &status, /*timed_out:*/ NULL);
+
+    /* totals <streams> <blocks> <compressed> <uncompressed> ... */
+    long long r = -EIO;
+    unsigned long long size;
+    const char *totals = strstr(out, "\ntotals\t");
+    if (status == 0 && totals != NULL
+     && sscanf(totals, "\ntotals\t%*u\t%*u\t%*u\t%llu", &size) == 1)
+        r = size;
+    else
+        error_msg("Can't get the size of the data in '%s'", path);
+
+    free(out);
+    free(path);
+    return r;
+}
+
+/* Returns 0 if SIZE bytes can be written to DIR and 1/INFLATE_RESERVE_PART
+ * of its file system is still left free, -errno otherwise */
+static int check_free_space(const char *dir, struct dump_dir *dd, const char *cold,
+        unsigned long long size)
+{
+    struct statvfs vfs;
+    if (statvfs(dir, &vfs) != 0)
+    {
+        const int r = -errno;
+        perror_msg("statvfs('%s')", dir);
+        return r;
+    }
+
+    const unsigned long long avail = (unsigned long long)vfs.f_bavail * vfs.f_frsize;
+    const unsigned long long reserve = (unsigned long long)vfs.f_blocks * vfs.f_frsize / INFLATE_RESERVE_PART;
+    if (size + reserve > avail)
+    {
+        error_msg("Not enough free space in '%s' to inflate '%s/%s' (%llu MiB)",
+                dir, dd->dd_dirname, cold, size / (1024 * 1024));
+        return -ENOSPC;
+    }
+
+    return 0;
+}
+
+/* An inflated problem must not push the dump location over
+ * MaxCrashReportsSize, abrtd would delete the biggest problems, most likely
+ * the inflated one. Returns 0 or -errno.
+ */
+static int check_dump_location_size(struct dump_dir *dd, const char *cold,
+        unsigned long long size)
+{
+    const bool conf_loaded = g_settings_dump_location != NULL;
+    if (!conf_loaded)
+        load_abrt_conf();
+
+    int r = 0;
+    /* Tools run by events get a relative path */
+    char *dir_path = realpath(dd->dd_dirname, NULL);
+    const char *dump_location = g_settings_dump_location;
+    const size_t len = strlen(dump_location);
+    if (g_settings_nMaxCrashReportsSize == 0
+        || dir_path == NULL
+        || strncmp(dir_path, dump_location, len) != 0
+        || dir_path[len] != '/')
+        goto finito;
+
+    struct stat st;
+    if (fstatat(dd->dd_fd, cold, &st, AT_SYMLINK_NOFOLLOW) != 0)
+    {
+        r = -errno;
+        goto finito;
+    }
+
+    /* NAME.xz is removed once NAME is restored */
+    const double max_size = g_settings_nMaxCrashReportsSize * (1024.0 * 1024.0);
+    const double new_size = dump_location_size_find_largest_dir(dump_location, NULL, NULL)
+                            - st.st_size + size;
+    if (new_size > max_size)
+    {
+        error_msg("Inflating '%s/%s' would exceed MaxCrashReportsSize (%u MiB) of '%s'",
+                dd->dd_dirname, cold, g_settings_nMaxCrashReportsSize, dump_location);
+        r = -EFBIG;
+    }
+
+finito:
+    free(dir_path);
+    if (!conf_loaded)
+        free_abrt_conf_data();
+    return r;
+}
+
+int problem_element_inflate(struct dump_dir *dd, const char *name)
+{
+    static const char *const args[] = { XZ, "-d", "-T0", "-q", "-c", NULL };
+
+    struct stat st;
+    if (fstatat(dd->dd_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+        return 0;
+
+    char *cold = xasprintf("%s"COLD_SUFFIX, name);
+    int r = -ENOENT;
+    if (fstatat(dd->dd_fd, cold, &st, AT_SYMLINK_NOFOLLOW) == 0)
+    {
+        /* The data stay in the problem directory, the same limits as for
+         * new problems apply */
+        const long long size = inflated_size(dd, cold);
+        r = size < 0 ? size : check_free_space(dd->dd_dirname, dd, cold, size);
+        if (r == 0)
+            r = check_dump_location_size(dd, cold, size);
+
+        if (r == 0)
+        {
+            log_notice("Inflating '%s/%s'", dd->dd_dirname, cold);
+            r = convert_element(dd, cold, name, args);
+        }
+    }
+    free(cold);
+
+    return r;
+}
+
+int problem_element_open_inflated(struct dump_dir *dd, const char *name)
+{
+    static const char *const args[] = { XZ, "-d", "-T0", "-q", "-c", NULL };
+
+    int fd = openat(dd->dd_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd >= 0)
+        return fd;
+    if (errno != ENOENT)
+        return -errno;
+
+    char *cold = xasprintf("%s"COLD_SUFFIX, name);
+    const int in_fd = openat(dd->dd_fd, cold, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (in_fd < 0)
+    {
+        fd = -errno;
+        free(cold);
+        return fd;
+    }
+
+    /* A coredump can inflate to gigabytes, don't fill up the disk */
+    const long long size = inflated_size(dd, cold);
+    fd = size < 0 ? size : check_free_space(LARGE_DATA_TMP_DIR, dd, cold, size);
+    free(cold);
+    if (fd < 0)
+        goto close_in;
+
+    /* The data disappear with the last descriptor */
+    fd = open(LARGE_DATA_TMP_DIR, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0 && (errno == EOPNOTSUPP || errno == EISDIR))
+    {
+        /* The file system doesn't support O_TMPFILE */
+        char tmp_path[] = LARGE_DATA_TMP_DIR"/abrt-inflated-XXXXXX";
+        fd = mkostemp(tmp_path, O_CLOEXEC);
+        if (fd >= 0)
+            unlink(tmp_path);
+    }
+    if (fd < 0)
+    {
+        fd = -errno;
+        perror_msg("Can't create a temporary file in '%s'", LARGE_DATA_TMP_DIR);
+        goto close_in;
+    }
+
+    log_notice("Inflating '%s/%s"COLD_SUFFIX"' to a temporary file", dd->dd_dirname, name);
+    const int r = run_filter(args, in_fd, fd);
+    if (r == 0 && lseek(fd, 0, SEEK_SET) == 0)
+        goto close_in;
+
+    close(fd);
+    fd = r < 0 ? r : -EIO;
+
+close_in:
+    close(in_fd);
+    return fd;
+}
+
+int problem_dir_inflate(const char *dump_dir_name)
+{
+    struct dump_dir *dd = dd_opendir(dump_dir_name, /*flags*/0);
+    if (dd == NULL)
+        return -ENOENT;
+
+    int r = 0;
+    for (const char *const *name = s_cold_elements; *name != NULL; ++name)
+    {
+        const int ret = problem_element_inflate(dd, *name);
+        if (ret != 0 && ret != -ENOENT && r == 0)
+            r = ret;
+    }
+
+    if (r == 0)
+        r = problem_coredump_restore(dd);
+
+    dd_close(dd);
+    return r;
+}
+
+/* Returns the number of saved bytes */
+static off_t compress_cold_elements(struct dump_dir *dd)
+{
+    off_t saved = 0;
+    for (const char *const *name = s_cold_elements; *name != NULL; ++name)
+    {
+        struct stat st;
+        /* Elements shared through the blob store stay shared, a compressed
+         * copy per problem would take more space than the single link */
+        if (fstatat(dd->dd_fd, *name, &st, AT_SYMLINK_NOFOLLOW) != 0
+            || !S_ISREG(st.st_mode)
+            || st.st_nlink > 1
+            || st.st_size < COLD_MIN_ELEMENT_SIZE)
+            continue;
+
+        if (problem_element_compress(dd, *name) != 0)
+            continue;
+
+        char *cold = xasprintf("%s"COLD_SUFFIX, *name);
+        struct stat cold_st;
+        if (fstatat(dd->dd_fd, cold, &cold_st, AT_SYMLINK_NOFOLLOW) == 0)
+            saved += st.st_size - cold_st.st_size;
+        free(cold);
+    }
+
+    return saved;
+}
+
+/* Problems without the last occurrence use the time of creation */
+static time_t problem_last_occurrence(struct dump_dir *dd)
+{
+    uint32_t last = 0;
+    if (problem_summary_load_uint32(dd, FILENAME_LAST_OCCURRENCE, &last) == 0 && last != 0)
+        return last;
+
+    return dd->dd_time;
+}
+
+int dump_location_compress_cold(const char *dump_location, unsigned min_age_sec)
+{
+    GPtrArray *entries = dump_location_list(dump_location, DUMP_LOCATION_LIST_LOCKED);
+    if (entries == NULL)
+        return -errno;
+
+    const time_t now = time(NULL);
+    int compressed = 0;
+    off_t saved = 0;
+    for (unsigned i = 0; i < entries->len; ++i)
+    {
+        const struct dump_location_entry *entry = g_ptr_array_index(entries, i);
+        if (entry->dle_locked)
+            continue;
+
+        char *path = concat_path_file(dump_location, entry->dle_name);
+        int sv_logmode = logmode;
+        logmode = g_verbose == 0 ? 0 : sv_logmode;
+        struct dump_dir *dd = dd_opendir(path, DD_DONT_WAIT_FOR_LOCK | DD_FAIL_QUIETLY_ENOENT | DD_FAIL_QUIETLY_EACCES);
+        logmode = sv_logmode;
+        free(path);
+
+        if (dd == NULL)
+            continue;
+
+        if (problem_dump_dir_is_complete(dd)
+            && now - problem_last_occurrence(dd) >= (time_t)min_age_sec)
+        {
+            const off_t dir_saved = compress_cold_elements(dd);
+            if (dir_saved != 0)
+            {
+                ++compressed;
+                saved += dir_saved;
+            }
+        }
+        dd_close(dd);
+    }
+    g_ptr_array_free(entries, TRUE);
+
+    if (compressed > 0)
+        log_warning("Compressed %d old problem directories in '%s', saved %llu KiB",
+                compressed, dump_location, (unsigned long long)(saved / 1024));
+
+    metrics_counter_add("abrt_cold_storage_saved_bytes_total", saved);
+    metrics_counter_add("abrt_cold_storage_problems_total", compressed);
+    metrics_flush("abrt-cold-storage");
+
+    return compressed;
+}
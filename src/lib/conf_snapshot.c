@@ -0,0 +1,236 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Compiled configuration snapshots
+ *
+ * The hook, abrt-server and abrtd load the same configuration files over and
+ * over again. The parsed contents of a configuration file are therefore
+ * stored in a binary file under VAR_RUN/abrt/conf together with a hash of
+ * the time stamps of the source files. As long as the source files do not
+ * change, the snapshot is mapped to memory and copied to the settings map
+ * without any parsing.
+ *
+ * The snapshot is a snapshot file whose generation is the SHA-1 of struct
+ * conf_source_stamp of all source files. Its payload consists of NUL
+ * terminated strings: the return value of load_conf_file_from_dirs() and
+ * pairs of KEY and VALUE.
+ */
+
+#include "internal_libabrt.h"
+
+#define CONF_SNAPSHOT_DIR   VAR_RUN"/abrt/conf"
+#define CONF_SNAPSHOT_MAGIC "ABRTCNF2"
+
+struct conf_source_stamp
+{
+    uint64_t dev;
+    uint64_t ino;
+    int64_t  size;
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+    uint32_t exists;
+    uint32_t padding;
+};
+
+static const char *get_snapshot_dir(void)
+{
+    const char *dir = getenv("ABRT_CONF_SNAPSHOT_DIR");
+    return dir != NULL ? dir : CONF_SNAPSHOT_DIR;
+}
+
+static unsigned count_directories(const char *const *dirs)
+{
+    unsigned cnt = 0;
+    while (dirs[cnt] != NULL)
+        ++cnt;
+    return cnt;
+}
+
+/* Snapshots are identified by the list of the source files */
+static char *get_snapshot_path(const char *file, const char *const *dirs)
+{
+    struct strbuf *buf = strbuf_new();
+    for (const char *const *dir = dirs; *dir != NULL; ++dir)
+        strbuf_append_strf(buf, "%s\n", *dir);
+    strbuf_append_str(buf, file);
+
+    char hash_str[SHA1_RESULT_LEN*2 + 1];
+    str_to_sha1str(hash_str, buf->buf);
+    strbuf_free(buf);
+
+    return xasprintf("%s/%s-%s", get_snapshot_dir(), file, hash_str);
+}
+
+/* Returns false if the stamps cannot be trusted: a source file has been
+ * modified in the current second and a next modification in the same second
+ * would not be detected on file systems with coarse time stamps.
+ */
+static bool get_source_stamps(const char *file, const char *const *dirs,
+        struct conf_source_stamp *stamps)
+{
+    bool trusted = true;
+    const time_t now = time(NULL);
+
+    for (unsigned i = 0; dirs[i] != NULL; ++i)
+    {
+        memset(&stamps[i], 0, sizeof(stamps[i]));
+
+        char *path = concat_path_file(dirs[i], file);
+        struct stat st;
+        if (stat(path, &st) == 0)
+        {
+            stamps[i].dev = st.st_dev;
+            stamps[i].ino = st.st_ino;
+            stamps[i].size = st.st_size;
+            stamps[i].mtime_sec = st.st_mtim.tv_sec;
+            stamps[i].mtime_nsec = st.st_mtim.tv_nsec;
+            stamps[i].exists = 1;
+
+            trusted = trusted && st.st_mtim.tv_sec < now;
+        }
+        free(path);
+    }
+
+    return trusted;
+}
+
+/* Returns the result stored in the snapshot or -1 if the snapshot cannot be
+ * used.
+ */
+static int load_snapshot(const char *path, const uint8_t generation[SHA1_RESULT_LEN],
+        map_string_t *settings)
+{
+    struct abrt_snapshot_file snapshot;
+    if (snapshot_file_open(&snapshot, path, CONF_SNAPSHOT_MAGIC, generation) != 0)
+        return -1;
+
+    /* Validate the items before modifying the settings */
+    const char *const end = snapshot.payload + snapshot.payload_size;
+    const char *item = snapshot.payload;
+    unsigned strings = 0;
+    while (item < end)
+    {
+        const char *nul = memchr(item, '\0', end - item);
+        if (nul == NULL)
+            break;
+
+        ++strings;
+        item = nul + 1;
+    }
+
+    int r = -1;
+    char *result_end = NULL;
+    const long result = strings > 0 ? strtol(snapshot.payload, &result_end, 10) : 0;
+    if (item != end || strings % 2 != 1 || result_end == snapshot.payload || *result_end != '\0')
+    {
+        log_notice("Configuration snapshot '%s' is corrupted", path);
+        goto finito;
+    }
+
+    item = snapshot.payload + strlen(snapshot.payload) + 1;
+    while (item < end)
+    {
+        const char *const key = item;
+        const char *const value = key + strlen(key) + 1;
+        item = value + strlen(value) + 1;
+
+        replace_map_string_item(settings, xstrdup(key), xstrdup(value));
+    }
+
+    log_debug("Loaded configuration snapshot '%s'", path);
+    r = result;
+
+finito:
+    snapshot_file_close(&snapshot);
+    return r;
+}
+
+static void save_snapshot(const char *path, const uint8_t generation[SHA1_RESULT_LEN],
+        map_string_t *settings, int result)
+{
+    const char *snapshot_dir = get_snapshot_dir();
+    if (mkdir(snapshot_dir, 0700) != 0 && errno != EEXIST)
+    {
+        log_debug("Can't create directory '%s': %s", snapshot_dir, strerror(errno));
+        return;
+    }
+
+    struct strbuf *payload = strbuf_new();
+    strbuf_append_strf(payload, "%d", result);
+    strbuf_append_char(payload, '\0');
+
+    GHashTableIter iter;
+    const char *key;
+    const char *value;
+    init_map_string_iter(&iter, settings);
+    while (next_map_string_iter(&iter, &key, &value))
+    {
+        strbuf_append_str(payload, key);
+        strbuf_append_char(payload, '\0');
+        strbuf_append_str(payload, value);
+        strbuf_append_char(payload, '\0');
+    }
+
+    if (snapshot_file_save(path, CONF_SNAPSHOT_MAGIC, generation, payload->buf, payload->len) == 0)
+        log_debug("Saved configuration snapshot '%s'", path);
+
+    strbuf_free(payload);
+}
+
+int load_conf_file_from_dirs_cached(const char *file, const char *const *dirs,
+        map_string_t *settings)
+{
+    /* Snapshots are written by root only and cover only plain file names
+     * loaded into an empty map.
+     */
+    if (geteuid() != 0 || strchr(file, '/') != NULL || g_hash_table_size(settings) != 0)
+        return load_conf_file_from_dirs(file, dirs, settings, /*skip key w/o values:*/ false);
+
+    const unsigned source_count = count_directories(dirs);
+    struct conf_source_stamp *stamps = xmalloc(source_count * sizeof(*stamps));
+    char *path = get_snapshot_path(file, dirs);
+
+    const bool trusted = get_source_stamps(file, dirs, stamps);
+    uint8_t generation[SHA1_RESULT_LEN];
+    snapshot_file_compute_sha1(stamps, source_count * sizeof(*stamps), generation);
+
+    int r = -1;
+    if (trusted)
+        r = load_snapshot(path, generation, settings);
+
+    if (r < 0)
+    {
+        r = load_conf_file_from_dirs(file, dirs, settings, /*skip key w/o values:*/ false);
+
+        /* Save the snapshot only if the sources have not been modified in
+         * the meantime.
+         */
+        struct conf_source_stamp *after = xmalloc(source_count * sizeof(*after));
+        if (trusted
+            && get_source_stamps(file, dirs, after)
+            && memcmp(stamps, after, source_count * sizeof(*after)) == 0)
+            save_snapshot(path, generation, settings, r);
+        free(after);
+    }
+
+    free(path);
+    free(stamps);
+    return r;
+}
@@ -0,0 +1,331 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Modules of a coredump
+ *
+ * The modules are reported by libdwfl exactly as 'eu-unstrip -n' does it,
+ * but in-process. libdwfl reads the core through mmap and touches only the
+ * program headers, the notes and the pages with the ELF headers and build-id
+ * notes of the mapped files, which are kept by minidumps and by the cores
+ * with left out mapped files too.
+ *
+ * 'eu-unstrip -n' looks up the ELF file and debuginfo of every module. The
+ * lookups are skipped for the modules whose build-id was found in the core
+ * unless CORE_MODULES_FIND_FILES is given, because nothing else than the
+ * build-id is needed to identify them.
+ *
+ * Bugs in libdwfl or corrupted coredumps can make the reading loop forever,
+ * so core_modules_load() runs abrt-core-modules which is killed after a
+ * timeout. The callers can have threads, so a forked copy of the caller
+ * could not safely do anything else than exec. The tool gets the coredump on
+ * its standard input and writes the modules as NUL terminated fields.
+ */
+
+#include <elfutils/libdwfl.h>
+#include "internal_libabrt.h"
+
+/* The fields of a module written by abrt-core-modules */
+#define CORE_MODULE_FIELDS 7
+
+static char *s_debuginfo_path = NULL;
+
+/* The callbacks of 'eu-unstrip --core' */
+static const Dwfl_Callbacks s_core_callbacks = {
+    .find_elf = dwfl_build_id_find_elf,
+    .find_debuginfo = dwfl_standard_find_debuginfo,
+    .debuginfo_path = &s_debuginfo_path,
+};
+
+struct core_modules_state
+{
+    int flags;
+    GList *modules;
+};
+
+static char *build_id_to_str(const unsigned char *bits, int len)
+{
+    char *str = xmalloc(len * 2 + 1);
+    bin2hex(str, (const char *)bits, len)[0] = '\0';
+    return str;
+}
+
+static int report_module(Dwfl_Module *mod, void **userdata, const char *name,
+        Dwarf_Addr start, void *arg)
+{
+    struct core_modules_state *state = arg;
+
+    const unsigned char *bits;
+    GElf_Addr vaddr = 0;
+    int len = dwfl_module_build_id(mod, &bits, &vaddr);
+
+    char *file = NULL;
+    char *debug = NULL;
+    if ((state->flags & CORE_MODULES_FIND_FILES) || len <= 0 || vaddr == 0)
+    {
+        Dwarf_Addr bias;
+        const bool have_elf = dwfl_module_getelf(mod, &bias) != NULL;
+        const bool have_dwarf = dwfl_module_getdwarf(mod, &bias) != NULL;
+
+        const char *mainfile = NULL;
+        const char *debugfile = NULL;
+        dwfl_module_info(mod, NULL, NULL, NULL, NULL, NULL, &mainfile, &debugfile);
+        /* The debuginfo is in the ELF file */
+        if (mainfile && debugfile && strcmp(mainfile, debugfile) == 0)
+            debugfile = ".";
+        file = xstrdup(mainfile ? mainfile : have_elf ? "." : "-");
+        debug = xstrdup(debugfile ? debugfile : have_dwarf ? "." : "-");
+
+        /* The ELF file has the build-id if the core doesn't */
+        len = dwfl_module_build_id(mod, &bits, &vaddr);
+    }
+
+    Dwarf_Addr end;
+    if (dwfl_module_info(mod, NULL, NULL, &end, NULL, NULL, NULL, NULL) == NULL)
+    {
+        error_msg("Can't get information about module '%s': %s", name, dwfl_errmsg(-1));
+        free(file);
+        free(debug);
+        return DWARF_CB_ABORT;
+    }
+
+    struct core_module *module = xzalloc(sizeof(*module));
+    module->cm_start = start;
+    module->cm_size = end - start;
+    if (len > 0)
+    {
+        module->cm_build_id = build_id_to_str(bits, len);
+        module->cm_build_id_vaddr = vaddr;
+    }
+    module->cm_file = file;
+    module->cm_debug = debug;
+    module->cm_name = xstrdup(name);
+
+    state->modules = g_list_prepend(state->modules, module);
+    return DWARF_CB_OK;
+}
+
+int core_modules_read(int fd, const char *name, int flags, GList **modules)
+{
+    *modules = NULL;
+
+    int r = -EINVAL;
+    elf_version(EV_CURRENT);
+    Elf *core = elf_begin(fd, ELF_C_READ_MMAP, NULL);
+    if (core == NULL)
+    {
+        error_msg("Can't read '%s': %s", name, elf_errmsg(-1));
+        return r;
+    }
+
+    Dwfl *dwfl = dwfl_begin(&s_core_callbacks);
+    if (dwfl == NULL)
+    {
+        error_msg("Can't initialize libdwfl: %s", dwfl_errmsg(-1));
+        goto end_elf;
+    }
+
+    if (dwfl_core_file_report(dwfl, core, /*executable:*/ NULL) < 0)
+    {
+        error_msg("Can't get modules of '%s': %s", name, dwfl_errmsg(-1));
+        goto end_dwfl;
+    }
+    dwfl_report_end(dwfl, NULL, NULL);
+
+    struct core_modules_state state = { .flags = flags, .modules = NULL };
+    if (dwfl_getmodules(dwfl, report_module, &state, 0) != 0)
+    {
+        core_modules_free(state.modules);
+        goto end_dwfl;
+    }
+
+    *modules = g_list_reverse(state.modules);
+    r = 0;
+
+end_dwfl:
+    dwfl_end(dwfl);
+end_elf:
+    elf_end(core);
+    return r;
+}
+
+static void append_field(GString *buf, const char *value)
+{
+    if (value == NULL)
+        value = "";
+    g_string_append_len(buf, value, strlen(value) + 1);
+}
+
+static void append_hex_field(GString *buf, unsigned long long value)
+{
+    g_string_append_printf(buf, "%llx", value);
+    g_string_append_c(buf, '\0');
+}
+
+int core_modules_write(int fd, GList *modules)
+{
+    GString *buf = g_string_new(NULL);
+    for (GList *li = modules; li != NULL; li = g_list_next(li))
+    {
+        const struct core_module *module = li->data;
+        append_hex_field(buf, module->cm_start);
+        append_hex_field(buf, module->cm_size);
+        append_field(buf, module->cm_build_id);
+        append_hex_field(buf, module->cm_build_id_vaddr);
+        append_field(buf, module->cm_file);
+        append_field(buf, module->cm_debug);
+        append_field(buf, module->cm_name);
+    }
+
+    const int r = full_write(fd, buf->str, buf->len) == (ssize_t)buf->len ? 0 : -EIO;
+    g_string_free(buf, TRUE);
+    return r;
+}
+
+static char *field_dup(const char *value)
+{
+    return value[0] != '\0' ? xstrdup(value) : NULL;
+}
+
+static int core_modules_parse(const char *data, size_t len, GList **modules)
+{
+    *modules = NULL;
+
+    const char *end = data + len;
+    while (data < end)
+    {
+        const char *fields[CORE_MODULE_FIELDS];
+        for (int i = 0; i < CORE_MODULE_FIELDS; ++i)
+        {
+            const char *nul = memchr(data, '\0', end - data);
+            if (nul == NULL)
+            {
+                error_msg("Truncated list of modules of coredump");
+                core_modules_free(*modules);
+                *modules = NULL;
+                return -EINVAL;
+            }
+            fields[i] = data;
+            data = nul + 1;
+        }
+
+        struct core_module *module = xzalloc(sizeof(*module));
+        module->cm_start = strtoull(fields[0], NULL, 16);
+        module->cm_size = strtoull(fields[1], NULL, 16);
+        module->cm_build_id = field_dup(fields[2]);
+        module->cm_build_id_vaddr = strtoull(fields[3], NULL, 16);
+        module->cm_file = field_dup(fields[4]);
+        module->cm_debug = field_dup(fields[5]);
+        module->cm_name = xstrdup(fields[6]);
+        *modules = g_list_prepend(*modules, module);
+    }
+
+    *modules = g_list_reverse(*modules);
+    return 0;
+}
+
+int core_modules_load(struct dump_dir *dd, int flags, unsigned timeout_sec, GList **modules)
+{
+    *modules = NULL;
+
+    const int fd = problem_element_open_inflated(dd, FILENAME_COREDUMP);
+    if (fd < 0)
+    {
+        if (fd != -ENOENT)
+            error_msg("Can't open '%s/"FILENAME_COREDUMP"': %s", dd->dd_dirname, strerror(-fd));
+        return fd;
+    }
+
+    char *name = concat_path_file(dd->dd_dirname, FILENAME_COREDUMP);
+
+    /* The test suite runs the tool from the build tree */
+    const char *tool = getenv("ABRT_CORE_MODULES_TOOL");
+    char *args[4];
+    char **pp = args;
+    *pp++ = (char *)(tool ? tool : LIBEXEC_DIR"/abrt-core-modules");
+    if (flags & CORE_MODULES_FIND_FILES)
+        *pp++ = (char *)"-f";
+    *pp++ = name;
+    *pp = NULL;
+
+    struct child_runner *runner = child_runner_new();
+    child_runner_spawn_filter(runner, args, fd, /*out_fd:*/ -1, MIN(timeout_sec * 1000ULL, UINT_MAX));
+    close(fd);
+    struct abrt_child *child = child_runner_wait(runner);
+
+    int r;
+    if (child->timed_out)
+    {
+        error_msg("Timeout exceeded: %u seconds, reading modules of '%s'", timeout_sec, name);
+        r = -ETIMEDOUT;
+    }
+    else if (!WIFEXITED(child->status) || WEXITSTATUS(child->status) != 0)
+        /* The tool has already told why */
+        r = -EINVAL;
+    else
+        r = core_modules_parse(child->output, child->output_len, modules);
+
+    abrt_child_free(child);
+    child_runner_free(runner);
+    free(name);
+    return r;
+}
+
+void core_module_free(struct core_module *module)
+{
+    if (!module)
+        return;
+
+    free(module->cm_build_id);
+    free(module->cm_file);
+    free(module->cm_debug);
+    free(module->cm_name);
+    free(module);
+}
+
+void core_modules_free(GList *modules)
+{
+    g_list_free_full(modules, (GDestroyNotify)core_module_free);
+}
+
+char *core_modules_to_unstrip_n(GList *modules)
+{
+    struct strbuf *buf = strbuf_new();
+    for (GList *li = modules; li != NULL; li = g_list_next(li))
+    {
+        const struct core_module *module = li->data;
+        strbuf_append_strf(buf, "%#llx+%#llx ", module->cm_start, module->cm_size);
+
+        if (module->cm_build_id)
+        {
+            strbuf_append_str(buf, module->cm_build_id);
+            if (module->cm_build_id_vaddr != 0)
+                strbuf_append_strf(buf, "@%#llx", module->cm_build_id_vaddr);
+        }
+        else
+            strbuf_append_char(buf, '-');
+
+        strbuf_append_strf(buf, " %s %s %s\n",
+                module->cm_file ? module->cm_file : "-",
+                module->cm_debug ? module->cm_debug : "-",
+                module->cm_name);
+    }
+
+    return strbuf_free_nobuf(buf);
+}
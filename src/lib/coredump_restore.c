@@ -0,0 +1,296 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Restoration of coredump segments left out by abrt-hook-ccpp
+ *
+ * The left out segments have p_filesz == 0 in coredump. The data are read
+ * from the mapped files and appended to coredump, then p_offset and p_filesz
+ * of the segments are updated. Program headers are written after the data,
+ * so an interrupted restoration leaves coredump valid.
+ */
+
+#include <link.h>
+#include "internal_libabrt.h"
+
+#if __WORDSIZE == 64
+# define CORE_ELFCLASS ELFCLASS64
+#else
+# define CORE_ELFCLASS ELFCLASS32
+#endif
+
+struct elided_segment
+{
+    unsigned long start;
+    unsigned long end;
+    unsigned long long offset;
+    unsigned long long dev;
+    unsigned long long ino;
+    long long size;
+    long long mtime;
+    const char *path;
+};
+
+static int parse_elided_segment(char *line, struct elided_segment *seg)
+{
+    int path_pos = 0;
+    if (sscanf(line, "%lx %lx %llx %llx %llu %lld %lld %n",
+               &seg->start, &seg->end, &seg->offset, &seg->dev, &seg->ino,
+               &seg->size, &seg->mtime, &path_pos) != 7
+        || path_pos == 0 || line[path_pos] != '/' || seg->end <= seg->start)
+        return -EINVAL;
+
+    seg->path = line + path_pos;
+    for (const unsigned char *c = (const unsigned char *)seg->path; *c != '\0'; ++c)
+        if (*c < ' ' || *c == 0x7f)
+            return -EINVAL;
+
+    return 0;
+}
+
+static ssize_t pwrite_full(int fd, const void *buf, size_t size, off_t ofs)
+{
+    size_t written = 0;
+    while (written < size)
+    {
+        const ssize_t w = pwrite(fd, (const char *)buf + written, size - written, ofs + written);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        written += w;
+    }
+
+    return written;
+}
+
+/* abrtd restores as root, so the data of files the crashed process could not
+ * read must not end up in its coredump */
+static bool uid_can_read(uid_t uid, const struct stat *st)
+{
+    if (uid == 0)
+        return true;
+    if (st->st_uid == uid)
+        return st->st_mode & S_IRUSR;
+    if (uid_in_group(uid, st->st_gid))
+        return st->st_mode & S_IRGRP;
+    return st->st_mode & S_IROTH;
+}
+
+/* Appends the data of SEG to CORE_FD at OFS */
+static int copy_segment_data(int core_fd, off_t ofs, const struct elided_segment *seg,
+        const char *rootdir, uid_t uid)
+{
+    char *path = rootdir ? concat_path_file(rootdir, seg->path) : xstrdup(seg->path);
+    int r = 0;
+
+    const int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't open '%s'", path);
+        goto finito;
+    }
+
+    if (!S_ISREG(st.st_mode) || !uid_can_read(uid, &st))
+    {
+        r = -EACCES;
+        error_msg("'%s' is not readable by the user %lu", path, (unsigned long)uid);
+        goto finito;
+    }
+
+    if (st.st_dev != seg->dev || st.st_ino != seg->ino
+        || st.st_size != seg->size || st.st_mtime != seg->mtime)
+    {
+        r = -ESTALE;
+        error_msg("'%s' has changed since the crash", path);
+        goto finito;
+    }
+
+    char buf[64 * 1024];
+    unsigned long long copied = 0;
+    const unsigned long long size = seg->end - seg->start;
+    while (copied < size)
+    {
+        const ssize_t rd = pread(fd, buf, MIN(sizeof(buf), size - copied), seg->offset + copied);
+        if (rd < 0)
+        {
+            r = -errno;
+            perror_msg("Can't read '%s'", path);
+            goto finito;
+        }
+
+        /* The tail of the last page of a mapping beyond EOF reads as zeros */
+        if (rd == 0)
+            break;
+
+        if (pwrite_full(core_fd, buf, rd, ofs + copied) != rd)
+        {
+            r = -errno;
+            perror_msg("Can't write coredump");
+            goto finito;
+        }
+        copied += rd;
+    }
+
+finito:
+    if (fd >= 0)
+        close(fd);
+    free(path);
+    return r;
+}
+
+int problem_coredump_restore(struct dump_dir *dd)
+{
+    char *manifest = dd_load_text_ext(dd, FILENAME_COREDUMP_ELIDED,
+            DD_FAIL_QUIETLY_ENOENT | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+    if (manifest == NULL)
+        return 0;
+
+    int r = 0;
+    ElfW(Phdr) *phdrs = NULL;
+    char *rootdir = NULL;
+
+    if (!dd->locked)
+    {
+        error_msg("Problem directory '%s' must be locked", dd->dd_dirname);
+        r = -EPERM;
+        goto finito;
+    }
+
+    const int core_fd = openat(dd->dd_fd, FILENAME_COREDUMP, O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+    if (core_fd < 0)
+    {
+        r = -errno;
+        perror_msg("Can't open '%s/%s'", dd->dd_dirname, FILENAME_COREDUMP);
+        goto finito;
+    }
+
+    ElfW(Ehdr) ehdr;
+    struct stat core_st;
+    if (pread(core_fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr)
+        || fstat(core_fd, &core_st) != 0
+        || memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0
+        || ehdr.e_ident[EI_CLASS] != CORE_ELFCLASS
+        || ehdr.e_type != ET_CORE
+        || ehdr.e_phentsize != sizeof(ElfW(Phdr)))
+    {
+        r = -EINVAL;
+        error_msg("'%s/%s' is not a supported core file", dd->dd_dirname, FILENAME_COREDUMP);
+        goto close_core;
+    }
+
+    const size_t phdrs_size = ehdr.e_phnum * sizeof(ElfW(Phdr));
+    phdrs = xmalloc(phdrs_size);
+    if (pread(core_fd, phdrs, phdrs_size, ehdr.e_phoff) != (ssize_t)phdrs_size)
+    {
+        r = -EINVAL;
+        error_msg("Can't read program headers of '%s/%s'", dd->dd_dirname, FILENAME_COREDUMP);
+        goto close_core;
+    }
+
+    char *uid_str = dd_load_text_ext(dd, FILENAME_UID,
+            DD_FAIL_QUIETLY_ENOENT | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+    char *end = NULL;
+    errno = 0;
+    const unsigned long uid = uid_str ? strtoul(uid_str, &end, 10) : 0;
+    const bool uid_valid = uid_str && errno == 0 && end != uid_str && *end == '\0'
+                           && uid == (uid_t)uid;
+    free(uid_str);
+    if (!uid_valid)
+    {
+        r = -EINVAL;
+        error_msg("Can't load '%s' of '%s'", FILENAME_UID, dd->dd_dirname);
+        goto close_core;
+    }
+
+    /* Paths are relative to the root directory of the crashed process */
+    rootdir = dd_load_text_ext(dd, FILENAME_ROOTDIR,
+            DD_FAIL_QUIETLY_ENOENT | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+
+    const long page_size = sysconf(_SC_PAGESIZE);
+    off_t append_ofs = core_st.st_size;
+    unsigned restored = 0;
+    for (char *line = manifest, *next; r == 0 && line != NULL && *line != '\0'; line = next)
+    {
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        struct elided_segment seg;
+        if (parse_elided_segment(line, &seg) != 0)
+        {
+            r = -EINVAL;
+            error_msg("Invalid line in '%s': '%s'", FILENAME_COREDUMP_ELIDED, line);
+            break;
+        }
+
+        unsigned i = 0;
+        while (i < ehdr.e_phnum
+               && (phdrs[i].p_type != PT_LOAD || phdrs[i].p_vaddr != seg.start
+                   || phdrs[i].p_memsz != seg.end - seg.start))
+            ++i;
+
+        if (i == ehdr.e_phnum)
+        {
+            r = -EINVAL;
+            error_msg("No segment at 0x%lx in '%s/%s'", seg.start, dd->dd_dirname, FILENAME_COREDUMP);
+            break;
+        }
+
+        /* Restored by an interrupted run */
+        if (phdrs[i].p_filesz != 0)
+            continue;
+
+        append_ofs = (append_ofs + page_size - 1) & ~(off_t)(page_size - 1);
+        r = copy_segment_data(core_fd, append_ofs, &seg, rootdir, uid);
+        phdrs[i].p_offset = append_ofs;
+        phdrs[i].p_filesz = phdrs[i].p_memsz;
+        append_ofs += phdrs[i].p_memsz;
+        ++restored;
+    }
+
+    if (r == 0
+        && (ftruncate(core_fd, append_ofs) != 0
+            || pwrite_full(core_fd, phdrs, phdrs_size, ehdr.e_phoff) != (ssize_t)phdrs_size
+            || fsync(core_fd) != 0))
+    {
+        r = -errno;
+        perror_msg("Can't update '%s/%s'", dd->dd_dirname, FILENAME_COREDUMP);
+    }
+
+    if (r == 0)
+    {
+        dd_delete_item(dd, FILENAME_COREDUMP_ELIDED);
+        log_notice("Restored %u segments of '%s/%s'", restored, dd->dd_dirname, FILENAME_COREDUMP);
+    }
+    else if (ftruncate(core_fd, core_st.st_size) != 0)
+        perror_msg("Can't truncate '%s/%s'", dd->dd_dirname, FILENAME_COREDUMP);
+
+close_core:
+    close(core_fd);
+finito:
+    free(rootdir);
+    free(phdrs);
+    free(manifest);
+    return r;
+}
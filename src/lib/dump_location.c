@@ -0,0 +1,602 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Sharded dump location
+ *
+ * Problem directories are always created directly in the dump location. With
+ * ShardDumpLocation enabled, abrt-server moves every new problem directory
+ * into one of 256 shards once post-create has finished:
+ *
+ *   DumpLocation/shard-XX/PROBLEM
+ *
+ * where XX is the first byte of the SHA-1 of the PROBLEM name. The shard of a
+ * problem can be computed from its name, so the top level of the dump
+ * location serves as the index of shards and stays small. The functions in
+ * this file always walk both the top level and the shards, hence a dump
+ * location can contain a mix of both layouts.
+ */
+
+#include "internal_libabrt.h"
+#include "problem_api.h"
+
+#define SHARD_PREFIX "shard-"
+#define SHARD_NAME_LEN (sizeof(SHARD_PREFIX) - 1 + 2)
+/* Walking is I/O bound, more threads than CPUs still help */
+#define MAX_WALKERS 16
+
+bool dump_location_is_shard_name(const char *name)
+{
+    return strncmp(name, SHARD_PREFIX, strlen(SHARD_PREFIX)) == 0
+        && strlen(name) == SHARD_NAME_LEN
+        && strspn(name + strlen(SHARD_PREFIX), "0123456789abcdef") == 2;
+}
+
+char *dump_location_shard_name(const char *name)
+{
+    uint8_t sha1[SHA1_RESULT_LEN];
+    sha1_ctx_t ctx;
+    sha1_begin(&ctx);
+    sha1_hash(&ctx, name, strlen(name));
+    sha1_end(&ctx, sha1);
+
+    return xasprintf(SHARD_PREFIX"%02x", sha1[0]);
+}
+
+char *dump_location_shard_path(const char *dump_location, const char *name)
+{
+    char *shard = dump_location_shard_name(name);
+    char *path = xasprintf("%s/%s/%s", dump_location, shard, name);
+    free(shard);
+    return path;
+}
+
+void dump_location_entry_free(struct dump_location_entry *entry)
+{
+    if (entry == NULL)
+        return;
+
+    free(entry->dle_name);
+    free(entry);
+}
+
+/*
+ * Walking
+ */
+
+struct walk
+{
+    int location_fd;
+    int flags;
+};
+
+/* A shard or the top level of the dump location */
+struct walk_unit
+{
+    char *shard;        /* NULL for the top level */
+    GPtrArray *names;   /* the top level entries, read in advance */
+    GPtrArray *entries; /* the result */
+    double other_size;  /* size of regular files which are not problems */
+};
+
+/* Like get_dirsize() but files with more links (see blob_store.c) count only
+ * by their share, so the sizes of all problems and of the blob store add up
+ * to the space really used.
+ */
+static double get_shared_dirsize_ext(int parent_fd, const char *name, bool skip_single_link)
+{
+    const int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    DIR *dp = fdopendir(fd);
+    if (dp == NULL)
+    {
+        close(fd);
+        return 0;
+    }
+
+    double size = 0;
+    struct dirent *dent;
+    while ((dent = readdir(dp)) != NULL)
+    {
+        struct stat st;
+        if (dot_or_dotdot(dent->d_name)
+            || fstatat(fd, dent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode))
+            size += get_shared_dirsize_ext(fd, dent->d_name, skip_single_link);
+        else if (S_ISREG(st.st_mode) && !(skip_single_link && st.st_nlink == 1))
+            size += (double)st.st_size / st.st_nlink;
+    }
+    closedir(dp);
+
+    return size;
+}
+
+static double get_shared_dirsize(int parent_fd, const char *name)
+{
+    return get_shared_dirsize_ext(parent_fd, name, /*skip_single_link*/false);
+}
+
+/* A problem directory has the 'time' element; a directory which is still
+ * being created has at least the lock. Anything else (hidden directories,
+ * the blob store, leftovers of other tools) is not listed.
+ */
+static bool is_problem_dir_at(int dir_fd, const char *name)
+{
+    if (name[0] == '.')
+        return false;
+
+    struct stat st;
+    char *element = concat_path_file(name, FILENAME_TIME);
+    bool problem = fstatat(dir_fd, element, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(st.st_mode);
+    free(element);
+
+    if (!problem)
+    {
+        char *lock = concat_path_file(name, ".lock");
+        problem = fstatat(dir_fd, lock, &st, AT_SYMLINK_NOFOLLOW) == 0;
+        free(lock);
+    }
+
+    return problem;
+}
+
+static void walk_add_entry(const struct walk *walk, struct walk_unit *unit, int dir_fd, const char *name)
+{
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return;
+
+    if (!S_ISDIR(st.st_mode))
+    {
+        if (S_ISREG(st.st_mode))
+            unit->other_size += st.st_size;
+        return;
+    }
+
+    /* Not a problem but it occupies space */
+    if (!is_problem_dir_at(dir_fd, name))
+    {
+        /* Blobs no problem links to are about to be removed by
+         * dump_location_blobs_gc(), so callers deleting several problems in
+         * a row see the size drop without collecting garbage every time */
+        const bool blob_store = unit->shard == NULL && strcmp(name, BLOB_STORE_DIR_NAME) == 0;
+        if (walk->flags & DUMP_LOCATION_LIST_SIZE)
+            unit->other_size += get_shared_dirsize_ext(dir_fd, name, blob_store);
+        return;
+    }
+
+    struct dump_location_entry *entry = xzalloc(sizeof(*entry));
+    entry->dle_name = unit->shard ? xasprintf("%s/%s", unit->shard, name) : xstrdup(name);
+
+    entry->dle_owner = st.st_uid;
+    entry->dle_mtime = st.st_mtime;
+
+    if (walk->flags & DUMP_LOCATION_LIST_LOCKED)
+    {
+        char *lock = concat_path_file(name, ".lock");
+        struct stat lock_st;
+        entry->dle_locked = fstatat(dir_fd, lock, &lock_st, AT_SYMLINK_NOFOLLOW) == 0;
+        free(lock);
+    }
+
+    if (walk->flags & DUMP_LOCATION_LIST_SIZE)
+        entry->dle_size = get_shared_dirsize(dir_fd, name);
+
+    g_ptr_array_add(unit->entries, entry);
+}
+
+/* Runs in a worker thread; touches only its own unit */
+static void walk_unit_run(gpointer data, gpointer user_data)
+{
+    struct walk_unit *unit = data;
+    const struct walk *walk = user_data;
+
+    if (unit->shard == NULL)
+    {
+        for (unsigned i = 0; i < unit->names->len; ++i)
+            walk_add_entry(walk, unit, walk->location_fd, g_ptr_array_index(unit->names, i));
+        return;
+    }
+
+    const int shard_fd = openat(walk->location_fd, unit->shard,
+                                O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (shard_fd < 0)
+        return;
+
+    DIR *dp = fdopendir(shard_fd);
+    if (dp == NULL)
+    {
+        close(shard_fd);
+        return;
+    }
+
+    struct dirent *dent;
+    while ((dent = readdir(dp)) != NULL)
+    {
+        if (!dot_or_dotdot(dent->d_name))
+            walk_add_entry(walk, unit, shard_fd, dent->d_name);
+    }
+    closedir(dp);
+}
+
+static void walk_unit_free(struct walk_unit *unit)
+{
+    free(unit->shard);
+    if (unit->names)
+        g_ptr_array_free(unit->names, TRUE);
+    if (unit->entries)
+        g_ptr_array_free(unit->entries, TRUE);
+    free(unit);
+}
+
+static struct walk_unit *walk_unit_new(char *shard)
+{
+    struct walk_unit *unit = xzalloc(sizeof(*unit));
+    unit->shard = shard;
+    unit->entries = g_ptr_array_new_with_free_func((GDestroyNotify)dump_location_entry_free);
+    return unit;
+}
+
+static unsigned walker_count(unsigned units)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 2)
+        cpus = 2;
+
+    return MIN(units, (unsigned)MIN(cpus * 2, MAX_WALKERS));
+}
+
+static GPtrArray *walk_dump_location(const char *dump_location, int flags, double *other_size)
+{
+    struct walk walk = {
+        .location_fd = open(dump_location, O_RDONLY | O_DIRECTORY | O_CLOEXEC),
+        .flags = flags,
+    };
+    if (walk.location_fd < 0)
+        return NULL;
+
+    DIR *dp = opendir(dump_location);
+    if (dp == NULL)
+    {
+        close(walk.location_fd);
+        return NULL;
+    }
+
+    GPtrArray *units = g_ptr_array_new_with_free_func((GDestroyNotify)walk_unit_free);
+    struct walk_unit *top = walk_unit_new(NULL);
+    top->names = g_ptr_array_new_with_free_func(free);
+    g_ptr_array_add(units, top);
+
+    struct dirent *dent;
+    while ((dent = readdir(dp)) != NULL)
+    {
+        if (dot_or_dotdot(dent->d_name))
+            continue;
+
+        struct stat st;
+        if (dump_location_is_shard_name(dent->d_name)
+            && fstatat(walk.location_fd, dent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+            && S_ISDIR(st.st_mode))
+            g_ptr_array_add(units, walk_unit_new(xstrdup(dent->d_name)));
+        else
+            g_ptr_array_add(top->names, xstrdup(dent->d_name));
+    }
+    closedir(dp);
+
+    GThreadPool *pool = NULL;
+    const unsigned walkers = walker_count(units->len);
+    if (walkers > 1)
+    {
+        GError *error = NULL;
+        pool = g_thread_pool_new(walk_unit_run, &walk, walkers, /*exclusive*/TRUE, &error);
+        if (pool == NULL)
+        {
+            log_notice("Walking '%s' in one thread: %s", dump_location, error->message);
+            g_error_free(error);
+        }
+    }
+
+    for (unsigned i = 0; i < units->len; ++i)
+    {
+        if (pool == NULL || !g_thread_pool_push(pool, g_ptr_array_index(units, i), NULL))
+            walk_unit_run(g_ptr_array_index(units, i), &walk);
+    }
+
+    if (pool != NULL)
+        g_thread_pool_free(pool, /*immediate*/FALSE, /*wait*/TRUE);
+
+    close(walk.location_fd);
+
+    GPtrArray *entries = g_ptr_array_new_with_free_func((GDestroyNotify)dump_location_entry_free);
+    for (unsigned i = 0; i < units->len; ++i)
+    {
+        struct walk_unit *unit = g_ptr_array_index(units, i);
+        for (unsigned j = 0; j < unit->entries->len; ++j)
+            g_ptr_array_add(entries, g_ptr_array_index(unit->entries, j));
+
+        /* The entries have been moved */
+        g_ptr_array_set_free_func(unit->entries, NULL);
+
+        if (other_size != NULL)
+            *other_size += unit->other_size;
+    }
+    g_ptr_array_free(units, TRUE);
+
+    log_debug("Found %u entries in '%s' using %u threads", entries->len, dump_location, walkers);
+    return entries;
+}
+
+GPtrArray *dump_location_list(const char *dump_location, int flags)
+{
+    return walk_dump_location(dump_location, flags, /*other size*/NULL);
+}
+
+double dump_location_size_find_largest_dir(const char *dump_location, char **worst_dir, const char *excluded)
+{
+    GHashTable *excluded_set = NULL;
+    if (excluded != NULL)
+    {
+        excluded_set = g_hash_table_new(g_str_hash, g_str_equal);
+        g_hash_table_add(excluded_set, (gpointer)excluded);
+    }
+
+    const double size = dump_location_size_find_largest_dir_ext(dump_location, worst_dir, excluded_set);
+
+    if (excluded_set != NULL)
+        g_hash_table_destroy(excluded_set);
+
+    return size;
+}
+
+double dump_location_size_find_largest_dir_ext(const char *dump_location, char **worst_dir, GHashTable *excluded)
+{
+    double size = 0;
+    GPtrArray *entries = walk_dump_location(dump_location, DUMP_LOCATION_LIST_SIZE, &size);
+    if (entries == NULL)
+        return 0;
+
+    const time_t now = time(NULL);
+    double max_weight = 0;
+    for (unsigned i = 0; i < entries->len; ++i)
+    {
+        struct dump_location_entry *entry = g_ptr_array_index(entries, i);
+        size += entry->dle_size;
+
+        if (worst_dir == NULL)
+            continue;
+
+        /* A problem keeps its name when it is moved into a shard */
+        const char *base = strrchr(entry->dle_name, '/');
+        base = base ? base + 1 : entry->dle_name;
+        if (excluded != NULL && (g_hash_table_contains(excluded, entry->dle_name)
+                                 || g_hash_table_contains(excluded, base)))
+            continue;
+
+        /* Same weighting as get_dirsize_find_largest_dir(): the bigger and
+         * the older, the sooner deleted */
+        double weight = entry->dle_size / 1024;
+        const long age = (now - entry->dle_mtime) / 60;
+        if (age > 0)
+            weight *= age;
+
+        if (weight > max_weight)
+        {
+            max_weight = weight;
+            free(*worst_dir);
+            *worst_dir = xstrdup(entry->dle_name);
+        }
+    }
+    g_ptr_array_free(entries, TRUE);
+
+    return size;
+}
+
+int dump_location_get_mtime(const char *dump_location, struct timespec *mtime)
+{
+    struct stat st;
+    if (stat(dump_location, &st) != 0)
+        return -errno;
+
+    *mtime = st.st_mtim;
+
+    DIR *dp = opendir(dump_location);
+    if (dp == NULL)
+        return -errno;
+
+    struct dirent *dent;
+    while ((dent = readdir(dp)) != NULL)
+    {
+        if (!dump_location_is_shard_name(dent->d_name)
+            || fstatat(dirfd(dp), dent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0
+            || !S_ISDIR(st.st_mode))
+            continue;
+
+        if (st.st_mtim.tv_sec > mtime->tv_sec
+            || (st.st_mtim.tv_sec == mtime->tv_sec && st.st_mtim.tv_nsec > mtime->tv_nsec))
+            *mtime = st.st_mtim;
+    }
+    closedir(dp);
+
+    return 0;
+}
+
+/*
+ * Sharding
+ */
+
+char *dump_location_move_to_shard(const char *dump_location, struct dump_dir *dd)
+{
+    const char *name = strrchr(dd->dd_dirname, '/');
+    if (name == NULL
+        || strncmp(dd->dd_dirname, dump_location, name - dd->dd_dirname) != 0
+        || dump_location[name - dd->dd_dirname] != '\0')
+    {
+        log_debug("'%s' is not at the top level of '%s'", dd->dd_dirname, dump_location);
+        return NULL;
+    }
+    ++name;
+
+    char *path = NULL;
+    char *shard = dump_location_shard_name(name);
+    const int location_fd = open(dump_location, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (location_fd < 0)
+    {
+        perror_msg("Can't open '%s'", dump_location);
+        goto finito;
+    }
+
+    /* Shards inherit owner, group and mode of the dump location */
+    struct stat st;
+    if (fstat(location_fd, &st) != 0)
+    {
+        perror_msg("Can't stat '%s'", dump_location);
+        goto close_location;
+    }
+
+    if (mkdirat(location_fd, shard, st.st_mode & 07777) == 0)
+    {
+        if (fchownat(location_fd, shard, st.st_uid, st.st_gid, AT_SYMLINK_NOFOLLOW) != 0
+            || fchmodat(location_fd, shard, st.st_mode & 07777, 0) != 0)
+        {
+            perror_msg("Can't set owner and mode of '%s/%s'", dump_location, shard);
+            unlinkat(location_fd, shard, AT_REMOVEDIR);
+            goto close_location;
+        }
+        log_info("Created shard '%s/%s'", dump_location, shard);
+    }
+    else if (errno != EEXIST)
+    {
+        perror_msg("Can't create '%s/%s'", dump_location, shard);
+        goto close_location;
+    }
+
+    char *sharded_name = concat_path_file(shard, name);
+    if (renameat(location_fd, name, location_fd, sharded_name) != 0)
+        perror_msg("Can't move '%s' to '%s/%s'", dd->dd_dirname, dump_location, sharded_name);
+    else
+        path = concat_path_file(dump_location, sharded_name);
+    free(sharded_name);
+
+close_location:
+    close(location_fd);
+finito:
+    free(shard);
+    return path;
+}
+
+struct dump_location_migration
+{
+    char *dml_location;
+    GList *dml_names; /* the top level directories left to check */
+    int dml_moved;
+};
+
+struct dump_location_migration *dump_location_migration_new(const char *dump_location)
+{
+    DIR *dp = opendir(dump_location);
+    if (dp == NULL)
+        return NULL;
+
+    struct dump_location_migration *migration = xzalloc(sizeof(*migration));
+    migration->dml_location = xstrdup(dump_location);
+
+    struct dirent *dent;
+    while ((dent = readdir(dp)) != NULL)
+    {
+        if (dent->d_name[0] == '.'
+            || dump_location_is_shard_name(dent->d_name))
+            continue;
+
+        /* Directories being created or unpacked */
+        const char *ext = strrchr(dent->d_name, '.');
+        if (ext && strcmp(ext, ".new") == 0)
+            continue;
+
+        struct stat st;
+        if (fstatat(dirfd(dp), dent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode))
+            migration->dml_names = g_list_prepend(migration->dml_names, xstrdup(dent->d_name));
+    }
+    closedir(dp);
+
+    return migration;
+}
+
+bool dump_location_migration_step(struct dump_location_migration *migration, unsigned count)
+{
+    while (migration->dml_names != NULL && count-- > 0)
+    {
+        char *name = migration->dml_names->data;
+        migration->dml_names = g_list_delete_link(migration->dml_names, migration->dml_names);
+
+        char *path = concat_path_file(migration->dml_location, name);
+        free(name);
+
+        int sv_logmode = logmode;
+        logmode = g_verbose == 0 ? 0 : sv_logmode;
+        struct dump_dir *dd = dd_opendir(path, DD_DONT_WAIT_FOR_LOCK | DD_FAIL_QUIETLY_ENOENT | DD_FAIL_QUIETLY_EACCES);
+        logmode = sv_logmode;
+        free(path);
+
+        /* Unprocessed directories are moved by abrt-server */
+        if (dd == NULL)
+            continue;
+
+        if (problem_dump_dir_is_complete(dd))
+        {
+            char *sharded = dump_location_move_to_shard(migration->dml_location, dd);
+            migration->dml_moved += sharded != NULL;
+            free(sharded);
+        }
+        dd_close(dd);
+    }
+
+    return migration->dml_names != NULL;
+}
+
+int dump_location_migration_free(struct dump_location_migration *migration)
+{
+    if (migration == NULL)
+        return 0;
+
+    const int moved = migration->dml_moved;
+    if (moved > 0)
+        log_warning("Moved %d problem directories of '%s' to shards", moved, migration->dml_location);
+
+    list_free_with_free(migration->dml_names);
+    free(migration->dml_location);
+    free(migration);
+
+    return moved;
+}
+
+int dump_location_migrate(const char *dump_location)
+{
+    struct dump_location_migration *migration = dump_location_migration_new(dump_location);
+    if (migration == NULL)
+        return -errno;
+
+    while (dump_location_migration_step(migration, UINT_MAX))
+        ;
+
+    return dump_location_migration_free(migration);
+}
@@ -63,12 +63,13 @@ void trim_problem_dirs(const char *dirname, double cap_size, const char *exclude
     }
     log_debug("excluded_basename:'%s'", excluded_basename);
 
+    int deleted = 0;
     int count = 20;
     while (--count >= 0)
     {
         /* We exclude our own dir from candidates for deletion (3rd param): */
         char *worst_basename = NULL;
-        double cur_size = get_dirsize_find_largest_dir(dirname, &worst_basename, excluded_basename);
+        double cur_size = dump_location_size_find_largest_dir(dirname, &worst_basename, excluded_basename);
         if (cur_size <= cap_size || !worst_basename)
         {
             log_info("cur_size:%.0f cap_size:%.0f, no (more) trimming", cur_size, cap_size);
@@ -79,9 +80,14 @@ void trim_problem_dirs(const char *dirname, double cap_size, const char *exclude
                 dirname, cur_size, cap_size / (1024*1024), worst_basename);
         char *d = concat_path_file(dirname, worst_basename);
         free(worst_basename);
-        delete_dump_dir(d);
+        if (delete_dump_dir(d) == 0)
+            ++deleted;
         free(d);
     }
+
+    /* Space of shared elements is freed with their last link */
+    if (deleted > 0)
+        dump_location_blobs_gc(dirname);
 }
 
 /**
@@ -111,142 +117,94 @@ static char* exec_vp(char **args, int redirect_stderr, int exec_timeout_sec, int
         NULL
     };
 
-    int flags = EXECFLG_INPUT_NUL | EXECFLG_OUTPUT | EXECFLG_SETSID | EXECFLG_QUIET;
+    int flags = EXECFLG_INPUT_NUL | EXECFLG_SETSID | EXECFLG_QUIET;
     if (redirect_stderr)
         flags |= EXECFLG_ERR2OUT;
     VERB1 flags &= ~EXECFLG_QUIET;
 
-    int pipeout[2];
-    pid_t child = fork_execv_on_steroids(flags, args, pipeout, (char**)env_vec, /*dir:*/ NULL, /*uid(unused):*/ 0);
-
-    /* We use this function to run gdb and unstrip. Bugs in gdb or corrupted
+    /* We use this function to run gdb. Bugs in gdb or corrupted
      * coredumps were observed to cause gdb to enter infinite loop.
      * Therefore we have a (largish) timeout, after which we kill the child.
      */
-    ndelay_on(pipeout[0]);
-    int t = time(NULL); /* int is enough, no need to use time_t */
-    int endtime = t + exec_timeout_sec;
-    struct strbuf *buf_out = strbuf_new();
-    while (1)
+    bool timed_out;
+    char *out = run_child(args, flags, (char**)env_vec, exec_timeout_sec * 1000, status, &timed_out);
+    if (out && timed_out)
     {
-        int timeout = endtime - t;
-        if (timeout < 0)
-        {
-            kill(child, SIGKILL);
-            strbuf_append_strf(buf_out, "\n"
-                        "Timeout exceeded: %u seconds, killing %s.\n"
-                        "Looks like gdb hung while generating backtrace.\n"
-                        "This may be a bug in gdb. Consider submitting a bug report to gdb developers.\n"
-                        "Please attach coredump from this crash to the bug report if you do.\n",
-                        exec_timeout_sec, args[0]
-            );
-            break;
-        }
-
-        /* We don't check poll result - checking read result is enough */
-        struct pollfd pfd;
-        pfd.fd = pipeout[0];
-        pfd.events = POLLIN;
-        poll(&pfd, 1, timeout * 1000);
-
-        char buff[1024];
-        int r = read(pipeout[0], buff, sizeof(buff) - 1);
-        if (r <= 0)
-        {
-            /* I did see EAGAIN happening here */
-            if (r < 0 && errno == EAGAIN)
-                goto next;
-            break;
-        }
-        buff[r] = '\0';
-        strbuf_append_str(buf_out, buff);
- next:
-        t = time(NULL);
+        struct strbuf *buf_out = strbuf_new();
+        strbuf_append_strf(buf_out, "%s\n"
+                    "Timeout exceeded: %u seconds, killing %s.\n"
+                    "Looks like gdb hung while generating backtrace.\n"
+                    "This may be a bug in gdb. Consider submitting a bug report to gdb developers.\n"
+                    "Please attach coredump from this crash to the bug report if you do.\n",
+                    out, exec_timeout_sec, args[0]
+        );
+        free(out);
+        out = strbuf_free_nobuf(buf_out);
     }
-    close(pipeout[0]);
 
-    /* Prevent having zombie child process, and maybe collect status
-     * (note that status == NULL is ok too) */
-    safe_waitpid(child, status, 0);
-
-    return strbuf_free_nobuf(buf_out);
+    return out;
 }
 
 char *run_unstrip_n(const char *dump_dir_name, unsigned timeout_sec)
 {
-    int flags = EXECFLG_INPUT_NUL | EXECFLG_OUTPUT | EXECFLG_SETSID | EXECFLG_QUIET;
-    VERB1 flags &= ~EXECFLG_QUIET;
-    int pipeout[2];
-    char* args[4];
-    args[0] = (char*)"eu-unstrip";
-    args[1] = xasprintf("--core=%s/"FILENAME_COREDUMP, dump_dir_name);
-    args[2] = (char*)"-n";
-    args[3] = NULL;
-    pid_t child = fork_execv_on_steroids(flags, args, pipeout, /*env_vec:*/ NULL, /*dir:*/ NULL, /*uid(unused):*/ 0);
-    free(args[1]);
-
-    /* Bugs in unstrip or corrupted coredumps can cause it to enter infinite loop.
-     * Therefore we have a (largish) timeout, after which we kill the child.
-     */
-    ndelay_on(pipeout[0]);
-    int t = time(NULL); /* int is enough, no need to use time_t */
-    int endtime = t + timeout_sec;
-    struct strbuf *buf_out = strbuf_new();
-    while (1)
-    {
-        int timeout = endtime - t;
-        if (timeout < 0)
-        {
-            kill(child, SIGKILL);
-            strbuf_free(buf_out);
-            buf_out = NULL;
-            break;
-        }
+    struct dump_dir *dd = dd_opendir(dump_dir_name, DD_OPEN_READONLY);
+    if (!dd)
+        return NULL;
 
-        /* We don't check poll result - checking read result is enough */
-        struct pollfd pfd;
-        pfd.fd = pipeout[0];
-        pfd.events = POLLIN;
-        poll(&pfd, 1, timeout * 1000);
+    GList *modules;
+    const int r = core_modules_load(dd, CORE_MODULES_FIND_FILES, timeout_sec, &modules);
+    dd_close(dd);
+    if (r != 0)
+        return NULL;
 
-        char buff[1024];
-        int r = read(pipeout[0], buff, sizeof(buff) - 1);
-        if (r <= 0)
-        {
-            /* I did see EAGAIN happening here */
-            if (r < 0 && errno == EAGAIN)
-                goto next;
-            break;
-        }
-        buff[r] = '\0';
-        strbuf_append_str(buf_out, buff);
- next:
-        t = time(NULL);
-    }
-    close(pipeout[0]);
+    char *out = core_modules_to_unstrip_n(modules);
+    core_modules_free(modules);
+    return out;
+}
 
-    /* Prevent having zombie child process */
-    int status;
-    safe_waitpid(child, &status, 0);
+/* The output of the commands following the backtrace commands is separated
+ * by these lines, gdb's "echo" needs the escaped form */
+#define GDB_REGISTERS_MARKER   "\n-----abrt-registers-----\n"
+#define GDB_REGISTERS_ECHO     "echo \\n-----abrt-registers-----\\n"
+#define GDB_EXPLOITABLE_MARKER "\n-----abrt-exploitable-----\n"
+#define GDB_EXPLOITABLE_ECHO   "echo \\n-----abrt-exploitable-----\\n"
 
-    if (status != 0 || buf_out == NULL)
-    {
-        /* unstrip didnt exit with exit code 0, or we timed out */
-        strbuf_free(buf_out);
-        return NULL;
-    }
+/* abrt-action-analyze-vulnerability saves only ratings >= 4 too */
+#define GDB_EXPLOITABLE_MIN_RATING 4
+
+char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char *debuginfo_dirs)
+{
+    return get_backtrace_ext(dump_dir_name, timeout_sec, debuginfo_dirs,
+            /*flags:*/ 0, /*exploitable:*/ NULL, /*registers:*/ NULL);
+}
 
-    return strbuf_free_nobuf(buf_out);
+/* The length of the backtrace without the output of the other commands */
+static size_t gdb_backtrace_len(const char *bt)
+{
+    const char *mark = strstr(bt, GDB_REGISTERS_MARKER);
+    if (!mark)
+        mark = strstr(bt, GDB_EXPLOITABLE_MARKER);
+    return mark ? mark - bt : strlen(bt);
 }
 
-char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char *debuginfo_dirs)
+char *get_backtrace_ext(const char *dump_dir_name, unsigned timeout_sec, const char *debuginfo_dirs,
+        int flags, char **exploitable, char **registers)
 {
     INITIALIZE_LIBABRT();
 
+    if (exploitable)
+        *exploitable = NULL;
+    if (registers)
+        *registers = NULL;
+
     struct dump_dir *dd = dd_opendir(dump_dir_name, /*flags:*/ 0);
     if (!dd)
         return NULL;
 
+    /* The cold storage compresses the core of old problems */
+    problem_element_inflate(dd, FILENAME_COREDUMP);
+    problem_element_inflate(dd, FILENAME_BINARY);
+
     char *executable = NULL;
     if (dd_exist(dd, FILENAME_BINARY))
         executable = concat_path_file(dd->dd_dirname, FILENAME_BINARY);
@@ -255,11 +213,26 @@ char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char
 
     dd_close(dd);
 
+    /* abrt-gdb-exploitable writes its verdict to a file so that it can't be
+     * mixed up with gdb's error messages */
+    char exploitable_file[] = LARGE_DATA_TMP_DIR"/abrt-exploitable-XXXXXX";
+    if (flags & GET_BACKTRACE_EXPLOITABLE)
+    {
+        int fd = mkstemp(exploitable_file);
+        if (fd < 0)
+        {
+            perror_msg("Can't create temporary file '%s'", exploitable_file);
+            flags &= ~GET_BACKTRACE_EXPLOITABLE;
+        }
+        else
+            close(fd);
+    }
+
     /* Let user know what's going on */
     log_warning(_("Generating backtrace"));
 
     unsigned i = 0;
-    char *args[25];
+    char *args[35];
     args[i++] = (char*)GDB;
     args[i++] = (char*)"-batch";
     struct strbuf *set_debug_file_directory = strbuf_new();
@@ -347,6 +320,30 @@ char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char
     args[i++] = (char*)"-ex";
     const unsigned dis_cmd_index = i++;
     args[dis_cmd_index] = (char*)"disassemble";
+
+    if (flags & GET_BACKTRACE_REGISTERS)
+    {
+        args[i++] = (char*)"-ex";
+        args[i++] = (char*)GDB_REGISTERS_ECHO;
+        args[i++] = (char*)"-ex";
+        args[i++] = (char*)"info registers";
+    }
+
+    /* The core is already loaded, analyzing it in the same gdb is much
+     * cheaper than running abrt-action-analyze-vulnerability and loading
+     * the core and all the debuginfo again */
+    unsigned exploitable_cmd_index = 0;
+    if (flags & GET_BACKTRACE_EXPLOITABLE)
+    {
+        args[i++] = (char*)"-ex";
+        args[i++] = (char*)GDB_EXPLOITABLE_ECHO;
+        args[i++] = (char*)"-ex";
+        args[i++] = (char*)"python exec(open(\""LIBEXEC_DIR"/abrt-gdb-exploitable\").read())";
+        args[i++] = (char*)"-ex";
+        exploitable_cmd_index = i++;
+        args[exploitable_cmd_index] = xasprintf("abrt-exploitable %d %s",
+                GDB_EXPLOITABLE_MIN_RATING, exploitable_file);
+    }
     args[i++] = NULL;
 
     /* Get the backtrace, but try to cap its size */
@@ -360,7 +357,9 @@ char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char
         args[bt_cmd_index] = xasprintf("%s backtrace %s%u", thread_apply_all, full, bt_depth);
         bt = exec_vp(args, /*redirect_stderr:*/ 1, timeout_sec, NULL);
         free(args[bt_cmd_index]);
-        if ((bt && strnlen(bt, 256*1024) < 256*1024) || bt_depth <= 32)
+        /* Only the backtrace counts, not the output of the other commands */
+        const size_t bt_len = bt ? gdb_backtrace_len(bt) : 0;
+        if ((bt && bt_len < 256*1024) || bt_depth <= 32)
         {
             break;
         }
@@ -368,7 +367,7 @@ char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char
         bt_depth /= 2;
         if (bt)
             log_warning("Backtrace is too big (%u bytes), reducing depth to %u",
-                        (unsigned)strlen(bt), bt_depth);
+                        (unsigned)bt_len, bt_depth);
         else
             /* (NB: in fact, current impl. of exec_vp() never returns NULL) */
             log_warning("Failed to generate backtrace, reducing depth to %u",
@@ -409,6 +408,39 @@ char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char
     free(args[debug_dir_cmd_index]);
     free(args[file_cmd_index]);
     free(args[core_cmd_index]);
+
+    /* Cut the output of the additional commands off the backtrace, the
+     * exploitability analysis runs last */
+    char *mark = bt ? strstr(bt, GDB_EXPLOITABLE_MARKER) : NULL;
+    if (mark)
+    {
+        *mark = '\0';
+        mark += strlen(GDB_EXPLOITABLE_MARKER);
+        if (mark[0] != '\0')
+            log_info("abrt-exploitable: %s", mark);
+    }
+
+    mark = bt ? strstr(bt, GDB_REGISTERS_MARKER) : NULL;
+    if (mark)
+    {
+        *mark = '\0';
+        if (registers)
+            *registers = xstrdup(mark + strlen(GDB_REGISTERS_MARKER));
+    }
+
+    if (exploitable_cmd_index > 0)
+    {
+        free(args[exploitable_cmd_index]);
+
+        /* The file stays empty if the rating is lower than the minimum */
+        char *text = xmalloc_open_read_close(exploitable_file, /*maxsize:*/ NULL);
+        if (text && text[0] != '\0' && bt && exploitable)
+            *exploitable = text;
+        else
+            free(text);
+        unlink(exploitable_file);
+    }
+
     return bt;
 }
 
@@ -544,6 +576,18 @@ bool dir_is_in_dump_location(const char *dir_name)
     while (*base_name && *base_name == '/')
         ++base_name;
 
+    /* or of one of its shards */
+    const char *slash = strchr(base_name, '/');
+    if (slash != NULL)
+    {
+        char *shard = xstrndup(base_name, slash - base_name);
+        const bool is_shard = dump_location_is_shard_name(shard);
+        free(shard);
+
+        if (is_shard)
+            base_name = slash + 1;
+    }
+
     if (*(base_name - 1) != '/' || !str_is_correct_filename(base_name))
     {
         log_debug("Invalid dump directory name: '%s'", base_name);
@@ -0,0 +1,374 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <sys/file.h>
+#include "internal_libabrt.h"
+
+#define METRICS_DIR         VAR_RUN"/abrt/metrics"
+#define METRICS_FILE_SUFFIX ".prom"
+
+static const char *get_metrics_dir(void)
+{
+    const char *dir = getenv("ABRT_METRICS_DIR");
+    return dir != NULL ? dir : METRICS_DIR;
+}
+
+/* Upper bounds of latency histogram buckets in seconds */
+static const double s_latency_buckets[] = {
+    0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60, 300,
+};
+
+enum metric_type {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+};
+
+static const char *const s_metric_type_names[] = {
+    [METRIC_COUNTER]   = "counter",
+    [METRIC_GAUGE]     = "gauge",
+    [METRIC_HISTOGRAM] = "histogram",
+};
+
+struct metric
+{
+    enum metric_type type;
+    double value;        /* counter increment, gauge value or histogram sum */
+    unsigned long count; /* histogram only */
+    unsigned long buckets[ARRAY_SIZE(s_latency_buckets)]; /* cumulative */
+};
+
+/* Metrics collected since the last flush: name -> struct metric */
+static GHashTable *s_metrics;
+
+static struct metric *get_metric(const char *name, enum metric_type type)
+{
+    if (s_metrics == NULL)
+        s_metrics = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+
+    struct metric *m = g_hash_table_lookup(s_metrics, name);
+    if (m == NULL)
+    {
+        m = xzalloc(sizeof(*m));
+        m->type = type;
+        g_hash_table_insert(s_metrics, xstrdup(name), m);
+    }
+
+    return m;
+}
+
+void metrics_counter_add(const char *name, double value)
+{
+    get_metric(name, METRIC_COUNTER)->value += value;
+}
+
+void metrics_gauge_set(const char *name, double value)
+{
+    get_metric(name, METRIC_GAUGE)->value = value;
+}
+
+void metrics_observe_seconds(const char *name, double seconds)
+{
+    struct metric *m = get_metric(name, METRIC_HISTOGRAM);
+    m->value += seconds;
+    ++m->count;
+
+    for (unsigned i = 0; i < ARRAY_SIZE(s_latency_buckets); ++i)
+        if (seconds <= s_latency_buckets[i])
+            ++m->buckets[i];
+}
+
+/* Returns the metric name without labels, e.g. 'foo' for 'foo{bar="baz"}' */
+static char *metric_base_name(const char *name)
+{
+    return xstrndup(name, strchrnul(name, '{') - name);
+}
+
+/* Builds the name of a histogram series: NAME{LABELS} -> NAME_SUFFIX{LABELS,le="LE"} */
+static char *histogram_series_name(const char *name, const char *suffix, const char *le)
+{
+    const char *labels = strchrnul(name, '{');
+    const int base_len = labels - name;
+
+    if (*labels == '\0')
+    {
+        if (le == NULL)
+            return xasprintf("%.*s%s", base_len, name, suffix);
+        return xasprintf("%.*s%s{le=\"%s\"}", base_len, name, suffix, le);
+    }
+
+    /* Strip '{' and '}' */
+    const char *inner = labels + 1;
+    int inner_len = strlen(inner);
+    if (inner_len > 0 && inner[inner_len - 1] == '}')
+        --inner_len;
+
+    if (le == NULL)
+        return xasprintf("%.*s%s{%.*s}", base_len, name, suffix, inner_len, inner);
+    return xasprintf("%.*s%s{%.*s,le=\"%s\"}", base_len, name, suffix, inner_len, inner, le);
+}
+
+/* Parses the Prometheus text format produced by serialize_metrics() */
+static void parse_metrics(char *text, GHashTable *values, GHashTable *types)
+{
+    char *line = text;
+    while (line != NULL && *line != '\0')
+    {
+        char *next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        if (prefixcmp(line, "# TYPE ") == 0)
+        {
+            char *name = line + strlen("# TYPE ");
+            char *type = strchr(name, ' ');
+            if (type != NULL && types != NULL)
+            {
+                *type++ = '\0';
+                g_hash_table_replace(types, xstrdup(name), xstrdup(type));
+            }
+        }
+        else if (line[0] != '#' && line[0] != '\0')
+        {
+            char *value = strrchr(line, ' ');
+            if (value != NULL)
+            {
+                *value++ = '\0';
+                double *v = xmalloc(sizeof(*v));
+                *v = strtod(value, NULL);
+                g_hash_table_replace(values, xstrdup(line), v);
+            }
+        }
+
+        line = next;
+    }
+}
+
+static void add_value(GHashTable *values, char *series, double value, bool replace)
+{
+    double *v = g_hash_table_lookup(values, series);
+    if (v == NULL)
+    {
+        v = xmalloc(sizeof(*v));
+        *v = 0;
+        g_hash_table_insert(values, series, v);
+    }
+    else
+        free(series);
+
+    *v = replace ? value : *v + value;
+}
+
+static void merge_metrics(GHashTable *values, GHashTable *types)
+{
+    GHashTableIter iter;
+    const char *name;
+    struct metric *m;
+    g_hash_table_iter_init(&iter, s_metrics);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&name, (gpointer *)&m))
+    {
+        g_hash_table_replace(types, metric_base_name(name), xstrdup(s_metric_type_names[m->type]));
+
+        if (m->type != METRIC_HISTOGRAM)
+        {
+            add_value(values, xstrdup(name), m->value, m->type == METRIC_GAUGE);
+            continue;
+        }
+
+        for (unsigned i = 0; i < ARRAY_SIZE(s_latency_buckets); ++i)
+        {
+            char le[sizeof(double)*3 + 8];
+            snprintf(le, sizeof(le), "%g", s_latency_buckets[i]);
+            add_value(values, histogram_series_name(name, "_bucket", le), m->buckets[i], false);
+        }
+        add_value(values, histogram_series_name(name, "_bucket", "+Inf"), m->count, false);
+        add_value(values, histogram_series_name(name, "_sum", NULL), m->value, false);
+        add_value(values, histogram_series_name(name, "_count", NULL), m->count, false);
+    }
+}
+
+/* Returns the family name (the one with TYPE) of the series */
+static const char *series_family(GHashTable *types, const char *series, char **base)
+{
+    *base = metric_base_name(series);
+    if (g_hash_table_lookup(types, *base) != NULL)
+        return *base;
+
+    static const char *const suffixes[] = { "_bucket", "_sum", "_count" };
+    for (unsigned i = 0; i < ARRAY_SIZE(suffixes); ++i)
+    {
+        const size_t len = strlen(*base);
+        const size_t suffix_len = strlen(suffixes[i]);
+        if (len > suffix_len && strcmp(*base + len - suffix_len, suffixes[i]) == 0)
+        {
+            (*base)[len - suffix_len] = '\0';
+            if (g_hash_table_lookup(types, *base) != NULL)
+                return *base;
+            (*base)[len - suffix_len] = suffixes[i][0];
+        }
+    }
+
+    return NULL;
+}
+
+static char *serialize_metrics(GHashTable *values, GHashTable *types)
+{
+    struct strbuf *buf = strbuf_new();
+
+    GList *series = g_list_sort(g_hash_table_get_keys(values), (GCompareFunc)strcmp);
+    char *last_family = NULL;
+    for (GList *iter = series; iter != NULL; iter = g_list_next(iter))
+    {
+        char *base = NULL;
+        const char *family = series_family(types, iter->data, &base);
+        if (family != NULL && g_strcmp0(family, last_family) != 0)
+        {
+            strbuf_append_strf(buf, "# TYPE %s %s\n", family, (char *)g_hash_table_lookup(types, family));
+            free(last_family);
+            last_family = xstrdup(family);
+        }
+        free(base);
+
+        const double *v = g_hash_table_lookup(values, iter->data);
+        strbuf_append_strf(buf, "%s %.15g\n", (char *)iter->data, *v);
+    }
+    free(last_family);
+    g_list_free(series);
+
+    return strbuf_free_nobuf(buf);
+}
+
+int metrics_flush(const char *component)
+{
+    if (s_metrics == NULL || g_hash_table_size(s_metrics) == 0)
+        return 0;
+
+    int r = 0;
+    const char *metrics_dir = get_metrics_dir();
+    char *path = xasprintf("%s/%s"METRICS_FILE_SUFFIX, metrics_dir, component);
+
+    if (mkdir(metrics_dir, 0755) != 0 && errno != EEXIST)
+    {
+        r = -errno;
+        log_debug("Can't create directory '%s': %s", metrics_dir, strerror(errno));
+        goto finito;
+    }
+
+    const int fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        r = -errno;
+        log_debug("Can't open '%s': %s", path, strerror(errno));
+        goto finito;
+    }
+
+    /* Short lived processes (hooks, abrt-server) update the same file */
+    if (flock(fd, LOCK_EX) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't lock '%s'", path);
+        close(fd);
+        goto finito;
+    }
+
+    GHashTable *values = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    GHashTable *types = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+
+    char *text = xmalloc_read(fd, NULL);
+    if (text != NULL)
+        parse_metrics(text, values, types);
+    free(text);
+
+    merge_metrics(values, types);
+    text = serialize_metrics(values, types);
+
+    const size_t len = strlen(text);
+    if (ftruncate(fd, 0) != 0
+        || lseek(fd, 0, SEEK_SET) != 0
+        || full_write(fd, text, len) != (ssize_t)len)
+    {
+        r = -errno;
+        perror_msg("Can't write '%s'", path);
+    }
+
+    free(text);
+    g_hash_table_destroy(types);
+    g_hash_table_destroy(values);
+    close(fd);
+
+    g_hash_table_remove_all(s_metrics);
+
+finito:
+    free(path);
+    return r;
+}
+
+char *metrics_load_text(void)
+{
+    struct strbuf *buf = strbuf_new();
+
+    const char *metrics_dir = get_metrics_dir();
+    DIR *dir = opendir(metrics_dir);
+    if (dir == NULL)
+        return strbuf_free_nobuf(buf);
+
+    GList *files = NULL;
+    struct dirent *dent;
+    while ((dent = readdir(dir)) != NULL)
+    {
+        const size_t len = strlen(dent->d_name);
+        if (len > strlen(METRICS_FILE_SUFFIX)
+            && strcmp(dent->d_name + len - strlen(METRICS_FILE_SUFFIX), METRICS_FILE_SUFFIX) == 0)
+            files = g_list_prepend(files, xstrdup(dent->d_name));
+    }
+    closedir(dir);
+
+    files = g_list_sort(files, (GCompareFunc)strcmp);
+    for (GList *iter = files; iter != NULL; iter = g_list_next(iter))
+    {
+        char *path = concat_path_file(metrics_dir, iter->data);
+        const int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        free(path);
+        if (fd < 0)
+            continue;
+
+        if (flock(fd, LOCK_SH) == 0)
+        {
+            char *text = xmalloc_read(fd, NULL);
+            if (text != NULL)
+                strbuf_append_str(buf, text);
+            free(text);
+        }
+        close(fd);
+    }
+    g_list_free_full(files, free);
+
+    return strbuf_free_nobuf(buf);
+}
+
+GHashTable *metrics_load(void)
+{
+    GHashTable *values = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+
+    char *text = metrics_load_text();
+    parse_metrics(text, values, NULL);
+    free(text);
+
+    return values;
+}
@@ -0,0 +1,223 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Post-create queue
+ *
+ * Problems waiting for post-create processing are started in the order of
+ * their priority (the lower number the sooner) and then in the order of their
+ * arrival. Cheap problem types go first, so users do not have to wait for
+ * their Python exceptions until gdb finishes its work on a huge core file.
+ * Problem directories bigger than PostCreateBigProblemSize are moved to the
+ * next priority class. A waiting problem gains one priority level every
+ * PostCreateAgingPeriod seconds, so no problem starves.
+ *
+ * The number of concurrently processed problems of one type is limited by
+ * the class of the type. The default limit is 1 because duplicate detection
+ * must see all the already processed problems of the same type.
+ */
+#include "libabrt.h"
+
+#define DEFAULT_CLASS_TYPE "*"
+#define DEFAULT_CLASS_PRIORITY 2
+#define DEFAULT_CLASS_MAX_RUNNING 1
+
+/* TYPE:PRIORITY[:MAX_RUNNING] */
+static bool parse_class(const char *spec, struct post_create_class *klass)
+{
+    const char *colon = strchr(spec, ':');
+    if (colon == NULL || colon == spec)
+        return false;
+
+    char *end;
+    errno = 0;
+    const long priority = strtol(colon + 1, &end, 10);
+    if (errno || end == colon + 1 || priority < INT_MIN || priority > INT_MAX)
+        return false;
+
+    unsigned long max_running = DEFAULT_CLASS_MAX_RUNNING;
+    if (*end == ':')
+    {
+        const char *num = end + 1;
+        errno = 0;
+        max_running = strtoul(num, &end, 10);
+        if (errno || end == num || max_running == 0 || max_running > UINT_MAX)
+            return false;
+    }
+
+    if (*end != '\0')
+        return false;
+
+    memset(klass, 0, sizeof(*klass));
+    klass->type = xstrndup(spec, colon - spec);
+    klass->priority = priority;
+    klass->max_running = max_running;
+    return true;
+}
+
+struct post_create_queue *post_create_queue_new(const char *classes,
+        unsigned max_running, unsigned aging_period, unsigned big_problem_size)
+{
+    struct post_create_queue *queue = xzalloc(sizeof(*queue));
+    queue->max_running = max_running != 0 ? max_running : 1;
+    queue->aging_period = aging_period;
+    queue->big_problem_size = big_problem_size * 1024.0 * 1024.0;
+
+    char **specs = g_strsplit_set(classes ? classes : "", " \t,", -1);
+    queue->classes = xzalloc((g_strv_length(specs) + 1) * sizeof(*queue->classes));
+
+    struct post_create_class default_class = {
+        .priority = DEFAULT_CLASS_PRIORITY,
+        .max_running = DEFAULT_CLASS_MAX_RUNNING,
+    };
+
+    unsigned count = 0;
+    for (char **spec = specs; *spec != NULL; ++spec)
+    {
+        if (**spec == '\0')
+            continue;
+
+        struct post_create_class klass;
+        if (!parse_class(*spec, &klass))
+        {
+            error_msg("Invalid post-create class '%s'", *spec);
+            continue;
+        }
+
+        if (strcmp(klass.type, DEFAULT_CLASS_TYPE) == 0)
+        {
+            free(klass.type);
+            klass.type = NULL;
+            default_class = klass;
+            continue;
+        }
+
+        queue->classes[count++] = klass;
+    }
+    g_strfreev(specs);
+
+    /* The last one is used for all other types */
+    queue->classes[count] = default_class;
+
+    return queue;
+}
+
+void post_create_queue_free(struct post_create_queue *queue)
+{
+    if (queue == NULL)
+        return;
+
+    g_list_free_full(queue->items, free);
+
+    for (struct post_create_class *klass = queue->classes; klass->type != NULL; ++klass)
+        free(klass->type);
+    free(queue->classes);
+
+    free(queue);
+}
+
+struct post_create_class *post_create_queue_find_class(struct post_create_queue *queue,
+        const char *type)
+{
+    struct post_create_class *klass = queue->classes;
+    for (; klass->type != NULL; ++klass)
+        if (type != NULL && strcmp(klass->type, type) == 0)
+            break;
+
+    return klass;
+}
+
+struct post_create_item *post_create_queue_push(struct post_create_queue *queue,
+        void *data, const char *type, double size, gint64 now)
+{
+    struct post_create_item *item = xzalloc(sizeof(*item));
+    item->data = data;
+    item->klass = post_create_queue_find_class(queue, type);
+    item->priority = item->klass->priority;
+    if (queue->big_problem_size > 0 && size >= queue->big_problem_size)
+        ++item->priority;
+    item->queued = now;
+
+    queue->items = g_list_append(queue->items, item);
+    return item;
+}
+
+/* Lower value means sooner processing */
+static gint64 effective_priority(struct post_create_queue *queue,
+        struct post_create_item *item, gint64 now)
+{
+    if (queue->aging_period == 0)
+        return item->priority;
+
+    const gint64 age = (now - item->queued) / ((gint64)queue->aging_period * G_USEC_PER_SEC);
+    return item->priority - age;
+}
+
+struct post_create_item *post_create_queue_start_next(struct post_create_queue *queue,
+        gint64 now)
+{
+    if (queue->running >= queue->max_running)
+        return NULL;
+
+    struct post_create_item *best = NULL;
+    gint64 best_priority = 0;
+
+    for (GList *iter = queue->items; iter != NULL; iter = g_list_next(iter))
+    {
+        struct post_create_item *item = (struct post_create_item *)iter->data;
+        if (item->running || item->klass->running >= item->klass->max_running)
+            continue;
+
+        const gint64 priority = effective_priority(queue, item, now);
+        /* The queue is ordered by arrival, so '<' keeps FIFO for ties */
+        if (best == NULL || priority < best_priority)
+        {
+            best = item;
+            best_priority = priority;
+        }
+    }
+
+    if (best == NULL)
+        return NULL;
+
+    best->running = true;
+    best->started = now;
+    ++best->klass->running;
+    ++queue->running;
+
+    const gint64 wait = best->started - best->queued;
+    ++best->klass->processed;
+    best->klass->total_wait += wait;
+    if (best->klass->max_wait < wait)
+        best->klass->max_wait = wait;
+
+    return best;
+}
+
+void post_create_queue_remove(struct post_create_queue *queue, struct post_create_item *item)
+{
+    if (item->running)
+    {
+        --item->klass->running;
+        --queue->running;
+    }
+
+    queue->items = g_list_remove(queue->items, item);
+    free(item);
+}
@@ -30,8 +30,9 @@ int for_each_problem_in_dir(const char *path,
                         int (*callback)(struct dump_dir *dd, void *arg),
                         void *arg)
 {
-    DIR *dp = opendir(path);
-    if (!dp)
+    /* Walks the shards of the dump location too */
+    GPtrArray *entries = dump_location_list(path, /*flags*/0);
+    if (!entries)
     {
         /* We don't want to yell if, say, $XDG_CACHE_DIR/abrt/spool doesn't exist */
         //perror_msg("Can't open directory '%s'", path);
@@ -39,13 +40,10 @@ int for_each_problem_in_dir(const char *path,
     }
 
     int brk = 0;
-    struct dirent *dent;
-    while ((dent = readdir(dp)) != NULL)
+    for (unsigned i = 0; i < entries->len; ++i)
     {
-        if (dot_or_dotdot(dent->d_name))
-            continue; /* skip "." and ".." */
-
-        char *full_name = concat_path_file(path, dent->d_name);
+        const struct dump_location_entry *entry = g_ptr_array_index(entries, i);
+        char *full_name = concat_path_file(path, entry->dle_name);
 
         struct dump_dir *dd = dd_opendir(full_name,   DD_OPEN_FD_ONLY
                                                     | DD_FAIL_QUIETLY_ENOENT
@@ -79,7 +77,7 @@ int for_each_problem_in_dir(const char *path,
         if (brk)
             break;
     }
-    closedir(dp);
+    g_ptr_array_free(entries, TRUE);
 
     return brk;
 }
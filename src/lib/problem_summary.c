@@ -0,0 +1,484 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Problem summary records
+ *
+ * Listing problems means reading the same handful of small elements (type,
+ * executable, uid, count, ...) from every problem directory, one file per
+ * element. The values of these elements are therefore also stored in a single
+ * file PROBLEM_SUMMARY_FILENAME inside the problem directory.
+ *
+ * Every stored element carries the inode number, size and modification time
+ * of its file. A value is used only if the stamps still match the element
+ * file, hence the elements modified by tools that do not update the summary
+ * are transparently loaded from their files.
+ *
+ * The summary is read once per opened problem directory and kept in memory
+ * until another directory is accessed. Since every value is checked against
+ * its element file, a summary rewritten in the meantime cannot result in
+ * a stale value; it only makes the reader fall back to the element files.
+ *
+ * Layout of a summary file (native byte order):
+ *   char     magic[8]
+ *   uint32_t version
+ *   uint32_t item_count
+ *   item_count times:
+ *     uint16_t name_len, char name[name_len]
+ *     uint8_t  exists
+ *     uint64_t ino, int64_t size, int64_t mtime_sec, int64_t mtime_nsec
+ *     uint32_t value_len, char value[value_len]
+ */
+
+#include "internal_libabrt.h"
+
+#define PROBLEM_SUMMARY_MAGIC    "ABRTSUM"
+#define PROBLEM_SUMMARY_VERSION  1
+#define PROBLEM_SUMMARY_MAX_SIZE (256 * 1024)
+/* Longer values are not worth caching */
+#define PROBLEM_SUMMARY_MAX_VALUE_SIZE (8 * 1024)
+
+static const char *const s_summary_elements[] = {
+    FILENAME_TYPE,
+    FILENAME_UID,
+    FILENAME_USERNAME,
+    FILENAME_HOSTNAME,
+    FILENAME_EXECUTABLE,
+    FILENAME_CMDLINE,
+    FILENAME_COUNT,
+    FILENAME_TIME,
+    FILENAME_LAST_OCCURRENCE,
+    FILENAME_UUID,
+    FILENAME_DUPHASH,
+    FILENAME_REASON,
+    FILENAME_COMPONENT,
+    FILENAME_PACKAGE,
+    FILENAME_PKG_NAME,
+    FILENAME_PKG_EPOCH,
+    FILENAME_PKG_VERSION,
+    FILENAME_PKG_RELEASE,
+    FILENAME_REPORTED_TO,
+    FILENAME_NOT_REPORTABLE,
+    FILENAME_CONTAINER_ID,
+};
+
+struct summary_stamp
+{
+    uint64_t ino;
+    int64_t  size;
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+};
+
+struct summary_item
+{
+    bool exists;
+    struct summary_stamp stamp;
+    char *value;
+};
+
+/* The summary of the directory accessed last, problems are usually processed
+ * one by one. D-Bus and event handlers may access problems from several
+ * threads, so the cache is guarded by a mutex (a static GMutex does not need
+ * to be initialized).
+ */
+static GMutex s_cache_lock;
+static struct
+{
+    bool valid;
+    /* Identification of the opened directory, the pointer is never
+     * dereferenced */
+    const struct dump_dir *dd;
+    int dd_fd;
+    char *dirname;
+    dev_t dir_dev;
+    GHashTable *items; /* element name -> struct summary_item, NULL if the
+                          directory has no valid summary */
+} s_cache;
+
+static void summary_stamp_init(struct summary_stamp *stamp, const struct stat *st)
+{
+    stamp->ino = st->st_ino;
+    stamp->size = st->st_size;
+    stamp->mtime_sec = st->st_mtim.tv_sec;
+    stamp->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+static void summary_item_free(struct summary_item *item)
+{
+    if (item == NULL)
+        return;
+
+    free(item->value);
+    free(item);
+}
+
+/* Must be called with s_cache_lock held */
+static void drop_cache(void)
+{
+    if (s_cache.items != NULL)
+        g_hash_table_destroy(s_cache.items);
+    free(s_cache.dirname);
+
+    memset(&s_cache, 0, sizeof(s_cache));
+}
+
+/*
+ * Writing
+ */
+
+static void put_bytes(GByteArray *buf, const void *data, size_t size)
+{
+    g_byte_array_append(buf, data, size);
+}
+
+#define PUT_VALUE(buf, type, value) \
+    do { type tmp_value = (value); put_bytes(buf, &tmp_value, sizeof(tmp_value)); } while (0)
+
+int problem_summary_save(struct dump_dir *dd)
+{
+    if (!dd->locked)
+    {
+        error_msg("Can't save summary of unlocked problem directory '%s'", dd->dd_dirname);
+        return -EINVAL;
+    }
+
+    GByteArray *buf = g_byte_array_new();
+    put_bytes(buf, PROBLEM_SUMMARY_MAGIC, sizeof(PROBLEM_SUMMARY_MAGIC));
+    PUT_VALUE(buf, uint32_t, PROBLEM_SUMMARY_VERSION);
+    const unsigned count_offset = buf->len;
+    PUT_VALUE(buf, uint32_t, 0);
+
+    uint32_t item_count = 0;
+    for (unsigned i = 0; i < ARRAY_SIZE(s_summary_elements); ++i)
+    {
+        const char *name = s_summary_elements[i];
+        struct summary_stamp stamp;
+        memset(&stamp, 0, sizeof(stamp));
+        char *value = NULL;
+
+        struct stat st;
+        if (fstatat(dd->dd_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+            /* Leave out anything that does not look like a text element */
+            if (!S_ISREG(st.st_mode) || st.st_size > PROBLEM_SUMMARY_MAX_VALUE_SIZE)
+                continue;
+
+            value = dd_load_text_ext(dd, name, DD_FAIL_QUIETLY_ENOENT | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+            if (value == NULL)
+                continue;
+
+            summary_stamp_init(&stamp, &st);
+        }
+        else if (errno != ENOENT)
+            continue;
+
+        const size_t name_len = strlen(name);
+        PUT_VALUE(buf, uint16_t, name_len);
+        put_bytes(buf, name, name_len);
+        PUT_VALUE(buf, uint8_t, value != NULL);
+        put_bytes(buf, &stamp, sizeof(stamp));
+
+        const size_t value_len = value ? strlen(value) : 0;
+        PUT_VALUE(buf, uint32_t, value_len);
+        put_bytes(buf, value, value_len);
+
+        free(value);
+        ++item_count;
+    }
+    memcpy(buf->data + count_offset, &item_count, sizeof(item_count));
+
+    int r = 0;
+    /* The directory is locked, no one else writes the temporary file */
+    const char *tmp_name = PROBLEM_SUMMARY_FILENAME".new";
+    unlinkat(dd->dd_fd, tmp_name, /*only files*/0);
+    const int fd = openat(dd->dd_fd, tmp_name,
+            O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, dd->mode);
+    if (fd < 0)
+    {
+        r = -errno;
+        perror_msg("Can't create file '%s' in '%s'", tmp_name, dd->dd_dirname);
+        goto finito;
+    }
+
+    if (geteuid() == 0 && fchown(fd, dd->dd_uid, dd->dd_gid) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't change ownership of '%s' in '%s'", tmp_name, dd->dd_dirname);
+        close(fd);
+        goto remove_tmp;
+    }
+
+    const bool written = full_write(fd, buf->data, buf->len) == (ssize_t)buf->len;
+    if (close(fd) != 0 || !written)
+    {
+        r = -EIO;
+        perror_msg("Can't write file '%s' in '%s'", tmp_name, dd->dd_dirname);
+        goto remove_tmp;
+    }
+
+    if (renameat(dd->dd_fd, tmp_name, dd->dd_fd, PROBLEM_SUMMARY_FILENAME) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't rename '%s' in '%s'", tmp_name, dd->dd_dirname);
+        goto remove_tmp;
+    }
+
+    log_debug("Saved summary of '%s' (%u elements)", dd->dd_dirname, item_count);
+
+    /* Let the next reader use the new summary */
+    g_mutex_lock(&s_cache_lock);
+    drop_cache();
+    g_mutex_unlock(&s_cache_lock);
+
+    goto finito;
+
+remove_tmp:
+    unlinkat(dd->dd_fd, tmp_name, /*only files*/0);
+finito:
+    g_byte_array_free(buf, TRUE);
+    return r;
+}
+
+/*
+ * Reading
+ */
+
+struct reader
+{
+    const char *pos;
+    const char *end;
+};
+
+static bool get_bytes(struct reader *rd, void *data, size_t size)
+{
+    if ((size_t)(rd->end - rd->pos) < size)
+        return false;
+
+    memcpy(data, rd->pos, size);
+    rd->pos += size;
+    return true;
+}
+
+static char *get_string(struct reader *rd, size_t len)
+{
+    if ((size_t)(rd->end - rd->pos) < len)
+        return NULL;
+
+    char *str = xstrndup(rd->pos, len);
+    rd->pos += len;
+    return str;
+}
+
+/* Returns NULL if the data is not a valid summary */
+static GHashTable *parse_summary(const char *data, size_t size)
+{
+    struct reader rd = { .pos = data, .end = data + size };
+
+    char magic[sizeof(PROBLEM_SUMMARY_MAGIC)];
+    uint32_t version;
+    uint32_t item_count;
+    if (!get_bytes(&rd, magic, sizeof(magic))
+        || memcmp(magic, PROBLEM_SUMMARY_MAGIC, sizeof(magic)) != 0
+        || !get_bytes(&rd, &version, sizeof(version))
+        || version != PROBLEM_SUMMARY_VERSION
+        || !get_bytes(&rd, &item_count, sizeof(item_count)))
+        return NULL;
+
+    GHashTable *items = g_hash_table_new_full(g_str_hash, g_str_equal,
+            free, (GDestroyNotify)summary_item_free);
+
+    for (uint32_t i = 0; i < item_count; ++i)
+    {
+        uint16_t name_len;
+        if (!get_bytes(&rd, &name_len, sizeof(name_len)))
+            goto invalid;
+
+        char *name = get_string(&rd, name_len);
+        if (name == NULL)
+            goto invalid;
+
+        struct summary_item *item = xzalloc(sizeof(*item));
+        g_hash_table_replace(items, name, item);
+
+        uint8_t exists;
+        uint32_t value_len;
+        if (!get_bytes(&rd, &exists, sizeof(exists))
+            || !get_bytes(&rd, &item->stamp, sizeof(item->stamp))
+            || !get_bytes(&rd, &value_len, sizeof(value_len))
+            || (item->value = get_string(&rd, value_len)) == NULL)
+            goto invalid;
+
+        item->exists = exists;
+    }
+
+    if (rd.pos == rd.end)
+        return items;
+
+invalid:
+    g_hash_table_destroy(items);
+    return NULL;
+}
+
+/* Returns the summary of the directory or NULL. The summary is loaded only
+ * once per opened directory. Must be called with s_cache_lock held.
+ */
+static GHashTable *get_summary_items(const struct dump_dir *dd)
+{
+    if (s_cache.valid
+        && s_cache.dd == dd
+        && s_cache.dd_fd == dd->dd_fd
+        && strcmp(s_cache.dirname, dd->dd_dirname) == 0)
+        return s_cache.items;
+
+    drop_cache();
+
+    struct stat dir_st;
+    if (fstat(dd->dd_fd, &dir_st) != 0)
+        return NULL;
+
+    s_cache.valid = true;
+    s_cache.dd = dd;
+    s_cache.dd_fd = dd->dd_fd;
+    s_cache.dirname = xstrdup(dd->dd_dirname);
+    s_cache.dir_dev = dir_st.st_dev;
+
+    /* The summary must have been written by the directory owner */
+    struct stat st;
+    if (fstatat(dd->dd_fd, PROBLEM_SUMMARY_FILENAME, &st, AT_SYMLINK_NOFOLLOW) != 0
+        || !S_ISREG(st.st_mode)
+        || st.st_uid != dir_st.st_uid
+        || st.st_size > PROBLEM_SUMMARY_MAX_SIZE)
+        return NULL;
+
+    const int fd = openat(dd->dd_fd, PROBLEM_SUMMARY_FILENAME, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    size_t size = PROBLEM_SUMMARY_MAX_SIZE;
+    char *data = xmalloc_read(fd, &size);
+    close(fd);
+    if (data == NULL)
+        return NULL;
+
+    s_cache.items = parse_summary(data, size);
+    free(data);
+
+    if (s_cache.items == NULL)
+        log_notice("Ignoring invalid summary in '%s'", dd->dd_dirname);
+
+    return s_cache.items;
+}
+
+/* Returns the item if it still describes the element file, otherwise NULL.
+ * Must be called with s_cache_lock held.
+ */
+static const struct summary_item *get_fresh_item(const struct dump_dir *dd, const char *name)
+{
+    GHashTable *items = get_summary_items(dd);
+    if (items == NULL)
+        return NULL;
+
+    const struct summary_item *item = g_hash_table_lookup(items, name);
+    if (item == NULL)
+        return NULL;
+
+    struct stat st;
+    if (fstatat(dd->dd_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return (errno == ENOENT && !item->exists) ? item : NULL;
+
+    if (!item->exists || !S_ISREG(st.st_mode) || st.st_dev != s_cache.dir_dev)
+        return NULL;
+
+    struct summary_stamp stamp;
+    summary_stamp_init(&stamp, &st);
+    if (memcmp(&stamp, &item->stamp, sizeof(stamp)) != 0)
+    {
+        log_debug("Summary of '%s' is out of date for '%s'", dd->dd_dirname, name);
+        return NULL;
+    }
+
+    return item;
+}
+
+/* Returns 1 and the value if the element is in the summary, 0 if the summary
+ * says the element does not exist and -1 if the summary cannot be used.
+ */
+static int load_summary_value(const struct dump_dir *dd, const char *name, char **value)
+{
+    int r = -1;
+
+    g_mutex_lock(&s_cache_lock);
+    const struct summary_item *item = get_fresh_item(dd, name);
+    if (item != NULL)
+    {
+        r = item->exists;
+        *value = item->exists ? xstrdup(item->value) : NULL;
+    }
+    g_mutex_unlock(&s_cache_lock);
+
+    return r;
+}
+
+char *problem_summary_load_text(const struct dump_dir *dd, const char *name, unsigned flags)
+{
+    char *value;
+    const int r = load_summary_value(dd, name, &value);
+    if (r > 0)
+        return value;
+
+    /* Let dd_load_text_ext() emit the error message */
+    if (r == 0 && (flags & DD_FAIL_QUIETLY_ENOENT))
+        return (flags & DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE) ? NULL : xstrdup("");
+
+    return dd_load_text_ext(dd, name, flags);
+}
+
+int problem_summary_load_uint32(const struct dump_dir *dd, const char *name, uint32_t *value)
+{
+    char *str;
+    const int r = load_summary_value(dd, name, &str);
+    if (r < 0)
+        return dd_load_uint32(dd, name, value);
+
+    if (r == 0)
+        return -ENOENT;
+
+    /* Same rules as dd_load_uint32() */
+    int retval = 0;
+    char *end;
+    if (*str == '\0' || *str == '-' || isspace(*str))
+    {
+        retval = -EINVAL;
+        goto finito;
+    }
+
+    errno = 0;
+    const unsigned long long res = strtoull(str, &end, 10);
+    if (errno != 0 || *end != '\0')
+        retval = -EINVAL;
+    else if (res > UINT32_MAX)
+        retval = -ERANGE;
+    else
+        *value = res;
+
+finito:
+    free(str);
+    return retval;
+}
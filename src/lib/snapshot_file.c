@@ -0,0 +1,173 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Snapshot files
+ *
+ * Layout of a snapshot file:
+ *   struct snapshot_file_header
+ *   header.payload_size bytes of the payload
+ */
+
+#include <sys/mman.h>
+#include "internal_libabrt.h"
+
+struct snapshot_file_header
+{
+    char     magic[SNAPSHOT_FILE_MAGIC_LEN];
+    uint8_t  generation[SHA1_RESULT_LEN];
+    uint8_t  sha1[SHA1_RESULT_LEN]; /* of the payload */
+    uint32_t payload_size;
+};
+
+void snapshot_file_compute_sha1(const void *data, size_t size, uint8_t sha1[SHA1_RESULT_LEN])
+{
+    sha1_ctx_t ctx;
+    sha1_begin(&ctx);
+    sha1_hash(&ctx, data, size);
+    sha1_end(&ctx, sha1);
+}
+
+int snapshot_file_open(struct abrt_snapshot_file *snapshot, const char *path,
+        const char *magic, const uint8_t generation[SHA1_RESULT_LEN])
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    const int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+            log_debug("Can't open '%s': %s", path, strerror(errno));
+        return -1;
+    }
+
+    int r = -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+        || (size_t)st.st_size < sizeof(struct snapshot_file_header))
+        goto close_fd;
+
+    /* Do not trust snapshots that could have been written by someone else */
+    if (st.st_uid != 0 || (st.st_mode & (S_IWGRP | S_IWOTH)))
+    {
+        log_notice("Ignoring '%s' with insecure owner or mode", path);
+        goto close_fd;
+    }
+
+    void *const map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        log_debug("Can't map '%s': %s", path, strerror(errno));
+        goto close_fd;
+    }
+
+    const struct snapshot_file_header *header = map;
+    const char *const payload = (const char *)map + sizeof(*header);
+
+    if (memcmp(header->magic, magic, sizeof(header->magic)) != 0
+        || header->payload_size != st.st_size - sizeof(*header))
+    {
+        log_debug("'%s' is not valid", path);
+        goto unmap;
+    }
+
+    if (memcmp(header->generation, generation, sizeof(header->generation)) != 0)
+    {
+        log_debug("'%s' is out of date", path);
+        goto unmap;
+    }
+
+    uint8_t sha1[SHA1_RESULT_LEN];
+    snapshot_file_compute_sha1(payload, header->payload_size, sha1);
+    if (memcmp(sha1, header->sha1, sizeof(sha1)) != 0)
+    {
+        log_notice("'%s' is corrupted", path);
+        goto unmap;
+    }
+
+    snapshot->payload = payload;
+    snapshot->payload_size = header->payload_size;
+    snapshot->map = map;
+    snapshot->map_size = st.st_size;
+    r = 0;
+
+unmap:
+    /* The payload stays mapped until snapshot_file_close() */
+    if (r != 0)
+        munmap(map, st.st_size);
+close_fd:
+    close(fd);
+    return r;
+}
+
+void snapshot_file_close(struct abrt_snapshot_file *snapshot)
+{
+    if (snapshot->map != NULL)
+        munmap(snapshot->map, snapshot->map_size);
+
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+int snapshot_file_save(const char *path, const char *magic,
+        const uint8_t generation[SHA1_RESULT_LEN], const void *payload, size_t payload_size)
+{
+    if (payload_size > UINT32_MAX)
+    {
+        error_msg("Can't save '%s', the payload is too big", path);
+        return -1;
+    }
+
+    struct snapshot_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(header.magic));
+    memcpy(header.generation, generation, sizeof(header.generation));
+    header.payload_size = payload_size;
+    snapshot_file_compute_sha1(payload, payload_size, header.sha1);
+
+    int r = -1;
+    char *tmp_path = xasprintf("%s.XXXXXX", path);
+    const int fd = mkstemp(tmp_path);
+    if (fd < 0)
+    {
+        log_debug("Can't create '%s': %s", tmp_path, strerror(errno));
+        goto finito;
+    }
+
+    const bool written = full_write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header)
+                      && full_write(fd, payload, payload_size) == (ssize_t)payload_size;
+    if (close(fd) != 0 || !written)
+    {
+        perror_msg("Can't write '%s'", tmp_path);
+        unlink(tmp_path);
+        goto finito;
+    }
+
+    if (rename(tmp_path, path) != 0)
+    {
+        perror_msg("Can't rename '%s' to '%s'", tmp_path, path);
+        unlink(tmp_path);
+        goto finito;
+    }
+
+    r = 0;
+
+finito:
+    free(tmp_path);
+    return r;
+}
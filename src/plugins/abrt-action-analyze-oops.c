@@ -16,8 +16,7 @@
     with this program; if not, write to the Free Software Foundation, Inc.,
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
-#include "libabrt.h"
-
+#include "analyze-utils.h"
 
 int main(int argc, char **argv)
 {
@@ -59,49 +58,7 @@ int main(int argc, char **argv)
     map_string_t *settings = new_map_string();
     load_abrt_plugin_conf_file("oops.conf", settings);
 
-    char *oops = dd_load_text(dd, FILENAME_BACKTRACE);
-    char hash_str[SHA1_RESULT_LEN*2 + 1];
-    int bad = koops_hash_str(hash_str, oops);
-    if (bad)
-    {
-        error_msg("Can't find a meaningful backtrace for hashing in '%s'", dump_dir_name);
-
-        /* Do not drop such oopses by default. */
-        int drop_notreportable_oopses = 0;
-        const int res = try_get_map_string_item_as_bool(settings,
-                "DropNotReportableOopses", &drop_notreportable_oopses);
-        if (!res || !drop_notreportable_oopses)
-        {
-            /* Let users know that they can configure ABRT to drop these oopses. */
-            log_warning("Preserving oops '%s' because DropNotReportableOopses is 'no'", dump_dir_name);
-
-            dd_save_text(dd, FILENAME_NOT_REPORTABLE,
-            _("The backtrace does not contain enough meaningful function frames "
-              "to be reported. It is annoying but it does not necessary "
-              "signalize a problem with your computer. ABRT will not allow "
-              "you to create a report in a bug tracking system but you "
-              "can contact kernel maintainers via e-mail.")
-            );
-
-            /* Try to generate the hash once more with no limits. */
-            /* We need UUID file for the local duplicates look-up and DUPHASH */
-            /* file is also useful because user can force ABRT to report */
-            /* the oops into a bug tracking system (Bugzilla). */
-            bad = koops_hash_str_ext(hash_str, oops,
-                    /* use no frame count limit */-1,
-                    /* use every frame in stacktrace */0);
-
-            /* If even this attempt fails, we can drop the oops without any hesitation. */
-        }
-    }
-
-    free(oops);
-
-    if (!bad)
-    {
-        dd_save_text(dd, FILENAME_UUID, hash_str);
-        dd_save_text(dd, FILENAME_DUPHASH, hash_str);
-    }
+    const int bad = abrt_analyze_oops(dd, settings, /*results*/NULL);
 
     dd_close(dd);
 
@@ -16,13 +16,7 @@
     with this program; if not, write to the Free Software Foundation, Inc.,
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
-#include "libabrt.h"
-
-#include <satyr/stacktrace.h>
-#include <satyr/python/stacktrace.h>
-#include <satyr/thread.h>
-#include <satyr/python/frame.h>
-#include <satyr/frame.h>
+#include "analyze-utils.h"
 
 int main(int argc, char **argv)
 {
@@ -60,45 +54,10 @@ int main(int argc, char **argv)
     struct dump_dir *dd = dd_opendir(dump_dir_name, /*flags:*/ 0);
     if (!dd)
         return 1;
-    char *bt = dd_load_text(dd, FILENAME_BACKTRACE);
-
-    /* save crash_function and exception_name into dumpdir */
-    char *error_message = NULL;
-    struct sr_stacktrace *stacktrace = sr_stacktrace_parse(SR_REPORT_PYTHON,
-                                                           (const char *)bt, &error_message);
-    if (stacktrace)
-    {
-        struct sr_python_stacktrace *python_stacktrace = (struct sr_python_stacktrace *)stacktrace;
-        if (python_stacktrace->exception_name)
-            dd_save_text(dd, FILENAME_EXCEPTION_TYPE, python_stacktrace->exception_name);
-        /* thread is the same as stacktrace, if stacktrace is not NULL, thread
-         * is not NULL as well */
-        struct sr_thread *thread = sr_stacktrace_find_crash_thread(stacktrace);
-        struct sr_python_frame *frame = (struct sr_python_frame *)sr_thread_frames(thread);
-        if (frame && frame->function_name)
-            dd_save_text(dd, FILENAME_CRASH_FUNCTION, frame->function_name);
-
-        sr_stacktrace_free(stacktrace);
-    }
-    else
-    {
-        error_msg("Can't parse stacktrace: %s", error_message);
-        free(error_message);
-    }
-
-    /* Hash 1st line of backtrace and save it as UUID and DUPHASH */
-    /* "example.py:1:<module>:ZeroDivisionError: integer division or modulo by zero" */
-
-    char *bt_end = strchrnul(bt, '\n');
-    *bt_end = '\0';
-    char hash_str[SHA1_RESULT_LEN*2 + 1];
-    str_to_sha1str(hash_str, bt);
 
-    free(bt);
+    const int r = abrt_analyze_python(dd, /*results*/NULL);
 
-    dd_save_text(dd, FILENAME_UUID, hash_str);
-    dd_save_text(dd, FILENAME_DUPHASH, hash_str);
     dd_close(dd);
 
-    return 0;
+    return r;
 }
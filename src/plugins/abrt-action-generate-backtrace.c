@@ -41,13 +41,17 @@ int main(int argc, char **argv)
     const char *program_usage_string = _(
         "& [options] -d DIR\n"
         "\n"
-        "Analyzes coredump in problem directory DIR, generates and saves backtrace"
+        "Analyzes coredump in problem directory DIR, generates and saves backtrace\n"
+        "\n"
+        "With -x, the same gdb session also saves the exploitability rating and\n"
+        "the registers of the crashed thread"
     );
     enum {
         OPT_v = 1 << 0,
         OPT_d = 1 << 1,
         OPT_i = 1 << 2,
         OPT_t = 1 << 3,
+        OPT_x = 1 << 4,
     };
     /* Keep enum above and order of options below in sync! */
     struct options program_options[] = {
@@ -55,12 +59,18 @@ int main(int argc, char **argv)
         OPT_STRING( 'd', NULL, &dump_dir_name   , "DIR"           , _("Problem directory")),
         OPT_STRING( 'i', NULL, &i_opt           , "DIR1[:DIR2]...", _("Additional debuginfo directories")),
         OPT_INTEGER('t', NULL, &exec_timeout_sec,                   _("Kill gdb if it runs for more than NUM seconds")),
+        OPT_BOOL(   'x', NULL, NULL,                                _("Save also exploitability rating and registers")),
         OPT_END()
     };
-    /*unsigned opts =*/ parse_opts(argc, argv, program_options, program_usage_string);
+    unsigned opts = parse_opts(argc, argv, program_options, program_usage_string);
 
     export_abrt_envvars(0);
 
+    /* gdb needs the whole coredump including the segments left out by
+     * abrt-hook-ccpp; does nothing if the problem is already restored */
+    if (problem_dir_inflate(dump_dir_name) != 0)
+        error_msg("Can't restore coredump, the backtrace may be incomplete");
+
     map_string_t *settings = new_map_string();
     if (!load_abrt_plugin_conf_file(CCPP_CONF, settings))
         error_msg("Can't load '%s'", CCPP_CONF);
@@ -78,8 +88,12 @@ int main(int argc, char **argv)
         debuginfo_dirs = xasprintf("%s:%s", debuginfo_location, i_opt);
 
     /* Create gdb backtrace */
-    char *backtrace = get_backtrace(dump_dir_name, exec_timeout_sec,
-            (debuginfo_dirs) ? debuginfo_dirs : debuginfo_location);
+    char *exploitable = NULL;
+    char *registers = NULL;
+    const int flags = (opts & OPT_x) ? GET_BACKTRACE_EXPLOITABLE | GET_BACKTRACE_REGISTERS : 0;
+    char *backtrace = get_backtrace_ext(dump_dir_name, exec_timeout_sec,
+            (debuginfo_dirs) ? debuginfo_dirs : debuginfo_location,
+            flags, &exploitable, &registers);
     free(debuginfo_location);
     if (!backtrace)
     {
@@ -95,7 +109,13 @@ int main(int argc, char **argv)
     if (!dd)
         return 1;
     dd_save_text(dd, FILENAME_BACKTRACE, backtrace);
+    if (exploitable)
+        dd_save_text(dd, FILENAME_EXPLOITABLE, exploitable);
+    if (registers)
+        dd_save_text(dd, FILENAME_REGISTERS, registers);
     dd_close(dd);
+    free(exploitable);
+    free(registers);
 
     /* Don't be completely silent. gdb run takes a few seconds,
      * it is useful to let user know it (maybe) worked.
@@ -60,6 +60,16 @@ int main(int argc, char **argv)
     if (g_verbose > 1)
         sr_debug_parser = true;
 
+    /* The coredump of an old problem can be compressed. The segments left
+     * out by abrt-hook-ccpp are not restored, the unwinder reads them from
+     * the mapped files. */
+    struct dump_dir *dd = dd_opendir(dump_dir_name, /*flags*/0);
+    if (dd != NULL)
+    {
+        problem_element_inflate(dd, FILENAME_COREDUMP);
+        dd_close(dd);
+    }
+
     /* Let user know what's going on */
     log_notice(_("Generating core_backtrace"));
 
@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2016  ABRT team
+    Copyright (C) 2016  RedHat Inc
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "libabrt.h"
+
+int main(int argc, char **argv)
+{
+    /* I18n */
+    setlocale(LC_ALL, "");
+#if ENABLE_NLS
+    bindtextdomain(PACKAGE, LOCALEDIR);
+    textdomain(PACKAGE);
+#endif
+
+    abrt_init(argv);
+
+    const char *dump_dir_name = ".";
+
+    /* Can't keep these strings/structs static: _() doesn't support that */
+    const char *program_usage_string = _(
+        "& [-v] [-d DIR] [ELEMENT]...\n"
+        "\n"
+        "Restores elements compressed by the cold storage of abrtd.\n"
+        "All big elements (coredump, binary, vmcore) and the parts of coredump\n"
+        "left out by abrt-hook-ccpp are restored if no ELEMENT is given."
+    );
+    enum {
+        OPT_v = 1 << 0,
+        OPT_d = 1 << 1,
+    };
+    /* Keep enum above and order of options below in sync! */
+    struct options program_options[] = {
+        OPT__VERBOSE(&g_verbose),
+        OPT_STRING('d', NULL, &dump_dir_name, "DIR", _("Problem directory")),
+        OPT_END()
+    };
+    /*unsigned opts =*/ parse_opts(argc, argv, program_options, program_usage_string);
+    argv += optind;
+
+    export_abrt_envvars(0);
+
+    if (argv[0] == NULL)
+        return problem_dir_inflate(dump_dir_name) != 0;
+
+    struct dump_dir *dd = dd_opendir(dump_dir_name, /*flags*/0);
+    if (dd == NULL)
+        return 1;
+
+    int retval = 0;
+    for (; *argv != NULL; ++argv)
+    {
+        const int r = problem_element_inflate(dd, *argv);
+        if (r == -ENOENT)
+            log_warning(_("Element '%s' does not exist"), *argv);
+        if (r != 0)
+            retval = 1;
+    }
+
+    dd_close(dd);
+    return retval;
+}
@@ -18,118 +18,575 @@
 */
 #include "libabrt.h"
 
-/* We remember N worst files and their sizes, not just one:
- * if DIR is deep, scanning it takes *a few seconds* even if it's in cache.
- * If we rescan it after each single file deletion, it can be VERY slow.
- * (I observed ~20 min long case).
+/* The files are found by a single parallel walk of DIR. We remember N worst
+ * files and their sizes in a bounded heap and delete them in one pass. The
+ * walk is repeated only if deleting all of them was not enough.
  */
-#define MAX_VICTIM_LIST_SIZE 128
+#define MAX_VICTIM_HEAP_SIZE 65536
+#define MAX_TRIM_WALKERS 16
+#define MAX_TRIM_ROUNDS 100
+
+/* The ledger remembers the files of every directory together with the
+ * directory's mtime. Adding or removing a file changes the mtime, so the
+ * directories whose mtime matches the ledger are not read again. Files
+ * modified in place are not noticed, which is fine for caches whose files
+ * are only added and deleted (abrt-action-install-debuginfo).
+ */
+#define TRIM_LEDGER_NAME ".abrt-trim-ledger"
+#define TRIM_LEDGER_HEADER "ABRT-TRIM-LEDGER 1"
+/* Directories modified shortly before the walk may be modified again
+ * without an mtime change (coarse timestamps) */
+#define TRIM_LEDGER_RACY_SEC 2
 
-struct name_and_size {
+struct victim {
     off_t size;
     double weighted_size_and_age;
-    char name[1];
+    char *name; /* relative to DIR */
 };
 
-/* Updates a list of files sorted by increasing weighted_size_and_age.
- */
-static GList *insert_name_and_sizes(GList *list, const char *name, double wsa, off_t sz)
+/* Min-heap: the least worthy victim is at the top and it is replaced
+ * when a worse file is found */
+struct victim_heap {
+    GArray *items;
+};
+
+struct ledger_file {
+    off_t size;
+    time_t mtime;
+    char *name;
+};
+
+struct ledger_dir {
+    struct timespec mtime;
+    GPtrArray *subdirs;
+    GArray *files;
+};
+
+struct trim_walk {
+    int dir_fd;
+    const char *dir;
+    time_t now;
+    GHashTable *preserved; /* names relative to DIR */
+    GHashTable *old_ledger;
+    GThreadPool *pool;
+
+    GMutex lock;
+    GCond done;
+    unsigned pending;
+    double size;
+    struct victim_heap victims;
+    GHashTable *new_ledger;
+    unsigned dirs;
+    unsigned cached_dirs;
+    unsigned long files;
+};
+
+static void victim_heap_init(struct victim_heap *heap)
+{
+    heap->items = g_array_new(FALSE, FALSE, sizeof(struct victim));
+}
+
+static void victim_heap_destroy(struct victim_heap *heap)
+{
+    for (unsigned i = 0; i < heap->items->len; ++i)
+        free(g_array_index(heap->items, struct victim, i).name);
+    g_array_free(heap->items, TRUE);
+}
+
+static bool victim_heap_wants(const struct victim_heap *heap, double wsa)
+{
+    return heap->items->len < MAX_VICTIM_HEAP_SIZE
+        || g_array_index(heap->items, struct victim, 0).weighted_size_and_age < wsa;
+}
+
+static void victim_heap_sift_down(GArray *items, unsigned i)
+{
+    struct victim *v = (struct victim *)items->data;
+    for (;;)
+    {
+        unsigned least = i;
+        const unsigned l = 2 * i + 1;
+        const unsigned r = l + 1;
+        if (l < items->len && v[l].weighted_size_and_age < v[least].weighted_size_and_age)
+            least = l;
+        if (r < items->len && v[r].weighted_size_and_age < v[least].weighted_size_and_age)
+            least = r;
+        if (least == i)
+            return;
+
+        const struct victim tmp = v[i];
+        v[i] = v[least];
+        v[least] = tmp;
+        i = least;
+    }
+}
+
+/* Takes ownership of NAME */
+static void victim_heap_push(struct victim_heap *heap, char *name, double wsa, off_t size)
+{
+    const struct victim victim = { .size = size, .weighted_size_and_age = wsa, .name = name };
+    GArray *items = heap->items;
+
+    if (items->len >= MAX_VICTIM_HEAP_SIZE)
+    {
+        struct victim *top = &g_array_index(items, struct victim, 0);
+        if (top->weighted_size_and_age >= wsa)
+        {
+            free(name);
+            return;
+        }
+        free(top->name);
+        *top = victim;
+        victim_heap_sift_down(items, 0);
+        return;
+    }
+
+    g_array_append_val(items, victim);
+    struct victim *v = (struct victim *)items->data;
+    for (unsigned i = items->len - 1; i > 0; )
+    {
+        const unsigned parent = (i - 1) / 2;
+        if (v[parent].weighted_size_and_age <= v[i].weighted_size_and_age)
+            break;
+        const struct victim tmp = v[i];
+        v[i] = v[parent];
+        v[parent] = tmp;
+        i = parent;
+    }
+}
+
+static gint victim_cmp_worst_first(gconstpointer a, gconstpointer b)
+{
+    const struct victim *va = a;
+    const struct victim *vb = b;
+    if (va->weighted_size_and_age > vb->weighted_size_and_age)
+        return -1;
+    return va->weighted_size_and_age < vb->weighted_size_and_age;
+}
+
+static struct ledger_dir *ledger_dir_new(void)
+{
+    struct ledger_dir *ld = xzalloc(sizeof(*ld));
+    ld->subdirs = g_ptr_array_new_with_free_func(free);
+    ld->files = g_array_new(FALSE, FALSE, sizeof(struct ledger_file));
+    return ld;
+}
+
+static void ledger_dir_free(struct ledger_dir *ld)
+{
+    if (ld == NULL)
+        return;
+
+    for (unsigned i = 0; i < ld->files->len; ++i)
+        free(g_array_index(ld->files, struct ledger_file, i).name);
+    g_array_free(ld->files, TRUE);
+    g_ptr_array_free(ld->subdirs, TRUE);
+    free(ld);
+}
+
+static GHashTable *ledger_new(void)
+{
+    return g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)ledger_dir_free);
+}
+
+/* The ledger can be modified by anyone who can write to DIR, so its names
+ * must not lead out of DIR. Like str_is_correct_filename() but without
+ * the length limit, the names in caches are often longer. */
+static bool ledger_name_is_valid(const char *name)
+{
+    return name[0] != '\0' && !dot_or_dotdot(name) && strchr(name, '/') == NULL;
+}
+
+/* "" is DIR itself */
+static bool ledger_relpath_is_valid(const char *relpath)
+{
+    if (relpath[0] == '\0')
+        return true;
+
+    char *copy = xstrdup(relpath);
+    bool valid = true;
+    for (char *name = copy, *next; valid && name != NULL; name = next)
+    {
+        next = strchr(name, '/');
+        if (next != NULL)
+            *next++ = '\0';
+        valid = ledger_name_is_valid(name);
+    }
+    free(copy);
+
+    return valid;
+}
+
+/* Returns NULL if the ledger does not exist or is not valid */
+static GHashTable *ledger_load(int dir_fd)
 {
-    struct name_and_size *ns;
-    unsigned list_len = 0;
-    GList *cur = list;
+    const int fd = openat(dir_fd, TRIM_LEDGER_NAME, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    FILE *fp = fdopen(fd, "r");
+    if (fp == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    GHashTable *ledger = ledger_new();
+    struct ledger_dir *ld = NULL;
+    bool valid = false;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
 
-    while (cur)
+    if ((len = getline(&line, &line_size, fp)) <= 0 || strcmp(line, TRIM_LEDGER_HEADER"\n") != 0)
+        goto finito;
+
+    while ((len = getline(&line, &line_size, fp)) > 0)
     {
-        ns = cur->data;
-        if (ns->weighted_size_and_age >= wsa)
+        if (line[len - 1] != '\n')
+            goto finito;
+        line[len - 1] = '\0';
+
+        int name_ofs = -1;
+        long long sec, nsec;
+        unsigned long long size;
+        if (line[0] == 'D' && sscanf(line, "D %lld %lld %n", &sec, &nsec, &name_ofs) == 2 && name_ofs > 0
+            && ledger_relpath_is_valid(line + name_ofs))
+        {
+            ld = ledger_dir_new();
+            ld->mtime.tv_sec = sec;
+            ld->mtime.tv_nsec = nsec;
+            g_hash_table_replace(ledger, xstrdup(line + name_ofs), ld);
+        }
+        else if (ld != NULL && line[0] == 'S' && line[1] == ' ' && ledger_name_is_valid(line + 2))
+            g_ptr_array_add(ld->subdirs, xstrdup(line + 2));
+        else if (ld != NULL && line[0] == 'F'
+                 && sscanf(line, "F %llu %lld %n", &size, &sec, &name_ofs) == 2 && name_ofs > 0
+                 && ledger_name_is_valid(line + name_ofs))
+        {
+            const struct ledger_file lf = { .size = size, .mtime = sec, .name = xstrdup(line + name_ofs) };
+            g_array_append_val(ld->files, lf);
+        }
+        else if (strcmp(line, "E") == 0)
+        {
+            valid = true;
             break;
-        list_len++;
-        cur = cur->next;
+        }
+        else
+            goto finito;
+    }
+
+finito:
+    free(line);
+    fclose(fp);
+
+    if (!valid)
+    {
+        log_notice("Ignoring invalid ledger '%s'", TRIM_LEDGER_NAME);
+        g_hash_table_destroy(ledger);
+        return NULL;
+    }
+
+    return ledger;
+}
+
+static void ledger_save(int dir_fd, const char *dir, GHashTable *ledger, time_t walk_start)
+{
+    const char *tmp = TRIM_LEDGER_NAME".tmp";
+    unlinkat(dir_fd, tmp, 0);
+    const int fd = openat(dir_fd, tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+    FILE *fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (fp == NULL)
+    {
+        perror_msg("Can't create '%s/%s'", dir, tmp);
+        if (fd >= 0)
+            close(fd);
+        return;
     }
-    list_len += g_list_length(cur);
 
-    if (cur != list || list_len < MAX_VICTIM_LIST_SIZE)
+    fputs(TRIM_LEDGER_HEADER"\n", fp);
+
+    GHashTableIter iter;
+    g_hash_table_iter_init(&iter, ledger);
+    const char *relpath;
+    const struct ledger_dir *ld;
+    while (g_hash_table_iter_next(&iter, (gpointer *)&relpath, (gpointer *)&ld))
     {
-        ns = xmalloc(sizeof(*ns) + strlen(name));
-        ns->weighted_size_and_age = wsa;
-        ns->size = sz;
-        strcpy(ns->name, name);
-        list = g_list_insert_before(list, cur, ns);
-        list_len++;
-        if (list_len > MAX_VICTIM_LIST_SIZE)
+        /* Not reliable, it will be read again next time */
+        if (ld->mtime.tv_sec >= walk_start - TRIM_LEDGER_RACY_SEC)
+            continue;
+
+        fprintf(fp, "D %lld %lld %s\n", (long long)ld->mtime.tv_sec, (long long)ld->mtime.tv_nsec, relpath);
+        for (unsigned i = 0; i < ld->subdirs->len; ++i)
+            fprintf(fp, "S %s\n", (const char *)g_ptr_array_index(ld->subdirs, i));
+        for (unsigned i = 0; i < ld->files->len; ++i)
         {
-            free(list->data);
-            list = g_list_delete_link(list, list);
+            const struct ledger_file *lf = &g_array_index(ld->files, struct ledger_file, i);
+            fprintf(fp, "F %llu %lld %s\n", (unsigned long long)lf->size, (long long)lf->mtime, lf->name);
         }
     }
+    fputs("E\n", fp);
+
+    if (fclose(fp) != 0 || renameat(dir_fd, tmp, dir_fd, TRIM_LEDGER_NAME) != 0)
+    {
+        perror_msg("Can't save '%s/%s'", dir, TRIM_LEDGER_NAME);
+        unlinkat(dir_fd, tmp, 0);
+    }
+}
 
-    return list;
+static char *relpath_join(const char *relpath, const char *name)
+{
+    return relpath[0] != '\0' ? concat_path_file(relpath, name) : xstrdup(name);
 }
 
-static double get_dir_size(const char *dirname,
-                GList **pp_worst_file_list,
-                GList *preserve_files_list
-) {
-    DIR *dp = opendir(dirname);
-    if (!dp)
-        return 0;
+static void trim_walk_dir(gpointer data, gpointer user_data);
 
-    /* "now" is used only if caller wants to know worst_file */
-    time_t now = pp_worst_file_list ? time(NULL) : 0;
-    struct dirent *dent;
+static void trim_walk_push(struct trim_walk *walk, char *relpath)
+{
+    g_mutex_lock(&walk->lock);
+    ++walk->pending;
+    g_mutex_unlock(&walk->lock);
+
+    if (walk->pool == NULL || !g_thread_pool_push(walk->pool, relpath, NULL))
+        trim_walk_dir(relpath, walk);
+}
+
+/* Accounts a file into the walk's results. NAME is the name in RELPATH. */
+static void trim_walk_file(struct trim_walk *walk, struct victim_heap *victims, double *size,
+        const char *relpath, const char *name, off_t file_size, time_t mtime)
+{
+    /* Account for filename and inode storage (approximately).
+     * This also makes even zero-length files to have nonzero cost.
+     */
+    double sz = file_size + strlen(name) + sizeof(struct stat);
+    *size += sz;
+
+    /* Calculate "weighted" size and age
+     * w = sz_kbytes * age_mins */
+    sz /= 1024;
+    long age = (walk->now - mtime) / 60;
+    if (age > 1)
+        sz *= age;
+
+    if (!victim_heap_wants(victims, sz))
+        return;
+
+    char *victim = relpath_join(relpath, name);
+    if (walk->preserved != NULL && g_hash_table_contains(walk->preserved, victim))
+    {
+        free(victim);
+        return;
+    }
+
+    victim_heap_push(victims, victim, sz, file_size);
+}
+
+/* Runs in a worker thread, walks one directory */
+static void trim_walk_dir(gpointer data, gpointer user_data)
+{
+    char *relpath = data;
+    struct trim_walk *walk = user_data;
+    const char *open_path = relpath[0] != '\0' ? relpath : ".";
+
+    struct victim_heap victims;
+    victim_heap_init(&victims);
     double size = 0;
+    unsigned long files = 0;
+    bool cached = false;
+    struct ledger_dir *ld = NULL;
+
+    struct stat st;
+    if (fstatat(walk->dir_fd, open_path, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISDIR(st.st_mode))
+        goto finito;
+
+    /* The ledger is only read, no need to lock it */
+    const struct ledger_dir *old = walk->old_ledger ? g_hash_table_lookup(walk->old_ledger, relpath) : NULL;
+    if (old != NULL
+        && old->mtime.tv_sec == st.st_mtim.tv_sec
+        && old->mtime.tv_nsec == st.st_mtim.tv_nsec)
+    {
+        cached = true;
+        for (unsigned i = 0; i < old->files->len; ++i)
+        {
+            const struct ledger_file *lf = &g_array_index(old->files, struct ledger_file, i);
+            trim_walk_file(walk, &victims, &size, relpath, lf->name, lf->size, lf->mtime);
+        }
+        files = old->files->len;
+
+        for (unsigned i = 0; i < old->subdirs->len; ++i)
+            trim_walk_push(walk, relpath_join(relpath, g_ptr_array_index(old->subdirs, i)));
+
+        goto finito;
+    }
+
+    const int fd = openat(walk->dir_fd, open_path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        goto finito;
+
+    DIR *dp = fdopendir(fd);
+    if (dp == NULL)
+    {
+        close(fd);
+        goto finito;
+    }
+
+    if (walk->new_ledger != NULL)
+    {
+        ld = ledger_dir_new();
+        ld->mtime = st.st_mtim;
+    }
+
+    struct dirent *dent;
     while ((dent = readdir(dp)) != NULL)
     {
         if (dot_or_dotdot(dent->d_name))
             continue;
 
-        char *fullname = concat_path_file(dirname, dent->d_name);
-        struct stat stats;
-        if (lstat(fullname, &stats) != 0)
-            goto next;
+        /* Our own ledger */
+        if (relpath[0] == '\0' && strncmp(dent->d_name, TRIM_LEDGER_NAME, strlen(TRIM_LEDGER_NAME)) == 0)
+            continue;
+
+        /* Names with newlines can't be stored in the ledger */
+        if (ld != NULL && strchr(dent->d_name, '\n') != NULL)
+        {
+            ledger_dir_free(ld);
+            ld = NULL;
+        }
+
+        if (dent->d_type == DT_DIR)
+        {
+            if (ld != NULL)
+                g_ptr_array_add(ld->subdirs, xstrdup(dent->d_name));
+            trim_walk_push(walk, relpath_join(relpath, dent->d_name));
+            continue;
+        }
+
+        if (dent->d_type != DT_REG && dent->d_type != DT_LNK && dent->d_type != DT_UNKNOWN)
+            continue;
+
+        struct stat fst;
+        if (fstatat(fd, dent->d_name, &fst, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
 
-        if (S_ISDIR(stats.st_mode))
+        if (S_ISDIR(fst.st_mode))
         {
-            double sz = get_dir_size(fullname, pp_worst_file_list, preserve_files_list);
-            size += sz;
+            if (ld != NULL)
+                g_ptr_array_add(ld->subdirs, xstrdup(dent->d_name));
+            trim_walk_push(walk, relpath_join(relpath, dent->d_name));
         }
-        else if (S_ISREG(stats.st_mode) || S_ISLNK(stats.st_mode))
+        else if (S_ISREG(fst.st_mode) || S_ISLNK(fst.st_mode))
         {
-            double sz = stats.st_size;
-            /* Account for filename and inode storage (approximately).
-             * This also makes even zero-length files to have nonzero cost.
-             */
-            sz += strlen(dent->d_name) + sizeof(stats);
-            size += sz;
-
-            if (pp_worst_file_list)
+            ++files;
+            trim_walk_file(walk, &victims, &size, relpath, dent->d_name, fst.st_size, fst.st_mtime);
+            if (ld != NULL)
             {
-                GList *cur = preserve_files_list;
-                while (cur)
-                {
-                    //log_warning("'%s' ? '%s'", fullname, *pp);
-                    if (strcmp(fullname, (char*)cur->data) == 0)
-                        goto next;
-                    cur = cur->next;
-                }
-
-                /* Calculate "weighted" size and age
-                 * w = sz_kbytes * age_mins */
-                sz /= 1024;
-                long age = (now - stats.st_mtime) / 60;
-                if (age > 1)
-                    sz *= age;
-
-                *pp_worst_file_list = insert_name_and_sizes(*pp_worst_file_list, fullname, sz, stats.st_size);
+                const struct ledger_file lf = {
+                    .size = fst.st_size,
+                    .mtime = fst.st_mtime,
+                    .name = xstrdup(dent->d_name)
+                };
+                g_array_append_val(ld->files, lf);
             }
         }
- next:
-        free(fullname);
     }
     closedir(dp);
 
-    return size;
+finito:
+    g_mutex_lock(&walk->lock);
+
+    walk->size += size;
+    walk->files += files;
+    ++walk->dirs;
+    if (cached)
+        ++walk->cached_dirs;
+
+    for (unsigned i = 0; i < victims.items->len; ++i)
+    {
+        struct victim *v = &g_array_index(victims.items, struct victim, i);
+        victim_heap_push(&walk->victims, v->name, v->weighted_size_and_age, v->size);
+    }
+    g_array_set_size(victims.items, 0);
+
+    /* Unchanged directories keep their old records, which are moved
+     * to the new ledger when the walk is over */
+    if (walk->new_ledger != NULL && (cached || ld != NULL))
+    {
+        g_hash_table_replace(walk->new_ledger, relpath, ld);
+        relpath = NULL;
+    }
+
+    if (--walk->pending == 0)
+        g_cond_signal(&walk->done);
+
+    g_mutex_unlock(&walk->lock);
+
+    victim_heap_destroy(&victims);
+    free(relpath);
+}
+
+static unsigned trim_walker_count(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 2)
+        cpus = 2;
+
+    return MIN(cpus * 2, MAX_TRIM_WALKERS);
+}
+
+/* Walks DIR and returns its size. The worst files are left in
+ * walk->victims. */
+static double trim_walk_run(struct trim_walk *walk)
+{
+    walk->now = time(NULL);
+    walk->size = 0;
+    walk->dirs = walk->cached_dirs = 0;
+    walk->files = 0;
+    victim_heap_init(&walk->victims);
+
+    GError *error = NULL;
+    walk->pool = g_thread_pool_new(trim_walk_dir, walk, trim_walker_count(), /*exclusive*/TRUE, &error);
+    if (walk->pool == NULL)
+    {
+        log_notice("Walking '%s' in one thread: %s", walk->dir, error->message);
+        g_error_free(error);
+    }
+
+    const gint64 start = g_get_monotonic_time();
+    trim_walk_push(walk, xstrdup(""));
+
+    g_mutex_lock(&walk->lock);
+    while (walk->pending != 0)
+        g_cond_wait(&walk->done, &walk->lock);
+    g_mutex_unlock(&walk->lock);
+
+    if (walk->pool != NULL)
+    {
+        g_thread_pool_free(walk->pool, /*immediate*/FALSE, /*wait*/TRUE);
+        walk->pool = NULL;
+    }
+
+    if (walk->new_ledger != NULL && walk->old_ledger != NULL)
+    {
+        GHashTableIter iter;
+        g_hash_table_iter_init(&iter, walk->old_ledger);
+        char *relpath;
+        struct ledger_dir *ld;
+        while (g_hash_table_iter_next(&iter, (gpointer *)&relpath, (gpointer *)&ld))
+        {
+            gpointer new_ld;
+            if (g_hash_table_lookup_extended(walk->new_ledger, relpath, NULL, &new_ld) && new_ld == NULL)
+            {
+                g_hash_table_iter_steal(&iter);
+                g_hash_table_replace(walk->new_ledger, relpath, ld);
+            }
+        }
+    }
+
+    log_info("Walked %u directories (%u unchanged) and %lu files of '%s' in %.2f s",
+            walk->dirs, walk->cached_dirs, walk->files, walk->dir,
+            (g_get_monotonic_time() - start) / (double)G_USEC_PER_SEC);
+
+    return walk->size;
 }
 
 static const char *parse_size_pfx(double *size, const char *str)
@@ -165,41 +622,110 @@ static void delete_dirs(gpointer data, gpointer exclude_path)
     trim_problem_dirs(dir, cap_size, exclude_path);
 }
 
+static int g_keep_ledger;
+
 static void delete_files(gpointer data, gpointer void_preserve_list)
 {
     double cap_size;
     const char *dir = parse_size_pfx(&cap_size, data);
     GList *preserve_files_list = void_preserve_list;
 
-    unsigned count = 100;
+    struct trim_walk walk = {
+        .dir = dir,
+        .dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC),
+    };
+    if (walk.dir_fd < 0)
+    {
+        perror_msg("Can't open '%s'", dir);
+        return;
+    }
+    g_mutex_init(&walk.lock);
+    g_cond_init(&walk.done);
+
+    /* The walk knows only the names relative to DIR */
+    const size_t dir_len = strlen(dir);
+    for (GList *cur = preserve_files_list; cur != NULL; cur = cur->next)
+    {
+        const char *name = cur->data;
+        if (strncmp(name, dir, dir_len) != 0)
+            continue;
+
+        name += dir_len;
+        while (*name == '/')
+            ++name;
+        if (name == (const char *)cur->data + dir_len && dir_len != 0 && dir[dir_len - 1] != '/')
+            continue;
+
+        if (walk.preserved == NULL)
+            walk.preserved = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+        g_hash_table_add(walk.preserved, xstrdup(name));
+    }
+
+    const time_t walk_start = time(NULL);
+    if (g_keep_ledger)
+        walk.old_ledger = ledger_load(walk.dir_fd);
+
+    unsigned count = MAX_TRIM_ROUNDS;
     while (--count != 0)
     {
-        GList *worst_file_list = NULL;
-        double cur_size = get_dir_size(dir, &worst_file_list, preserve_files_list);
+        if (g_keep_ledger)
+            walk.new_ledger = ledger_new();
+
+        double cur_size = trim_walk_run(&walk);
 
-        if (cur_size <= cap_size || !worst_file_list)
+        if (walk.new_ledger != NULL)
         {
-            list_free_with_free(worst_file_list);
+            if (walk.old_ledger != NULL)
+                g_hash_table_destroy(walk.old_ledger);
+            walk.old_ledger = walk.new_ledger;
+            walk.new_ledger = NULL;
+        }
+
+        GArray *victims = walk.victims.items;
+        if (cur_size <= cap_size || victims->len == 0)
+        {
+            victim_heap_destroy(&walk.victims);
             log_info("cur_size:%.0f cap_size:%.0f, no (more) trimming", cur_size, cap_size);
             break;
         }
 
-        /* Invert the list, so that largest/oldest file is first */
-        worst_file_list = g_list_reverse(worst_file_list);
-        /* And delete (some of) them */
-        while (worst_file_list && cur_size > cap_size)
+        /* Largest/oldest file first */
+        g_array_sort(victims, victim_cmp_worst_first);
+        for (unsigned i = 0; i < victims->len && cur_size > cap_size; ++i)
         {
-            struct name_and_size *ns = worst_file_list->data;
-            log_notice("%s is %.0f bytes (more than %.0f MB), deleting '%s' (%llu bytes)",
-                    dir, cur_size, cap_size / (1024*1024), ns->name, (long long)ns->size);
-            if (unlink(ns->name) != 0)
-                perror_msg("Can't unlink '%s'", ns->name);
+            const struct victim *v = &g_array_index(victims, struct victim, i);
+            if (!ledger_relpath_is_valid(v->name))
+            {
+                error_msg("Not deleting '%s/%s', it is not in '%s'", dir, v->name, dir);
+                continue;
+            }
+
+            log_notice("%s is %.0f bytes (more than %.0f MB), deleting '%s/%s' (%llu bytes)",
+                    dir, cur_size, cap_size / (1024*1024), dir, v->name, (long long)v->size);
+            if (unlinkat(walk.dir_fd, v->name, 0) != 0)
+                perror_msg("Can't unlink '%s/%s'", dir, v->name);
             else
-                cur_size -= ns->size;
-            free(ns);
-            worst_file_list = g_list_delete_link(worst_file_list, worst_file_list);
+                cur_size -= v->size;
         }
+        victim_heap_destroy(&walk.victims);
+
+        if (cur_size <= cap_size)
+            break;
     }
+
+    /* The directories with deleted files have a new mtime and will be
+     * read again next time */
+    if (walk.old_ledger != NULL)
+    {
+        ledger_save(walk.dir_fd, dir, walk.old_ledger, walk_start);
+        g_hash_table_destroy(walk.old_ledger);
+    }
+
+    if (walk.preserved != NULL)
+        g_hash_table_destroy(walk.preserved);
+    g_cond_clear(&walk.done);
+    g_mutex_clear(&walk.lock);
+    close(walk.dir_fd);
 }
 
 int main(int argc, char **argv)
@@ -219,7 +745,7 @@ int main(int argc, char **argv)
 
     /* Can't keep these strings/structs static: _() doesn't support that */
     const char *program_usage_string = _(
-        "& [-v] [-d SIZE:DIR]... [-f SIZE:DIR]... [-p DIR] [FILE]...\n"
+        "& [-v] [-d SIZE:DIR]... [-f SIZE:DIR]... [-L] [-p DIR] [FILE]...\n"
         "\n"
         "Deletes problem dirs (-d) or files (-f) in DIRs until they are smaller than SIZE.\n"
         "FILEs are preserved (never deleted)."
@@ -229,6 +755,7 @@ int main(int argc, char **argv)
         OPT_d = 1 << 1,
         OPT_f = 1 << 2,
         OPT_p = 1 << 3,
+        OPT_L = 1 << 4,
     };
     /* Keep enum above and order of options below in sync! */
     struct options program_options[] = {
@@ -236,6 +763,7 @@ int main(int argc, char **argv)
         OPT_LIST('d'  , NULL, &dir_list , "SIZE:DIR", _("Delete whole problem directories")),
         OPT_LIST('f'  , NULL, &file_list, "SIZE:DIR", _("Delete files inside this directory")),
         OPT_STRING('p', NULL, &preserve,  "DIR"     , _("Preserve this directory")),
+        OPT_BOOL(  'L', NULL, &g_keep_ledger,          _("Remember sizes of files in -f DIRs to speed up the next run")),
         OPT_END()
     };
     /*unsigned opts =*/ parse_opts(argc, argv, program_options, program_usage_string);
@@ -468,6 +468,7 @@ abrt_journal_watch_cores(abrt_journal_watch_t *watch, void *user_data)
     {
         /* We don't want to update the counter here. */
         error_msg(_("Not saving repeating crash after %ds (limit is %ds)"), sub, conf->awc_throttle);
+        metrics_counter_add("abrt_dump_journal_core_throttled_total", 1);
         goto watch_cleanup;
     }
 
@@ -489,9 +490,11 @@ abrt_journal_watch_cores(abrt_journal_watch_t *watch, void *user_data)
     }
 
     abrt_journal_update_occurrence(info.ci_executable_path, current);
+    metrics_counter_add("abrt_dump_journal_core_crashes_total", 1);
 
 watch_cleanup:
     abrt_journal_save_current_position(info.ci_journal, ABRT_JOURNAL_WATCH_STATE_FILE);
+    metrics_flush("abrt-dump-journal-core");
 
     if (info.ci_executable_path != NULL)
         free(info.ci_executable_path);
@@ -23,10 +23,33 @@
 
 #define ABRT_JOURNAL_KOOPS_ANALYZER "abrt-journal-koops"
 
+/* An oops being assembled is processed once no kernel message arrives for */
+#define ABRT_JOURNAL_OOPS_IDLE_MS 250
+/* or once it has been assembled for */
+#define ABRT_JOURNAL_OOPS_MAX_COLLECT_MS 5000
+/* or once it has this many lines */
+#define ABRT_JOURNAL_OOPS_MAX_LINES 4096
+
 /*
  * Koops extractor
  */
 
+/* Reads the current message without the kernel log level and jiffies */
+static void abrt_journal_get_koops_line(abrt_journal_t *journal, struct abrt_koops_line_info *line_info)
+{
+    char *line = abrt_journal_get_log_line(journal);
+    if (line == NULL)
+        error_msg_and_die(_("Cannot read journal data."));
+
+    char *orig_line = line;
+    line_info->level = koops_line_skip_level((const char **)&line);
+    koops_line_skip_jiffies((const char **)&line);
+
+    memmove(orig_line, line, strlen(line) + 1);
+
+    line_info->ptr = orig_line;
+}
+
 static GList* abrt_journal_extract_kernel_oops(abrt_journal_t *journal)
 {
     size_t lines_info_count = 0;
@@ -35,23 +58,13 @@ static GList* abrt_journal_extract_kernel_oops(abrt_journal_t *journal)
 
     do
     {
-        char *line = abrt_journal_get_log_line(journal);
-        if (line == NULL)
-            error_msg_and_die(_("Cannot read journal data."));
-
         if (lines_info_count == lines_info_size)
         {
             lines_info_size *= 2;
             lines_info = xrealloc(lines_info, lines_info_size * sizeof(lines_info[0]));
         }
 
-        char *orig_line = line;
-        lines_info[lines_info_count].level = koops_line_skip_level((const char **)&line);
-        koops_line_skip_jiffies((const char **)&line);
-
-        memmove(orig_line, line, strlen(line) + 1);
-
-        lines_info[lines_info_count].ptr = orig_line;
+        abrt_journal_get_koops_line(journal, &lines_info[lines_info_count]);
 
         ++lines_info_count;
     }
@@ -72,46 +85,124 @@ static GList* abrt_journal_extract_kernel_oops(abrt_journal_t *journal)
 }
 
 /*
- * An adatapter of abrt_journal_extract_kernel_oops for abrt_journal_watch_callback
+ * A streaming adapter of the koops extractor for abrt_journal_watch_callback
+ *
+ * Kernel messages are fed one by one. A suspicious message starts an oops,
+ * the following messages are appended to it until the kernel prints an end
+ * marker, no kernel message arrives for ABRT_JOURNAL_OOPS_IDLE_MS or one of
+ * the limits is hit. Then the collected lines are passed to the extractor.
+ * Nothing is read twice and the journal is never skipped.
  */
 struct watch_journald_settings
 {
     const char *dump_location;
     int oops_utils_flags;
+    GList *strings;
+    GList *blacklisted_strings;
+
+    struct abrt_koops_line_info *lines_info;
+    size_t lines_info_count;
+    size_t lines_info_size;
+    gint64 oops_start;
 };
 
-static void abrt_journal_watch_extract_kernel_oops(abrt_journal_watch_t *watch, void *data)
+static bool koops_line_is_suspicious(const struct watch_journald_settings *conf, const char *line)
 {
-    const struct watch_journald_settings *conf = (const struct watch_journald_settings *)data;
+    GList *cur = conf->strings;
+    for (; cur; cur = g_list_next(cur))
+        if (strstr(line, cur->data) != NULL)
+            break;
 
-    abrt_journal_t *journal = abrt_journal_watch_get_journal(watch);
+    if (cur == NULL)
+        return false;
 
-    /* Give systemd-journal one second to suck in all kernel's strings */
-    if (abrt_oops_signaled_sleep(1) > 0)
-    {
-        abrt_journal_watch_stop(watch);
+    for (cur = conf->blacklisted_strings; cur; cur = g_list_next(cur))
+        if (strstr(line, cur->data) != NULL)
+            return false;
+
+    return true;
+}
+
+/* The kernel prints these after the last line of an oops */
+static bool koops_line_ends_oops(const char *line)
+{
+    return strstr(line, "---[ end trace") != NULL
+        || strstr(line, "Kernel panic - not syncing:") != NULL;
+}
+
+static void abrt_journal_watch_process_kernel_oops(abrt_journal_watch_t *watch, void *data)
+{
+    struct watch_journald_settings *conf = (struct watch_journald_settings *)data;
+
+    if (conf->lines_info_count == 0)
         return;
-    }
 
-    GList *oopses = abrt_journal_extract_kernel_oops(journal);
+    abrt_journal_watch_set_idle_timeout(watch, -1);
+
+    const gint64 start = g_get_monotonic_time();
+    log_debug("Processing %zu lines collected in %lld ms", conf->lines_info_count,
+            (long long)(start - conf->oops_start) / 1000);
+
+    GList *oopses = NULL;
+    koops_extract_oopses_from_lines(&oopses, conf->lines_info, conf->lines_info_count);
+    log_debug("Extracted: %d oopses", g_list_length(oopses));
+
+    for (size_t i = 0; i < conf->lines_info_count; ++i)
+        free(conf->lines_info[i].ptr);
+    conf->lines_info_count = 0;
+
     abrt_oops_process_list(oopses, conf->dump_location,
                            ABRT_JOURNAL_KOOPS_ANALYZER, conf->oops_utils_flags);
 
-    g_list_free_full(oopses, (GDestroyNotify)free);
+    metrics_counter_add("abrt_dump_journal_oops_oopses_total", g_list_length(oopses));
+    metrics_observe_seconds("abrt_dump_journal_oops_processing_seconds",
+            (g_get_monotonic_time() - start) / (double)G_USEC_PER_SEC);
+    metrics_flush("abrt-dump-journal-oops");
 
-    /* Skip stuff which appeared while processing oops as it is not necessary */
-    /* to catch all consecutive oopses (anyway such oopses are almost */
-    /* certainly duplicates of the already extracted ones) */
-    abrt_journal_seek_tail(journal);
+    g_list_free_full(oopses, (GDestroyNotify)free);
 
     /* In case of disaster, lets make sure we won't read the journal messages */
     /* again. */
-    abrt_journal_save_current_position(journal, ABRT_JOURNAL_WATCH_STATE_FILE);
+    abrt_journal_save_current_position(abrt_journal_watch_get_journal(watch), ABRT_JOURNAL_WATCH_STATE_FILE);
 
     if (g_abrt_oops_sleep_woke_up_on_signal > 0)
         abrt_journal_watch_stop(watch);
 }
 
+static void abrt_journal_watch_collect_kernel_oops(abrt_journal_watch_t *watch, void *data)
+{
+    struct watch_journald_settings *conf = (struct watch_journald_settings *)data;
+
+    struct abrt_koops_line_info line_info;
+    abrt_journal_get_koops_line(abrt_journal_watch_get_journal(watch), &line_info);
+
+    if (conf->lines_info_count == 0)
+    {
+        if (!koops_line_is_suspicious(conf, line_info.ptr))
+        {
+            free(line_info.ptr);
+            return;
+        }
+
+        log_debug("Found oops start: '%s'", line_info.ptr);
+        conf->oops_start = g_get_monotonic_time();
+    }
+
+    if (conf->lines_info_count == conf->lines_info_size)
+    {
+        conf->lines_info_size = conf->lines_info_size ? conf->lines_info_size * 2 : 32;
+        conf->lines_info = xrealloc(conf->lines_info, conf->lines_info_size * sizeof(conf->lines_info[0]));
+    }
+    conf->lines_info[conf->lines_info_count++] = line_info;
+
+    if (koops_line_ends_oops(line_info.ptr)
+        || conf->lines_info_count >= ABRT_JOURNAL_OOPS_MAX_LINES
+        || g_get_monotonic_time() - conf->oops_start >= ABRT_JOURNAL_OOPS_MAX_COLLECT_MS * 1000)
+        abrt_journal_watch_process_kernel_oops(watch, conf);
+    else
+        abrt_journal_watch_set_idle_timeout(watch, ABRT_JOURNAL_OOPS_IDLE_MS);
+}
+
 /*
  * Koops extractor end
  */
@@ -154,22 +245,25 @@ static void watch_journald(abrt_journal_t *journal, const char *dump_location, i
     struct watch_journald_settings watch_conf = {
         .dump_location = dump_location,
         .oops_utils_flags = flags,
-    };
-
-    struct abrt_journal_watch_notify_strings notify_strings_conf = {
-        .decorated_cb = abrt_journal_watch_extract_kernel_oops,
-        .decorated_cb_data = &watch_conf,
         .strings = koops_strings,
         .blacklisted_strings = koops_strings_blacklist,
     };
 
     abrt_journal_watch_t *watch = NULL;
-    if (abrt_journal_watch_new(&watch, journal, abrt_journal_watch_notify_strings, &notify_strings_conf) < 0)
+    if (abrt_journal_watch_new(&watch, journal, abrt_journal_watch_collect_kernel_oops, &watch_conf) < 0)
         error_msg_and_die(_("Failed to initialize systemd-journal watch"));
 
+    abrt_journal_watch_set_idle_callback(watch, abrt_journal_watch_process_kernel_oops, &watch_conf);
+
     abrt_journal_watch_run_sync(watch);
+
+    /* Don't lose an oops interrupted by a signal */
+    abrt_journal_watch_process_kernel_oops(watch, &watch_conf);
+
     abrt_journal_watch_free(watch);
 
+    free(watch_conf.lines_info);
+    g_list_free(koops_strings_blacklist);
     g_list_free(koops_strings);
 }
 
@@ -88,8 +88,14 @@ static void abrt_journal_watch_extract_xorg_crashes(abrt_journal_watch_t *watch,
         return;
     }
 
+    const gint64 start = g_get_monotonic_time();
     GList *crashes = abrt_journal_extract_xorg_crashes(journal);
     abrt_xorg_process_list_of_crashes(crashes, conf->dump_location, conf->xorg_utils_flags);
+
+    metrics_counter_add("abrt_dump_journal_xorg_crashes_total", g_list_length(crashes));
+    metrics_observe_seconds("abrt_dump_journal_xorg_processing_seconds",
+            (g_get_monotonic_time() - start) / (double)G_USEC_PER_SEC);
+    metrics_flush("abrt-dump-journal-xorg");
     g_list_free_full(crashes, (GDestroyNotify)xorg_crash_info_free);
 
     /* In case of disaster, lets make sure we won't read the journal messages */
@@ -375,6 +375,10 @@ struct abrt_journal_watch
 
     abrt_journal_watch_callback callback;
     void *callback_data;
+
+    abrt_journal_watch_callback idle_callback;
+    void *idle_callback_data;
+    gint64 idle_deadline; /* 0 if disarmed */
 };
 
 int abrt_journal_watch_new(abrt_journal_watch_t **watch, abrt_journal_t *journal, abrt_journal_watch_callback callback, void *callback_data)
@@ -400,6 +404,17 @@ abrt_journal_t *abrt_journal_watch_get_journal(abrt_journal_watch_t *watch)
     return watch->j;
 }
 
+void abrt_journal_watch_set_idle_callback(abrt_journal_watch_t *watch, abrt_journal_watch_callback callback, void *callback_data)
+{
+    watch->idle_callback = callback;
+    watch->idle_callback_data = callback_data;
+}
+
+void abrt_journal_watch_set_idle_timeout(abrt_journal_watch_t *watch, int timeout_ms)
+{
+    watch->idle_deadline = timeout_ms < 0 ? 0 : g_get_monotonic_time() + (gint64)timeout_ms * 1000;
+}
+
 int abrt_journal_watch_run_sync(abrt_journal_watch_t *watch)
 {
     sigset_t mask;
@@ -434,7 +449,24 @@ int abrt_journal_watch_run_sync(abrt_journal_watch_t *watch)
         }
         else if (r == 0)
         {
-            ppoll(&pollfd, 1, NULL, &mask);
+            struct timespec idle_timeout;
+            struct timespec *timeout = NULL;
+            if (watch->idle_deadline != 0 && watch->idle_callback != NULL)
+            {
+                const gint64 remaining = watch->idle_deadline - g_get_monotonic_time();
+                if (remaining <= 0)
+                {
+                    watch->idle_deadline = 0;
+                    watch->idle_callback(watch, watch->idle_callback_data);
+                    continue;
+                }
+
+                idle_timeout.tv_sec = remaining / G_USEC_PER_SEC;
+                idle_timeout.tv_nsec = (remaining % G_USEC_PER_SEC) * 1000;
+                timeout = &idle_timeout;
+            }
+
+            ppoll(&pollfd, 1, timeout, &mask);
             r = sd_journal_process(watch->j->j);
             if (r < 0)
             {
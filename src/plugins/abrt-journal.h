@@ -106,6 +106,22 @@ void abrt_journal_watch_free(abrt_journal_watch_t *watch);
  */
 abrt_journal_t *abrt_journal_watch_get_journal(abrt_journal_watch_t *watch);
 
+/*
+ * The idle call back is called once no new message arrives before the
+ * deadline armed by abrt_journal_watch_set_idle_timeout(). The deadline is
+ * disarmed before the call back is called.
+ */
+void abrt_journal_watch_set_idle_callback(abrt_journal_watch_t *watch,
+                                          abrt_journal_watch_callback callback,
+                                          void *callback_data);
+
+/*
+ * Arms the idle deadline timeout_ms from now. A negative timeout_ms disarms
+ * the deadline.
+ */
+void abrt_journal_watch_set_idle_timeout(abrt_journal_watch_t *watch,
+                                         int timeout_ms);
+
 /*
  * Starts reading journal messages and waiting for new messages in a loop.
  *
@@ -0,0 +1,488 @@
+/*
+    Copyright (C) 2016  ABRT team
+    Copyright (C) 2016  RedHat Inc
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Recomputes the hashes and the backtrace derived elements of all problems
+ * in the dump location, e.g. after an update of the hashing algorithms.
+ *
+ * The problem directories are analyzed by a pool of threads. Every analyzed
+ * or skipped directory is appended to the state file, so an interrupted run
+ * continues where it stopped. The file is removed when all directories are
+ * done.
+ */
+
+#include "analyze-utils.h"
+#include "problem_api.h"
+
+#define REANALYZE_STATE_FILE VAR_STATE"/abrt-reanalyze.state"
+#define MAX_REANALYZE_WORKERS 16
+
+enum reanalyze_result {
+    REANALYZE_UNCHANGED,
+    REANALYZE_CHANGED,
+    REANALYZE_SKIPPED,
+    REANALYZE_FAILED,
+    REANALYZE_RESULTS,
+};
+
+static const char *const s_result_names[] = {
+    [REANALYZE_UNCHANGED] = "unchanged",
+    [REANALYZE_CHANGED] = "changed",
+    [REANALYZE_SKIPPED] = "skipped",
+    [REANALYZE_FAILED] = "failed",
+};
+
+/* The elements written by the analyzers */
+static const char *const s_analyzed_elements[] = {
+    FILENAME_UUID,
+    FILENAME_DUPHASH,
+    FILENAME_CRASH_FUNCTION,
+    FILENAME_RATING,
+    FILENAME_EXCEPTION_TYPE,
+    FILENAME_NOT_REPORTABLE,
+    NULL
+};
+
+struct reanalyze
+{
+    const char *dump_location;
+    char *blacklisted_xorg_modules;
+    map_string_t *oops_settings;
+
+    /* Directories analyzed by the previous run, read only */
+    GHashTable *done;
+    FILE *state;
+
+    GMutex lock;
+    GCond finished;
+    unsigned pending;
+    unsigned results[REANALYZE_RESULTS];
+};
+
+static volatile sig_atomic_t s_interrupted;
+
+static void handle_signal(int signo)
+{
+    s_interrupted = 1;
+}
+
+/* Returns the values of s_analyzed_elements, NULL for missing elements */
+static char **load_analyzed_elements(struct dump_dir *dd)
+{
+    char **values = xzalloc(sizeof(s_analyzed_elements));
+    for (size_t i = 0; s_analyzed_elements[i] != NULL; ++i)
+        values[i] = dd_load_text_ext(dd, s_analyzed_elements[i],
+                DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE | DD_FAIL_QUIETLY_ENOENT);
+
+    return values;
+}
+
+static void free_analyzed_elements(char **values)
+{
+    for (size_t i = 0; s_analyzed_elements[i] != NULL; ++i)
+        free(values[i]);
+    free(values);
+}
+
+/* Returns true if RESULTS change any of OLD_VALUES, the elements missing in
+ * RESULTS are kept */
+static bool analyzed_elements_differ(char **old_values, problem_data_t *results)
+{
+    for (size_t i = 0; s_analyzed_elements[i] != NULL; ++i)
+    {
+        const char *value = problem_data_get_content_or_NULL(results, s_analyzed_elements[i]);
+        if (value != NULL && g_strcmp0(old_values[i], value) != 0)
+            return true;
+    }
+
+    return false;
+}
+
+/* The results are written to temporary elements first and renamed only when
+ * all of them are written. Readers which don't lock the directory never see
+ * a half-written element. */
+static int save_analyzed_elements(struct dump_dir *dd, problem_data_t *results)
+{
+    int r = 0;
+    for (size_t i = 0; s_analyzed_elements[i] != NULL; ++i)
+    {
+        const char *value = problem_data_get_content_or_NULL(results, s_analyzed_elements[i]);
+        if (value == NULL)
+            continue;
+
+        char *tmp = xasprintf(".%s.new", s_analyzed_elements[i]);
+        /* Left over by an interrupted run */
+        dd_delete_item(dd, tmp);
+        dd_save_text(dd, tmp, value);
+        if (!dd_exist(dd, tmp))
+            r = -1;
+        free(tmp);
+    }
+
+    for (size_t i = 0; s_analyzed_elements[i] != NULL; ++i)
+    {
+        if (problem_data_get_content_or_NULL(results, s_analyzed_elements[i]) == NULL)
+            continue;
+
+        char *tmp = xasprintf(".%s.new", s_analyzed_elements[i]);
+        if (r != 0)
+            dd_delete_item(dd, tmp);
+        else if (renameat(dd->dd_fd, tmp, dd->dd_fd, s_analyzed_elements[i]) != 0)
+        {
+            perror_msg("Can't rename '%s/%s'", dd->dd_dirname, tmp);
+            dd_delete_item(dd, tmp);
+            r = -1;
+        }
+        free(tmp);
+    }
+
+    return r;
+}
+
+/* Runs the analyzers of the post-create event of the problem type */
+static int run_analyzers(struct reanalyze *ra, struct dump_dir *dd, const char *type,
+        problem_data_t *results)
+{
+    if (strcmp(type, "CCpp") == 0)
+    {
+        int r = abrt_analyze_ccpp(dd, results);
+        if (r == 0 && dd_exist(dd, FILENAME_BACKTRACE))
+            r = abrt_analyze_backtrace(dd, results);
+
+        return r;
+    }
+
+    if (strcmp(type, "Python") == 0 || strcmp(type, "Python3") == 0)
+        return abrt_analyze_python(dd, results);
+
+    if (strcmp(type, "Kerneloops") == 0 || strcmp(type, "vmcore") == 0)
+    {
+        /* Hashes of hardware errors come from abrt-action-check-oops-for-hw-error */
+        if (dd_exist(dd, "mce"))
+            return -1;
+
+        return abrt_analyze_oops(dd, ra->oops_settings, results);
+    }
+
+    if (strcmp(type, "xorg") == 0)
+        return abrt_analyze_xorg(dd, ra->blacklisted_xorg_modules, results);
+
+    return -1;
+}
+
+static enum reanalyze_result reanalyze_dir(struct reanalyze *ra, const char *name)
+{
+    char *path = concat_path_file(ra->dump_location, name);
+    struct dump_dir *dd = dd_opendir(path, DD_DONT_WAIT_FOR_LOCK | DD_FAIL_QUIETLY_ENOENT | DD_FAIL_QUIETLY_EACCES);
+    free(path);
+
+    /* Locked directories are being processed by somebody else */
+    if (dd == NULL)
+        return REANALYZE_SKIPPED;
+
+    char *type = dd_load_text_ext(dd, FILENAME_TYPE, DD_FAIL_QUIETLY_ENOENT | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+    if (type == NULL || !problem_dump_dir_is_complete(dd))
+    {
+        free(type);
+        dd_close(dd);
+        return REANALYZE_SKIPPED;
+    }
+
+    /* The analyzers save their results in memory, they are written only if
+     * all of them succeed, so other processes see either the old or the new
+     * values */
+    char **old_values = load_analyzed_elements(dd);
+    problem_data_t *results = problem_data_new();
+    const int r = run_analyzers(ra, dd, type, results);
+    free(type);
+
+    enum reanalyze_result result;
+    if (r < 0)
+        result = REANALYZE_SKIPPED;
+    else if (r > 0)
+        result = REANALYZE_FAILED;
+    else if (!analyzed_elements_differ(old_values, results))
+        result = REANALYZE_UNCHANGED;
+    else if (save_analyzed_elements(dd, results) != 0)
+        result = REANALYZE_FAILED;
+    else
+        result = REANALYZE_CHANGED;
+
+    if (result == REANALYZE_CHANGED)
+    {
+        log_info("Reanalyzed '%s'", name);
+        problem_summary_save(dd);
+    }
+
+    problem_data_free(results);
+    free_analyzed_elements(old_values);
+    dd_close(dd);
+
+    return result;
+}
+
+static void reanalyze_worker(gpointer data, gpointer user_data)
+{
+    char *name = data;
+    struct reanalyze *ra = user_data;
+
+    /* Not recorded in the state file, the next run analyzes the rest */
+    const bool interrupted = s_interrupted;
+    const enum reanalyze_result result = interrupted ? REANALYZE_SKIPPED : reanalyze_dir(ra, name);
+
+    g_mutex_lock(&ra->lock);
+    if (!interrupted)
+    {
+        ++ra->results[result];
+        /* Failed directories are tried again by the next run */
+        if (ra->state != NULL && result != REANALYZE_FAILED)
+        {
+            fprintf(ra->state, "%s\n", name);
+            fflush(ra->state);
+        }
+    }
+    if (--ra->pending == 0)
+        g_cond_signal(&ra->finished);
+    g_mutex_unlock(&ra->lock);
+
+    free(name);
+}
+
+/* The state file starts with the dump location, the other lines are
+ * the analyzed and skipped directories. An incomplete last line is ignored. */
+static GHashTable *load_state(FILE *fp, const char *dump_location)
+{
+    GHashTable *done = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    bool header = true;
+    while ((len = getline(&line, &size, fp)) > 0)
+    {
+        if (line[len - 1] != '\n')
+            break;
+        line[len - 1] = '\0';
+
+        if (header)
+        {
+            header = false;
+            if (strcmp(line, dump_location) != 0)
+            {
+                log_notice("State file is for '%s', starting over", line);
+                break;
+            }
+            continue;
+        }
+
+        g_hash_table_add(done, xstrdup(line));
+    }
+    free(line);
+
+    if (header || g_hash_table_size(done) == 0)
+    {
+        g_hash_table_destroy(done);
+        return NULL;
+    }
+
+    return done;
+}
+
+static unsigned reanalyze_worker_count(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        cpus = 1;
+
+    return MIN(cpus, MAX_REANALYZE_WORKERS);
+}
+
+int main(int argc, char **argv)
+{
+    /* I18n */
+    setlocale(LC_ALL, "");
+#if ENABLE_NLS
+    bindtextdomain(PACKAGE, LOCALEDIR);
+    textdomain(PACKAGE);
+#endif
+
+    abrt_init(argv);
+
+    const char *dump_location = NULL;
+    const char *state_file = REANALYZE_STATE_FILE;
+    int workers = 0;
+
+    /* Can't keep these strings/structs static: _() doesn't support that */
+    const char *program_usage_string = _(
+        "& [-vR] [-d DIR] [-j NUM] [-s FILE]\n"
+        "\n"
+        "Recomputes UUID, DUPHASH and crash function of all problems in DIR\n"
+        "(DumpLocation by default) in parallel threads. The analyzed directories\n"
+        "are recorded in FILE and skipped by the next run until all of them\n"
+        "are done."
+    );
+    enum {
+        OPT_v = 1 << 0,
+        OPT_d = 1 << 1,
+        OPT_j = 1 << 2,
+        OPT_s = 1 << 3,
+        OPT_R = 1 << 4,
+    };
+    /* Keep enum above and order of options below in sync! */
+    struct options program_options[] = {
+        OPT__VERBOSE(&g_verbose),
+        OPT_STRING( 'd', NULL, &dump_location, "DIR", _("Dump location")),
+        OPT_INTEGER('j', NULL, &workers, _("Number of threads (default: number of CPUs)")),
+        OPT_STRING( 's', NULL, &state_file, "FILE", _("State file (default: "REANALYZE_STATE_FILE")")),
+        OPT_BOOL(   'R', NULL, NULL, _("Ignore the state of the previous run")),
+        OPT_END()
+    };
+    const unsigned opts = parse_opts(argc, argv, program_options, program_usage_string);
+
+    export_abrt_envvars(0);
+
+    if (!dump_location)
+    {
+        load_abrt_conf();
+        dump_location = g_settings_dump_location;
+        g_settings_dump_location = NULL;
+        free_abrt_conf_data();
+    }
+
+    if (workers <= 0)
+        workers = reanalyze_worker_count();
+
+    struct reanalyze ra = {
+        .dump_location = dump_location,
+    };
+    g_mutex_init(&ra.lock);
+    g_cond_init(&ra.finished);
+
+    GPtrArray *entries = dump_location_list(dump_location, /*flags*/0);
+    if (entries == NULL)
+    {
+        perror_msg("Can't list '%s'", dump_location);
+        return 1;
+    }
+
+    if (!(opts & OPT_R))
+    {
+        FILE *fp = fopen(state_file, "r");
+        if (fp != NULL)
+        {
+            ra.done = load_state(fp, dump_location);
+            fclose(fp);
+        }
+    }
+
+    ra.state = fopen(state_file, ra.done != NULL ? "a" : "w");
+    if (ra.state == NULL)
+        perror_msg("Can't open '%s', the run can't be resumed", state_file);
+    else if (ra.done == NULL)
+    {
+        fprintf(ra.state, "%s\n", dump_location);
+        fflush(ra.state);
+    }
+
+    ra.blacklisted_xorg_modules = abrt_analyze_xorg_blacklisted_modules();
+    ra.oops_settings = new_map_string();
+    load_abrt_plugin_conf_file("oops.conf", ra.oops_settings);
+
+    signal(SIGTERM, handle_signal);
+    signal(SIGINT, handle_signal);
+
+    GError *error = NULL;
+    GThreadPool *pool = g_thread_pool_new(reanalyze_worker, &ra, workers, /*exclusive*/TRUE, &error);
+    if (pool == NULL)
+    {
+        log_notice("Analyzing in one thread: %s", error->message);
+        g_error_free(error);
+    }
+
+    const gint64 start = g_get_monotonic_time();
+    unsigned resumed = 0;
+    for (unsigned i = 0; i < entries->len && !s_interrupted; ++i)
+    {
+        const struct dump_location_entry *entry = g_ptr_array_index(entries, i);
+        if (ra.done != NULL && g_hash_table_contains(ra.done, entry->dle_name))
+        {
+            ++resumed;
+            continue;
+        }
+
+        g_mutex_lock(&ra.lock);
+        ++ra.pending;
+        g_mutex_unlock(&ra.lock);
+
+        char *name = xstrdup(entry->dle_name);
+        if (pool == NULL || !g_thread_pool_push(pool, name, NULL))
+            reanalyze_worker(name, &ra);
+    }
+
+    g_mutex_lock(&ra.lock);
+    while (ra.pending != 0)
+        g_cond_wait(&ra.finished, &ra.lock);
+    g_mutex_unlock(&ra.lock);
+
+    if (pool != NULL)
+        g_thread_pool_free(pool, /*immediate*/FALSE, /*wait*/TRUE);
+
+    const double elapsed = (g_get_monotonic_time() - start) / (double)G_USEC_PER_SEC;
+
+    unsigned analyzed = 0;
+    for (int i = 0; i < REANALYZE_RESULTS; ++i)
+    {
+        if (i != REANALYZE_SKIPPED)
+            analyzed += ra.results[i];
+
+        char *metric = xasprintf("abrt_reanalyze_problems_total{result=\"%s\"}", s_result_names[i]);
+        metrics_counter_add(metric, ra.results[i]);
+        free(metric);
+    }
+    metrics_observe_seconds("abrt_reanalyze_duration_seconds", elapsed);
+    metrics_flush("abrt-reanalyze");
+
+    printf(_("Analyzed %u problems in %.1f s (%.1f problems/s): "
+             "%u changed, %u unchanged, %u failed, %u skipped\n"),
+            analyzed, elapsed, elapsed > 0 ? analyzed / elapsed : 0.0,
+            ra.results[REANALYZE_CHANGED], ra.results[REANALYZE_UNCHANGED],
+            ra.results[REANALYZE_FAILED], ra.results[REANALYZE_SKIPPED]);
+    if (resumed != 0)
+        printf(_("%u problems were analyzed by the previous run\n"), resumed);
+
+    if (ra.state != NULL)
+    {
+        fclose(ra.state);
+        if (!s_interrupted && unlink(state_file) != 0)
+            perror_msg("Can't remove '%s'", state_file);
+    }
+
+    if (s_interrupted)
+        log_warning(_("Interrupted, run '%s' again to analyze the rest"), g_progname);
+
+    if (ra.done != NULL)
+        g_hash_table_destroy(ra.done);
+    free_map_string(ra.oops_settings);
+    free(ra.blacklisted_xorg_modules);
+    g_ptr_array_free(entries, TRUE);
+    g_mutex_clear(&ra.lock);
+    g_cond_clear(&ra.finished);
+
+    return s_interrupted || ra.results[REANALYZE_FAILED] != 0;
+}
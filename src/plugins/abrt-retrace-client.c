@@ -506,6 +506,10 @@ static int create(bool delete_temp_archive,
     }
     else if (dump_dir_name != NULL)
     {
+        /* The coredump or vmcore of an old problem can be compressed */
+        if (problem_dir_inflate(dump_dir_name) != 0)
+            error_msg_and_die(_("Can't restore compressed files in '%s'"), dump_dir_name);
+
         struct dump_dir *dd = dd_opendir(dump_dir_name, /*flags*/ 0);
         if (!dd)
             xfunc_die(); /* dd_opendir already emitted error message */
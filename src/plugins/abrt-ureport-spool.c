@@ -0,0 +1,611 @@
+/*
+    Copyright (C) 2016  ABRT team
+    Copyright (C) 2016  RedHat Inc
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * uReport spool
+ *
+ * 'abrt-ureport-spool -e' is run by abrt-action-ureport in a problem
+ * directory instead of reporter-ureport if spooling is enabled. It only
+ * saves the uReport to the spool directory. The uReports of problems with
+ * the same duphash are coalesced into one entry:
+ *
+ *   SPOOL/DUPHASH/ureport.json - the uReport of the first occurrence
+ *   SPOOL/DUPHASH/problems     - a line with the problem directory per occurrence
+ *
+ * 'abrt-ureport-spool -f' submits a batch of entries, one uReport per entry,
+ * and saves the response of the server in all problem directories of the
+ * entry. The entries being submitted are renamed to .sending.DUPHASH, so new
+ * occurrences go to a new entry in the meantime.
+ *
+ * If the server can't be reached, the rest of the batch stays in the spool
+ * and the next submission is postponed; the delay doubles with every failed
+ * attempt up to SPOOL_BACKOFF_MAX.
+ */
+#include <sys/file.h>
+#include <libreport/ureport.h>
+#include <libreport/libreport_curl.h>
+#include "libabrt.h"
+
+#define SPOOL_DIR VAR_STATE"/ureport-spool"
+#define SPOOL_LOCK ".lock"
+#define SPOOL_FLUSH_LOCK ".flush"
+#define SPOOL_BACKOFF ".backoff"
+#define SPOOL_SENDING_PREFIX ".sending."
+#define SPOOL_UREPORT "ureport.json"
+#define SPOOL_PROBLEMS "problems"
+
+#define SPOOL_BACKOFF_MIN (5 * 60)
+#define SPOOL_BACKOFF_MAX (6 * 60 * 60)
+#define SPOOL_DEFAULT_BATCH 50
+
+enum submit_result
+{
+    SUBMIT_SENT,
+    SUBMIT_REJECTED,
+    SUBMIT_UNREACHABLE,
+};
+
+struct spool
+{
+    const char *path;
+    int dir_fd;
+};
+
+static void spool_open(struct spool *spool, const char *path)
+{
+    if (g_mkdir_with_parents(path, 0700) != 0)
+        perror_msg_and_die("Can't create '%s'", path);
+
+    spool->path = path;
+    spool->dir_fd = open(path, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+    if (spool->dir_fd < 0)
+        perror_msg_and_die("Can't open '%s'", path);
+}
+
+/* Returns the descriptor holding the lock or -1 if NONBLOCK and the lock is held */
+static int spool_lock(struct spool *spool, const char *name, int flags)
+{
+    int fd = openat(spool->dir_fd, name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        perror_msg_and_die("Can't open '%s/%s'", spool->path, name);
+
+    while (flock(fd, LOCK_EX | flags) != 0)
+    {
+        if (errno == EINTR)
+            continue;
+        if (errno == EWOULDBLOCK)
+        {
+            close(fd);
+            return -1;
+        }
+        perror_msg_and_die("Can't lock '%s/%s'", spool->path, name);
+    }
+
+    return fd;
+}
+
+static void spool_unlock(int lock_fd)
+{
+    /* Closing the descriptor releases the lock */
+    close(lock_fd);
+}
+
+static char *load_entry_file(struct spool *spool, const char *entry, const char *name)
+{
+    char *path = xasprintf("%s/%s/%s", spool->path, entry, name);
+    char *content = malloc_open_read_close(path, /*maxsize:*/ NULL);
+    if (!content)
+        perror_msg("Can't read '%s'", path);
+    free(path);
+    return content;
+}
+
+static int append_problems(struct spool *spool, const char *entry, const char *problems)
+{
+    char *path = xasprintf("%s/%s/"SPOOL_PROBLEMS, spool->path, entry);
+    int r = -1;
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0)
+        perror_msg("Can't open '%s'", path);
+    else
+    {
+        if (full_write_str(fd, problems) >= 0 && fsync(fd) == 0)
+            r = 0;
+        else
+            perror_msg("Can't write '%s'", path);
+        close(fd);
+    }
+
+    free(path);
+    return r;
+}
+
+/* Writes a file atomically */
+static int save_file(const char *path, const char *content)
+{
+    char *tmp_path = xasprintf("%s.tmp", path);
+    int r = 0;
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0
+     || full_write_str(fd, content) < 0
+     || fsync(fd) != 0
+     || close(fd) != 0
+     || rename(tmp_path, path) != 0)
+    {
+        perror_msg("Can't save '%s'", path);
+        unlink(tmp_path);
+        r = -1;
+    }
+
+    free(tmp_path);
+    return r;
+}
+
+static void remove_entry(struct spool *spool, const char *entry)
+{
+    const int entry_fd = openat(spool->dir_fd, entry, O_DIRECTORY | O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *dir = entry_fd >= 0 ? fdopendir(entry_fd) : NULL;
+    if (!dir)
+    {
+        if (entry_fd >= 0)
+            close(entry_fd);
+        perror_msg("Can't open '%s/%s'", spool->path, entry);
+        return;
+    }
+
+    struct dirent *dent;
+    while ((dent = readdir(dir)) != NULL)
+        if (!dot_or_dotdot(dent->d_name) && unlinkat(entry_fd, dent->d_name, 0) != 0)
+            perror_msg("Can't remove '%s/%s/%s'", spool->path, entry, dent->d_name);
+    closedir(dir);
+
+    if (unlinkat(spool->dir_fd, entry, AT_REMOVEDIR) != 0)
+        perror_msg("Can't remove '%s/%s'", spool->path, entry);
+}
+
+/* The uReports are coalesced by duphash, UUID is the fall back */
+static char *problem_spool_key(struct dump_dir *dd)
+{
+    static const char *const elements[] = { FILENAME_DUPHASH, FILENAME_UUID, NULL };
+
+    for (const char *const *e = elements; *e != NULL; ++e)
+    {
+        char *key = dd_load_text_ext(dd, *e, DD_FAIL_QUIETLY_ENOENT | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+        if (key && key[0] != '\0' && key[0] != '.' && str_is_correct_filename(key))
+            return key;
+        free(key);
+    }
+
+    return NULL;
+}
+
+static int spool_enqueue(struct spool *spool, struct ureport_server_config *config, const char *dump_dir_name)
+{
+    struct dump_dir *dd = dd_opendir(dump_dir_name, DD_OPEN_READONLY);
+    if (!dd)
+        return 1;
+
+    char *key = problem_spool_key(dd);
+    dd_close(dd);
+    if (!key)
+    {
+        error_msg("Problem '%s' has neither %s nor %s, can't spool its uReport",
+                  dump_dir_name, FILENAME_DUPHASH, FILENAME_UUID);
+        return 1;
+    }
+
+    int r = 1;
+    char *json = ureport_from_dump_dir_ext(dump_dir_name, &config->ur_prefs);
+    if (!json)
+        goto free_key;
+
+    char *problem_line = xasprintf("%s\n", dump_dir_name);
+    const int lock_fd = spool_lock(spool, SPOOL_LOCK, 0);
+
+    if (mkdirat(spool->dir_fd, key, 0700) == 0)
+    {
+        /* The first occurrence, the uReport is written before the entry is
+         * complete, so a crash leaves an entry without occurrences only */
+        char *path = xasprintf("%s/%s/"SPOOL_UREPORT, spool->path, key);
+        const int saved = save_file(path, json);
+        free(path);
+        if (saved != 0)
+        {
+            remove_entry(spool, key);
+            goto unlock;
+        }
+    }
+    else if (errno != EEXIST)
+    {
+        perror_msg("Can't create '%s/%s'", spool->path, key);
+        goto unlock;
+    }
+    else
+        log_info("Coalescing uReport of '%s' with the spooled uReport '%s'", dump_dir_name, key);
+
+    if (append_problems(spool, key, problem_line) == 0)
+    {
+        log_warning(_("uReport has been queued for submission"));
+        r = 0;
+    }
+
+unlock:
+    spool_unlock(lock_fd);
+    free(problem_line);
+    free(json);
+free_key:
+    free(key);
+    return r;
+}
+
+/* Moves an entry taken for submission back to the spool. If a new occurrence
+ * has been spooled meanwhile, the occurrences are merged into the new entry.
+ * Must be called with SPOOL_LOCK held. */
+static void spool_return_entry(struct spool *spool, const char *sending)
+{
+    const char *key = sending + strlen(SPOOL_SENDING_PREFIX);
+    if (renameat(spool->dir_fd, sending, spool->dir_fd, key) == 0)
+        return;
+
+    if (errno != EEXIST && errno != ENOTEMPTY)
+    {
+        perror_msg("Can't rename '%s/%s'", spool->path, sending);
+        return;
+    }
+
+    char *problems = load_entry_file(spool, sending, SPOOL_PROBLEMS);
+    if (problems && append_problems(spool, key, problems) == 0)
+        remove_entry(spool, sending);
+    free(problems);
+}
+
+/* Returns the sorted names of the entries starting with PREFIX or of all
+ * entries if PREFIX is NULL */
+static GList *spool_list_entries(struct spool *spool, const char *prefix)
+{
+    DIR *dir = opendir(spool->path);
+    if (!dir)
+        perror_msg_and_die("Can't open '%s'", spool->path);
+
+    GList *names = NULL;
+    struct dirent *dent;
+    while ((dent = readdir(dir)) != NULL)
+    {
+        if (prefix ? prefixcmp(dent->d_name, prefix) == 0 : dent->d_name[0] != '.')
+            names = g_list_prepend(names, xstrdup(dent->d_name));
+    }
+    closedir(dir);
+
+    return g_list_sort(names, (GCompareFunc)strcmp);
+}
+
+/* Takes up to BATCH entries for submission, entries left over from an
+ * interrupted run are returned to the spool first */
+static GList *spool_take_batch(struct spool *spool, int batch)
+{
+    const int lock_fd = spool_lock(spool, SPOOL_LOCK, 0);
+
+    GList *left_over = spool_list_entries(spool, SPOOL_SENDING_PREFIX);
+    for (GList *li = left_over; li != NULL; li = g_list_next(li))
+        spool_return_entry(spool, li->data);
+    list_free_with_free(left_over);
+
+    GList *names = spool_list_entries(spool, /*prefix:*/ NULL);
+    GList *taken = NULL;
+    for (GList *li = names; li != NULL && batch > 0; li = g_list_next(li))
+    {
+        const char *key = li->data;
+        char *sending = xasprintf(SPOOL_SENDING_PREFIX"%s", key);
+        if (renameat(spool->dir_fd, key, spool->dir_fd, sending) != 0)
+        {
+            perror_msg("Can't rename '%s/%s'", spool->path, key);
+            free(sending);
+            continue;
+        }
+
+        taken = g_list_prepend(taken, sending);
+        --batch;
+    }
+    list_free_with_free(names);
+
+    spool_unlock(lock_fd);
+    return g_list_reverse(taken);
+}
+
+static void problem_increment_ureports_counter(const char *dump_dir_name)
+{
+    struct dump_dir *dd = dd_opendir(dump_dir_name, DD_FAIL_QUIETLY_ENOENT);
+    if (!dd)
+        return;
+
+    char *counter = dd_load_text_ext(dd, "ureports_counter", DD_FAIL_QUIETLY_ENOENT);
+    unsigned long count = strtoul(counter, NULL, 10);
+    free(counter);
+
+    char count_str[sizeof(unsigned long) * 3 + 1];
+    sprintf(count_str, "%lu", count + 1);
+    dd_save_text(dd, "ureports_counter", count_str);
+    dd_close(dd);
+}
+
+static enum submit_result submit_entry(struct spool *spool, struct ureport_server_config *config,
+        const char *email, const char *entry)
+{
+    char *json = load_entry_file(spool, entry, SPOOL_UREPORT);
+    char *problems = load_entry_file(spool, entry, SPOOL_PROBLEMS);
+    if (!json || !problems)
+    {
+        /* An entry interrupted in spool_enqueue() */
+        free(json);
+        free(problems);
+        return SUBMIT_REJECTED;
+    }
+
+    const char *key = entry + strlen(SPOOL_SENDING_PREFIX);
+    enum submit_result result = SUBMIT_REJECTED;
+    post_state_t *post_state = ureport_do_post(json, config, UREPORT_SUBMIT_ACTION);
+    if (post_state->curl_result != CURLE_OK || post_state->http_resp_code >= 500)
+    {
+        log_notice("Can't submit uReport '%s': %s", key,
+                   post_state->curl_result != CURLE_OK ? post_state->curl_error_msg : "server error");
+        free_post_state(post_state);
+        result = SUBMIT_UNREACHABLE;
+        goto free_entry;
+    }
+
+    struct ureport_server_response *resp = ureport_server_response_from_reply(post_state, config);
+    free_post_state(post_state);
+    if (!resp)
+        goto free_entry;
+
+    if (resp->urr_is_error)
+    {
+        error_msg(_("Server responded with an error: '%s'"), resp->urr_value);
+        goto free_resp;
+    }
+
+    unsigned occurrences = 0;
+    for (char *line = problems, *end; *line != '\0'; line = end)
+    {
+        end = strchrnul(line, '\n');
+        if (*end == '\n')
+            *end++ = '\0';
+        if (*line == '\0')
+            continue;
+
+        ureport_server_response_save_in_dump_dir(resp, line, config);
+        problem_increment_ureports_counter(line);
+        ++occurrences;
+    }
+
+    log_warning(_("uReport '%s' of %u occurrence(s) has been submitted"), key, occurrences);
+
+    if (email && resp->urr_bthash)
+        ureport_attach_string(resp->urr_bthash, "email", email, config);
+
+    result = SUBMIT_SENT;
+
+free_resp:
+    ureport_server_response_free(resp);
+free_entry:
+    free(problems);
+    free(json);
+    return result;
+}
+
+/* The backoff file contains the number of failed attempts and the time of
+ * the next attempt. Must be called with SPOOL_FLUSH_LOCK held. */
+static void spool_load_backoff(struct spool *spool, unsigned *failures, time_t *next_attempt)
+{
+    *failures = 0;
+    *next_attempt = 0;
+
+    char *path = concat_path_file(spool->path, SPOOL_BACKOFF);
+    char *content = malloc_open_read_close(path, /*maxsize:*/ NULL);
+    free(path);
+    if (!content)
+        return;
+
+    long long next;
+    if (sscanf(content, "%u %lld", failures, &next) == 2)
+        *next_attempt = next;
+    else
+        *failures = 0;
+    free(content);
+}
+
+static void spool_save_backoff(struct spool *spool, unsigned failures)
+{
+    if (failures == 0)
+    {
+        unlinkat(spool->dir_fd, SPOOL_BACKOFF, 0);
+        return;
+    }
+
+    long delay = SPOOL_BACKOFF_MIN;
+    for (unsigned i = 1; i < failures && delay < SPOOL_BACKOFF_MAX; ++i)
+        delay *= 2;
+    delay = MIN(delay, SPOOL_BACKOFF_MAX);
+
+    log_notice("Postponing the next submission by %ld seconds", delay);
+    char *content = xasprintf("%u %lld\n", failures, (long long)(time(NULL) + delay));
+    char *path = concat_path_file(spool->path, SPOOL_BACKOFF);
+    save_file(path, content);
+    free(path);
+    free(content);
+}
+
+static int spool_flush(struct spool *spool, struct ureport_server_config *config,
+        const char *email, int batch, bool force)
+{
+    const int flush_lock_fd = spool_lock(spool, SPOOL_FLUSH_LOCK, LOCK_NB);
+    if (flush_lock_fd < 0)
+    {
+        log_notice("The spool is being flushed by another process");
+        return 0;
+    }
+
+    unsigned failures;
+    time_t next_attempt;
+    spool_load_backoff(spool, &failures, &next_attempt);
+    if (!force && next_attempt > time(NULL))
+    {
+        log_notice("Submission is postponed until %lld", (long long)next_attempt);
+        spool_unlock(flush_lock_fd);
+        return 0;
+    }
+
+    GList *taken = spool_take_batch(spool, batch);
+    log_info("Submitting %u spooled uReport(s)", g_list_length(taken));
+
+    unsigned sent = 0;
+    unsigned rejected = 0;
+    bool unreachable = false;
+    for (GList *li = taken; li != NULL && !unreachable; li = g_list_next(li))
+    {
+        switch (submit_entry(spool, config, email, li->data))
+        {
+            case SUBMIT_SENT:
+                ++sent;
+                break;
+            case SUBMIT_REJECTED:
+                /* Submitting it again doesn't help */
+                ++rejected;
+                break;
+            case SUBMIT_UNREACHABLE:
+                unreachable = true;
+                continue;
+        }
+
+        remove_entry(spool, li->data);
+        li->data = (free(li->data), NULL);
+    }
+
+    if (unreachable)
+    {
+        const int lock_fd = spool_lock(spool, SPOOL_LOCK, 0);
+        for (GList *li = taken; li != NULL; li = g_list_next(li))
+            if (li->data)
+                spool_return_entry(spool, li->data);
+        spool_unlock(lock_fd);
+
+        error_msg(_("Can't reach the uReport server, the uReports are kept in '%s'"), spool->path);
+        ++failures;
+    }
+    else
+        failures = 0;
+
+    spool_save_backoff(spool, failures);
+    spool_unlock(flush_lock_fd);
+
+    log_info("Submitted %u, rejected %u uReport(s)", sent, rejected);
+    list_free_with_free(taken);
+    return unreachable || rejected > 0;
+}
+
+int main(int argc, char **argv)
+{
+    /* I18n */
+    setlocale(LC_ALL, "");
+#if ENABLE_NLS
+    bindtextdomain(PACKAGE, LOCALEDIR);
+    textdomain(PACKAGE);
+#endif
+
+    abrt_init(argv);
+
+    const char *dump_dir_name = ".";
+    const char *spool_path = SPOOL_DIR;
+    const char *conf_file = UREPORT_CONF_FILE_PATH;
+    int batch = SPOOL_DEFAULT_BATCH;
+
+    /* Can't keep these strings/structs static: _() doesn't support that */
+    const char *program_usage_string = _(
+        "& [-v] [-c FILE] [-s DIR] -e [-d DIR]\n"
+        "& [-v] [-c FILE] [-s DIR] -f [-F] [-n NUM]\n"
+        "\n"
+        "Queues uReport of the problem in DIR (-e) or submits a batch of queued\n"
+        "uReports (-f). uReports of problems with the same duphash are queued\n"
+        "once and submitted together."
+    );
+    enum {
+        OPT_v = 1 << 0,
+        OPT_c = 1 << 1,
+        OPT_s = 1 << 2,
+        OPT_e = 1 << 3,
+        OPT_d = 1 << 4,
+        OPT_f = 1 << 5,
+        OPT_F = 1 << 6,
+        OPT_n = 1 << 7,
+    };
+    /* Keep enum above and order of options below in sync! */
+    struct options program_options[] = {
+        OPT__VERBOSE(&g_verbose),
+        OPT_STRING( 'c', NULL, &conf_file, "FILE", _("Configuration file")),
+        OPT_STRING( 's', NULL, &spool_path, "DIR", _("Spool directory (default: "SPOOL_DIR")")),
+        OPT_BOOL(   'e', NULL, NULL, _("Queue uReport of the problem")),
+        OPT_STRING( 'd', NULL, &dump_dir_name, "DIR", _("Problem directory")),
+        OPT_BOOL(   'f', NULL, NULL, _("Submit queued uReports")),
+        OPT_BOOL(   'F', NULL, NULL, _("Submit even if the submission is postponed")),
+        OPT_INTEGER('n', NULL, &batch, _("Maximal number of uReports to submit (default: 50)")),
+        OPT_END()
+    };
+    const unsigned opts = parse_opts(argc, argv, program_options, program_usage_string);
+
+    if (!(opts & OPT_e) == !(opts & OPT_f) || batch <= 0)
+        show_usage_and_die(program_usage_string, program_options);
+
+    export_abrt_envvars(0);
+
+    map_string_t *settings = new_map_string();
+    if (!load_conf_file(conf_file, settings, /*skip key w/o values:*/ false))
+        error_msg("Could not load configuration from '%s'", conf_file);
+
+    struct ureport_server_config config;
+    ureport_server_config_init(&config);
+    ureport_server_config_load(&config, settings);
+
+    struct spool spool;
+    spool_open(&spool, spool_path);
+
+    int r;
+    if (opts & OPT_e)
+    {
+        char *real_dir = realpath(dump_dir_name, NULL);
+        if (!real_dir)
+            perror_msg_and_die("Can't resolve '%s'", dump_dir_name);
+
+        r = spool_enqueue(&spool, &config, real_dir);
+        free(real_dir);
+    }
+    else
+    {
+        const char *email = getenv("uReport_ContactEmail");
+        if (!email)
+            email = get_map_string_item_or_NULL(settings, "ContactEmail");
+
+        r = spool_flush(&spool, &config, email, batch, opts & OPT_F);
+    }
+
+    close(spool.dir_fd);
+    ureport_server_config_destroy(&config);
+    free_map_string(settings);
+
+    return r;
+}
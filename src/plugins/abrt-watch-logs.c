@@ -0,0 +1,668 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  Red Hat, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Watches several log files with one inotify instance and extracts kernel
+ * oopses and Xorg backtraces without spawning abrt-dump-oops or
+ * abrt-dump-xorg.
+ *
+ * The parent directories of the logs are watched, so rotated and re-created
+ * logs are noticed without polling. Appended bytes are read exactly once and
+ * searched for all suspicious strings in a single pass. A line with a hit is
+ * held in memory together with everything appended after it until the log
+ * stops growing for LOG_QUIET_MS (or LOG_HOLD_MAX_MS elapse), then the held
+ * range is passed to the extractors.
+ */
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include "libabrt.h"
+#include "oops-utils.h"
+#include "xorg-utils.h"
+
+#define MAX_SCAN_BLOCK  (4*1024*1024)
+#define READ_AHEAD          (10*1024)
+#define ABRT_DUMP_OOPS_ANALYZER "abrt-oops"
+
+/* An oops is written in a burst of lines, wait for the end of the burst */
+#define LOG_QUIET_MS      200
+/* but don't let a chatty log postpone the processing forever */
+#define LOG_HOLD_MAX_MS  2000
+/* How often a log in a nonexistent directory is looked for */
+#define LOG_RETRY_MS    60000
+
+enum {
+    LOG_KERNEL = 1 << 0,
+    LOG_XORG   = 1 << 1,
+};
+
+struct watched_log
+{
+    char *path;
+    const char *name;  /* basename of path */
+    unsigned kinds;
+    int wd;            /* watch of the parent directory */
+    int fd;
+    off_t pos;
+    bool seen;         /* false until the first successful open */
+
+    GString *buf;      /* unprocessed bytes, a partial line or a held range */
+    size_t scanned;    /* bytes of buf already searched */
+    gint64 hold_since; /* 0 if buf contains no hit */
+    gint64 last_growth;
+};
+
+/* All suspicious strings searched in a single pass
+ *
+ * Positions are rejected by a bitmap of the first two bytes of the strings,
+ * the few remaining candidates are compared with the strings starting with
+ * the same byte.
+ */
+struct log_pattern
+{
+    const char *str;
+    size_t len;
+    unsigned kinds;
+};
+
+struct log_matcher
+{
+    GArray *patterns;
+    GSList *by_first[256];
+    unsigned char pairs[65536 / 8];
+    size_t max_len;
+};
+
+static struct log_matcher s_matcher;
+
+static char *s_dump_location;
+static int s_oops_flags;
+static int s_xorg_flags;
+
+static void log_matcher_add(struct log_matcher *m, const char *str, unsigned kinds)
+{
+    const size_t len = strlen(str);
+    if (len < 2)
+        error_msg_and_die("Search string '%s' is too short", str);
+
+    struct log_pattern pattern = { .str = str, .len = len, .kinds = kinds };
+    g_array_append_val(m->patterns, pattern);
+    m->max_len = MAX(m->max_len, len);
+
+    const unsigned pair = (unsigned char)str[0] | ((unsigned char)str[1] << 8);
+    m->pairs[pair / 8] |= 1 << (pair % 8);
+}
+
+static void log_matcher_init(struct log_matcher *m, unsigned kinds)
+{
+    memset(m, 0, sizeof(*m));
+    m->patterns = g_array_new(FALSE, FALSE, sizeof(struct log_pattern));
+
+    if (kinds & LOG_KERNEL)
+    {
+        GList *strings = koops_suspicious_strings_list();
+        for (GList *li = strings; li != NULL; li = g_list_next(li))
+            log_matcher_add(m, li->data, LOG_KERNEL);
+        g_list_free(strings);
+    }
+
+    if (kinds & LOG_XORG)
+        log_matcher_add(m, XORG_SEARCH_STRING, LOG_XORG);
+
+    /* The array is not resized anymore, the pointers are stable */
+    for (unsigned i = 0; i < m->patterns->len; ++i)
+    {
+        struct log_pattern *pattern = &g_array_index(m->patterns, struct log_pattern, i);
+        const unsigned char first = pattern->str[0];
+        m->by_first[first] = g_slist_prepend(m->by_first[first], pattern);
+    }
+}
+
+/* Returns the position of the first string of one of KINDS in [BEGIN, END) */
+static const char *log_matcher_find(const struct log_matcher *m, unsigned kinds,
+        const char *begin, const char *end)
+{
+    for (const char *p = begin; p + 1 < end; ++p)
+    {
+        const unsigned pair = (unsigned char)p[0] | ((unsigned char)p[1] << 8);
+        if (!(m->pairs[pair / 8] & (1 << (pair % 8))))
+            continue;
+
+        for (GSList *li = m->by_first[(unsigned char)p[0]]; li != NULL; li = g_slist_next(li))
+        {
+            const struct log_pattern *pattern = li->data;
+            if ((pattern->kinds & kinds)
+                && (size_t)(end - p) >= pattern->len
+                && memcmp(p, pattern->str, pattern->len) == 0)
+                return p;
+        }
+    }
+
+    return NULL;
+}
+
+struct mem_lines
+{
+    char *pos;
+    char *end;
+};
+
+static char *mem_get_next_line(void *data)
+{
+    struct mem_lines *lines = data;
+    if (lines->pos >= lines->end)
+        return NULL;
+
+    char *eol = memchr(lines->pos, '\n', lines->end - lines->pos);
+    if (eol == NULL)
+        eol = lines->end;
+
+    char *line = xstrndup(lines->pos, eol - lines->pos);
+    lines->pos = eol + 1;
+    return line;
+}
+
+static void extract_xorg_crashes(char *data, size_t len)
+{
+    struct mem_lines lines = { .pos = data, .end = data + len };
+    int bt_count = 0;
+    char *line;
+    while ((line = mem_get_next_line(&lines)) != NULL)
+    {
+        char *p = skip_pfx(line);
+        if (strcmp(p, XORG_SEARCH_STRING) == 0)
+        {
+            struct xorg_crash_info *crash_info = process_xorg_bt(&mem_get_next_line, &lines);
+            if (crash_info)
+            {
+                if (s_xorg_flags & ABRT_XORG_PRINT_STDOUT)
+                    xorg_crash_info_print_crash(crash_info);
+                if (s_dump_location != NULL && bt_count++ <= ABRT_OOPS_MAX_DUMPED_COUNT)
+                {
+                    xorg_crash_info_create_dump_dir(crash_info, s_dump_location,
+                                                    (s_xorg_flags & ABRT_XORG_WORLD_READABLE));
+                    if (s_xorg_flags & ABRT_XORG_THROTTLE_CREATION)
+                        abrt_xorg_signaled_sleep(1);
+                }
+                xorg_crash_info_free(crash_info);
+            }
+            else
+                log_warning(_("Failed to parse Backtrace from log file"));
+        }
+        free(line);
+    }
+}
+
+static void log_scan(struct watched_log *log);
+
+/* Passes the held range to the extractors, keeps the last partial line */
+static void log_flush(struct watched_log *log)
+{
+    GString *buf = log->buf;
+    const char *last_nl = memrchr(buf->str, '\n', buf->len);
+    size_t len = last_nl != NULL ? last_nl - buf->str + 1 : buf->len;
+    char *rest = xstrndup(buf->str + len, buf->len - len);
+    if (last_nl == NULL)
+    {
+        /* the extractors need the range terminated by a newline */
+        g_string_append_c(buf, '\n');
+        len = buf->len;
+    }
+
+    log_info("Processing %zu bytes of '%s' held for %lld ms", len, log->path,
+            (long long)(g_get_monotonic_time() - log->hold_since) / 1000);
+
+    /* Xorg goes first, the kernel extractor overwrites the newlines */
+    if (log->kinds & LOG_XORG)
+        extract_xorg_crashes(buf->str, len);
+
+    if (log->kinds & LOG_KERNEL)
+    {
+        GList *oops_list = NULL;
+        koops_extract_oopses(&oops_list, buf->str, len);
+        abrt_oops_process_list(oops_list, s_dump_location, ABRT_DUMP_OOPS_ANALYZER, s_oops_flags);
+        list_free_with_free(oops_list);
+    }
+
+    g_string_assign(buf, rest);
+    free(rest);
+    log->scanned = 0;
+    log->hold_since = 0;
+
+    /* The partial line may be the beginning of the next problem, it is held
+     * as if it was appended right now, not when the flushed range grew */
+    log->last_growth = g_get_monotonic_time();
+    log_scan(log);
+}
+
+/* Searches the bytes appended to buf since the last scan */
+static void log_scan(struct watched_log *log)
+{
+    GString *buf = log->buf;
+    if (log->hold_since != 0)
+    {
+        if (buf->len >= MAX_SCAN_BLOCK)
+            log_flush(log);
+        return;
+    }
+
+    /* A string may be split between two reads */
+    const size_t overlap = s_matcher.max_len - 1;
+    const size_t from = log->scanned > overlap ? log->scanned - overlap : 0;
+    const char *hit = log_matcher_find(&s_matcher, log->kinds, buf->str + from, buf->str + buf->len);
+    log->scanned = buf->len;
+
+    if (hit != NULL)
+    {
+        const char *line = memrchr(buf->str, '\n', hit - buf->str);
+        const size_t line_ofs = line != NULL ? line - buf->str + 1 : 0;
+        log_debug("Found a suspicious string in '%s': '%.*s'", log->path,
+                (int)MIN(buf->len - line_ofs, 80), buf->str + line_ofs);
+
+        g_string_erase(buf, 0, line_ofs);
+        log->scanned = buf->len;
+        log->hold_since = log->last_growth;
+
+        if (buf->len >= MAX_SCAN_BLOCK)
+            log_flush(log);
+        return;
+    }
+
+    /* Nothing found, keep only the partial last line */
+    const char *last_nl = memrchr(buf->str, '\n', buf->len);
+    size_t keep = last_nl != NULL ? buf->len - (last_nl - buf->str + 1) : buf->len;
+    if (keep > MAX_SCAN_BLOCK)
+        keep = overlap;
+    g_string_erase(buf, 0, buf->len - keep);
+    log->scanned = buf->len;
+}
+
+/* Reads everything appended to the log since the last read */
+static void log_read(struct watched_log *log)
+{
+    struct stat st;
+    if (fstat(log->fd, &st) != 0)
+    {
+        perror_msg("Can't stat '%s'", log->path);
+        return;
+    }
+
+    if (st.st_size < log->pos)
+    {
+        log_info("'%s' was truncated", log->path);
+        log->pos = 0;
+        if (log->hold_since == 0)
+            g_string_truncate(log->buf, 0);
+        log->scanned = MIN(log->scanned, log->buf->len);
+    }
+
+    if (st.st_size == log->pos)
+        return;
+
+    log_info("'%s' grew by %llu bytes, from %llu to %llu", log->path,
+            (long long)(st.st_size - log->pos), (long long)log->pos, (long long)st.st_size);
+
+    /* Shared by all logs, they are read one at a time */
+    static char *chunk;
+    if (chunk == NULL)
+        chunk = xmalloc(MAX_SCAN_BLOCK);
+
+    for (;;)
+    {
+        const ssize_t r = pread(log->fd, chunk, MAX_SCAN_BLOCK, log->pos);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            perror_msg("Can't read '%s'", log->path);
+        if (r <= 0)
+            break;
+
+        log->pos += r;
+        log->last_growth = g_get_monotonic_time();
+        g_string_append_len(log->buf, chunk, r);
+        log_scan(log);
+    }
+}
+
+static void log_close(struct watched_log *log)
+{
+    if (log->fd < 0)
+        return;
+
+    /* Don't lose what was written before the log was rotated */
+    log_read(log);
+    close(log->fd);
+    log->fd = -1;
+}
+
+static void log_open(struct watched_log *log)
+{
+    log->fd = open(log->path, O_RDONLY | O_CLOEXEC);
+    if (log->fd < 0)
+    {
+        if (errno != ENOENT)
+            perror_msg("Can't open '%s'", log->path);
+        return;
+    }
+
+    log_info("Opened '%s'", log->path);
+    log->pos = 0;
+
+    /* If the log is large, skip the beginning.
+     * IOW: ignore old log messages because they are unlikely
+     * to have sufficiently recent data to be useful.
+     * A rotated log is new, read it from the beginning.
+     */
+    struct stat st;
+    if (!log->seen && fstat(log->fd, &st) == 0 && st.st_size > (MAX_SCAN_BLOCK - READ_AHEAD))
+        log->pos = st.st_size - (MAX_SCAN_BLOCK - READ_AHEAD);
+    log->seen = true;
+
+    log_read(log);
+}
+
+/* Closes the log if it was deleted or replaced and opens the new one */
+static void log_update(struct watched_log *log)
+{
+    if (log->fd >= 0)
+    {
+        struct stat fd_st, path_st;
+        if (fstat(log->fd, &fd_st) == 0
+            && stat(log->path, &path_st) == 0
+            && fd_st.st_ino == path_st.st_ino
+            && fd_st.st_dev == path_st.st_dev)
+        {
+            log_read(log);
+            return;
+        }
+
+        log_info("Inode# of '%s' changed, closing fd", log->path);
+        log_close(log);
+    }
+
+    log_open(log);
+}
+
+static void log_add_watch(struct watched_log *log, int inotify_fd)
+{
+    char *dir = xstrndup(log->path, log->name - log->path);
+    if (dir[0] == '\0')
+    {
+        free(dir);
+        dir = xstrdup(".");
+    }
+
+    log->wd = inotify_add_watch(inotify_fd, dir,
+                IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+    if (log->wd < 0)
+        perror_msg("inotify_add_watch failed on '%s'", dir);
+    else
+        log_info("Added inotify watch for '%s'", dir);
+
+    free(dir);
+}
+
+/* Returns ms until the held range of the log must be processed or -1 */
+static gint64 log_hold_remaining_ms(const struct watched_log *log, gint64 now)
+{
+    if (log->hold_since == 0)
+        return -1;
+
+    const gint64 deadline = MIN(log->last_growth + LOG_QUIET_MS * 1000,
+                                log->hold_since + LOG_HOLD_MAX_MS * 1000);
+    return deadline <= now ? 0 : (deadline - now + 999) / 1000;
+}
+
+static void handle_inotify_events(int inotify_fd, struct watched_log *logs, unsigned count)
+{
+    /* inotify events are aligned to struct inotify_event */
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const ssize_t len = read(inotify_fd, buf, sizeof(buf));
+    if (len < 0)
+    {
+        if (errno != EINTR && errno != EAGAIN) /* I saw EINTR here on strace attach */
+            perror_msg("Error reading inotify fd");
+        return;
+    }
+
+    for (char *p = buf; p < buf + len; )
+    {
+        const struct inotify_event *event = (const struct inotify_event *)p;
+        p += sizeof(*event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+            log_warning("Inotify queue overflowed, rescanning all logs");
+            for (unsigned i = 0; i < count; ++i)
+                log_update(&logs[i]);
+            continue;
+        }
+
+        if (event->len == 0)
+            continue;
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            struct watched_log *log = &logs[i];
+            if (log->wd != event->wd || strcmp(log->name, event->name) != 0)
+                continue;
+
+            log_debug("Change in '%s' detected", log->path);
+            if (event->mask & IN_MODIFY)
+            {
+                if (log->fd >= 0)
+                    log_read(log);
+                else
+                    log_open(log);
+            }
+            else
+                log_update(log);
+        }
+    }
+}
+
+static unsigned add_logs(GArray *logs, GList *paths, unsigned kind)
+{
+    unsigned kinds = 0;
+    for (GList *li = paths; li != NULL; li = g_list_next(li))
+    {
+        kinds |= kind;
+
+        unsigned i = 0;
+        for (; i < logs->len; ++i)
+        {
+            struct watched_log *log = &g_array_index(logs, struct watched_log, i);
+            if (strcmp(log->path, li->data) == 0)
+            {
+                log->kinds |= kind;
+                break;
+            }
+        }
+        if (i < logs->len)
+            continue;
+
+        struct watched_log log = {
+            .path = xstrdup(li->data),
+            .kinds = kind,
+            .wd = -1,
+            .fd = -1,
+            .buf = g_string_new(NULL),
+        };
+        log.name = strrchr(log.path, '/');
+        log.name = log.name != NULL ? log.name + 1 : log.path;
+        if (log.name[0] == '\0')
+            error_msg_and_die("'%s' is not a file name", log.path);
+
+        g_array_append_val(logs, log);
+    }
+
+    return kinds;
+}
+
+int main(int argc, char **argv)
+{
+    /* I18n */
+    setlocale(LC_ALL, "");
+#if ENABLE_NLS
+    bindtextdomain(PACKAGE, LOCALEDIR);
+    textdomain(PACKAGE);
+#endif
+
+    abrt_init(argv);
+
+    GList *kernel_logs = NULL;
+    GList *xorg_logs = NULL;
+    const char *dump_location = NULL;
+
+    /* Can't keep these strings/structs static: _() doesn't support that */
+    const char *program_usage_string = _(
+        "& [-vsoxt] [-d DIR | -D] [-k FILE]... [-X FILE]...\n"
+        "\n"
+        "Watch the kernel log FILEs for oopses and the Xorg log FILEs\n"
+        "for backtraces and create a new problem directory in DIR for\n"
+        "every found problem"
+    );
+    enum {
+        OPT_v = 1 << 0,
+        OPT_s = 1 << 1,
+        OPT_o = 1 << 2,
+        OPT_d = 1 << 3,
+        OPT_D = 1 << 4,
+        OPT_x = 1 << 5,
+        OPT_t = 1 << 6,
+        OPT_k = 1 << 7,
+        OPT_X = 1 << 8,
+    };
+    /* Keep enum above and order of options below in sync! */
+    struct options program_options[] = {
+        OPT__VERBOSE(&g_verbose),
+        OPT_BOOL(  's', NULL, NULL, _("Log to syslog")),
+        OPT_BOOL(  'o', NULL, NULL, _("Print found problems on standard output")),
+        /* oopses don't contain any sensitive info, and even
+         * the old koops app was showing the oopses to all users
+         */
+        OPT_STRING('d', NULL, &dump_location, "DIR", _("Create new problem directory in DIR for every problem found")),
+        OPT_BOOL(  'D', NULL, NULL, _("Same as -d DumpLocation, DumpLocation is specified in abrt.conf")),
+        OPT_BOOL(  'x', NULL, NULL, _("Make the problem directory world readable")),
+        OPT_BOOL(  't', NULL, NULL, _("Throttle problem directory creation to 1 per second")),
+        OPT_LIST(  'k', NULL, &kernel_logs, "FILE", _("Watch kernel log FILE for oopses")),
+        OPT_LIST(  'X', NULL, &xorg_logs, "FILE", _("Watch Xorg log FILE for backtraces")),
+        OPT_END()
+    };
+    unsigned opts = parse_opts(argc, argv, program_options, program_usage_string);
+
+    export_abrt_envvars(0);
+
+    msg_prefix = g_progname;
+    if ((opts & OPT_s) || getenv("ABRT_SYSLOG"))
+    {
+        logmode = LOGMODE_JOURNAL;
+    }
+
+    if (argv[optind] || !(opts & (OPT_k | OPT_X)))
+        show_usage_and_die(program_usage_string, program_options);
+
+    if (opts & OPT_D)
+    {
+        if (opts & OPT_d)
+            show_usage_and_die(program_usage_string, program_options);
+        load_abrt_conf();
+        dump_location = g_settings_dump_location;
+        g_settings_dump_location = NULL;
+        free_abrt_conf_data();
+    }
+    s_dump_location = (char *)dump_location;
+
+    if (opts & OPT_x)
+    {
+        s_oops_flags |= ABRT_OOPS_WORLD_READABLE;
+        s_xorg_flags |= ABRT_XORG_WORLD_READABLE;
+    }
+    if (opts & OPT_t)
+    {
+        s_oops_flags |= ABRT_OOPS_THROTTLE_CREATION;
+        s_xorg_flags |= ABRT_XORG_THROTTLE_CREATION;
+    }
+    if (opts & OPT_o)
+    {
+        s_oops_flags |= ABRT_OOPS_PRINT_STDOUT;
+        s_xorg_flags |= ABRT_XORG_PRINT_STDOUT;
+    }
+
+    GArray *logs = g_array_new(FALSE, FALSE, sizeof(struct watched_log));
+    unsigned kinds = add_logs(logs, kernel_logs, LOG_KERNEL);
+    kinds |= add_logs(logs, xorg_logs, LOG_XORG);
+    log_matcher_init(&s_matcher, kinds);
+
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1)
+        perror_msg_and_die("inotify_init failed");
+
+    for (unsigned i = 0; i < logs->len; ++i)
+    {
+        struct watched_log *log = &g_array_index(logs, struct watched_log, i);
+        log_add_watch(log, inotify_fd);
+        log_open(log);
+    }
+
+    while (1)
+    {
+        int timeout = -1;
+        const gint64 now = g_get_monotonic_time();
+        for (unsigned i = 0; i < logs->len; ++i)
+        {
+            struct watched_log *log = &g_array_index(logs, struct watched_log, i);
+            if (log_hold_remaining_ms(log, now) == 0)
+                log_flush(log);
+
+            gint64 log_timeout = log_hold_remaining_ms(log, now);
+            if (log->wd < 0 && (log_timeout < 0 || log_timeout > LOG_RETRY_MS))
+                log_timeout = LOG_RETRY_MS;
+            if (log_timeout >= 0 && (timeout < 0 || log_timeout < timeout))
+                timeout = log_timeout;
+        }
+
+        struct pollfd pfd = { .fd = inotify_fd, .events = POLLIN };
+        log_debug("Waiting for logs to change, timeout %d ms", timeout);
+        /* We block here: */
+        const int r = poll(&pfd, 1, timeout);
+        if (r < 0 && errno != EINTR)
+            perror_msg_and_die("poll");
+
+        if (r > 0)
+        {
+            handle_inotify_events(inotify_fd, (struct watched_log *)logs->data, logs->len);
+            continue;
+        }
+
+        /* Retry watching the logs in directories which didn't exist */
+        for (unsigned i = 0; i < logs->len; ++i)
+        {
+            struct watched_log *log = &g_array_index(logs, struct watched_log, i);
+            if (log->wd >= 0)
+                continue;
+
+            log_add_watch(log, inotify_fd);
+            if (log->wd >= 0)
+                log_update(log);
+        }
+    }
+
+    return 0;
+}
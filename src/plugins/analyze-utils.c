@@ -0,0 +1,727 @@
+/*
+ * Copyright (C) 2016  ABRT team
+ * Copyright (C) 2016  RedHat Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <satyr/stacktrace.h>
+#include <satyr/thread.h>
+#include <satyr/frame.h>
+#include <satyr/core/stacktrace.h>
+#include <satyr/core/thread.h>
+#include <satyr/core/frame.h>
+#include <satyr/gdb/frame.h>
+#include <satyr/gdb/stacktrace.h>
+#include <satyr/python/stacktrace.h>
+#include <satyr/python/frame.h>
+#include <satyr/normalize.h>
+
+#include "analyze-utils.h"
+
+#define XORG_CONF "xorg.conf"
+
+static void analyze_save_text(struct dump_dir *dd, problem_data_t *results,
+        const char *name, const char *value)
+{
+    if (results != NULL)
+        problem_data_add_text_noteditable(results, name, value);
+    else
+        dd_save_text(dd, name, value);
+}
+
+/*
+ * CCpp
+ */
+
+/* The UUIDs used to be computed from the output of 'eu-unstrip -n' trimmed
+ * to the part between '+' and '@' without white spaces:
+ *
+ * 0x400000+0x209000 23c77451cf6adff77fc1f5ee2a01d75de6511dda@0x40024c - - [exe]
+ *          ^^^^^^^^ ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
+ * The same string is built from the modules, so the UUIDs don't change.
+ */
+static char *build_ids_from_core_modules(GList *modules)
+{
+    struct strbuf *buf = strbuf_new();
+    for (GList *li = modules; li != NULL; li = g_list_next(li))
+    {
+        const struct core_module *module = li->data;
+        strbuf_append_strf(buf, "%#llx", module->cm_size);
+
+        if (module->cm_build_id && module->cm_build_id_vaddr != 0)
+        {
+            strbuf_append_str(buf, module->cm_build_id);
+            continue;
+        }
+
+        /* Without '@', everything up to the end of the line was taken */
+        char *rest = xasprintf("%s%s%s%s",
+                module->cm_build_id ? module->cm_build_id : "-",
+                module->cm_file ? module->cm_file : "-",
+                module->cm_debug ? module->cm_debug : "-",
+                module->cm_name);
+        for (const char *c = rest; *c != '\0' && *c != '@'; ++c)
+            if (!isspace(*c))
+                strbuf_append_char(buf, *c);
+        free(rest);
+    }
+
+    return strbuf_free_nobuf(buf);
+}
+
+static struct sr_core_thread *
+core_thread_from_core_stacktrace(struct sr_core_stacktrace *stacktrace)
+{
+    struct sr_core_thread *thread = sr_core_stacktrace_find_crash_thread(stacktrace);
+    if (!thread)
+    {
+        log_info("Failed to find crash thread");
+        return NULL;
+    }
+
+    return thread;
+}
+
+static struct sr_core_stacktrace *
+core_stacktrace_from_core_json(char *core_backtrace)
+{
+    char *error = NULL;
+    struct sr_core_stacktrace *stacktrace = sr_core_stacktrace_from_json_text(core_backtrace, &error);
+    if (!stacktrace)
+    {
+        if (error)
+        {
+            log_info("Failed to parse core backtrace: %s", error);
+            free(error);
+        }
+        return NULL;
+    }
+
+    return stacktrace;
+}
+
+static char *build_ids_from_core_backtrace(struct dump_dir *dd)
+{
+    char *json = dd_load_text_ext(dd, FILENAME_CORE_BACKTRACE,
+                                  DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE | DD_FAIL_QUIETLY_ENOENT);
+    if (!json)
+        return NULL;
+
+    struct sr_core_stacktrace *stacktrace = core_stacktrace_from_core_json(json);
+    free(json);
+
+    if (!stacktrace)
+        return NULL;
+
+    struct sr_core_thread *thread = core_thread_from_core_stacktrace(stacktrace);
+
+    if (!thread)
+    {
+        sr_core_stacktrace_free(stacktrace);
+        return NULL;
+    }
+
+    void *build_id_list = NULL;
+
+    struct strbuf *strbuf = strbuf_new();
+    for (struct sr_core_frame *frame = thread->frames;
+         frame;
+         frame = frame->next)
+    {
+        if (frame->build_id)
+            build_id_list = g_list_prepend(build_id_list, frame->build_id);
+    }
+
+    build_id_list = g_list_sort(build_id_list, (GCompareFunc)strcmp);
+    for (GList *iter = build_id_list; iter; iter = g_list_next(iter))
+    {
+        GList *next = g_list_next(iter);
+        if (next == NULL || 0 != strcmp(iter->data, next->data))
+        {
+            strbuf = strbuf_append_strf(strbuf, "%s\n", (char *)iter->data);
+        }
+    }
+    g_list_free(build_id_list);
+    sr_core_stacktrace_free(stacktrace);
+
+    return strbuf_free_nobuf(strbuf);
+}
+
+int abrt_analyze_ccpp(struct dump_dir *dd, problem_data_t *results)
+{
+    /* Sizes and build ids of the modules of coredump */
+    char *unstrip_n_output = NULL;
+    GList *modules;
+    const int r = core_modules_load(dd, /*flags:*/ 0, /*timeout_sec:*/ 30, &modules);
+    if (r == 0)
+    {
+        unstrip_n_output = build_ids_from_core_modules(modules);
+        core_modules_free(modules);
+    }
+    else if (r == -ENOSPC)
+        /* coredump.xz can't be inflated now, the UUID computed from
+         * core_backtrace would differ from the one computed from coredump */
+        return r;
+    else
+    {
+        /* bad dump_dir_name, can't run unstrip, etc...
+         * or maybe missing coredump - try generating it from core_backtrace
+         */
+
+        unstrip_n_output = build_ids_from_core_backtrace(dd);
+    }
+
+    /* Hash package + executable + unstrip_n_output and save it as UUID */
+
+    char *executable = dd_load_text(dd, FILENAME_EXECUTABLE);
+    /* FILENAME_PACKAGE may be missing if ProcessUnpackaged = yes... */
+    char *package = dd_load_text_ext(dd, FILENAME_PACKAGE, DD_FAIL_QUIETLY_ENOENT);
+    /* Package variable has "firefox-3.5.6-1.fc11[.1]" format */
+    /* Remove distro suffix and maybe least significant version number */
+    char *p = package;
+    while (*p)
+    {
+        if (*p == '.' && (p[1] < '0' || p[1] > '9'))
+        {
+            /* We found "XXXX.nondigitXXXX", trim this part */
+            *p = '\0';
+            break;
+        }
+        p++;
+    }
+    char *first_dot = strchr(package, '.');
+    if (first_dot)
+    {
+        char *last_dot = strrchr(first_dot, '.');
+        if (last_dot != first_dot)
+        {
+            /* There are more than one dot: "1.2.3"
+             * Strip last part, we don't want to distinguish crashes
+             * in packages which differ only by minor release number.
+             */
+            *last_dot = '\0';
+        }
+    }
+
+    /* glibc formats NULL as "(null)", older UUIDs were computed that way */
+    char *string_to_hash = xasprintf("%s%s%s", package, executable,
+                                     unstrip_n_output ? unstrip_n_output : "(null)");
+    free(package);
+    free(executable);
+    free(unstrip_n_output);
+
+    log_debug("String to hash: %s", string_to_hash);
+
+    char hash_str[SHA1_RESULT_LEN*2 + 1];
+    str_to_sha1str(hash_str, string_to_hash);
+    free(string_to_hash);
+
+    analyze_save_text(dd, results, FILENAME_UUID, hash_str);
+
+    /* Create crash_function element from core_backtrace */
+    char *core_backtrace_json = dd_load_text_ext(dd, FILENAME_CORE_BACKTRACE,
+                                                 DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+    if (core_backtrace_json)
+    {
+        struct sr_core_stacktrace *stacktrace = core_stacktrace_from_core_json(core_backtrace_json);
+        free(core_backtrace_json);
+
+        if (!stacktrace)
+            goto next;
+
+        struct sr_core_thread *thread = core_thread_from_core_stacktrace(stacktrace);
+
+        if (!thread)
+            goto next;
+
+        sr_normalize_core_thread(thread);
+
+        struct sr_core_frame *frame = thread->frames;
+        if (frame->function_name)
+            analyze_save_text(dd, results, FILENAME_CRASH_FUNCTION, frame->function_name);
+
+next:
+        /* can be NULL */
+        sr_core_stacktrace_free(stacktrace);
+    }
+
+    return 0;
+}
+
+/*
+ * C/C++ backtrace
+ */
+
+int abrt_analyze_backtrace(struct dump_dir *dd, problem_data_t *results)
+{
+    char *component = dd_load_text(dd, FILENAME_COMPONENT);
+
+    /* Read backtrace */
+    char *backtrace_str = dd_load_text_ext(dd, FILENAME_BACKTRACE,
+                                           DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+    if (!backtrace_str)
+    {
+        free(component);
+        return 1;
+    }
+
+    /* Compute backtrace hash */
+    struct sr_location location;
+    sr_location_init(&location);
+    const char *backtrace_str_ptr = backtrace_str;
+    struct sr_gdb_stacktrace *backtrace = sr_gdb_stacktrace_parse(&backtrace_str_ptr, &location);
+    free(backtrace_str);
+
+    /* Store backtrace hash */
+    if (!backtrace)
+    {
+        /*
+         * The parser failed. Compute the duphash from the executable
+         * instead of a backtrace.
+         * and component only.  This is not supposed to happen often.
+         */
+        log_warning(_("Backtrace parsing failed for %s"), dd->dd_dirname);
+        log_warning("%d:%d: %s", location.line, location.column, location.message);
+        struct strbuf *emptybt = strbuf_new();
+
+        char *executable = dd_load_text(dd, FILENAME_EXECUTABLE);
+        strbuf_prepend_str(emptybt, executable);
+        free(executable);
+
+        strbuf_prepend_str(emptybt, component);
+
+        log_debug("Generating duphash: %s", emptybt->buf);
+        char hash_str[SHA1_RESULT_LEN*2 + 1];
+        str_to_sha1str(hash_str, emptybt->buf);
+
+        analyze_save_text(dd, results, FILENAME_DUPHASH, hash_str);
+        /*
+         * Other parts of ABRT assume that if no rating is available,
+         * it is ok to allow reporting of the bug. To be sure no bad
+         * backtrace is reported, rate the backtrace with the lowest
+         * rating.
+         */
+        analyze_save_text(dd, results, FILENAME_RATING, "0");
+
+        strbuf_free(emptybt);
+        free(component);
+
+        /* Report success even if the parser failed, as the backtrace
+         * has been created and rated. The failure is caused by a flaw
+         * in the parser, not in the backtrace.
+         */
+        return 0;
+    }
+
+    uint32_t tid = -1;
+    if (dd_load_uint32(dd, FILENAME_TID, &tid) == 0)
+        sr_gdb_stacktrace_set_crash_tid(backtrace, tid);
+
+    /* Compute duplication hash. */
+    struct sr_thread *crash_thread =
+        (struct sr_thread *)sr_gdb_stacktrace_find_crash_thread(backtrace);
+
+    if (crash_thread)
+    {
+        char *hash_str;
+
+        if (g_verbose >= 3)
+        {
+            hash_str = sr_thread_get_duphash(crash_thread, 3, component,
+                                             SR_DUPHASH_NOHASH);
+            log_warning("Generating duphash: %s", hash_str);
+            free(hash_str);
+        }
+
+        hash_str = sr_thread_get_duphash(crash_thread, 3, component,
+                                         SR_DUPHASH_NORMAL);
+        analyze_save_text(dd, results, FILENAME_DUPHASH, hash_str);
+        free(hash_str);
+    }
+    else
+        log_warning(_("Crash thread not found"));
+
+
+    /* Compute the backtrace rating. */
+    float quality = sr_gdb_stacktrace_quality_complex(backtrace);
+    const char *rating;
+    if (quality < 0.6f)
+        rating = "0";
+    else if (quality < 0.7f)
+        rating = "1";
+    else if (quality < 0.8f)
+        rating = "2";
+    else if (quality < 0.9f)
+        rating = "3";
+    else
+        rating = "4";
+    analyze_save_text(dd, results, FILENAME_RATING, rating);
+
+    /* Get the function name from the crash frame. */
+    struct sr_gdb_frame *crash_frame = sr_gdb_stacktrace_get_crash_frame(backtrace);
+    if (crash_frame)
+    {
+        if (crash_frame->function_name &&
+            0 != strcmp(crash_frame->function_name, "??"))
+        {
+            analyze_save_text(dd, results, FILENAME_CRASH_FUNCTION, crash_frame->function_name);
+        }
+        sr_gdb_frame_free(crash_frame);
+    }
+    sr_gdb_stacktrace_free(backtrace);
+    free(component);
+    return 0;
+}
+
+/*
+ * Python
+ */
+
+int abrt_analyze_python(struct dump_dir *dd, problem_data_t *results)
+{
+    char *bt = dd_load_text(dd, FILENAME_BACKTRACE);
+
+    /* save crash_function and exception_name into dumpdir */
+    char *error_message = NULL;
+    struct sr_stacktrace *stacktrace = sr_stacktrace_parse(SR_REPORT_PYTHON,
+                                                           (const char *)bt, &error_message);
+    if (stacktrace)
+    {
+        struct sr_python_stacktrace *python_stacktrace = (struct sr_python_stacktrace *)stacktrace;
+        if (python_stacktrace->exception_name)
+            analyze_save_text(dd, results, FILENAME_EXCEPTION_TYPE, python_stacktrace->exception_name);
+        /* thread is the same as stacktrace, if stacktrace is not NULL, thread
+         * is not NULL as well */
+        struct sr_thread *thread = sr_stacktrace_find_crash_thread(stacktrace);
+        struct sr_python_frame *frame = (struct sr_python_frame *)sr_thread_frames(thread);
+        if (frame && frame->function_name)
+            analyze_save_text(dd, results, FILENAME_CRASH_FUNCTION, frame->function_name);
+
+        sr_stacktrace_free(stacktrace);
+    }
+    else
+    {
+        error_msg("Can't parse stacktrace: %s", error_message);
+        free(error_message);
+    }
+
+    /* Hash 1st line of backtrace and save it as UUID and DUPHASH */
+    /* "example.py:1:<module>:ZeroDivisionError: integer division or modulo by zero" */
+
+    char *bt_end = strchrnul(bt, '\n');
+    *bt_end = '\0';
+    char hash_str[SHA1_RESULT_LEN*2 + 1];
+    str_to_sha1str(hash_str, bt);
+
+    free(bt);
+
+    analyze_save_text(dd, results, FILENAME_UUID, hash_str);
+    analyze_save_text(dd, results, FILENAME_DUPHASH, hash_str);
+
+    return 0;
+}
+
+/*
+ * Kernel oops
+ */
+
+int abrt_analyze_oops(struct dump_dir *dd, map_string_t *settings, problem_data_t *results)
+{
+    char *oops = dd_load_text(dd, FILENAME_BACKTRACE);
+    char hash_str[SHA1_RESULT_LEN*2 + 1];
+    int bad = koops_hash_str(hash_str, oops);
+    if (bad)
+    {
+        error_msg("Can't find a meaningful backtrace for hashing in '%s'", dd->dd_dirname);
+
+        /* Do not drop such oopses by default. */
+        int drop_notreportable_oopses = 0;
+        const int res = try_get_map_string_item_as_bool(settings,
+                "DropNotReportableOopses", &drop_notreportable_oopses);
+        if (!res || !drop_notreportable_oopses)
+        {
+            /* Let users know that they can configure ABRT to drop these oopses. */
+            log_warning("Preserving oops '%s' because DropNotReportableOopses is 'no'", dd->dd_dirname);
+
+            analyze_save_text(dd, results, FILENAME_NOT_REPORTABLE,
+            _("The backtrace does not contain enough meaningful function frames "
+              "to be reported. It is annoying but it does not necessary "
+              "signalize a problem with your computer. ABRT will not allow "
+              "you to create a report in a bug tracking system but you "
+              "can contact kernel maintainers via e-mail.")
+            );
+
+            /* Try to generate the hash once more with no limits. */
+            /* We need UUID file for the local duplicates look-up and DUPHASH */
+            /* file is also useful because user can force ABRT to report */
+            /* the oops into a bug tracking system (Bugzilla). */
+            bad = koops_hash_str_ext(hash_str, oops,
+                    /* use no frame count limit */-1,
+                    /* use every frame in stacktrace */0);
+
+            /* If even this attempt fails, we can drop the oops without any hesitation. */
+        }
+    }
+
+    free(oops);
+
+    if (!bad)
+    {
+        analyze_save_text(dd, results, FILENAME_UUID, hash_str);
+        analyze_save_text(dd, results, FILENAME_DUPHASH, hash_str);
+    }
+
+    return bad;
+}
+
+/*
+ * Xorg
+ */
+
+static
+void trim_spaces(char *str)
+{
+    char *src = str;
+    char *dst = str;
+    while (*src)
+    {
+        if (!isspace(*src))
+            *dst++ = *src;
+        src++;
+    }
+    *dst = '\0';
+}
+
+static
+char* is_in_comma_separated_list_with_fmt(const char *value, const char *fmt, const char *list)
+{
+    if (!list || !value)
+        return NULL;
+    while (*list)
+    {
+        const char *comma = strchrnul(list, ',');
+        char *pattern = xasprintf(fmt, (int)(comma - list), list);
+        char *match = strstr(value, pattern);
+        free(pattern);
+        if (match)
+            return xstrndup(list, comma - list);
+        if (!*comma)
+            break;
+        list = comma + 1;
+    }
+    return NULL;
+}
+
+char *abrt_analyze_xorg_blacklisted_modules(void)
+{
+    map_string_t *settings = new_map_string();
+    log_notice("Loading settings from '%s'", XORG_CONF);
+    load_abrt_plugin_conf_file(XORG_CONF, settings);
+    log_debug("Loaded '%s'", XORG_CONF);
+    char *blacklisted_modules = xstrdup(get_map_string_item_or_empty(settings, "BlacklistedXorgModules"));
+    trim_spaces(blacklisted_modules);
+    free_map_string(settings);
+
+    return blacklisted_modules;
+}
+
+static bool is_hex_digit(char c)
+{
+    return isxdigit((unsigned char)c);
+}
+
+/* Appends the normalized LINE to BUF unless it is to be dropped:
+ *
+ * # Generate duplicate detection hashes.
+ * # To err on the "flag it as a dup" side is way better than the opposite.
+ * # To this end:
+ * # - sanitize whitespace
+ * # - remove N: prefix
+ * # - remove path: we don't care whether it's /usr/lib64/foo or /lib/foo
+ * # - remove VERSION from so.VERSION
+ * # - drop main() invocation
+ * # - replace all hex constants with string "0xZ".
+ *
+ * Used to be a sed script, every step does what its sed expression did.
+ */
+static void xorg_normalize_line(struct strbuf *buf, const char *line, size_t len)
+{
+    /* s/[ \t][ \t]*\/ /g */
+    char *norm = xmalloc(len + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (line[i] == ' ' || line[i] == '\t')
+        {
+            while (i + 1 < len && (line[i + 1] == ' ' || line[i + 1] == '\t'))
+                ++i;
+            norm[n++] = ' ';
+        }
+        else
+            norm[n++] = line[i];
+    }
+
+    /* s/  *$// */
+    while (n > 0 && norm[n - 1] == ' ')
+        --n;
+    norm[n] = '\0';
+
+    /* s/^[0-9][0-9]*: // */
+    char *p = norm;
+    const size_t digits = strspn(p, "0123456789");
+    if (digits > 0 && p[digits] == ':' && p[digits + 1] == ' ')
+        p += digits + 2;
+
+    /* s@^/[^ ]*\/@@ */
+    if (p[0] == '/')
+    {
+        const char *end = strchrnul(p, ' ');
+        const char *slash = memrchr(p + 1, '/', end - p - 1);
+        if (slash != NULL)
+            p = (char *)slash + 1;
+    }
+
+    /* s/\.so\.[0-9][0-9]*\/.so/ */
+    for (char *so = strstr(p, ".so."); so != NULL; so = strstr(so + 1, ".so."))
+    {
+        if (isdigit((unsigned char)so[4]))
+        {
+            const char *after = so + 4 + strspn(so + 4, "0123456789");
+            memmove(so + 3, after, strlen(after) + 1);
+            break;
+        }
+    }
+
+    /* /libc_start_main/d */
+    if (strstr(p, "libc_start_main") == NULL)
+    {
+        /* s/0x[0-9a-fA-F][0-9a-fA-F]*\/0xZ/g */
+        while (*p)
+        {
+            if (p[0] == '0' && p[1] == 'x' && is_hex_digit(p[2]))
+            {
+                strbuf_append_str(buf, "0xZ");
+                p += 2;
+                while (is_hex_digit(*p))
+                    ++p;
+            }
+            else
+                strbuf_append_char(buf, *p++);
+        }
+        strbuf_append_char(buf, '\n');
+    }
+
+    free(norm);
+}
+
+/* Returns the hash of the normalized backtrace without adjacent duplicate lines */
+static int xorg_backtrace_hash(struct dump_dir *dd, char hash_str[SHA1_RESULT_LEN*2 + 1])
+{
+    const int fd = openat(dd->dd_fd, FILENAME_BACKTRACE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+    {
+        perror_msg("Can't open '%s/%s'", dd->dd_dirname, FILENAME_BACKTRACE);
+        return -1;
+    }
+
+    size_t size = INT_MAX;
+    char *backtrace = xmalloc_read(fd, &size);
+    close(fd);
+    if (backtrace == NULL)
+    {
+        perror_msg("Can't read '%s/%s'", dd->dd_dirname, FILENAME_BACKTRACE);
+        return -1;
+    }
+
+    struct strbuf *normalized = strbuf_new();
+    size_t last_ofs = 0;
+    size_t last_len = (size_t)-1;
+    for (const char *line = backtrace; line < backtrace + size; )
+    {
+        const char *eol = memchr(line, '\n', backtrace + size - line);
+        if (eol == NULL)
+            eol = backtrace + size;
+
+        const size_t ofs = normalized->len;
+        xorg_normalize_line(normalized, line, eol - line);
+
+        /* | uniq */
+        const size_t len = normalized->len - ofs;
+        if (len == last_len && memcmp(normalized->buf + ofs, normalized->buf + last_ofs, len) == 0)
+        {
+            normalized->len = ofs;
+            normalized->buf[ofs] = '\0';
+        }
+        else if (len != 0)
+        {
+            last_ofs = ofs;
+            last_len = len;
+        }
+
+        line = eol + 1;
+    }
+    free(backtrace);
+
+    str_to_sha1str(hash_str, normalized->buf);
+    strbuf_free(normalized);
+
+    return 0;
+}
+
+int abrt_analyze_xorg(struct dump_dir *dd, const char *blacklisted_modules,
+        problem_data_t *results)
+{
+    char *backtrace = dd_load_text(dd, FILENAME_BACKTRACE);
+    char *xorg_log = dd_load_text_ext(dd, "Xorg.0.log", DD_FAIL_QUIETLY_ENOENT);
+    char *blacklisted = is_in_comma_separated_list_with_fmt(backtrace, "/%.*s", blacklisted_modules);
+    if (!blacklisted)
+        blacklisted = is_in_comma_separated_list_with_fmt(xorg_log, "LoadModule: \"%.*s\"", blacklisted_modules);
+
+    /* get and save crash_function */
+    /* xorg backtrace is extracted from journal and looks like:
+     * 0: /usr/libexec/Xorg (OsLookupColor+0x139) [0x59ab89]
+     * 1: /lib64/libc.so.6 (__restore_rt+0x0) [0x7f2b13545b1f]
+     * 2: /lib64/libc.so.6 (__select_nocancel+0xa) [0x7f2b13609e7a]
+     * 3: /usr/libexec/Xorg (WaitForSomething+0x1c8) [0x593568]
+     * 4: /usr/libexec/Xorg (SendErrorToClient+0x111) [0x43a3a1]
+     */
+    char *crash_function = strchr(backtrace, '(');
+    if (crash_function++)
+    {
+        char *end = strchr(crash_function, '+');
+        if (!end)
+            end = strchr(crash_function, ')');
+        if (end)
+            *end = '\0';
+        analyze_save_text(dd, results, FILENAME_CRASH_FUNCTION, crash_function);
+    }
+
+    free(backtrace);
+    free(xorg_log);
+
+    if (blacklisted)
+    {
+        char *foobared = xasprintf(_("Module '%s' was loaded - won't report this crash"), blacklisted);
+        free(blacklisted);
+        analyze_save_text(dd, results, FILENAME_NOT_REPORTABLE, foobared);
+        free(foobared);
+        return 0;
+    }
+
+    char hash_str[SHA1_RESULT_LEN*2 + 1];
+    if (xorg_backtrace_hash(dd, hash_str) != 0)
+        return 1;
+
+    analyze_save_text(dd, results, FILENAME_UUID, hash_str);
+    analyze_save_text(dd, results, FILENAME_DUPHASH, hash_str);
+
+    return 0;
+}
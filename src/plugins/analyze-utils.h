@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2016  ABRT team
+ * Copyright (C) 2016  RedHat Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef _ABRT_ANALYZE_UTILS_H_
+#define _ABRT_ANALYZE_UTILS_H_
+
+#include "libabrt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The analyzers of abrt-action-analyze-{c,backtrace,python,oops,xorg}
+ *
+ * All functions expect DD opened for writing, save the computed elements in
+ * DD, or in RESULTS if it is not NULL, and return the exit code of
+ * the corresponding tool.
+ */
+
+/* Saves UUID and crash_function computed from coredump or core_backtrace */
+int abrt_analyze_ccpp(struct dump_dir *dd, problem_data_t *results);
+
+/* Saves DUPHASH, rating and crash_function computed from the gdb backtrace */
+int abrt_analyze_backtrace(struct dump_dir *dd, problem_data_t *results);
+
+/* Saves UUID, DUPHASH, crash_function and exception_type */
+int abrt_analyze_python(struct dump_dir *dd, problem_data_t *results);
+
+/* Saves UUID and DUPHASH, SETTINGS are the values of oops.conf */
+int abrt_analyze_oops(struct dump_dir *dd, map_string_t *settings, problem_data_t *results);
+
+/* Loads BlacklistedXorgModules from xorg.conf without white spaces */
+char *abrt_analyze_xorg_blacklisted_modules(void);
+
+/* Saves UUID, DUPHASH and crash_function or not-reportable if one of
+ * BLACKLISTED_MODULES was loaded */
+int abrt_analyze_xorg(struct dump_dir *dd, const char *blacklisted_modules,
+        problem_data_t *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_ABRT_ANALYZE_UTILS_H_*/
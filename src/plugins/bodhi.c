@@ -132,6 +132,12 @@
 
 static const char *bodhi_url = "https://bodhi.fedoraproject.org/updates";
 
+/* Seconds for which a response is used without asking bodhi */
+#define BODHI_CACHE_TTL (60 * 60)
+
+/* The most bodhi returns at once, the newest updates come first */
+#define BODHI_ROWS_PER_PAGE 100
+
 struct bodhi {
     char *nvr;
 #if 0
@@ -166,6 +172,12 @@ static void free_bodhi_item(struct bodhi *b)
     free(b);
 }
 
+static GHashTable *bodhi_table_new(void)
+{
+    return g_hash_table_new_full(g_str_hash, g_str_equal, free,
+                                 (GDestroyNotify) free_bodhi_item);
+}
+
 static void bodhi_read_value(json_object *json, const char *item_name,
                              void *value, int flags)
 {
@@ -319,8 +331,7 @@ static GHashTable *bodhi_parse_json(json_object *json, const char *release)
 
     int updates_len = json_object_array_length(updates);
 
-    GHashTable *bodhi_table = g_hash_table_new_full(g_str_hash, g_str_equal, free,
-                                                    (GDestroyNotify) free_bodhi_item);
+    GHashTable *bodhi_table = bodhi_table_new();
     for (int i = 0; i < updates_len; ++i)
     {
         json_object *updates_item = json_object_array_get_idx(updates, i);
@@ -392,29 +403,236 @@ static GHashTable *bodhi_parse_json(json_object *json, const char *release)
     return bodhi_table;
 }
 
-static GHashTable *bodhi_query_list(const char *query, const char *release)
+/*
+ * Response cache
+ *
+ * The updates found by a query are saved in a file named after the SHA-1 of
+ * the query URL, which contains the release and the sorted package names or
+ * bug ids:
+ *
+ *   Query: URL
+ *   Time: SECONDS_SINCE_EPOCH
+ *   ETag: VALUE
+ *   Last-Modified: VALUE
+ *
+ *   NAME NVR
+ *   ...
+ *
+ * A response younger than the TTL is used without asking bodhi. An older one
+ * is revalidated with If-None-Match/If-Modified-Since if bodhi provided a
+ * validator, so an unchanged result is not downloaded and parsed again.
+ */
+struct bodhi_cache_entry {
+    time_t time;
+    char *etag;
+    char *last_modified;
+    GHashTable *updates;
+};
+
+static void bodhi_cache_entry_free(struct bodhi_cache_entry *entry)
+{
+    if (!entry)
+        return;
+
+    free(entry->etag);
+    free(entry->last_modified);
+    if (entry->updates)
+        g_hash_table_destroy(entry->updates);
+    free(entry);
+}
+
+static char *bodhi_cache_path(const char *url)
+{
+    char *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, url, -1);
+    char *path = g_build_filename(g_get_user_cache_dir(), "abrt", "bodhi", hash, NULL);
+    g_free(hash);
+    return path;
+}
+
+/* Returns the value of "NAME: VALUE" line or NULL */
+static const char *cache_line_value(const char *line, const char *name)
+{
+    return prefixcmp(line, name) == 0 ? line + strlen(name) : NULL;
+}
+
+static struct bodhi_cache_entry *bodhi_cache_load(const char *path, const char *url)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return NULL;
+
+    struct bodhi_cache_entry *entry = xzalloc(sizeof(*entry));
+    entry->updates = bodhi_table_new();
+
+    bool valid = false;
+    bool in_header = true;
+    char *line;
+    while ((line = xmalloc_fgetline(fp)) != NULL)
+    {
+        const char *value;
+        if (!in_header)
+        {
+            char *nvr = strchr(line, ' ');
+            if (nvr)
+            {
+                *nvr++ = '\0';
+                struct bodhi *b = xzalloc(sizeof(*b));
+                b->nvr = xstrdup(nvr);
+                g_hash_table_replace(entry->updates, xstrdup(line), b);
+            }
+        }
+        else if (line[0] == '\0')
+            in_header = false;
+        else if ((value = cache_line_value(line, "Query: ")) != NULL)
+            valid = strcmp(value, url) == 0;
+        else if ((value = cache_line_value(line, "Time: ")) != NULL)
+            entry->time = strtoll(value, NULL, 10);
+        else if ((value = cache_line_value(line, "ETag: ")) != NULL)
+            entry->etag = xstrdup(value);
+        else if ((value = cache_line_value(line, "Last-Modified: ")) != NULL)
+            entry->last_modified = xstrdup(value);
+
+        free(line);
+    }
+    fclose(fp);
+
+    if (!valid || in_header || entry->time <= 0)
+    {
+        log_notice("Ignoring invalid cache file '%s'", path);
+        bodhi_cache_entry_free(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+static void bodhi_cache_save(const char *path, const char *url, struct bodhi_cache_entry *entry)
+{
+    char *dir = g_path_get_dirname(path);
+    if (g_mkdir_with_parents(dir, 0700) != 0)
+    {
+        perror_msg("Can't create '%s'", dir);
+        g_free(dir);
+        return;
+    }
+    g_free(dir);
+
+    struct strbuf *buf = strbuf_new();
+    strbuf_append_strf(buf, "Query: %s\nTime: %lld\n", url, (long long)entry->time);
+    if (entry->etag)
+        strbuf_append_strf(buf, "ETag: %s\n", entry->etag);
+    if (entry->last_modified)
+        strbuf_append_strf(buf, "Last-Modified: %s\n", entry->last_modified);
+    strbuf_append_char(buf, '\n');
+
+    if (entry->updates)
+    {
+        GHashTableIter iter;
+        const char *name;
+        const struct bodhi *b;
+        g_hash_table_iter_init(&iter, entry->updates);
+        while (g_hash_table_iter_next(&iter, (void **) &name, (void **) &b))
+            strbuf_append_strf(buf, "%s %s\n", name, b->nvr);
+    }
+
+    /* Write the file atomically, other instances may read it */
+    char *tmp_path = xasprintf("%s.XXXXXX", path);
+    int fd = mkstemp(tmp_path);
+    if (fd < 0)
+        perror_msg("Can't save '%s'", path);
+    else
+    {
+        bool written = full_write_str(fd, buf->buf) >= 0;
+        /* close() on every path, it reports delayed write errors too */
+        written = close(fd) == 0 && written;
+        if (!written || rename(tmp_path, path) != 0)
+        {
+            perror_msg("Can't save '%s'", path);
+            unlink(tmp_path);
+        }
+    }
+
+    free(tmp_path);
+    strbuf_free(buf);
+}
+
+static char *bodhi_response_header(post_state_t *post_state, const char *name)
+{
+    const size_t len = strlen(name);
+    for (unsigned i = 0; i < post_state->header_cnt; ++i)
+    {
+        const char *header = post_state->headers[i];
+        if (strncasecmp(header, name, len) == 0 && header[len] == ':')
+        {
+            char *value = xstrdup(skip_whitespace(header + len + 1));
+            strtrim(value);
+            return value[0] != '\0' ? value : (free(value), NULL);
+        }
+    }
+
+    return NULL;
+}
+
+static GHashTable *bodhi_query_list(const char *query, const char *release, unsigned cache_ttl)
 {
     char *bodhi_url_bugs = xasprintf("%s/?%s", bodhi_url, query);
 
+    char *cache_path = NULL;
+    struct bodhi_cache_entry *cached = NULL;
+    if (cache_ttl > 0)
+    {
+        cache_path = bodhi_cache_path(bodhi_url_bugs);
+        cached = bodhi_cache_load(cache_path, bodhi_url_bugs);
+    }
+
+    GHashTable *bodhi_table = NULL;
+    const time_t now = time(NULL);
+    if (cached && cached->time <= now && now - cached->time < cache_ttl)
+    {
+        log_info("Using cached response of '%s'", bodhi_url_bugs);
+        goto use_cached;
+    }
+
     post_state_t *post_state = new_post_state(POST_WANT_BODY
+                                              | POST_WANT_HEADERS
                                               | POST_WANT_SSL_VERIFY
                                               | POST_WANT_ERROR_MSG);
 
-    const char *headers[] = {
+    const char *headers[4] = {
         "Accept: application/json",
         NULL
     };
 
+    /* Revalidate the cached response */
+    char *if_none_match = NULL;
+    char *if_modified_since = NULL;
+    unsigned header_cnt = 1;
+    if (cached && cached->etag)
+        headers[header_cnt++] = if_none_match = xasprintf("If-None-Match: %s", cached->etag);
+    if (cached && cached->last_modified)
+        headers[header_cnt++] = if_modified_since = xasprintf("If-Modified-Since: %s", cached->last_modified);
+
     get(post_state, bodhi_url_bugs, "application/x-www-form-urlencoded",
                      headers);
 
+    free(if_none_match);
+    free(if_modified_since);
+
+    if (cached && post_state->http_resp_code == 304)
+    {
+        log_info("Cached response of '%s' is still valid", bodhi_url_bugs);
+        free_post_state(post_state);
+        cached->time = now;
+        bodhi_cache_save(cache_path, bodhi_url_bugs, cached);
+        goto use_cached;
+    }
+
     if (post_state->http_resp_code != 200 && post_state->http_resp_code != 400)
     {
         char *errmsg = post_state->curl_error_msg;
         if (errmsg && errmsg[0])
             error_msg_and_die("%s '%s'", errmsg, bodhi_url_bugs);
     }
-    free(bodhi_url_bugs);
 
 //    log_warning("%s", post_state->body);
 
@@ -438,22 +656,55 @@ static GHashTable *bodhi_query_list(const char *query, const char *release)
         }
     }
 
-    GHashTable *bodhi_table = bodhi_parse_json(json, release);
+    bodhi_table = bodhi_parse_json(json, release);
+
+    /* Only the first page is read, a part of the result must not be
+     * used as the whole one later */
+    bool truncated = false;
+    if (post_state->http_resp_code == 200)
+    {
+        int page = 1, pages = 1;
+        bodhi_read_value(json, "page", &page, BODHI_READ_INT);
+        bodhi_read_value(json, "pages", &pages, BODHI_READ_INT);
+        truncated = page < pages;
+        if (truncated)
+            log_notice("Bodhi returned page %d of %d of '%s', not caching it", page, pages, bodhi_url_bugs);
+    }
     json_object_put(json);
+
+    if (cache_path && post_state->http_resp_code == 200 && !truncated)
+    {
+        struct bodhi_cache_entry entry = {
+            .time = now,
+            .etag = bodhi_response_header(post_state, "ETag"),
+            .last_modified = bodhi_response_header(post_state, "Last-Modified"),
+            .updates = bodhi_table,
+        };
+        bodhi_cache_save(cache_path, bodhi_url_bugs, &entry);
+        free(entry.etag);
+        free(entry.last_modified);
+    }
+
     free_post_state(post_state);
+    goto free_query;
+
+use_cached:
+    bodhi_table = cached->updates;
+    cached->updates = NULL;
+
+free_query:
+    bodhi_cache_entry_free(cached);
+    g_free(cache_path);
+    free(bodhi_url_bugs);
 
     return bodhi_table;
 }
 
-static char *rpm_get_nvr_by_pkg_name(const char *pkg_name)
+/* The rpm configuration is read once for all packages */
+static char *rpm_get_nvr_by_pkg_name(rpmts ts, const char *pkg_name)
 {
-    int status = rpmReadConfigFiles((const char *) NULL, (const char *) NULL);
-    if (status)
-        error_msg_and_die("error reading RPM rc files");
-
     char *nvr = NULL;
 
-    rpmts ts = rpmtsCreate();
     rpmdbMatchIterator iter = rpmtsInitIterator(ts, RPMTAG_NAME, pkg_name, 0);
     Header header = rpmdbNextIterator(iter);
 
@@ -468,15 +719,34 @@ static char *rpm_get_nvr_by_pkg_name(const char *pkg_name)
 
 error:
     rpmdbFreeIterator(iter);
-    rpmtsFree(ts);
-
-    rpmFreeRpmrc();
-    rpmFreeCrypto();
-    rpmFreeMacros(NULL);
 
     return nvr;
 }
 
+/* Package names sorted and without duplicates, so the same set of packages
+ * is always the same query */
+static char *bodhi_packages_query(char **names)
+{
+    GList *sorted = NULL;
+    for (; *names; ++names)
+        sorted = g_list_prepend(sorted, *names);
+    sorted = g_list_sort(sorted, (GCompareFunc) strcmp);
+
+    struct strbuf *packages = strbuf_new();
+    for (GList *li = sorted; li != NULL; li = g_list_next(li))
+    {
+        if (li->next && strcmp(li->data, li->next->data) == 0)
+            continue;
+
+        char *escaped = g_uri_escape_string(li->data, NULL, 0);
+        strbuf_append_strf(packages, "%s%s", packages->len ? "," : "", escaped);
+        free(escaped);
+    }
+    g_list_free(sorted);
+
+    return strbuf_free_nobuf(packages);
+}
+
 int main(int argc, char **argv)
 {
     abrt_init(argv);
@@ -487,9 +757,15 @@ int main(int argc, char **argv)
         OPT_b = 1 << 3,
         OPT_u = 1 << 4,
         OPT_r = 1 << 5,
+        OPT_t = 1 << 6,
+        OPT_a = 1 << 7,
     };
 
     const char *bugs = NULL, *release = NULL, *dump_dir_path = ".";
+    int cache_ttl = BODHI_CACHE_TTL;
+    const char *env_cache_ttl = getenv("Bodhi_CacheTTL");
+    if (env_cache_ttl)
+        cache_ttl = xatoi(env_cache_ttl);
     /* Keep enum above and order of options below in sync! */
     struct options program_options[] = {
         OPT__VERBOSE(&g_verbose),
@@ -498,11 +774,13 @@ int main(int argc, char **argv)
         OPT_STRING('b', "bugs", &bugs, "ID1[,ID2,...]" , _("List of bug ids")),
         OPT_STRING('u', "url", &bodhi_url, "URL", _("Specify a bodhi server url")),
         OPT_OPTSTRING('r', "release", &release, "RELEASE", _("Specify a release")),
+        OPT_INTEGER('t', "cache-ttl", &cache_ttl, _("Use cached responses younger than NUM seconds, 0 disables the cache")),
+        OPT_BOOL('a', "all-packages", NULL, _("Check all PKG-NAMEs by one query")),
         OPT_END()
     };
 
     const char *program_usage_string = _(
-        "& [-v] [-r[RELEASE]] (-b ID1[,ID2,...] | PKG-NAME) [PKG-NAME]... \n"
+        "& [-v] [-r[RELEASE]] [-t NUM] [-a] (-b ID1[,ID2,...] | PKG-NAME) [PKG-NAME]... \n"
         "\n"
         "Search for updates on bodhi server"
     );
@@ -561,16 +839,24 @@ int main(int argc, char **argv)
 
     if (argv[optind])
     {
-        char *escaped = g_uri_escape_string(argv[optind], NULL, 0);
-        query = strbuf_append_strf(query, "packages=%s&", escaped);
-        free(escaped);
+        char *packages;
+        /* Not every bodhi server is known to accept the list */
+        if (opts & OPT_a)
+            packages = bodhi_packages_query(argv + optind);
+        else
+        {
+            if (argv[optind + 1])
+                log_notice("Checking only '%s', use -a to check all packages", argv[optind]);
+            packages = g_uri_escape_string(argv[optind], NULL, 0);
+        }
+        query = strbuf_append_strf(query, "packages=%s&", packages);
+        free(packages);
     }
 
-    if (query->buf[query->len - 1] == '&')
-        query->buf[query->len - 1] = '\0';
+    query = strbuf_append_strf(query, "rows_per_page=%d", BODHI_ROWS_PER_PAGE);
 
     log_warning(_("Searching for updates"));
-    GHashTable *update_hash_tbl = bodhi_query_list(query->buf, release);
+    GHashTable *update_hash_tbl = bodhi_query_list(query->buf, release, MAX(cache_ttl, 0));
     strbuf_free(query);
 
     if (!update_hash_tbl || !g_hash_table_size(update_hash_tbl))
@@ -584,10 +870,15 @@ int main(int argc, char **argv)
     char *name;
     struct bodhi *b;
     struct strbuf *q = strbuf_new();
+
+    if (rpmReadConfigFiles((const char *) NULL, (const char *) NULL))
+        error_msg_and_die("error reading RPM rc files");
+    rpmts ts = rpmtsCreate();
+
     g_hash_table_iter_init(&iter, update_hash_tbl);
     while (g_hash_table_iter_next(&iter, (void **) &name, (void **) &b))
     {
-        char *installed_pkg_nvr = rpm_get_nvr_by_pkg_name(name);
+        char *installed_pkg_nvr = rpm_get_nvr_by_pkg_name(ts, name);
         if (installed_pkg_nvr && rpmvercmp(installed_pkg_nvr, b->nvr) >= 0)
         {
             log_info("Update %s is older or same as local version %s, skipping", b->nvr, installed_pkg_nvr);
@@ -599,6 +890,11 @@ int main(int argc, char **argv)
         strbuf_append_strf(q, " %s", b->nvr);
     }
 
+    rpmtsFree(ts);
+    rpmFreeRpmrc();
+    rpmFreeCrypto();
+    rpmFreeMacros(NULL);
+
     /*g_hash_table_unref(update_hash_tbl);*/
 
     if (!q->len)
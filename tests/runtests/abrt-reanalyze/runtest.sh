@@ -0,0 +1,152 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of abrt-reanalyze
+#   Description: Check that abrt-reanalyze recomputes the hashes of a dump location
+#   Author: ABRT team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="abrt-reanalyze"
+PACKAGE="abrt"
+
+# Creates a complete problem directory with stale hashes
+function create_problem
+{
+    rlRun "mkdir -p $DUMP_LOCATION/$1"
+    echo -n "$2" > $DUMP_LOCATION/$1/type
+    echo -n "1" > $DUMP_LOCATION/$1/count
+    echo -n "1460000000" > $DUMP_LOCATION/$1/time
+    echo -n "stale" > $DUMP_LOCATION/$1/uuid
+    echo -n "stale" > $DUMP_LOCATION/$1/duphash
+    if [ -n "$3" ]; then
+        cp $3 $DUMP_LOCATION/$1/backtrace
+    fi
+}
+
+# Runs the analyzer of the post-create event on a copy of the problem
+function analyze_copy
+{
+    rm -rf $1.copy
+    cp -r $DUMP_LOCATION/$1 $1.copy
+    rm -f $1.copy/uuid $1.copy/duphash
+    rlRun "$2 -d $1.copy"
+}
+
+rlJournalStart
+    rlPhaseStartSetup
+        TmpDir=$(mktemp -d)
+        pushd $TmpDir
+
+        DUMP_LOCATION=$TmpDir/dumps
+        STATE_FILE=$TmpDir/reanalyze.state
+
+        cat > xorg_backtrace <<EOF
+0: /usr/libexec/Xorg (OsLookupColor+0x139) [0x59ab89]
+1: /lib64/libc.so.6 (__restore_rt+0x0) [0x7f2b13545b1f]
+2: /lib64/libc.so.6 (__select_nocancel+0xa) [0x7f2b13609e7a]
+3: /usr/libexec/Xorg (WaitForSomething+0x1c8) [0x593568]
+4: /usr/libexec/Xorg (WaitForSomething+0x1c8) [0x593568]
+5: /usr/libexec/Xorg (SendErrorToClient+0x111) [0x43a3a1]
+EOF
+
+        cat > python_backtrace <<EOF
+reanalyze.py:2:<module>:ZeroDivisionError: division by zero
+
+Traceback (most recent call last):
+  File "/usr/bin/reanalyze.py", line 2, in <module>
+    1/0
+ZeroDivisionError: division by zero
+
+Local variables in innermost frame:
+__name__: '__main__'
+EOF
+
+        create_problem xorg-1 xorg xorg_backtrace
+        create_problem python-1 Python3 python_backtrace
+        # Fails, the backtrace is missing
+        create_problem xorg-2 xorg
+        # Skipped, not complete
+        create_problem xorg-3 xorg xorg_backtrace
+        rm -f $DUMP_LOCATION/xorg-3/count
+
+        # The hash of abrt-action-analyze-xorg used to be computed by this
+        # pipeline
+        XORG_HASH=$(sed \
+            -e 's/[ \t][ \t]*/ /g' -e 's/  *$//' \
+            -e 's/^[0-9][0-9]*: //' \
+            -e 's@^/[^ ]*/@@' \
+            -e 's/\.so\.[0-9][0-9]*/.so/' \
+            -e '/libc_start_main/d' \
+            -e 's/0x[0-9a-fA-F][0-9a-fA-F]*/0xZ/g' \
+            xorg_backtrace \
+            | uniq \
+            | sha1sum | sed 's/[ \t].*//')
+
+        analyze_copy python-1 abrt-action-analyze-python
+    rlPhaseEnd
+
+    rlPhaseStartTest "hashes are recomputed"
+        rlRun "abrt-reanalyze -vvv -j 2 -d $DUMP_LOCATION -s $STATE_FILE >reanalyze.log 2>&1" 1
+        rlAssertGrep "2 changed, 0 unchanged, 1 failed, 1 skipped" reanalyze.log
+
+        rlAssertEquals "xorg UUID" "$(cat $DUMP_LOCATION/xorg-1/uuid)" "$XORG_HASH"
+        rlAssertEquals "xorg DUPHASH" "$(cat $DUMP_LOCATION/xorg-1/duphash)" "$XORG_HASH"
+
+        rlAssertEquals "Python UUID" "$(cat $DUMP_LOCATION/python-1/uuid)" "$(cat python-1.copy/uuid)"
+        rlAssertEquals "Python DUPHASH" "$(cat $DUMP_LOCATION/python-1/duphash)" "$(cat python-1.copy/duphash)"
+
+        rlAssertEquals "Failed problem is untouched" "$(cat $DUMP_LOCATION/xorg-2/uuid)" "stale"
+        rlAssertEquals "Skipped problem is untouched" "$(cat $DUMP_LOCATION/xorg-3/uuid)" "stale"
+        rlAssertNotExists $DUMP_LOCATION/xorg-1/.uuid.new
+
+        rlAssertNotExists $STATE_FILE
+    rlPhaseEnd
+
+    rlPhaseStartTest "up to date hashes are unchanged"
+        rlRun "abrt-reanalyze -vvv -j 2 -d $DUMP_LOCATION -s $STATE_FILE >reanalyze_again.log 2>&1" 1
+        rlAssertGrep "0 changed, 2 unchanged, 1 failed, 1 skipped" reanalyze_again.log
+        rlAssertEquals "xorg UUID" "$(cat $DUMP_LOCATION/xorg-1/uuid)" "$XORG_HASH"
+    rlPhaseEnd
+
+    rlPhaseStartTest "failed problems are analyzed by the resumed run"
+        # The state file of an interrupted run which analyzed all problems
+        # but the failed one
+        printf "%s\n" $DUMP_LOCATION xorg-1 python-1 xorg-3 > $STATE_FILE
+        cp xorg_backtrace $DUMP_LOCATION/xorg-2/backtrace
+
+        rlRun "abrt-reanalyze -vvv -j 2 -d $DUMP_LOCATION -s $STATE_FILE >reanalyze_resumed.log 2>&1"
+        rlAssertGrep "1 changed, 0 unchanged, 0 failed, 0 skipped" reanalyze_resumed.log
+        rlAssertGrep "3 problems were analyzed by the previous run" reanalyze_resumed.log
+        rlAssertEquals "xorg UUID" "$(cat $DUMP_LOCATION/xorg-2/uuid)" "$XORG_HASH"
+        rlAssertNotExists $STATE_FILE
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        rlBundleLogs abrt $(echo *.log)
+        popd # TmpDir
+        rm -rf $TmpDir
+    rlPhaseEnd
+    rlJournalPrintText
+rlJournalEnd
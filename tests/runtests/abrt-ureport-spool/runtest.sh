@@ -0,0 +1,134 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of abrt-ureport-spool
+#   Description: Verify queueing and batched submission of uReports
+#   Author: ABRT team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="abrt-ureport-spool"
+PACKAGE="abrt"
+
+rlJournalStart
+    rlPhaseStartSetup
+        check_prior_crashes
+
+        LANG=""
+        export LANG
+
+        TmpDir=$(mktemp -d)
+        cp -- fakefaf.py  "$TmpDir"
+        pushd "$TmpDir"
+
+        SPOOL="$TmpDir/spool"
+        rlRun "augtool set /files/etc/libreport/plugins/ureport.conf/URL http://127.0.0.1:12345/faf" 0 "set URL to ureport.conf"
+        rlRun "augtool rm /files/etc/libreport/plugins/ureport.conf/ContactEmail" 0 "rm ContactEmail settings from ureport.conf"
+    rlPhaseEnd
+
+    rlPhaseStartTest "queue uReport instead of sending it"
+        prepare
+        generate_crash
+        wait_for_hooks
+        get_crash_path
+
+        rlRun "echo 0 > $crash_PATH/ureports_counter" 0 "set ureports_counter to 0"
+        duphash=$(cat $crash_PATH/duphash)
+
+        # Automatic reporting runs the event non-interactively
+        pushd $crash_PATH
+        REPORT_CLIENT_NONINTERACTIVE=1 uReport_Spool=yes /usr/libexec/abrt-action-ureport -vvv &> $TmpDir/ureport.log
+        rlAssertEquals "abrt-action-ureport succeeded" "$?" "0"
+        popd #$crash_PATH
+
+        # abrt-action-ureport uses the default spool, move the entry to ours
+        rlRun "mkdir -p $SPOOL && mv /var/lib/abrt/ureport-spool/$duphash $SPOOL/" 0 "move the queued uReport"
+
+        rlAssertGrep "uReport has been queued for submission" ureport.log
+        rlAssertNotGrep "curl sent header: 'POST /faf/reports/new/ HTTP/1" ureport.log
+        rlAssertExists "$SPOOL/$duphash/ureport.json"
+        rlAssertGrep "$crash_PATH" "$SPOOL/$duphash/problems"
+        rlAssertEquals "ureports_counter is not changed" "$(cat $crash_PATH/ureports_counter)" "0"
+    rlPhaseEnd
+
+    rlPhaseStartTest "coalesce occurrences with the same duphash"
+        rlRun "/usr/libexec/abrt-ureport-spool -s $SPOOL -e -d $crash_PATH" 0 "queue the second occurrence"
+        rlAssertEquals "one queued uReport" "$(ls $SPOOL | wc -l)" "1"
+        rlAssertEquals "two occurrences" "$(wc -l < $SPOOL/$duphash/problems)" "2"
+    rlPhaseEnd
+
+    rlPhaseStartTest "keep uReports when the server is not reachable"
+        rlRun "/usr/libexec/abrt-ureport-spool -vvv -s $SPOOL -f &> flush1.log" 1 "submission fails"
+
+        rlAssertGrep "Can't reach the uReport server" flush1.log
+        rlAssertExists "$SPOOL/$duphash/ureport.json"
+        rlAssertExists "$SPOOL/.backoff"
+
+        ./fakefaf.py &> server.log &
+        FAF_PID=$!
+        sleep 1
+
+        rlRun "/usr/libexec/abrt-ureport-spool -vvv -s $SPOOL -f &> flush2.log" 0 "submission is postponed"
+        rlAssertGrep "Submission is postponed" flush2.log
+        rlAssertNotGrep ".* - - \[.*\] \"POST /faf/reports/new/ HTTP/1.1\" 202 -" server.log
+    rlPhaseEnd
+
+    rlPhaseStartTest "submit coalesced uReports at once"
+        rlRun "/usr/libexec/abrt-ureport-spool -vvv -s $SPOOL -f -F &> flush3.log" 0 "forced submission"
+
+        rlAssertGrep "uReport '$duphash' of 2 occurrence(s) has been submitted" flush3.log
+        rlAssertEquals "one POST request" "$(grep -c 'POST /faf/reports/new/' server.log)" "1"
+        rlAssertNotExists "$SPOOL/$duphash"
+        rlAssertNotExists "$SPOOL/.backoff"
+        rlAssertEquals "ureports_counter counts the occurrences" "$(cat $crash_PATH/ureports_counter)" "2"
+        rlAssertGrep "uReport: BTHASH=691cf824e3e07457156125636e86c50279e29496" $crash_PATH/reported_to
+    rlPhaseEnd
+
+    rlPhaseStartTest "send uReport right away when reporting interactively"
+        rlRun "echo 3 > $crash_PATH/count" 0 "add an occurrence"
+
+        pushd $crash_PATH
+        uReport_Spool=yes /usr/libexec/abrt-action-ureport -vvv &> $TmpDir/ureport_interactive.log
+        # The server knows a bug, the user is told so and the event stops
+        rlAssertEquals "abrt-action-ureport stops the event" "$?" "70"
+        popd #$crash_PATH
+
+        kill $FAF_PID
+
+        rlAssertGrep "sending uReport right away" ureport_interactive.log
+        rlAssertNotGrep "uReport has been queued for submission" ureport_interactive.log
+        rlAssertNotExists "/var/lib/abrt/ureport-spool/$duphash"
+        rlAssertEquals "another POST request" "$(grep -c 'POST /faf/reports/new/' server.log)" "2"
+        rlAssertEquals "ureports_counter is increased" "$(cat $crash_PATH/ureports_counter)" "3"
+
+        rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash dir"
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        rlBundleLogs abrt $(ls server* ureport* flush*)
+        popd # TmpDir
+        rm -rf -- "$TmpDir"
+    rlPhaseEnd
+    rlJournalPrintText
+rlJournalEnd
@@ -33,17 +33,28 @@ PACKAGE="abrt"
 
 function fake_serve {
     f="$1"
+    extra_headers="$2"
     echo "Serving $f on port 12345"
-    { echo -ne "HTTP/1.1 200 OK\r\nContent-Length: $(wc -c < $f)\r\nContent-Type: application/json\r\n\r\n";
+    { echo -ne "HTTP/1.1 200 OK\r\nContent-Length: $(wc -c < $f)\r\nContent-Type: application/json\r\n$extra_headers\r\n";
     cat $f; } | nc -l 12345 > request &
     sleep 1
 }
 
+function fake_not_modified {
+    echo "Serving 304 Not Modified on port 12345"
+    echo -ne "HTTP/1.1 304 Not Modified\r\n\r\n" | nc -l 12345 > request &
+    sleep 1
+}
+
 rlJournalStart
     rlPhaseStartSetup
         TmpDir=$(mktemp -d)
         cp -R queries/* $TmpDir
         pushd $TmpDir
+
+        # Every query must reach the fake server, the cache is tested below
+        export XDG_CACHE_HOME=$TmpDir/cache
+        export Bodhi_CacheTTL=0
     rlPhaseEnd
 
     rlPhaseStartTest "sanity"
@@ -145,7 +156,7 @@ rlJournalStart
         rlRun "echo 'y' | abrt-bodhi -vvv -u http://localhost:12345 abrt &> output" 0
 
         cp request request.pkgmgr-by-package.log
-        rlAssertGrep 'packages=abrt ' request
+        rlAssertGrep 'packages=abrt&rows_per_page=100 ' request
 
         cp output output.pkgmgr-by-package.log
         rlAssertGrep 'by running: dnf update ' output
@@ -165,6 +176,70 @@ rlJournalStart
         rlAssertGrep 'failed to parse package name from nvr: '"'"'-1.1.9-2.fc24'"'"'' output
     rlPhaseEnd
 
+    rlPhaseStartTest "first package only"
+        fake_serve python_query
+        rlRun "echo 'y' | abrt-bodhi -vvv -u http://localhost:12345 python3 python &> output" 0
+
+        cp request request.first-package.log
+        rlAssertGrep 'GET /?packages=python3&rows_per_page=100 ' request
+
+        cp output output.first-package.log
+        rlAssertGrep "Checking only 'python3'" output
+    rlPhaseEnd
+
+    rlPhaseStartTest "batch query"
+        fake_serve python_query
+        rlRun "echo 'y' | abrt-bodhi -vvv -u http://localhost:12345 -a python3 python python-docs python &> output" 0
+
+        cp request request.batch.log
+        rlAssertGrep 'GET /?packages=python,python-docs,python3&rows_per_page=100 ' request
+
+        cp output output.batch.log
+        rlAssertGrep 'An update exists.*python-2000.7.12-1.fc24' output
+        rlAssertGrep 'An update exists.*python3-3000.4.3-6.fc23' output
+        rlAssertGrep 'An update exists.*python-docs-2000.7.10-1.fc22' output
+    rlPhaseEnd
+
+    rlPhaseStartTest "cached response"
+        fake_serve memtest_query 'ETag: "memtest-1"\r\n'
+        rlRun "echo 'y' | Bodhi_CacheTTL=3600 abrt-bodhi -vvv -u http://localhost:12345 memtest86+ &> output" 0
+        cp output output.cache-miss.log
+        rlAssertGrep 'Found package: memtest86+' output
+        rlAssertEquals "one cache file" "$(ls $XDG_CACHE_HOME/abrt/bodhi | wc -l)" "1"
+        rlAssertGrep 'ETag: "memtest-1"' $XDG_CACHE_HOME/abrt/bodhi/*
+
+        # no server is listening
+        rlRun "echo 'y' | Bodhi_CacheTTL=3600 abrt-bodhi -vvv -u http://localhost:12345 memtest86+ &> output" 0
+        cp output output.cache-hit.log
+        rlAssertGrep 'Using cached response' output
+        rlAssertGrep 'An update exists.*memtest86+-5.01-14.fc23' output
+    rlPhaseEnd
+
+    rlPhaseStartTest "revalidated response"
+        sleep 2
+        fake_not_modified
+        rlRun "echo 'y' | Bodhi_CacheTTL=1 abrt-bodhi -vvv -u http://localhost:12345 memtest86+ &> output" 0
+
+        cp request request.revalidate.log
+        rlAssertGrep 'If-None-Match: "memtest-1"' request
+
+        cp output output.revalidate.log
+        rlAssertGrep 'is still valid' output
+        rlAssertNotGrep 'Found package: memtest86+' output
+        rlAssertGrep 'An update exists.*memtest86+-5.01-14.fc23' output
+    rlPhaseEnd
+
+    rlPhaseStartTest "truncated response"
+        # python_query is the first of 2 pages
+        fake_serve python_query 'ETag: "python-1"\r\n'
+        rlRun "echo 'y' | Bodhi_CacheTTL=3600 abrt-bodhi -vvv -u http://localhost:12345 python &> output" 0
+
+        cp output output.truncated.log
+        rlAssertGrep 'Bodhi returned page 1 of 2' output
+        rlAssertGrep 'An update exists.*python-2000.7.12-1.fc24' output
+        rlAssertEquals "only the memtest cache file" "$(ls $XDG_CACHE_HOME/abrt/bodhi | wc -l)" "1"
+    rlPhaseEnd
+
     rlPhaseStartCleanup
         killall nc
         rlBundleLogs abrt-bodhi $(ls *.log)
@@ -0,0 +1,96 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of ccpp-crash-loops
+#   Description: test coalescing of crash loops in abrt-hook-ccpp
+#   Author: ABRT Team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="ccpp-crash-loops"
+PACKAGE="abrt"
+
+CCPP_CFG_FILE="/etc/abrt/plugins/CCpp.conf"
+
+rlJournalStart
+    rlPhaseStartSetup
+        check_prior_crashes
+
+        TmpDir=$(mktemp -d)
+        pushd $TmpDir
+
+        rlFileBackup $CCPP_CFG_FILE
+        sed -i '/^CoalesceCrashLoops/d' $CCPP_CFG_FILE
+        echo "CoalesceCrashLoops = yes" >> $CCPP_CFG_FILE
+        echo "CoalesceCrashLoopsPeriod = 600" >> $CCPP_CFG_FILE
+
+        rlRun "useradd testuser" 0
+    rlPhaseEnd
+
+    rlPhaseStartTest "same crash is coalesced"
+        prepare
+        generate_crash
+        wait_for_hooks
+        get_crash_path
+
+        rlAssertEquals "One problem" "_1" "_$(abrt-cli list 2> /dev/null | grep -c Directory)"
+        rlAssertEquals "Count of the first crash" "_1" "_$(cat $crash_PATH/count)"
+
+        # Coalesced crashes run no post-create event, there is nothing to wait for
+        generate_crash
+        generate_crash
+        sleep 2
+
+        rlAssertEquals "Still one problem" "_1" "_$(abrt-cli list 2> /dev/null | grep -c Directory)"
+        rlAssertEquals "Crashes are counted" "_3" "_$(cat $crash_PATH/count)"
+        rlAssertExists "$crash_PATH/last_occurrence"
+        FIRST_PATH=$crash_PATH
+    rlPhaseEnd
+
+    rlPhaseStartTest "crash of another user is not coalesced"
+        prepare
+        generate_crash testuser
+        wait_for_hooks
+
+        rlAssertEquals "Two problems" "_2" "_$(abrt-cli list 2> /dev/null | grep -c Directory)"
+        rlAssertEquals "The first problem is unchanged" "_3" "_$(cat $FIRST_PATH/count)"
+
+        for dir in $(abrt-cli list 2> /dev/null | grep Directory | awk '{ print $2 }'); do
+            if [ "$dir" != "$FIRST_PATH" ]; then
+                rlAssertEquals "Count of the other user's crash" "_1" "_$(cat $dir/count)"
+                rlAssertEquals "Owned by the other user" "_$(id -u testuser)" "_$(cat $dir/uid)"
+            fi
+        done
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        rlRun "abrt-cli rm $(abrt-cli list 2> /dev/null | grep Directory | awk '{ print $2 }')" 0 "Remove crash directories"
+        rlRun "userdel -r -f testuser" 0
+        rlRun "rm -rf /var/run/abrt/ccpp-crash-loops" 0 "Remove crash loop records"
+        popd # $TmpDir
+        rlRun "rm -r $TmpDir" 0 "Removing tmp directory"
+        rlFileRestore # CCPP_CFG_FILE
+    rlPhaseEnd
+rlJournalPrintText
+rlJournalEnd
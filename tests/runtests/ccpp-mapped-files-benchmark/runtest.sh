@@ -0,0 +1,109 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of ccpp-mapped-files-benchmark
+#   Description: measure disk usage and time of capturing processes mapping big files
+#   Author: ABRT Team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="ccpp-mapped-files-benchmark"
+PACKAGE="abrt"
+
+CFG_FILE="/etc/abrt/abrt-action-save-package-data.conf"
+CCPP_CFG_FILE="/etc/abrt/plugins/CCpp.conf"
+
+function measure_capture() {
+    local mode=$1
+
+    sed -i '/^ElideMappedFiles/d' $CCPP_CFG_FILE
+    echo "ElideMappedFiles = $mode" >> $CCPP_CFG_FILE
+
+    rlRun "rm -f core* /tmp/abrt-done"
+    local start=$(date +%s%N)
+    rlRun "./map_files data.bin $LIBRARIES" 139
+    wait_for_hooks
+    local end=$(date +%s%N)
+    get_crash_path
+
+    rlAssertExists core*
+    rlAssertExists $crash_PATH/coredump
+
+    local user_size=$(stat -c %s core*)
+    local abrt_size=$(stat -c %s $crash_PATH/coredump)
+
+    rlLog "ElideMappedFiles=$mode: time $(( (end - start) / 1000000 )) ms"
+    rlLog "ElideMappedFiles=$mode: user core $user_size bytes, ABRT core $abrt_size bytes"
+
+    if [ "$mode" == "yes" ]; then
+        rlAssertExists $crash_PATH/coredump_elided
+        rlAssertGreater "ABRT core is much smaller" $((user_size/4)) $abrt_size
+
+        local start=$(date +%s%N)
+        rlRun "abrt-action-inflate-elements -d $crash_PATH"
+        local end=$(date +%s%N)
+        rlLog "Restoration: $(( (end - start) / 1000000 )) ms"
+
+        rlAssertNotExists $crash_PATH/coredump_elided
+        rlAssertGreater "Restored core contains the mappings" $(stat -c %s $crash_PATH/coredump) $((user_size/2))
+    fi
+
+    rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash directory"
+    rlRun "rm -f core*"
+}
+
+rlJournalStart
+    rlPhaseStartSetup
+        check_prior_crashes
+
+        TmpDir=$(mktemp -d /var/tmp/abrt-test.XXXXXX)
+        rlRun "cp map_files.c $TmpDir/"
+        pushd $TmpDir
+        rlRun "gcc -std=gnu99 -Wall -o map_files map_files.c" 0 "Compiling map_files.c"
+        rlRun "dd if=/dev/urandom of=data.bin bs=1M count=300" 0 "Creating a big data file"
+        LIBRARIES=$(find /usr/lib64 -maxdepth 1 -name 'lib*.so*' -type f -size +512k | head -n 100 | tr '\n' ' ')
+        rlRun "ulimit -c unlimited"
+
+        rlFileBackup $CFG_FILE $CCPP_CFG_FILE
+        sed -i 's/ProcessUnpackaged = no/ProcessUnpackaged = yes/g' $CFG_FILE
+        sed -i 's/\(MakeCompatCore\) = no/\1 = yes/g' $CCPP_CFG_FILE
+    rlPhaseEnd
+
+    rlPhaseStartTest "ElideMappedFiles = no"
+        rlAssertGrep "abrt-hook-ccpp" /proc/sys/kernel/core_pattern
+        measure_capture no
+    rlPhaseEnd
+
+    rlPhaseStartTest "ElideMappedFiles = yes"
+        rlAssertGrep "abrt-hook-ccpp" /proc/sys/kernel/core_pattern
+        measure_capture yes
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        popd # $TmpDir
+        rlRun "rm -r $TmpDir" 0 "Removing tmp directory"
+        rlFileRestore # CFG_FILE CCPP_CFG_FILE
+    rlPhaseEnd
+rlJournalPrintText
+rlJournalEnd
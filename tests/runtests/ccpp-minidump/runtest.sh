@@ -0,0 +1,86 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of ccpp-minidump
+#   Description: test minidump capture mode of abrt-hook-ccpp
+#   Author: ABRT Team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="ccpp-minidump"
+PACKAGE="abrt"
+
+CCPP_CFG_FILE="/etc/abrt/plugins/CCpp.conf"
+
+function gdb_backtrace() {
+    gdb -batch -ex "bt" $1 $2 2>/dev/null | grep '^#' | sed 's/0x[0-9a-f]* in //'
+}
+
+rlJournalStart
+    rlPhaseStartSetup
+        check_prior_crashes
+
+        TmpDir=$(mktemp -d)
+        pushd $TmpDir
+        rlRun "ulimit -c unlimited"
+
+        rlFileBackup $CCPP_CFG_FILE
+        sed -i '/^MinidumpCore/d;/^SparseCore/d' $CCPP_CFG_FILE
+        echo "MinidumpCore = yes" >> $CCPP_CFG_FILE
+        sed -i 's/\(MakeCompatCore\) = no/\1 = yes/g' $CCPP_CFG_FILE
+    rlPhaseEnd
+
+    rlPhaseStartTest "MinidumpCore = yes"
+        rlAssertGrep "abrt-hook-ccpp" /proc/sys/kernel/core_pattern
+
+        prepare
+        generate_crash
+        wait_for_hooks
+        get_crash_path
+
+        rlAssertExists core*
+        rlAssertExists $crash_PATH/coredump
+
+        user_size=$(stat -c %s core*)
+        abrt_size=$(stat -c %s $crash_PATH/coredump)
+        rlLog "User core: $user_size bytes, minidump: $abrt_size bytes"
+        rlAssertGreater "Minidump is small" $((user_size/4)) $abrt_size
+
+        EXECUTABLE=$(cat $crash_PATH/executable)
+        gdb_backtrace $EXECUTABLE core* > full_bt.log
+        gdb_backtrace $EXECUTABLE $crash_PATH/coredump > mini_bt.log
+        rlAssertGreater "Backtrace has frames" $(wc -l < mini_bt.log) 0
+        rlAssertNotDiffer full_bt.log mini_bt.log
+
+        rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash directory"
+        rlRun "rm -f core*"
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        popd # $TmpDir
+        rlRun "rm -r $TmpDir" 0 "Removing tmp directory"
+        rlFileRestore # CCPP_CFG_FILE
+    rlPhaseEnd
+rlJournalPrintText
+rlJournalEnd
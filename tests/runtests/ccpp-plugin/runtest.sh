@@ -115,6 +115,34 @@ EOF
         rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash directory"
     rlPhaseEnd
 
+    rlPhaseStartTest "exploitability rated by the gdb generating backtrace"
+        prepare
+        generate_crash
+        wait_for_hooks
+        get_crash_path
+
+        # post-create doesn't run a gdb of its own
+        rlAssertNotExists "$crash_PATH/exploitable"
+
+        pushd $crash_PATH
+        rlRun "abrt-action-analyze-vulnerability"
+        [ -e exploitable ] && rlRun "mv exploitable $OLDPWD/exploitable.separate"
+        popd
+
+        rlRun "abrt-action-generate-backtrace -x -d $crash_PATH"
+        rlAssertExists "$crash_PATH/backtrace"
+        rlAssertNotGrep "abrt-exploitable-----" "$crash_PATH/backtrace"
+        rlAssertNotGrep "abrt-registers-----" "$crash_PATH/backtrace"
+        rlRun "test -s $crash_PATH/registers" 0 "registers saved"
+        if [ -e exploitable.separate ]; then
+            rlAssertNotDiffer exploitable.separate "$crash_PATH/exploitable"
+        else
+            rlAssertNotExists "$crash_PATH/exploitable"
+        fi
+
+        rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash directory"
+    rlPhaseEnd
+
     rlPhaseStartTest "crash in a non-init PID NS"
         # I did not use 'unshare --fork --pid will_segfault' because unshare
         # kills itself with the signal the child received.
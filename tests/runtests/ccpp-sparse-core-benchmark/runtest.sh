@@ -0,0 +1,100 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of ccpp-sparse-core-benchmark
+#   Description: measure disk usage and time of sparse core capture
+#   Author: ABRT Team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="ccpp-sparse-core-benchmark"
+PACKAGE="abrt"
+
+CFG_FILE="/etc/abrt/abrt-action-save-package-data.conf"
+CCPP_CFG_FILE="/etc/abrt/plugins/CCpp.conf"
+BIGCORE_SRC="$(pwd)/../bz591504-sparse-core-files-performance-hit/bigcore.c"
+
+function measure_capture() {
+    local mode=$1
+
+    sed -i '/^SparseCore/d' $CCPP_CFG_FILE
+    echo "SparseCore = $mode" >> $CCPP_CFG_FILE
+
+    rlRun "rm -f core* /tmp/abrt-done"
+    local start=$(date +%s%N)
+    rlRun "sh -c './bigcore; exit 0' &>/dev/null"
+    wait_for_hooks
+    local end=$(date +%s%N)
+    get_crash_path
+
+    rlAssertExists core*
+    rlAssertExists $crash_PATH/coredump
+
+    local user_apparent=$(du -B1 --apparent-size core* | sed 's/[ \t].*//')
+    local user_actual=$(du -B1 core* | sed 's/[ \t].*//')
+    local abrt_apparent=$(du -B1 --apparent-size $crash_PATH/coredump | sed 's/[ \t].*//')
+    local abrt_actual=$(du -B1 $crash_PATH/coredump | sed 's/[ \t].*//')
+
+    rlLog "SparseCore=$mode: time $(( (end - start) / 1000000 )) ms"
+    rlLog "SparseCore=$mode: user core apparent:$user_apparent allocated:$user_actual"
+    rlLog "SparseCore=$mode: ABRT core apparent:$abrt_apparent allocated:$abrt_actual"
+
+    if [ "$mode" == "yes" ]; then
+        rlAssertGreater "User core is very sparse" $((user_apparent/50)) $user_actual
+        rlAssertGreater "ABRT core is very sparse" $((abrt_apparent/50)) $abrt_actual
+    fi
+
+    rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash directory"
+    rlRun "rm -f core*"
+}
+
+rlJournalStart
+    rlPhaseStartSetup
+        TmpDir=$(mktemp -d)
+        rlRun "cc $BIGCORE_SRC -o $TmpDir/bigcore" 0 "Compiling bigcore.c"
+        pushd $TmpDir
+        rlRun "ulimit -c unlimited"
+
+        rlFileBackup $CFG_FILE $CCPP_CFG_FILE
+        sed -i 's/ProcessUnpackaged = no/ProcessUnpackaged = yes/g' $CFG_FILE
+        sed -i 's/\(MakeCompatCore\) = no/\1 = yes/g' $CCPP_CFG_FILE
+    rlPhaseEnd
+
+    rlPhaseStartTest "SparseCore = no"
+        rlAssertGrep "abrt-hook-ccpp" /proc/sys/kernel/core_pattern
+        measure_capture no
+    rlPhaseEnd
+
+    rlPhaseStartTest "SparseCore = yes"
+        rlAssertGrep "abrt-hook-ccpp" /proc/sys/kernel/core_pattern
+        measure_capture yes
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        popd # $TmpDir
+        rlRun "rm -r $TmpDir" 0 "Removing tmp directory"
+        rlFileRestore # CFG_FILE CCPP_CFG_FILE
+    rlPhaseEnd
+rlJournalPrintText
+rlJournalEnd
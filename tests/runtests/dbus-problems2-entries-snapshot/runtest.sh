@@ -0,0 +1,103 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of dbus-problems2-entries-snapshot
+#   Description: Check that abrt-dbus counts problems from the entries snapshot
+#   Author: ABRT team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="dbus-problems2-entries-snapshot"
+PACKAGE="abrt-dbus"
+TEST_USER="abrt-dbus-test"
+
+function start_abrt_dbus
+{
+    ABRT_DBUS_PROBLEMS_LIMIT=3 ABRT_DBUS_NEW_PROBLEMS_BATCH=10 \
+        abrt-dbus -vvv -t 100 &> $1 &
+    ABRT_DBUS_PID=$!
+    sleep 2
+}
+
+function stop_abrt_dbus
+{
+    # abrt-dbus writes the entries snapshot on exit
+    kill -TERM $ABRT_DBUS_PID
+    wait $ABRT_DBUS_PID
+}
+
+rlJournalStart
+    rlPhaseStartSetup
+        check_prior_crashes
+        load_abrt_conf
+
+        TmpDir=$(mktemp -d)
+        cp test_entries_snapshot.py $TmpDir
+        pushd $TmpDir
+
+        useradd $TEST_USER -M -g wheel || rlDie "Cannot proceed without the user"
+        TEST_USER_UID=$(id -u $TEST_USER | tr -d "\n")
+
+        export PYTHONPATH=$OLDPWD/../dbus-problems2-sanity/cases
+
+        killall abrt-dbus
+    rlPhaseEnd
+
+    rlPhaseStartTest "owners are stored in the snapshot"
+        start_abrt_dbus abrt_dbus_fill_up.log
+        rlRun "python3 test_entries_snapshot.py $TEST_USER_UID test_fill_up"
+        stop_abrt_dbus
+
+        rlAssertExists /var/run/abrt/problems2-entries
+        rlAssertEquals "Three problems are listed" \
+            "$(grep -c -v '^#' /var/run/abrt/problems2-entries)" "3"
+        rlAssertGrep "^[0-9]\+ $TEST_USER_UID " /var/run/abrt/problems2-entries
+    rlPhaseEnd
+
+    rlPhaseStartTest "stale entries are dropped on the first access"
+        # Makes the problem directory newer than the snapshot but does not
+        # touch the dump location
+        STALE_DIR=$(find $ABRT_CONF_DUMP_LOCATION -mindepth 1 -maxdepth 1 -type d -user $TEST_USER | head -1)
+        rlRun "rm -f $STALE_DIR/time"
+
+        start_abrt_dbus abrt_dbus_stale.log
+        rlAssertGrep "Loaded 3 entries from the snapshot" abrt_dbus_stale.log
+        rlAssertNotGrep "Not a problem directory anymore" abrt_dbus_stale.log
+
+        rlRun "python3 test_entries_snapshot.py $TEST_USER_UID test_stale_dropped"
+        rlAssertGrep "Not a problem directory anymore: $STALE_DIR" abrt_dbus_stale.log
+        stop_abrt_dbus
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        rlBundleLogs abrt $(ls *.log)
+
+        rm -rf $ABRT_CONF_DUMP_LOCATION/*
+        userdel -r -f $TEST_USER
+
+        popd # TmpDir
+        rm -rf $TmpDir
+    rlPhaseEnd
+    rlJournalPrintText
+rlJournalEnd
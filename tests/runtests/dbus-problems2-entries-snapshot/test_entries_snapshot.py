@@ -0,0 +1,39 @@
+#!/usr/bin/python3
+# vim: set makeprg=python3-flake8\ %
+
+import abrt_p2_testing
+from abrt_p2_testing import create_problem
+
+
+# Must be equal to ABRT_DBUS_PROBLEMS_LIMIT in runtest.sh
+PROBLEMS_LIMIT = 3
+
+
+class TestEntriesSnapshot(abrt_p2_testing.TestCase):
+
+    def assertProblemsLimitReached(self):
+        self.assertRaisesProblems2Exception("No more problems can be created",
+                                            create_problem, self, self.p2)
+
+    def test_fill_up(self):
+        for i in range(0, PROBLEMS_LIMIT):
+            create_problem(self, self.p2)
+
+        self.assertProblemsLimitReached()
+
+    def test_stale_dropped(self):
+        # The owners are taken from the snapshot without touching
+        # the problem directories
+        self.assertProblemsLimitReached()
+
+        # One of the problem directories is no longer a problem
+        problems = self.p2.GetProblems(0, dict())
+        self.assertEqual(PROBLEMS_LIMIT - 1, len(problems))
+
+        # The stale entry no longer counts
+        create_problem(self, self.p2)
+        self.assertProblemsLimitReached()
+
+
+if __name__ == "__main__":
+    abrt_p2_testing.main(TestEntriesSnapshot)
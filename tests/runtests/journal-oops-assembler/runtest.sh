@@ -0,0 +1,134 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of journal-oops-assembler
+#   Description: Check when abrt-dump-journal-oops processes an oops in the follow mode
+#   Author: ABRT team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="journal-oops-assembler"
+PACKAGE="abrt"
+EXAMPLES_PATH="../../examples"
+
+# Must be equal to ABRT_JOURNAL_OOPS_MAX_LINES in abrt-dump-journal-oops.c
+OOPS_MAX_LINES=4096
+
+function start_dumper
+{
+    # The stored cursor would make the dumper read the messages of the
+    # previous phases
+    rm -f /var/lib/abrt/abrt-dump-journal-oops.state
+
+    ABRT_DUMP_JOURNAL_OOPS_DEBUG_FILTER="SYSLOG_IDENTIFIER=abrt_test" \
+        setsid abrt-dump-journal-oops -vvv -e -f -o >$1 2>&1 &
+    ABRT_DUMPER_PID=$!
+    sleep 2
+}
+
+function stop_dumper
+{
+    kill -TERM $ABRT_DUMPER_PID
+    wait $ABRT_DUMPER_PID
+}
+
+rlJournalStart
+    rlPhaseStartSetup
+        TmpDir=$(mktemp -d)
+
+        # A warning ending with the end marker
+        sed -n '/WARNING: at/,/end trace/p' $EXAMPLES_PATH/oops5.test > $TmpDir/oops.test
+        OOPS_LINES=$(wc -l < $TmpDir/oops.test)
+
+        pushd $TmpDir
+
+        printf "not an oops line %d\n" $(seq 1 3) > trailing.test
+        head -n -1 oops.test > oops_no_marker.test
+        head -n 1 oops.test > oops_start.test
+        printf "oops line %d\n" $(seq 1 $((OOPS_MAX_LINES + 100))) >> oops_start.test
+
+        rlRun "systemctl stop abrt-oops"
+    rlPhaseEnd
+
+    rlPhaseStartTest "the end marker finishes an oops"
+        start_dumper end_marker.log
+
+        # The lines following the marker arrive without any pause
+        rlRun "cat oops.test trailing.test | logger -t abrt_test"
+        rlRun "journalctl --flush"
+        sleep 2
+
+        rlAssertGrep "Processing $OOPS_LINES lines" end_marker.log
+        rlAssertGrep "Found oopses: 1" end_marker.log
+        rlAssertNotGrep "Found oops start: 'not an oops line" end_marker.log
+
+        stop_dumper
+    rlPhaseEnd
+
+    rlPhaseStartTest "an idle journal finishes an oops"
+        start_dumper idle.log
+
+        rlRun "logger -t abrt_test -f oops_no_marker.test"
+        rlRun "journalctl --flush"
+        sleep 2
+
+        # Must not be appended to the oops
+        rlRun "logger -t abrt_test -f trailing.test"
+        rlRun "journalctl --flush"
+        sleep 2
+
+        rlAssertGrep "Processing $((OOPS_LINES - 1)) lines" idle.log
+        rlAssertGrep "Found oopses: 1" idle.log
+        rlAssertEquals "The oops is processed once" \
+            "$(grep -c 'Processing [0-9]\+ lines' idle.log)" "1"
+
+        stop_dumper
+    rlPhaseEnd
+
+    rlPhaseStartTest "a long oops is cut"
+        start_dumper size_limit.log
+
+        rlRun "logger -t abrt_test -f oops_start.test"
+        rlRun "journalctl --flush"
+        sleep 5
+
+        rlAssertGrep "Processing $OOPS_MAX_LINES lines" size_limit.log
+        # The rest is not suspicious and is not collected
+        rlAssertEquals "The oops is processed once" \
+            "$(grep -c 'Processing [0-9]\+ lines' size_limit.log)" "1"
+
+        stop_dumper
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        # Do not confuse the system dumper. The stored cursor is invalid in the default configuration.
+        rlRun "rm -f /var/lib/abrt/abrt-dump-journal-oops.state"
+        rlRun "systemctl start abrt-oops"
+
+        rlBundleLogs abrt $(echo *.log)
+        popd # TmpDir
+        rm -rf $TmpDir
+    rlPhaseEnd
+    rlJournalPrintText
+rlJournalEnd
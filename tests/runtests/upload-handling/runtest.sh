@@ -101,6 +101,35 @@ rlJournalStart
         rlRun "rm -rf problem_dir/malicious problem_dir/dangerous $TmpDir/abrt_upload_test"
     rlPhaseEnd
 
+    rlPhaseStartTest "handle uploads in parallel"
+        rm -f "/var/spool/abrt-upload/upload.tar.gz"
+        rm -rf $ABRT_CONF_DUMP_LOCATION/remote*
+
+        for i in $(seq 1 8); do
+            cp $TmpDir/upload.tar.gz $TmpDir/upload$i.tar.gz
+        done
+        rlRun "mv $TmpDir/upload[1-8].tar.gz /var/spool/abrt-upload"
+
+        c=0
+        while [ $(ls -d $ABRT_CONF_DUMP_LOCATION/remote* 2>/dev/null | wc -l) -lt 8 ]; do
+            sleep 0.5
+            let c=$c+1
+            if [ $c -gt 120 ]; then
+                rlFail "Timeout"
+                break
+            fi
+        done
+
+        rlAssertEquals "All archives unpacked" "_8" "_$(ls -d $ABRT_CONF_DUMP_LOCATION/remote* | wc -l)"
+        rlAssertEquals "No working directories in dump location" "_0" "_$(ls -A $ABRT_CONF_DUMP_LOCATION | grep -c '^\.abrt-upload')"
+        for d in $ABRT_CONF_DUMP_LOCATION/remote*; do
+            rlAssertExists "$d/coredump"
+        done
+
+        rm -f /var/spool/abrt-upload/upload[1-8].tar.gz
+        rem_upload_dir=$( echo $ABRT_CONF_DUMP_LOCATION/remote* )
+    rlPhaseEnd
+
     rlPhaseStartCleanup
         popd # TmpDir
         rm -rf $TmpDir
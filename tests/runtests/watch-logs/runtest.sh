@@ -0,0 +1,91 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of watch-logs
+#   Description: test extraction of oopses and Xorg crashes by abrt-watch-logs
+#   Author: ABRT Team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="watch-logs"
+PACKAGE="abrt"
+EXAMPLES_PATH="../../examples"
+
+OOPS="oops-with-jiffies.test"
+XORG_CRASH="crash_bz530463.test"
+
+# The oopses found so far
+function found_oopses
+{
+    grep -c 'Found oopses:' watch.err
+}
+
+rlJournalStart
+    rlPhaseStartSetup
+        TmpDir=$(mktemp -d)
+        cp $EXAMPLES_PATH/$OOPS $TmpDir
+        cp ../dumpxorg/$XORG_CRASH $TmpDir
+        rlRun "pushd $TmpDir"
+
+        touch messages Xorg.0.log
+        abrt-watch-logs -o -k $TmpDir/messages -X $TmpDir/Xorg.0.log >watch.out 2>watch.err &
+        WATCH_PID=$!
+        sleep 1
+    rlPhaseEnd
+
+    rlPhaseStartTest "oops"
+        cat $OOPS >> messages
+        sleep 3
+        rlAssertEquals "Found the oops" "_$(found_oopses)" "_1"
+    rlPhaseEnd
+
+    rlPhaseStartTest "oops written in parts"
+        head -n 5 $OOPS >> messages
+        sleep 0.1
+        tail -n +6 $OOPS >> messages
+        sleep 3
+        rlAssertEquals "Found the oops once" "_$(found_oopses)" "_2"
+    rlPhaseEnd
+
+    rlPhaseStartTest "rotated log"
+        rlRun "mv messages messages.1"
+        cat $OOPS > messages
+        sleep 3
+        rlAssertEquals "Found the oops in the new log" "_$(found_oopses)" "_3"
+    rlPhaseEnd
+
+    rlPhaseStartTest "Xorg crash"
+        cat $XORG_CRASH >> Xorg.0.log
+        sleep 3
+        rlAssertGrep "xorg_backtrace" watch.out
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        kill $WATCH_PID
+        wait $WATCH_PID
+        rlRun "popd"
+        rlRun "rm -r $TmpDir" 0 "Removing tmp directory"
+    rlPhaseEnd
+    rlJournalPrintText
+rlJournalEnd